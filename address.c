@@ -0,0 +1,182 @@
+#include "address.h"
+#include "performance.h"
+#include "sha512.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Entries live in fixed chunks that never move, so readers can follow a
+// handle without the lock
+#define ADDRESS_CHUNK_BITS 12
+#define ADDRESS_CHUNK_SIZE (1 << ADDRESS_CHUNK_BITS)
+#define ADDRESS_MAX_CHUNKS 4096
+
+typedef struct {
+    AddressId id;
+    char text[ADDRESS_TEXT_LENGTH];
+} AddressEntry;
+
+typedef struct {
+    AddressEntry *chunks[ADDRESS_MAX_CHUNKS];
+    AddressHandle *index;  // Open addressing by id, linear probing; 0 = empty
+    int index_capacity;    // Power of two, at most half full
+    volatile int count;    // Handle h is entry h - 1
+    PlatformMutex *lock;
+} AddressTable;
+
+static AddressTable address_table;
+
+static AddressEntry *entry_for(AddressHandle handle) {
+    uint32_t i = handle - 1;
+    return &address_table.chunks[i >> ADDRESS_CHUNK_BITS][i & (ADDRESS_CHUNK_SIZE - 1)];
+}
+
+static uint32_t id_hash(const AddressId *id) {
+    uint32_t hash;
+    memcpy(&hash, id->bytes, sizeof(hash));
+    return hash;
+}
+
+// Slot holding id, or the empty slot where it would go
+static int find_slot(const AddressId *id) {
+    int mask = address_table.index_capacity - 1;
+    int slot = (int)(id_hash(id) & (uint32_t)mask);
+    while (address_table.index[slot] != 0 &&
+           memcmp(entry_for(address_table.index[slot])->id.bytes, id->bytes, ADDRESS_ID_SIZE) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow_index(void) {
+    int capacity = address_table.index_capacity ? address_table.index_capacity * 2 : 1024;
+    AddressHandle *old = address_table.index;
+    AddressHandle *index = calloc(capacity, sizeof(AddressHandle));
+    if (index == NULL) return false;
+    
+    address_table.index = index;
+    address_table.index_capacity = capacity;
+    for (int handle = 1; handle <= address_table.count; handle++) {
+        address_table.index[find_slot(&entry_for(handle)->id)] = (AddressHandle)handle;
+    }
+    free(old);
+    return true;
+}
+
+bool init_address_table(void) {
+    if (address_table.lock != NULL) return true;
+    
+    address_table.lock = create_mutex();
+    if (address_table.lock == NULL) return false;
+    if (address_intern(COINBASE_ADDRESS_TEXT) != ADDRESS_COINBASE) {
+        cleanup_address_table();
+        return false;
+    }
+    return true;
+}
+
+void cleanup_address_table(void) {
+    for (int i = 0; i < ADDRESS_MAX_CHUNKS; i++) {
+        free(address_table.chunks[i]);
+    }
+    free(address_table.index);
+    destroy_mutex(address_table.lock);
+    memset(&address_table, 0, sizeof(AddressTable));
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Characters of text that count, which need not be terminated past them
+static size_t text_length(const char *text) {
+    size_t length = 0;
+    while (length < ADDRESS_TEXT_LENGTH - 1 && text[length] != '\0') length++;
+    return length;
+}
+
+void address_to_id(const char *text, AddressId *id) {
+    size_t length = text_length(text);
+    
+    // Key-derived addresses carry their id as hex
+    if (length == 3 + 2 * ADDRESS_ID_SIZE && memcmp(text, "ARC", 3) == 0) {
+        bool canonical = true;
+        for (int i = 0; i < ADDRESS_ID_SIZE && canonical; i++) {
+            int high = hex_value(text[3 + 2 * i]);
+            int low = hex_value(text[4 + 2 * i]);
+            canonical = high >= 0 && low >= 0;
+            id->bytes[i] = (uint8_t)(high * 16 + low);
+        }
+        if (canonical) return;
+    }
+    
+    uint8_t digest[SHA512_DIGEST_SIZE];
+    sha512(text, length, digest);
+    memcpy(id->bytes, digest, ADDRESS_ID_SIZE);
+}
+
+AddressHandle address_find(const char *text) {
+    if (text == NULL || text[0] == '\0' || address_table.lock == NULL) return 0;
+    
+    AddressId id;
+    address_to_id(text, &id);
+    lock_mutex(address_table.lock);
+    AddressHandle handle = (address_table.index_capacity > 0) ? address_table.index[find_slot(&id)] : 0;
+    unlock_mutex(address_table.lock);
+    return handle;
+}
+
+// New entry for id in its empty index slot; 0 when memory runs out
+static AddressHandle add_entry(const AddressId *id, const char *text, int slot) {
+    int i = address_table.count;
+    int chunk = i >> ADDRESS_CHUNK_BITS;
+    if (chunk >= ADDRESS_MAX_CHUNKS) return 0;
+    if (address_table.chunks[chunk] == NULL) {
+        address_table.chunks[chunk] = calloc(ADDRESS_CHUNK_SIZE, sizeof(AddressEntry));
+        if (address_table.chunks[chunk] == NULL) return 0;
+    }
+    
+    AddressEntry *entry = &address_table.chunks[chunk][i & (ADDRESS_CHUNK_SIZE - 1)];
+    entry->id = *id;
+    memcpy(entry->text, text, text_length(text));
+    address_table.index[slot] = (AddressHandle)(i + 1);
+    atomic_store_int(&address_table.count, i + 1);
+    return (AddressHandle)(i + 1);
+}
+
+AddressHandle address_intern(const char *text) {
+    if (text == NULL || text[0] == '\0' || !init_address_table()) return 0;
+    
+    AddressId id;
+    address_to_id(text, &id);
+    lock_mutex(address_table.lock);
+    AddressHandle handle = 0;
+    if ((address_table.count + 1) * 2 <= address_table.index_capacity || grow_index()) {
+        int slot = find_slot(&id);
+        handle = address_table.index[slot];
+        if (handle == 0) handle = add_entry(&id, text, slot);
+    }
+    unlock_mutex(address_table.lock);
+    return handle;
+}
+
+const char *address_text(AddressHandle handle) {
+    if (handle == 0 || handle > (AddressHandle)atomic_load_int(&address_table.count)) return "";
+    
+    return entry_for(handle)->text;
+}
+
+const AddressId *address_id(AddressHandle handle) {
+    if (handle == 0 || handle > (AddressHandle)atomic_load_int(&address_table.count)) return NULL;
+    
+    return &entry_for(handle)->id;
+}
+
+int address_count(void) {
+    return atomic_load_int(&address_table.count);
+}
+
+uint32_t address_handle_hash(AddressHandle handle) {
+    return handle * 2654435761u;
+}
@@ -0,0 +1,47 @@
+#ifndef ADDRESS_H
+#define ADDRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interned addresses. Every textual address maps to a fixed 20-byte
+// binary id: for addresses derived from a public key ("ARC" and 40 hex
+// digits) the id is those digits, for any other text (older wallets,
+// COINBASE) the start of its SHA-512. Within the process each id gets a
+// 32-bit handle, so transactions and indexes compare and hash a single
+// integer; text is only needed for display, files and peers.
+// Handles never change or go away until cleanup_address_table. Interning
+// takes a lock; address_text and address_id do not.
+#define ADDRESS_TEXT_LENGTH 64  // Text including its terminator
+#define ADDRESS_ID_SIZE 20
+
+typedef uint32_t AddressHandle;  // 0 = no address
+
+// Interned before anything else, so its handle is fixed
+#define ADDRESS_COINBASE ((AddressHandle)1)
+#define COINBASE_ADDRESS_TEXT "COINBASE"
+
+typedef struct {
+    uint8_t bytes[ADDRESS_ID_SIZE];
+} AddressId;
+
+// Call before addresses are interned from several threads; later calls are no-ops
+bool init_address_table(void);
+void cleanup_address_table(void);  // Every handle handed out becomes invalid
+
+void address_to_id(const char *text, AddressId *id);
+
+// Handle for text (at most ADDRESS_TEXT_LENGTH - 1 characters are used),
+// added on first use; 0 for empty text or when memory runs out
+AddressHandle address_intern(const char *text);
+AddressHandle address_find(const char *text);  // 0 when text was never interned
+
+const char *address_text(AddressHandle handle);  // "" for 0
+const AddressId *address_id(AddressHandle handle);  // NULL for 0
+int address_count(void);
+
+// For tables keyed by handle: handles are dense, so they are spread with
+// a multiplicative hash
+uint32_t address_handle_hash(AddressHandle handle);
+
+#endif
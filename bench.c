@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pi.h"
+#include "performance.h"
+
+// Digits per buffer; 16 MB packed, well past a 4 KB page TLB's reach
+#define BENCH_DIGITS (1 << 25)
+#define BENCH_ROUNDS 8
+
+// Derives and histograms a chain of digit buffers the way block mining
+// does, each from the one before; returns digits processed per second
+static double run_digit_rounds(const PiDigits *base) {
+    PiDigits prev;
+    if (!pi_digits_derive(&prev, base, NULL, 0)) return 0.0;
+    
+    int counts[10];
+    clock_t start = clock();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        PiDigits next;
+        if (!pi_digits_derive(&next, base, &prev, round + 1)) break;
+        pi_digits_histogram(&next, counts);
+        pi_digits_free(&prev);
+        prev = next;
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    pi_digits_free(&prev);
+    
+    return seconds > 0.0 ? (double)BENCH_DIGITS * BENCH_ROUNDS / seconds : 0.0;
+}
+
+int main(void) {
+    printf("Pi digit buffer benchmark: %d rounds of %d digits\n\n", BENCH_ROUNDS, BENCH_DIGITS);
+    
+    // Throughput does not depend on the digit values, only on the buffer size
+    char seed[1024];
+    get_pi_digits(seed, (int)sizeof(seed) - 1);
+    PiDigits base;
+    if (!pi_digits_alloc(&base, BENCH_DIGITS)) {
+        fprintf(stderr, "Could not allocate %d digits\n", BENCH_DIGITS);
+        return 1;
+    }
+    for (size_t i = 0; i < pi_packed_size(BENCH_DIGITS); i += sizeof(seed) / 2) {
+        size_t chunk = pi_packed_size(BENCH_DIGITS) - i;
+        if (chunk > sizeof(seed) / 2) chunk = sizeof(seed) / 2;
+        pi_pack_digits(base.packed + i, seed, (int)chunk * 2);
+    }
+    
+    double rates[2];
+    for (int pass = 0; pass < 2; pass++) {
+        set_large_pages_enabled(pass == 0);
+        LargeBufferStats before, after;
+        get_large_buffer_stats(&before);
+        rates[pass] = run_digit_rounds(&base);
+        get_large_buffer_stats(&after);
+        
+        printf("Huge pages %-3s: %8.1f M digits/sec (buffers: %" PRIu64 " huge, %" PRIu64 " transparent, %" PRIu64 " regular)\n",
+               pass == 0 ? "on" : "off", rates[pass] / 1e6,
+               after.explicit_huge - before.explicit_huge,
+               after.transparent_huge - before.transparent_huge,
+               after.regular - before.regular);
+    }
+    if (rates[1] > 0.0) {
+        printf("\nSpeedup with huge pages: %.2fx\n", rates[0] / rates[1]);
+    }
+    
+    pi_digits_free(&base);
+    stop_worker_pool();
+    release_thread_scratch_pool();
+    return 0;
+}
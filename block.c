@@ -2,6 +2,10 @@
 #include "utils.h"
 #include "pi.h"
 #include "wallet.h"
+#include "digitstore.h"
+#include "performance.h"
+#include "txpool.h"
+#include "verifycache.h"
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
@@ -11,12 +15,29 @@
 // Forward declaration
 bool create_coinbase_transaction(Transaction *tx, const char *miner_address, uint64_t reward);
 
-void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const char *miner_address, const RewardSystem *reward_system) {    if (block == NULL) {
+void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const char *miner_address, const RewardSystem *reward_system) {
+    mine_block_with_transactions(block, prev_hash, prev_block, miner_address, reward_system, NULL, 0);
+}
+
+void mine_block_with_transactions(Block *block, uint32_t prev_hash, const Block *prev_block,
+                                  const char *miner_address, const RewardSystem *reward_system,
+                                  Transaction *const *transactions, int count) {
+    if (block == NULL) {
         return;
     }
     
-    // Initialize block
+    // The coinbase takes the first slot
+    if (count < 0) count = 0;
+    if (count > MAX_TRANSACTIONS_PER_BLOCK - 1) count = MAX_TRANSACTIONS_PER_BLOCK - 1;
+    uint64_t fees = 0;
+    for (int i = 0; i < count; i++) {
+        fees += transactions[i]->fee;
+    }
+    
+    // Initialize block (the caller assigns the height before mining)
+    int index = block->index;
     memset(block, 0, sizeof(Block));
+    block->index = index;
     block->timestamp = time(NULL);
     block->transaction_count = 0;
     
@@ -29,15 +50,28 @@ void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const
     if (reward_system != NULL) {
         block->mining_reward = calculate_mining_reward(reward_system, block->index);
         
-        // Create coinbase transaction for mining reward
-        if (block->mining_reward > 0 && miner_address != NULL) {
+        // Create coinbase transaction for mining reward and the fees
+        if (block->mining_reward + fees > 0 && miner_address != NULL) {
             Transaction coinbase_tx;
-            if (create_coinbase_transaction(&coinbase_tx, miner_address, block->mining_reward)) {
+            if (create_coinbase_transaction(&coinbase_tx, miner_address, block->mining_reward + fees)) {
                 add_transaction_to_block(block, &coinbase_tx);
             }
         }
     }
-      
+    
+    // Transfers are shared with the caller, not copied
+    for (int i = 0; i < count; i++) {
+        add_shared_transaction(block, transactions[i]);
+    }
+    block->prev_hash = prev_hash;
+    block->merkle_root = compute_merkle_root(block);
+    
+    mine_assembled_block(block, prev_block);
+}
+
+void mine_assembled_block(Block *block, const Block *prev_block) {
+    if (block == NULL) return;
+    
     block->timestamp = time(NULL);
     
     // Use exponential difficulty but limit growth for memory optimization
@@ -46,7 +80,6 @@ void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const
         power = 25;
     }
     block->difficulty = 1 << power;
-    block->prev_hash = prev_hash;
     
     // Calculate total difficulty for chain selection
     block->total_difficulty = (prev_block != NULL) ? 
@@ -59,14 +92,32 @@ void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const
         digits_to_store = (block->difficulty > 10000) ? 10000 : block->difficulty;
     }
     
-    // Dynamically allocate memory for Pi digits
-    block->pi_digits = malloc(digits_to_store + 1);
-    if (block->pi_digits == NULL) {
+    // Scratch memory used while mining this block is released in one step
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    
+    // Use previous block's Pi digits as seed for next calculation. The
+    // generator output is shared through the digit store, so each
+    // (algorithm, length) pair is only computed and kept once.
+    int seed = pi_seed_for_block(prev_block);
+    block->pi_base_id = digit_store_get_base(pi_algorithm_for_block(prev_block), digits_to_store);
+    PiDigits base, prev_digits;
+    bool have_prev = prev_block != NULL && block_pi_digits(prev_block, &prev_digits);
+    if (!digit_store_lookup(block->pi_base_id, &base) ||
+        !pi_digits_derive(&block->pi_digits, &base, have_prev ? &prev_digits : NULL, seed)) {
         printf("Error: Could not allocate memory for Pi digits\n");
+        reset_memory_pool_to(scratch, mark);
         return;
-    }    // Use previous block's Pi digits as seed for next calculation
-    get_pi_digits_from_previous(block->pi_digits, digits_to_store, (const void *)prev_block);
-    block->pi_digits_count = digits_to_store;
+    }
+    
+    // Digits as long as the previous block's are kept as a recipe once
+    // mined; the others become the payload later recipes start from
+    bool derived = prev_block != NULL &&
+                   digit_derivation_extend(&block->pi_recipe, &prev_block->pi_recipe, prev_block->pi_digits_id,
+                                           block->pi_base_id, seed);
+    if (!derived) {
+        block->pi_digits_id = digit_store_intern(&block->pi_digits);
+    }
     
     // Calculate initial block hash
     block->hash = calculate_block_hash(block);
@@ -83,46 +134,183 @@ void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const
             break;
         }
     }
+    
+    if (derived) {
+        int count = block->pi_digits.count;
+        pi_digits_free(&block->pi_digits);
+        block->pi_digits.count = count;
+    }
+    reset_memory_pool_to(scratch, mark);
 }
 
 // Add transaction to block
 bool add_transaction_to_block(Block *block, const Transaction *tx) {
     if (block == NULL || tx == NULL) return false;
     
+    Transaction *record = tx_new(tx);
+    if (record == NULL) return false;
+    
+    bool ok = add_shared_transaction(block, record);
+    tx_release(record);
+    return ok;
+}
+
+bool add_shared_transaction(Block *block, Transaction *tx) {
+    if (block == NULL || tx == NULL) return false;
+    
     if (block->transaction_count >= MAX_TRANSACTIONS_PER_BLOCK) {
         return false;
     }
     
-    block->transactions[block->transaction_count] = *tx;
+    if (block->transaction_count >= block->transaction_capacity) {
+        int new_capacity = block->transaction_capacity ? block->transaction_capacity * 2 : 4;
+        if (new_capacity > MAX_TRANSACTIONS_PER_BLOCK) new_capacity = MAX_TRANSACTIONS_PER_BLOCK;
+        Transaction **temp = realloc(block->transactions, new_capacity * sizeof(Transaction *));
+        if (temp == NULL) return false;
+        block->transactions = temp;
+        block->transaction_capacity = new_capacity;
+    }
+    
+    block->transactions[block->transaction_count] = tx_retain(tx);
     block->transaction_count++;
     return true;
 }
 
+// Unpacks up to room of the block's digits into the hash text
+static void append_hash_digits(const Block *block, char *out, int room) {
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits digits;
+    if (block_pi_digits(block, &digits)) {
+        pi_digits_to_string(&digits, 0, (digits.count < room) ? digits.count : room, out);
+    } else {
+        *out = '\0';
+    }
+    reset_memory_pool_to(scratch, mark);
+}
+
 // Calculate block hash including all transactions
 uint32_t calculate_block_hash(const Block *block) {
     if (block == NULL) return 0;
     
     char content[8192]; // Larger buffer for transactions
     int offset = 0;
-      // Add basic block data
+    
+    // The header, with the Merkle root standing in for the transactions,
+    // comes before the digits so long digit runs cannot push it out
+    if (!block->legacy_hash) {
+        offset += snprintf(content, sizeof(content),
+                          "%d%lld%d%u%u%s%" PRIu64 "%016" PRIx64,
+                          block->index, (long long)block->timestamp, block->difficulty,
+                          block->prev_hash, block->nonce, block->miner_address,
+                          block->mining_reward, block->merkle_root);
+        int room = (int)sizeof(content) - offset - 1;
+        append_hash_digits(block, content + offset, room);
+        return simple_hash(content);
+    }
+    
+    // Add basic block data
     offset += snprintf(content + offset, sizeof(content) - offset, 
-                      "%d%lld%d%s%u%u%s%" PRIu64, 
-                      block->index, (long long)block->timestamp, block->difficulty, 
-                      block->pi_digits ? block->pi_digits : "", block->prev_hash, 
-                      block->nonce, block->miner_address, block->mining_reward);
+                      "%d%lld%d", 
+                      block->index, (long long)block->timestamp, block->difficulty);
+    
+    // Pi digits are unpacked straight into the hash text, truncated to the buffer
+    int room = (int)sizeof(content) - offset - 1;
+    append_hash_digits(block, content + offset, room);
+    offset += block->pi_digits.count;
+    
+    if (offset < (int)sizeof(content)) {
+        offset += snprintf(content + offset, sizeof(content) - offset, 
+                          "%u%u%s%" PRIu64, 
+                          block->prev_hash, block->nonce, 
+                          block->miner_address, block->mining_reward);
+    }
     
-    // Add transaction data    for (int i = 0; i < block->transaction_count && offset < sizeof(content) - 100; i++) {
+    // Add transaction data
+    for (int i = 0; i < block->transaction_count && offset < (int)sizeof(content) - 100; i++) {
         offset += snprintf(content + offset, sizeof(content) - offset,
                           "%s%s%" PRIu64 "%u", 
-                          block->transactions[i].from_address,
-                          block->transactions[i].to_address,
-                          block->transactions[i].amount,
-                          block->transactions[i].hash);
+                          address_text(block->transactions[i]->from),
+                          address_text(block->transactions[i]->to),
+                          block->transactions[i]->amount,
+                          block->transactions[i]->hash);
     }
     
     return simple_hash(content);
 }
 
+#define TRANSACTION_FIELDS_SIZE (2 * WALLET_ADDRESS_LENGTH + 4 * sizeof(uint64_t) + sizeof(uint32_t) + 1)
+
+// Copies an address as its binary id, or as its zero-padded text field
+static size_t address_field(AddressHandle handle, bool text, char *out) {
+    if (text) {
+        memset(out, 0, WALLET_ADDRESS_LENGTH);
+        strncpy(out, address_text(handle), WALLET_ADDRESS_LENGTH - 1);
+        return WALLET_ADDRESS_LENGTH;
+    }
+    
+    const AddressId *id = address_id(handle);
+    if (id != NULL) {
+        memcpy(out, id->bytes, ADDRESS_ID_SIZE);
+    } else {
+        memset(out, 0, ADDRESS_ID_SIZE);
+    }
+    return ADDRESS_ID_SIZE;
+}
+
+// Fields one after another, without the struct's padding
+static size_t transaction_fields(const Transaction *tx, bool text_addresses, char data[TRANSACTION_FIELDS_SIZE]) {
+    int64_t timestamp = (int64_t)tx->timestamp;
+    size_t offset = 0;
+    offset += address_field(tx->from, text_addresses, data + offset);
+    offset += address_field(tx->to, text_addresses, data + offset);
+    memcpy(data + offset, &tx->amount, sizeof(uint64_t)); offset += sizeof(uint64_t);
+    memcpy(data + offset, &timestamp, sizeof(int64_t)); offset += sizeof(int64_t);
+    memcpy(data + offset, &tx->fee, sizeof(uint64_t)); offset += sizeof(uint64_t);
+    memcpy(data + offset, &tx->hash, sizeof(uint32_t)); offset += sizeof(uint32_t);
+    data[offset++] = tx->is_coinbase ? 1 : 0;
+    
+    // Leaves of transactions from before sequence numbers stay as they were
+    if (tx->sequence != TRANSACTION_UNSEQUENCED) {
+        memcpy(data + offset, &tx->sequence, sizeof(uint64_t)); offset += sizeof(uint64_t);
+    }
+    return offset;
+}
+
+static uint64_t leaf_hash(const Transaction *tx, bool text_addresses) {
+    if (tx == NULL) return 0;
+    
+    char data[TRANSACTION_FIELDS_SIZE];
+    return fast_hash64(data, transaction_fields(tx, text_addresses, data));
+}
+
+uint64_t transaction_leaf_hash(const Transaction *tx) {
+    return leaf_hash(tx, false);
+}
+
+uint64_t merkle_parent_hash(uint64_t left, uint64_t right) {
+    uint64_t pair[2] = {left, right};
+    return fast_hash64((const char *)pair, sizeof(pair));
+}
+
+uint64_t compute_merkle_root(const Block *block) {
+    if (block == NULL || block->transaction_count <= 0) return 0;
+    
+    uint64_t level[MAX_TRANSACTIONS_PER_BLOCK];
+    int count = block->transaction_count;
+    for (int i = 0; i < count; i++) {
+        level[i] = leaf_hash(block->transactions[i], block->text_leaves);
+    }
+    while (count > 1) {
+        int parents = 0;
+        for (int i = 0; i < count; i += 2) {
+            level[parents++] = (i + 1 < count) ? merkle_parent_hash(level[i], level[i + 1]) : level[i];
+        }
+        count = parents;
+    }
+    return level[0];
+}
+
 // Check if proof of work is valid (simplified - just check if hash has certain properties)
 bool is_valid_proof_of_work(const Block *block) {
     if (block == NULL) return false;
@@ -146,8 +334,140 @@ bool validate_block(const Block *block, const Block *prev_block) {
         return false;
     }
     
-    // Check if block hash is valid
-    if (block->hash != calculate_block_hash(block)) {
+    return validate_block_contents(block);
+}
+
+// Transactions a worker checks at once; one signature batch each
+#define VALIDATE_CHUNK_TRANSACTIONS 32
+
+typedef struct {
+    const Block *block;
+    uint64_t fees;
+    volatile int failed;
+} TransactionCheckJob;
+
+// Format rules and signatures of transactions [start, end), which need
+// nothing but the block
+static bool check_transaction_range(const Block *block, uint64_t fees, int start, int end) {
+    for (int i = start; i < end; i++) {
+        const Transaction *tx = block->transactions[i];
+        if (tx->is_coinbase) {
+            if (i != 0 || tx->amount != block->mining_reward + fees || tx->fee != 0 ||
+                tx->from != ADDRESS_COINBASE || tx->to == 0 || tx->to != address_find(block->miner_address)) {
+                return false;
+            }
+        } else if (!is_valid_transfer(tx)) {
+            return false;
+        }
+    }
+    
+    return block->unsigned_transfers || verify_transaction_batch(block->transactions + start, end - start);
+}
+
+static void check_transactions_task(void *context, int index) {
+    TransactionCheckJob *job = context;
+    if (atomic_load_int(&job->failed)) return;
+    
+    int start = index * VALIDATE_CHUNK_TRANSACTIONS;
+    int end = start + VALIDATE_CHUNK_TRANSACTIONS;
+    if (end > job->block->transaction_count) end = job->block->transaction_count;
+    if (!check_transaction_range(job->block, job->fees, start, end)) {
+        atomic_store_int(&job->failed, 1);
+    }
+}
+
+// Rules a block's transactions must follow on their own: at most one
+// coinbase, first in the block, paying the miner exactly the reward.
+// Larger blocks are checked in chunks on several threads.
+bool validate_block_transactions(const Block *block) {
+    if (block == NULL) return false;
+    if (block->transaction_count < 0 || block->transaction_count > MAX_TRANSACTIONS_PER_BLOCK) {
+        return false;
+    }
+    
+    // The coinbase collects the reward and every transfer's fee
+    uint64_t fees = 0;
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction *tx = block->transactions[i];
+        if (!tx->is_coinbase) {
+            if (tx->fee > UINT64_MAX - fees || tx->amount > UINT64_MAX - tx->fee) return false;
+            fees += tx->fee;
+        }
+    }
+    if (block->mining_reward > UINT64_MAX - fees) return false;
+    
+    int chunks = (block->transaction_count + VALIDATE_CHUNK_TRANSACTIONS - 1) / VALIDATE_CHUNK_TRANSACTIONS;
+    TransactionCheckJob job = {block, fees, 0};
+    if (chunks > 1 && parallel_for(chunks, check_transactions_task, &job)) {
+        return !job.failed;
+    }
+    return check_transaction_range(block, fees, 0, block->transaction_count);
+}
+
+bool is_valid_transfer(const Transaction *tx) {
+    if (tx == NULL || tx->is_coinbase) return false;
+    
+    return tx->from != 0 && tx->to != 0 &&
+           tx->amount != 0 && tx->amount <= UINT64_MAX - tx->fee &&
+           tx->from != ADDRESS_COINBASE && tx->from != tx->to;
+}
+
+// Everything validate_block_contents looks at: the header, every field
+// and signature of the transactions, and the digits' content id
+static VerifyKey block_validation_key(const Block *block) {
+    Sha512 ctx;
+    sha512_init(&ctx);
+    int64_t timestamp = (int64_t)block->timestamp;
+    uint64_t digits_id = block->pruned ? block->digits_commitment :
+                         (block->pi_digits_id != 0) ? block->pi_digits_id :
+                         (block->pi_digits.packed != NULL) ? digit_store_content_id(&block->pi_digits) :
+                         digit_derivation_key(&block->pi_recipe);
+    uint8_t flags = (uint8_t)((block->legacy_hash ? 1 : 0) | (block->unsigned_transfers ? 2 : 0) |
+                              (block->pruned ? 4 : 0) | (block->text_leaves ? 8 : 0) |
+                              (block->unsequenced_transfers ? 16 : 0));
+    sha512_update(&ctx, &block->index, sizeof(int));
+    sha512_update(&ctx, &timestamp, sizeof(timestamp));
+    sha512_update(&ctx, &block->difficulty, sizeof(int));
+    sha512_update(&ctx, &block->prev_hash, sizeof(uint32_t));
+    sha512_update(&ctx, &block->hash, sizeof(uint32_t));
+    sha512_update(&ctx, &block->merkle_root, sizeof(uint64_t));
+    sha512_update(&ctx, &block->nonce, sizeof(uint32_t));
+    sha512_update(&ctx, &block->mining_reward, sizeof(uint64_t));
+    sha512_update(&ctx, block->miner_address, WALLET_ADDRESS_LENGTH);
+    sha512_update(&ctx, &flags, sizeof(flags));
+    sha512_update(&ctx, &block->pi_digits.count, sizeof(int));
+    sha512_update(&ctx, &digits_id, sizeof(digits_id));
+    sha512_update(&ctx, &block->transaction_count, sizeof(int));
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction *tx = block->transactions[i];
+        char data[TRANSACTION_FIELDS_SIZE];
+        sha512_update(&ctx, data, transaction_fields(tx, false, data));
+        sha512_update(&ctx, tx->public_key, ED25519_PUBLIC_KEY_SIZE);
+        sha512_update(&ctx, tx->signature, ED25519_SIGNATURE_SIZE);
+    }
+    
+    uint8_t digest[SHA512_DIGEST_SIZE];
+    sha512_final(&ctx, digest);
+    return verify_key_from_digest(digest);
+}
+
+bool validate_block_contents(const Block *block) {
+    if (block == NULL) return false;
+    if (block->transaction_count < 0 || block->transaction_count > MAX_TRANSACTIONS_PER_BLOCK) {
+        return false;
+    }
+    
+    // A block with exactly this content passed before
+    VerifyKey key = block_validation_key(block);
+    if (verify_cache_contains(VERIFY_CACHE_BLOCKS, &key)) return true;
+    
+    // Check if block hash is valid (a pruned body can no longer be hashed)
+    if (!block->pruned && block->hash != calculate_block_hash(block)) {
+        return false;
+    }
+    
+    // The hash only covers the transactions through the Merkle root
+    if (!block->pruned && !block->legacy_hash && block->merkle_root != compute_merkle_root(block)) {
         return false;
     }
     
@@ -156,6 +476,8 @@ bool validate_block(const Block *block, const Block *prev_block) {
         return false;
     }
     
+    if (!validate_block_transactions(block)) return false;
+    verify_cache_insert(VERIFY_CACHE_BLOCKS, &key);
     return true;
 }
 
@@ -165,7 +487,14 @@ void print_block(const Block *block) {
         return;
     }
     
-    int pi_len = block->pi_digits ? strlen(block->pi_digits) : 0;
+    int pi_len = block->pi_digits.count;
+    char digit_line[72];
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits digits;
+    if (!block_pi_digits(block, &digits)) {
+        memset(&digits, 0, sizeof(PiDigits));
+    }
     
     // Format mining reward
     char reward_str[64];
@@ -176,21 +505,30 @@ void print_block(const Block *block) {
     printf("+==============================================================================+\n");
     printf("| Timestamp      : %-20lld                                      |\n", (long long)block->timestamp);
     printf("| Difficulty     : %-10d digits of Pi to compute                      |\n", block->difficulty);
-    printf("| Stored Digits  : %-10d (optimized for memory)                       |\n", block->pi_digits_count);
+    printf("| Stored Digits  : %-10d (optimized for memory)                       |\n", block->pi_digits.count);
     printf("| Previous Hash  : %-20u                                      |\n", block->prev_hash);
     printf("| Block Hash     : %-20u                                      |\n", block->hash);
+    printf("| Merkle Root    : %016" PRIx64 "                                          |\n", block->merkle_root);
     printf("| Nonce          : %-20u                                      |\n", block->nonce);
     printf("| Miner Address  : %-50s      |\n", block->miner_address);
     printf("| Mining Reward  : %-50s      |\n", reward_str);    printf("| Transactions   : %-10d                                            |\n", block->transaction_count);
     printf("| Total Difficulty: %-20" PRIu64 "                                     |\n", block->total_difficulty);
     printf("+==============================================================================+\n");
     
+    if (block->pruned) {
+        printf("| Body pruned    : digits commitment %016" PRIx64 "                          |\n",
+               block->digits_commitment);
+        printf("+==============================================================================+\n\n");
+        reset_memory_pool_to(scratch, mark);
+        return;
+    }
+    
     // Show transactions
     if (block->transaction_count > 0) {
         printf("|                              TRANSACTIONS                                    |\n");
         printf("+==============================================================================+\n");
         for (int i = 0; i < block->transaction_count; i++) {
-            print_transaction(&block->transactions[i]);
+            print_transaction(block->transactions[i]);
         }
         printf("+==============================================================================+\n");
     }
@@ -198,57 +536,104 @@ void print_block(const Block *block) {
     printf("|                         PI COMPUTATION RESULT                               |\n");
     printf("+==============================================================================+\n");
     printf("| Successfully computed %d digits of Pi for this block!                      |\n", pi_len);
-    if (block->pi_digits_count < block->difficulty) {
+    if (block->pi_digits.count < block->difficulty) {
         printf("| (Memory optimized: showing first %d of %d digits)                      |\n", 
-               block->pi_digits_count, block->difficulty);
+               block->pi_digits.count, block->difficulty);
     }
     printf("|                                                                              |\n");
     
     // Display Pi digits in chunks of 70 characters per line for better readability
-    if (block->pi_digits) {
-        for (int i = 0; i < pi_len; i += 70) {
-            printf("| ");
-            int chars_printed = 0;
-            for (int j = i; j < i + 70 && j < pi_len; j++) {
-                printf("%c", block->pi_digits[j]);
-                chars_printed++;
-            }
-            // Fill remaining space with spaces to align with border
-            for (int k = chars_printed; k < 70; k++) {
-                printf(" ");
-            }
-            printf(" |\n");
-        }
+    for (int i = 0; i < pi_len; i += 70) {
+        pi_digits_to_string(&digits, i, 70, digit_line);
+        // Fill remaining space with spaces to align with border
+        printf("| %-70s |\n", digit_line);
     }
     
     printf("|                                                                              |\n");
     
     // Show the complete Pi value in a better format
-    if (pi_len <= 65 && block->pi_digits) {
-        printf("| Pi = 3.%s", block->pi_digits);
+    if (pi_len > 0 && pi_len <= 65) {
+        pi_digits_to_string(&digits, 0, pi_len, digit_line);
+        printf("| Pi = 3.%s", digit_line);
         // Add padding spaces to align with the border
         for (int k = pi_len + 8; k < 77; k++) { // 8 = length of "Pi = 3."
             printf(" ");
         }
         printf("|\n");
-    } else if (block->pi_digits) {
-        printf("| Pi = 3.");
+    } else if (pi_len > 0) {
         // Show first 60 digits, then indicate truncation
-        for (int i = 0; i < 60 && i < pi_len; i++) {
-            printf("%c", block->pi_digits[i]);
-        }
-        printf("... |\n");
+        pi_digits_to_string(&digits, 0, 60, digit_line);
+        printf("| Pi = 3.%s... |\n", digit_line);
     }
     
     printf("|                                                                              |\n");
     printf("| >> Mining Status: COMPLETE - %d Pi digits successfully calculated!        |\n", pi_len);
     printf("| >> Proof of Work: VALID - Nonce %u found after Pi calculation!           |\n", block->nonce);
     printf("+==============================================================================+\n\n");
+    reset_memory_pool_to(scratch, mark);
 }
 
 void cleanup_block(Block *block) {
-    if (block != NULL && block->pi_digits != NULL) {
-        free(block->pi_digits);
-        block->pi_digits = NULL;
+    if (block == NULL) return;
+    
+    // Shared payloads are released, privately owned ones freed
+    if (block->pi_digits_id != 0) {
+        digit_store_release(block->pi_digits_id);
+        block->pi_digits.packed = NULL;
+        block->pi_digits.count = 0;
+        block->pi_digits_id = 0;
+    } else {
+        pi_digits_free(&block->pi_digits);
+    }
+    
+    if (block->pi_base_id != 0) {
+        digit_store_release(block->pi_base_id);
+        block->pi_base_id = 0;
+    }
+    digit_derivation_release(&block->pi_recipe);
+    block->pi_digits.count = 0;
+    
+    for (int i = 0; i < block->transaction_count; i++) {
+        tx_release(block->transactions[i]);
+    }
+    free(block->transactions);
+    block->transactions = NULL;
+    block->transaction_count = 0;
+    block->transaction_capacity = 0;
+}
+
+bool block_pi_digits(const Block *block, PiDigits *digits) {
+    if (block == NULL || digits == NULL) return false;
+    
+    if (block->pi_digits.packed != NULL) {
+        *digits = block->pi_digits;
+        return true;
     }
+    if (block->pi_recipe.anchor_id == 0 || block->pi_digits.count <= 0) return false;
+    
+    digits->count = block->pi_digits.count;
+    digits->packed = allocate_from_pool(thread_scratch_pool(), pi_packed_size(digits->count));
+    return digits->packed != NULL &&
+           digit_derivation_build(&block->pi_recipe, digits->count, digits->packed);
+}
+
+void prune_block(Block *block) {
+    if (block == NULL || block->pruned) return;
+    
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits digits;
+    uint64_t commitment = block_pi_digits(block, &digits) ? digit_store_content_id(&digits) : 0;
+    reset_memory_pool_to(scratch, mark);
+    cleanup_block(block);
+    block->digits_commitment = commitment;
+    block->pruned = true;
+}
+
+size_t block_body_size(const Block *block) {
+    if (block == NULL || block->pruned) return 0;
+    
+    return (size_t)block->transaction_capacity * sizeof(Transaction *) +
+           (size_t)block->transaction_count * sizeof(Transaction) +
+           ((block->pi_digits.packed != NULL) ? pi_packed_size(block->pi_digits.count) : 0);
 }
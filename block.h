@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <time.h>
 #include "wallet.h"
+#include "pi.h"
+#include "digitstore.h"
 
 #define MAX_PI_DIGITS 10000000  // 10 million digits - very large buffer
 #define MAX_TRANSACTIONS_PER_BLOCK 100
@@ -13,26 +15,66 @@ typedef struct {
     int index;
     time_t timestamp;
     int difficulty;
-    char *pi_digits;     // Dynamically allocated Pi digits
-    int pi_digits_count; // Number of Pi digits stored
+    PiDigits pi_digits;  // Packed Pi digits (count = number stored; packed is NULL when only the recipe is kept)
+    uint64_t pi_digits_id; // Shared payload in the digit store (0 = owned by the block)
+    uint64_t pi_base_id;   // Generator base the digits were derived from (0 = none)
+    DigitDerivation pi_recipe;  // Rebuilds the digits when no payload is kept
     uint32_t prev_hash;
     uint32_t hash;
+    uint64_t merkle_root;  // Commits the transactions; the hash covers it
+    bool legacy_hash;      // Hash covers the transaction text instead (chain files before version 7)
+    bool unsigned_transfers;  // Transfers predate signatures (chain files before version 8)
+    bool text_leaves;      // Merkle leaves hash the address text (chain files before version 9)
+    bool unsequenced_transfers;  // Transfers predate sequence numbers (chain files before version 10)
     
     // Enhanced blockchain features
-    Transaction transactions[MAX_TRANSACTIONS_PER_BLOCK];
+    Transaction **transactions;  // Shared records (see txpool.h), NULL when empty
     int transaction_count;
+    int transaction_capacity;
     char miner_address[WALLET_ADDRESS_LENGTH];
     uint64_t mining_reward;
     uint32_t nonce;  // For additional proof of work validation
     uint64_t total_difficulty;  // Cumulative difficulty for chain selection
+    
+    // Pruned blocks keep the header but no transactions or digits
+    bool pruned;
+    uint64_t digits_commitment;  // Content id of the dropped digits (pruned blocks only)
 } Block;
 
 void mine_block(Block *block, uint32_t prev_hash, const Block *prev_block, const char *miner_address, const RewardSystem *reward_system);
+// Mines a block holding the given transfers after the coinbase, which also
+// collects their fees. The block takes its own references to them.
+void mine_block_with_transactions(Block *block, uint32_t prev_hash, const Block *prev_block,
+                                  const char *miner_address, const RewardSystem *reward_system,
+                                  Transaction *const *transactions, int count);
+// Mines a block whose index, prev_hash, miner, reward, transactions and
+// Merkle root are already in place: difficulty, digits and nonce
+void mine_assembled_block(Block *block, const Block *prev_block);
 void print_block(const Block *block);
 void cleanup_block(Block *block);  // Free dynamically allocated memory
-bool add_transaction_to_block(Block *block, const Transaction *tx);
+bool add_transaction_to_block(Block *block, const Transaction *tx);  // Adds a new record holding a copy
+bool add_shared_transaction(Block *block, Transaction *tx);         // Adds a reference to tx
 bool validate_block(const Block *block, const Block *prev_block);
+bool validate_block_contents(const Block *block);  // Checks that do not need the previous block; passes are cached
+bool validate_block_transactions(const Block *block);  // Stateless rules and signatures, in parallel batches; cached ones are skipped
+bool is_valid_transfer(const Transaction *tx);  // The rules a non-coinbase transaction must meet
 uint32_t calculate_block_hash(const Block *block);
+
+// Merkle tree over the transactions in block order; a node left without a
+// sibling at the end of a level moves up unchanged. Leaves hash the
+// binary address ids.
+uint64_t transaction_leaf_hash(const Transaction *tx);
+uint64_t merkle_parent_hash(uint64_t left, uint64_t right);
+uint64_t compute_merkle_root(const Block *block);  // 0 without transactions
 bool is_valid_proof_of_work(const Block *block);
 
+// The block's digits: its payload, or the digits its recipe stands for
+// rebuilt in the thread's scratch pool, which the caller resets. False
+// when the block has no digits.
+bool block_pi_digits(const Block *block, PiDigits *digits);
+
+// Drops the block's body, keeping its header and a commitment to its digits
+void prune_block(Block *block);
+size_t block_body_size(const Block *block);  // Bytes held by transactions and digits
+
 #endif
@@ -0,0 +1,260 @@
+#include "blocktemplate.h"
+#include "txpool.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static bool has_coinbase(const BlockTemplate *tmpl) {
+    return tmpl->coinbase.amount > 0;
+}
+
+static int leaf_count(const BlockTemplate *tmpl) {
+    return (has_coinbase(tmpl) ? 1 : 0) + tmpl->count;
+}
+
+static const Transaction *leaf_transaction(const BlockTemplate *tmpl, int leaf) {
+    if (has_coinbase(tmpl)) {
+        return (leaf == 0) ? &tmpl->coinbase : tmpl->transfers[leaf - 1];
+    }
+    return tmpl->transfers[leaf];
+}
+
+static uint64_t node_hash(const BlockTemplate *tmpl, int level, int index) {
+    int left = 2 * index;
+    if (left + 1 >= tmpl->level_count[level]) return tmpl->tree[level][left];
+    return merkle_parent_hash(tmpl->tree[level][left], tmpl->tree[level][left + 1]);
+}
+
+static void set_root(BlockTemplate *tmpl) {
+    int level = 0;
+    while (tmpl->level_count[level] > 1) level++;
+    tmpl->merkle_root = (tmpl->level_count[0] > 0) ? tmpl->tree[level][0] : 0;
+    tmpl->revision++;
+}
+
+// Rehashes leaves from first on and every node above them; appending or
+// removing leaves only disturbs nodes at or after their position
+static void refresh_tree(BlockTemplate *tmpl, int first) {
+    int count = leaf_count(tmpl);
+    for (int i = first; i < count; i++) {
+        tmpl->tree[0][i] = transaction_leaf_hash(leaf_transaction(tmpl, i));
+    }
+    tmpl->level_count[0] = count;
+    
+    for (int level = 0; tmpl->level_count[level] > 1; level++) {
+        int parents = (tmpl->level_count[level] + 1) / 2;
+        first /= 2;
+        for (int i = first; i < parents; i++) {
+            tmpl->tree[level + 1][i] = node_hash(tmpl, level, i);
+        }
+        tmpl->level_count[level + 1] = parents;
+    }
+    set_root(tmpl);
+}
+
+// Rehashes one leaf and its path to the root; the leaf count is unchanged
+static void update_leaf(BlockTemplate *tmpl, int leaf) {
+    tmpl->tree[0][leaf] = transaction_leaf_hash(leaf_transaction(tmpl, leaf));
+    for (int level = 0; tmpl->level_count[level] > 1; level++) {
+        leaf /= 2;
+        tmpl->tree[level + 1][leaf] = node_hash(tmpl, level, leaf);
+    }
+    set_root(tmpl);
+}
+
+// The coinbase pays reward + fees; it drops out when that comes to nothing
+static void rebuild_coinbase(BlockTemplate *tmpl) {
+    uint64_t amount = tmpl->reward + tmpl->fees;
+    if (amount > 0 && tmpl->miner_address[0] != '\0') {
+        create_coinbase_transaction(&tmpl->coinbase, tmpl->miner_address, amount);
+    } else {
+        memset(&tmpl->coinbase, 0, sizeof(Transaction));
+    }
+}
+
+// Updates the coinbase and the tree after leaves from first_transfer on
+// were appended or removed
+static void update_after_change(BlockTemplate *tmpl, bool had_coinbase, int first_transfer) {
+    rebuild_coinbase(tmpl);
+    if (had_coinbase != has_coinbase(tmpl)) {
+        refresh_tree(tmpl, 0);
+        return;
+    }
+    refresh_tree(tmpl, (had_coinbase ? 1 : 0) + first_transfer);
+    if (had_coinbase) update_leaf(tmpl, 0);
+}
+
+static int find_transfer(const BlockTemplate *tmpl, const Transaction *tx) {
+    for (int i = 0; i < tmpl->count; i++) {
+        if (same_transaction(tmpl->transfers[i], tx)) return i;
+    }
+    return -1;
+}
+
+static void release_transfers(BlockTemplate *tmpl) {
+    for (int i = 0; i < tmpl->count; i++) {
+        tx_release(tmpl->transfers[i]);
+    }
+    tmpl->count = 0;
+    tmpl->fees = 0;
+}
+
+void init_block_template(BlockTemplate *tmpl) {
+    if (tmpl == NULL) return;
+    
+    memset(tmpl, 0, sizeof(BlockTemplate));
+    tmpl->height = -1;  // No tip yet; the first set_tip rebuilds
+}
+
+void cleanup_block_template(BlockTemplate *tmpl) {
+    if (tmpl == NULL) return;
+    
+    release_transfers(tmpl);
+    init_block_template(tmpl);
+}
+
+void block_template_set_tip(BlockTemplate *tmpl, const Block *tip, const char *miner_address,
+                            const RewardSystem *reward_system) {
+    if (tmpl == NULL) return;
+    
+    int height = (tip != NULL) ? tip->index + 1 : 0;
+    uint32_t prev_hash = (tip != NULL) ? tip->hash : 0;
+    if (height != tmpl->height || prev_hash != tmpl->prev_hash) {
+        // A block on the old tip spent the template's balances exactly as
+        // far as its own transfers go; any other move means a rebuild
+        if (tip != NULL && tip->index == tmpl->height && tip->prev_hash == tmpl->prev_hash) {
+            for (int i = 0; i < tip->transaction_count; i++) {
+                if (!tip->transactions[i]->is_coinbase) block_template_remove(tmpl, tip->transactions[i]);
+            }
+        } else {
+            tmpl->needs_rebuild = true;
+        }
+        tmpl->height = height;
+        tmpl->prev_hash = prev_hash;
+    }
+    
+    bool had_coinbase = has_coinbase(tmpl);
+    memset(tmpl->miner_address, 0, WALLET_ADDRESS_LENGTH);
+    if (miner_address != NULL) strncpy(tmpl->miner_address, miner_address, WALLET_ADDRESS_LENGTH - 1);
+    tmpl->reward = (reward_system != NULL) ? calculate_mining_reward(reward_system, height) : 0;
+    update_after_change(tmpl, had_coinbase, tmpl->count);
+}
+
+// Whether tx pays more than some sender's last transfer in the template,
+// the only ones that can leave without stranding a later transfer
+static bool outranks_a_tail(const BlockTemplate *tmpl, const Transaction *tx) {
+    for (int i = tmpl->count - 1; i >= 0; i--) {
+        const Transaction *tail = tmpl->transfers[i];
+        bool last = true;
+        for (int j = i + 1; j < tmpl->count && last; j++) {
+            last = tmpl->transfers[j]->from != tail->from;
+        }
+        if (last && tx->fee > tail->fee) return true;
+    }
+    return false;
+}
+
+// Whether tx carries the number after its sender's last transfer in the
+// template, or the state's next one when it has none there; anything else
+// means the pool holds earlier transfers the template went without
+static bool follows_sender(const BlockTemplate *tmpl, const Transaction *tx) {
+    if (tmpl->state == NULL) return true;
+    for (int i = tmpl->count - 1; i >= 0; i--) {
+        if (tmpl->transfers[i]->from == tx->from) return tx->sequence == tmpl->transfers[i]->sequence + 1;
+    }
+    return tx->sequence == state_get_sequence(tmpl->state, tx->from);
+}
+
+bool block_template_add(BlockTemplate *tmpl, Transaction *tx) {
+    if (tmpl == NULL || !is_valid_transfer(tx)) return false;
+    
+    // Appending it would strand it without its sender's earlier transfers
+    if (!follows_sender(tmpl, tx)) {
+        tmpl->needs_rebuild = true;
+        return false;
+    }
+    
+    // When full, a better arrival cannot simply replace a transfer: the
+    // template does not see what else its sender has queued. The next
+    // refill rebuilds it from the pool in a minable order instead.
+    if (tmpl->count >= TEMPLATE_MAX_TRANSFERS) {
+        if (outranks_a_tail(tmpl, tx)) tmpl->needs_rebuild = true;
+        return false;
+    }
+    if (tx->fee > UINT64_MAX - tmpl->reward - tmpl->fees || find_transfer(tmpl, tx) >= 0) return false;
+    
+    bool had_coinbase = has_coinbase(tmpl);
+    tmpl->transfers[tmpl->count++] = tx_retain(tx);
+    tmpl->fees += tx->fee;
+    update_after_change(tmpl, had_coinbase, tmpl->count - 1);
+    return true;
+}
+
+bool block_template_remove(BlockTemplate *tmpl, const Transaction *tx) {
+    if (tmpl == NULL || tx == NULL) return false;
+    
+    int index = find_transfer(tmpl, tx);
+    if (index < 0) return false;
+    
+    bool had_coinbase = has_coinbase(tmpl);
+    tmpl->fees -= tmpl->transfers[index]->fee;
+    tx_release(tmpl->transfers[index]);
+    memmove(&tmpl->transfers[index], &tmpl->transfers[index + 1],
+            (size_t)(tmpl->count - index - 1) * sizeof(Transaction *));
+    tmpl->count--;
+    update_after_change(tmpl, had_coinbase, index);
+    return true;
+}
+
+void block_template_on_mempool(void *context, Transaction *tx, bool added) {
+    BlockTemplate *tmpl = context;
+    if (added) {
+        block_template_add(tmpl, tx);
+    } else {
+        block_template_remove(tmpl, tx);
+    }
+}
+
+bool block_template_refill(BlockTemplate *tmpl, Mempool *pool, const ChainState *state) {
+    if (tmpl == NULL || pool == NULL) return false;
+    tmpl->state = state;
+    if (!tmpl->needs_rebuild && (tmpl->count >= TEMPLATE_MAX_TRANSFERS || pool->count <= tmpl->count)) {
+        return false;
+    }
+    
+    Transaction *best[TEMPLATE_MAX_TRANSFERS];
+    int count = mempool_peek(pool, state, best, TEMPLATE_MAX_TRANSFERS);
+    release_transfers(tmpl);
+    for (int i = 0; i < count; i++) {
+        if (best[i]->fee > UINT64_MAX - tmpl->reward - tmpl->fees) continue;
+        tmpl->transfers[tmpl->count++] = tx_retain(best[i]);
+        tmpl->fees += best[i]->fee;
+    }
+    rebuild_coinbase(tmpl);
+    refresh_tree(tmpl, 0);
+    tmpl->needs_rebuild = false;
+    return true;
+}
+
+bool block_template_fill_block(const BlockTemplate *tmpl, Block *block) {
+    if (tmpl == NULL || block == NULL || tmpl->height < 0) return false;
+    
+    memset(block, 0, sizeof(Block));
+    block->index = tmpl->height;
+    block->timestamp = time(NULL);
+    block->prev_hash = tmpl->prev_hash;
+    memcpy(block->miner_address, tmpl->miner_address, WALLET_ADDRESS_LENGTH);
+    block->mining_reward = tmpl->reward;
+    
+    // The coinbase is copied, transfers are shared
+    bool ok = !has_coinbase(tmpl) || add_transaction_to_block(block, &tmpl->coinbase);
+    for (int i = 0; ok && i < tmpl->count; i++) {
+        ok = add_shared_transaction(block, tmpl->transfers[i]);
+    }
+    if (!ok) {
+        cleanup_block(block);
+        return false;
+    }
+    block->merkle_root = tmpl->merkle_root;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef BLOCKTEMPLATE_H
+#define BLOCKTEMPLATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "block.h"
+#include "mempool.h"
+#include "state.h"
+
+// The next block to mine, kept current as transfers enter and leave the
+// mempool and as the tip moves. Each change touches only the Merkle nodes
+// above the leaves it moves, so the root and the fee total are always
+// ready and a block can be filled from the template without rebuilding
+// it. Leaf 0 is the coinbase whenever it pays anything.
+#define TEMPLATE_MAX_TRANSFERS (MAX_TRANSACTIONS_PER_BLOCK - 1)
+#define TEMPLATE_TREE_LEVELS 8  // Enough for MAX_TRANSACTIONS_PER_BLOCK leaves
+
+typedef struct {
+    int height;
+    uint32_t prev_hash;
+    char miner_address[WALLET_ADDRESS_LENGTH];
+    uint64_t reward;
+    uint64_t fees;
+    Transaction coinbase;                              // Pays reward + fees
+    Transaction *transfers[TEMPLATE_MAX_TRANSFERS];    // Shared records, one reference each
+    int count;
+    uint64_t tree[TEMPLATE_TREE_LEVELS][MAX_TRANSACTIONS_PER_BLOCK];  // Leaves first
+    int level_count[TEMPLATE_TREE_LEVELS];
+    uint64_t merkle_root;
+    uint64_t revision;   // Changes with every update, so a stale copy can be told apart
+    bool needs_rebuild;  // The tip moved somewhere the transfers may no longer be funded
+    const ChainState *state;  // Borrowed from the last refill; arrivals must follow on from it
+} BlockTemplate;
+
+void init_block_template(BlockTemplate *tmpl);
+void cleanup_block_template(BlockTemplate *tmpl);
+
+// Moves the template onto tip (NULL for the genesis block). When tip
+// extends the previous tip, its transfers just leave the template;
+// otherwise the next refill rebuilds it.
+void block_template_set_tip(BlockTemplate *tmpl, const Block *tip, const char *miner_address,
+                            const RewardSystem *reward_system);
+
+// False when full or already present. A full template asks for a rebuild
+// when tx pays more than a sender's last transfer in it; so does a
+// transfer that does not carry its sender's next sequence number, as one
+// arriving behind transfers the template left in the pool would.
+bool block_template_add(BlockTemplate *tmpl, Transaction *tx);
+bool block_template_remove(BlockTemplate *tmpl, const Transaction *tx);
+
+// Mempool listener keeping a template (the context) in step with the pool
+void block_template_on_mempool(void *context, Transaction *tx, bool added);
+
+// Fills free room from the pool's best transfers, or rebuilds the
+// transfers after set_tip asked for it; returns whether anything changed.
+// Later arrivals are checked against state (may be NULL), which must
+// outlive the template or the next refill.
+bool block_template_refill(BlockTemplate *tmpl, Mempool *pool, const ChainState *state);
+
+// Fills block with the template's header fields and shared transactions,
+// ready for mine_assembled_block
+bool block_template_fill_block(const BlockTemplate *tmpl, Block *block);
+
+#endif
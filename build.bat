@@ -6,7 +6,7 @@ REM Try different compilers
 where gcc >nul 2>&1
 if %ERRORLEVEL% == 0 (
     echo Using GCC compiler...
-    gcc -o archimed.exe main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c -lws2_32 -std=c17 -Wall -Wextra
+    gcc -o archimed.exe main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c chain.c state.c config.c mempool.c blocktemplate.c txpool.c digitstore.c compress.c storage.c journal.c sha512.c ed25519.c verifycache.c address.c rescan.c keystore.c -lws2_32 -std=c17 -Wall -Wextra
     if %ERRORLEVEL% == 0 (
         echo Build successful!
         echo.
@@ -22,7 +22,7 @@ if %ERRORLEVEL% == 0 (
 where cl >nul 2>&1
 if %ERRORLEVEL% == 0 (
     echo Using Microsoft Visual C++ compiler...
-    cl main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c ws2_32.lib /Fe:archimed.exe
+    cl main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c chain.c state.c config.c mempool.c blocktemplate.c txpool.c digitstore.c compress.c storage.c journal.c sha512.c ed25519.c verifycache.c address.c rescan.c keystore.c ws2_32.lib /Fe:archimed.exe
     if %ERRORLEVEL% == 0 (
         echo Build successful!
         echo.
@@ -38,7 +38,7 @@ if %ERRORLEVEL% == 0 (
 where clang >nul 2>&1
 if %ERRORLEVEL% == 0 (
     echo Using Clang compiler...
-    clang -o archimed.exe main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c -lws2_32 -std=c17 -Wall -Wextra
+    clang -o archimed.exe main.c block.c pi.c utils.c wallet.c network.c performance.c menu.c chain.c state.c config.c mempool.c blocktemplate.c txpool.c digitstore.c compress.c storage.c journal.c sha512.c ed25519.c verifycache.c address.c rescan.c keystore.c -lws2_32 -std=c17 -Wall -Wextra
     if %ERRORLEVEL% == 0 (
         echo Build successful!
         echo.
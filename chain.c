@@ -0,0 +1,257 @@
+#include "chain.h"
+#include "performance.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_MASK (CHAIN_CHUNK_BLOCKS - 1)
+
+// Blocks checked per parallel validation task
+#define VALIDATE_BATCH_BLOCKS 32
+
+static ChainChunk **load_directory(const Chain *chain) {
+    return (ChainChunk **)atomic_load_ptr((void *const volatile *)&chain->directory);
+}
+
+// Replaces the directory with a larger copy. Readers may still hold the
+// old one, so it is retired rather than freed.
+static bool grow_directory(Chain *chain, int capacity) {
+    if (chain->retired_count >= CHAIN_MAX_DIRECTORIES) return false;
+    
+    ChainChunk **directory = calloc((size_t)capacity, sizeof(ChainChunk *));
+    if (directory == NULL) return false;
+    
+    if (chain->directory != NULL) {
+        memcpy(directory, chain->directory, chain->chunk_count * sizeof(ChainChunk *));
+        chain->retired[chain->retired_count++] = chain->directory;
+    }
+    
+    atomic_store_ptr((void *volatile *)&chain->directory, directory);
+    chain->directory_capacity = capacity;
+    return true;
+}
+
+static bool add_chunk(Chain *chain) {
+    if (chain->chunk_count >= chain->directory_capacity &&
+        !grow_directory(chain, chain->directory_capacity * 2)) {
+        return false;
+    }
+    
+    // Bodies start zeroed so unused slots can be cleaned up safely
+    ChainChunk *chunk = calloc(1, sizeof(ChainChunk));
+    if (chunk == NULL) return false;
+    
+    chain->directory[chain->chunk_count++] = chunk;
+    return true;
+}
+
+bool init_chain(Chain *chain, int initial_capacity) {
+    if (chain == NULL) return false;
+    
+    memset(chain, 0, sizeof(Chain));
+    int chunks = (initial_capacity + CHAIN_CHUNK_BLOCKS - 1) / CHAIN_CHUNK_BLOCKS;
+    if (chunks < 16) chunks = 16;
+    
+    return grow_directory(chain, chunks);
+}
+
+void cleanup_chain(Chain *chain) {
+    if (chain == NULL) return;
+    
+    chain_truncate(chain, 0);
+    for (int i = 0; i < chain->chunk_count; i++) {
+        free(chain->directory[i]);
+    }
+    for (int i = 0; i < chain->retired_count; i++) {
+        free(chain->retired[i]);
+    }
+    free(chain->directory);
+    memset(chain, 0, sizeof(Chain));
+}
+
+int chain_size(const Chain *chain) {
+    return (chain != NULL) ? atomic_load_int(&chain->size) : 0;
+}
+
+Block *chain_block(const Chain *chain, int height) {
+    if (height < 0 || height >= chain_size(chain)) return NULL;
+    
+    // The size is published after the chunk, so the directory holds it
+    ChainChunk **directory = load_directory(chain);
+    return &directory[height >> CHAIN_CHUNK_BITS]->bodies[height & CHUNK_MASK];
+}
+
+Block *chain_tip(const Chain *chain) {
+    return chain_block(chain, chain_size(chain) - 1);
+}
+
+bool chain_append(Chain *chain, const Block *block) {
+    if (chain == NULL || block == NULL || chain->directory == NULL) return false;
+    
+    int height = chain->size;
+    if ((height >> CHAIN_CHUNK_BITS) >= chain->chunk_count && !add_chunk(chain)) {
+        return false;
+    }
+    
+    ChainChunk *chunk = chain->directory[height >> CHAIN_CHUNK_BITS];
+    int slot = height & CHUNK_MASK;
+    BlockHeaderTable *h = &chunk->headers;
+    h->hash[slot] = block->hash;
+    h->prev_hash[slot] = block->prev_hash;
+    h->index[slot] = block->index;
+    h->timestamp[slot] = block->timestamp;
+    h->difficulty[slot] = block->difficulty;
+    h->total_difficulty[slot] = block->total_difficulty;
+    h->nonce[slot] = block->nonce;
+    chunk->bodies[slot] = *block;
+    if (block->pruned && chain->pruned_height == height) {
+        chain->pruned_height = height + 1;
+    }
+    
+    atomic_store_int(&chain->size, height + 1);
+    return true;
+}
+
+void chain_truncate(Chain *chain, int height) {
+    if (chain == NULL || height < 0) return;
+    
+    // Emptied chunks are kept for the next appends
+    while (chain->size > height) {
+        int last = chain->size - 1;
+        atomic_store_int(&chain->size, last);
+        Block *body = &chain->directory[last >> CHAIN_CHUNK_BITS]->bodies[last & CHUNK_MASK];
+        cleanup_block(body);
+        memset(body, 0, sizeof(Block));
+    }
+    if (chain->pruned_height > height) {
+        chain->pruned_height = height;
+    }
+}
+
+int chain_prune_height(const Chain *chain, int keep_blocks, size_t byte_budget) {
+    int size = chain_size(chain);
+    if (size == 0 || (keep_blocks <= 0 && byte_budget == 0)) return 0;
+    
+    // Walk down from the tip until either limit is reached
+    int height = size - 1;
+    size_t used = block_body_size(chain_block(chain, height));
+    while (height > chain->pruned_height) {
+        if (keep_blocks > 0 && size - height >= keep_blocks) break;
+        
+        size_t body = block_body_size(chain_block(chain, height - 1));
+        if (byte_budget > 0 && used + body > byte_budget) break;
+        used += body;
+        height--;
+    }
+    return height;
+}
+
+int chain_prune_bodies(Chain *chain, int height) {
+    if (chain == NULL) return 0;
+    if (height > chain->size - 1) height = chain->size - 1;
+    
+    int pruned = 0;
+    for (int i = chain->pruned_height; i < height; i++) {
+        Block *block = chain_block(chain, i);
+        if (!block->pruned) {
+            prune_block(block);
+            pruned++;
+        }
+    }
+    if (height > chain->pruned_height) {
+        chain->pruned_height = height;
+    }
+    return pruned;
+}
+
+int chain_find_hash(const Chain *chain, uint32_t hash) {
+    int size = chain_size(chain);
+    if (size == 0) return -1;
+    
+    ChainChunk **directory = load_directory(chain);
+    for (int base = 0; base < size; base += CHAIN_CHUNK_BLOCKS) {
+        const uint32_t *hashes = directory[base >> CHAIN_CHUNK_BITS]->headers.hash;
+        int count = (size - base < CHAIN_CHUNK_BLOCKS) ? size - base : CHAIN_CHUNK_BLOCKS;
+        for (int i = 0; i < count; i++) {
+            if (hashes[i] == hash) return base + i;
+        }
+    }
+    return -1;
+}
+
+int chain_verify_links(const Chain *chain) {
+    int size = chain_size(chain);
+    if (size == 0) return -1;
+    
+    // Each block must point at its predecessor and carry the running
+    // difficulty total; only the header columns are read
+    ChainChunk **directory = load_directory(chain);
+    const BlockHeaderTable *first = &directory[0]->headers;
+    if (first->total_difficulty[0] != (uint64_t)first->difficulty[0]) {
+        return 0;
+    }
+    
+    uint32_t prev_hash = first->hash[0];
+    int prev_index = first->index[0];
+    uint64_t prev_total = first->total_difficulty[0];
+    for (int i = 1; i < size; i++) {
+        const BlockHeaderTable *h = &directory[i >> CHAIN_CHUNK_BITS]->headers;
+        int slot = i & CHUNK_MASK;
+        if (h->prev_hash[slot] != prev_hash || h->index[slot] != prev_index + 1 ||
+            h->total_difficulty[slot] != prev_total + (uint64_t)h->difficulty[slot]) {
+            return i;
+        }
+        prev_hash = h->hash[slot];
+        prev_index = h->index[slot];
+        prev_total = h->total_difficulty[slot];
+    }
+    return -1;
+}
+
+typedef struct {
+    const Chain *chain;
+    int from_height;
+    int size;
+    int *first_invalid;  // Per batch, -1 when the whole batch is valid
+} ValidateJob;
+
+static void validate_batch_task(void *context, int index) {
+    ValidateJob *job = context;
+    int start = job->from_height + index * VALIDATE_BATCH_BLOCKS;
+    int end = start + VALIDATE_BATCH_BLOCKS;
+    if (end > job->size) end = job->size;
+    
+    job->first_invalid[index] = -1;
+    for (int height = start; height < end; height++) {
+        if (!validate_block_contents(chain_block(job->chain, height))) {
+            job->first_invalid[index] = height;
+            return;
+        }
+    }
+}
+
+int chain_validate(const Chain *chain, int from_height) {
+    int size = chain_size(chain);
+    if (from_height < 0) from_height = 0;
+    if (from_height >= size) return -1;
+    
+    int batches = (size - from_height + VALIDATE_BATCH_BLOCKS - 1) / VALIDATE_BATCH_BLOCKS;
+    ValidateJob job = {chain, from_height, size, malloc(batches * sizeof(int))};
+    int invalid = -1;
+    if (job.first_invalid != NULL && parallel_for(batches, validate_batch_task, &job)) {
+        // Batches cover increasing heights, so the first failure is the lowest
+        for (int i = 0; i < batches && invalid < 0; i++) {
+            invalid = job.first_invalid[i];
+        }
+    } else {
+        for (int height = from_height; height < size && invalid < 0; height++) {
+            if (!validate_block_contents(chain_block(chain, height))) invalid = height;
+        }
+    }
+    free(job.first_invalid);
+    
+    int broken = chain_verify_links(chain);
+    if (broken >= 0 && (invalid < 0 || broken < invalid)) {
+        invalid = broken;
+    }
+    return invalid;
+}
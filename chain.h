@@ -0,0 +1,85 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "block.h"
+
+// In-memory chain, split hot/cold and stored in fixed-size chunks.
+// Each chunk keeps the header fields that chain walks read in a
+// structure-of-arrays table, and the full blocks (transactions, digits,
+// miner data) in a separate array. Chunks are found through a directory
+// and never move once allocated, so block pointers stay valid while the
+// chain grows and growing never copies blocks.
+//
+// One thread appends; any number of threads may read concurrently
+// through chain_block and the header scans. Truncation and cleanup need
+// the chain to themselves.
+#define CHAIN_CHUNK_BITS 8
+#define CHAIN_CHUNK_BLOCKS (1 << CHAIN_CHUNK_BITS)
+#define CHAIN_MAX_DIRECTORIES 32
+
+typedef struct {
+    uint32_t hash[CHAIN_CHUNK_BLOCKS];
+    uint32_t prev_hash[CHAIN_CHUNK_BLOCKS];
+    int index[CHAIN_CHUNK_BLOCKS];
+    time_t timestamp[CHAIN_CHUNK_BLOCKS];
+    int difficulty[CHAIN_CHUNK_BLOCKS];
+    uint64_t total_difficulty[CHAIN_CHUNK_BLOCKS];
+    uint32_t nonce[CHAIN_CHUNK_BLOCKS];
+} BlockHeaderTable;
+
+typedef struct {
+    BlockHeaderTable headers;
+    Block bodies[CHAIN_CHUNK_BLOCKS];
+} ChainChunk;
+
+typedef struct {
+    ChainChunk **directory;  // Published to readers, replaced when full
+    int directory_capacity;
+    int chunk_count;         // Chunks allocated (may exceed what size needs)
+    int size;                // Published after the block is in place
+    int pruned_height;       // Blocks below this height have no body
+    
+    // Outgrown directories stay valid for readers until cleanup
+    ChainChunk **retired[CHAIN_MAX_DIRECTORIES];
+    int retired_count;
+} Chain;
+
+bool init_chain(Chain *chain, int initial_capacity);
+void cleanup_chain(Chain *chain);  // Also cleans up every block
+
+int chain_size(const Chain *chain);
+
+// Block at height, NULL when out of range. The pointer stays valid until
+// the block is truncated away or the chain is cleaned up.
+Block *chain_block(const Chain *chain, int height);
+Block *chain_tip(const Chain *chain);
+
+// Moves block onto the end of the chain. On success the chain owns its
+// digits and transactions; on failure the caller still does.
+bool chain_append(Chain *chain, const Block *block);
+
+// Drops the blocks at height and above
+void chain_truncate(Chain *chain, int height);
+
+// Pruning keeps every header but drops the bodies of blocks below height.
+// chain_prune_height picks that height so at most keep_blocks recent
+// bodies (0 = any number) using at most byte_budget bytes (0 = no limit)
+// are kept; the tip's body is always kept since the next block derives
+// its digits from it. Pruning needs the chain to itself; returns the
+// number of bodies dropped.
+int chain_prune_height(const Chain *chain, int keep_blocks, size_t byte_budget);
+int chain_prune_bodies(Chain *chain, int height);
+
+// Header-only scans
+int chain_find_hash(const Chain *chain, uint32_t hash);  // Height or -1
+int chain_verify_links(const Chain *chain);             // First bad height or -1
+
+// Full validation of the blocks from from_height up: hashes, proof of work
+// and transaction rules are checked on worker threads, then the links in
+// one sequential header sweep. Returns the first invalid height or -1.
+int chain_validate(const Chain *chain, int from_height);
+
+#endif
@@ -0,0 +1,241 @@
+#include "compress.h"
+#include <string.h>
+
+#ifdef ARCHIMED_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+#define LZ_TAIL_LITERALS 5  // Last bytes are always emitted as literals
+
+bool codec_available(int codec) {
+    switch (codec) {
+        case CODEC_NONE:
+        case CODEC_LZ:
+            return true;
+#ifdef ARCHIMED_HAVE_ZLIB
+        case CODEC_ZLIB:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+int default_codec(void) {
+#ifdef ARCHIMED_HAVE_ZLIB
+    return CODEC_ZLIB;
+#else
+    return CODEC_LZ;
+#endif
+}
+
+const char *codec_name(int codec) {
+    switch (codec) {
+        case CODEC_NONE: return "none";
+        case CODEC_LZ: return "lz";
+        case CODEC_ZLIB: return "zlib";
+        default: return "unknown";
+    }
+}
+
+size_t codec_bound(int codec, size_t n) {
+    switch (codec) {
+        case CODEC_LZ:
+            return lz_compress_bound(n);
+#ifdef ARCHIMED_HAVE_ZLIB
+        case CODEC_ZLIB:
+            return (size_t)compressBound((uLong)n);
+#endif
+        default:
+            return n;
+    }
+}
+
+size_t codec_compress(int codec, const uint8_t *src, size_t n, uint8_t *dst, size_t capacity) {
+    if (src == NULL || dst == NULL) return 0;
+
+    switch (codec) {
+        case CODEC_NONE:
+            if (n > capacity) return 0;
+            memcpy(dst, src, n);
+            return n;
+        case CODEC_LZ:
+            return lz_compress(src, n, dst, capacity);
+#ifdef ARCHIMED_HAVE_ZLIB
+        case CODEC_ZLIB: {
+            uLongf out_size = (uLongf)capacity;
+            if (compress2(dst, &out_size, src, (uLong)n, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                return 0;
+            }
+            return (size_t)out_size;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+bool codec_decompress(int codec, const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size) {
+    if (src == NULL || dst == NULL) return false;
+
+    switch (codec) {
+        case CODEC_NONE:
+            if (n != raw_size) return false;
+            memcpy(dst, src, n);
+            return true;
+        case CODEC_LZ:
+            return lz_decompress(src, n, dst, raw_size);
+#ifdef ARCHIMED_HAVE_ZLIB
+        case CODEC_ZLIB: {
+            uLongf out_size = (uLongf)raw_size;
+            return uncompress(dst, &out_size, src, (uLong)n) == Z_OK && out_size == raw_size;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+size_t lz_compress_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Lengths of 15 and above spill into extra bytes of 255 plus a remainder
+static bool put_length(uint8_t *dst, size_t capacity, size_t *op, size_t length) {
+    while (length >= 255) {
+        if (*op >= capacity) return false;
+        dst[(*op)++] = 255;
+        length -= 255;
+    }
+    if (*op >= capacity) return false;
+    dst[(*op)++] = (uint8_t)length;
+    return true;
+}
+
+static bool emit_sequence(uint8_t *dst, size_t capacity, size_t *op,
+                          const uint8_t *literals, size_t literal_length,
+                          size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    uint8_t token = (uint8_t)(((literal_length < 15 ? literal_length : 15) << 4) |
+                              (match_code < 15 ? match_code : 15));
+
+    if (*op >= capacity) return false;
+    dst[(*op)++] = token;
+    if (literal_length >= 15 && !put_length(dst, capacity, op, literal_length - 15)) return false;
+
+    if (*op + literal_length > capacity) return false;
+    memcpy(dst + *op, literals, literal_length);
+    *op += literal_length;
+
+    // The final sequence carries literals only
+    if (match_length == 0) return true;
+
+    if (*op + 2 > capacity) return false;
+    dst[(*op)++] = (uint8_t)(offset & 0xFF);
+    dst[(*op)++] = (uint8_t)(offset >> 8);
+    if (match_code >= 15 && !put_length(dst, capacity, op, match_code - 15)) return false;
+    return true;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t capacity) {
+    if (src == NULL || dst == NULL) return 0;
+
+    // Positions are stored +1 so zero marks an empty slot
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    if (n > LZ_MIN_MATCH + LZ_TAIL_LITERALS) {
+        size_t limit = n - LZ_TAIL_LITERALS;
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET ||
+                read32(src + candidate - 1) != sequence) {
+                ip++;
+                continue;
+            }
+            candidate--;
+
+            size_t length = LZ_MIN_MATCH;
+            while (ip + length < limit && src[candidate + length] == src[ip + length]) {
+                length++;
+            }
+
+            if (!emit_sequence(dst, capacity, &op, src + anchor, ip - anchor, ip - candidate, length)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!emit_sequence(dst, capacity, &op, src + anchor, n - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+static bool get_length(const uint8_t *src, size_t n, size_t *ip, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= n) return false;
+        byte = src[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size) {
+    if (src == NULL || dst == NULL) return false;
+
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < n) {
+        uint8_t token = src[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(src, n, &ip, &literal_length)) return false;
+        if (ip + literal_length > n || op + literal_length > raw_size) return false;
+        memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        if (ip == n) break; // Final literal-only sequence
+
+        if (ip + 2 > n) return false;
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !get_length(src, n, &ip, &match_length)) return false;
+        match_length += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > op || op + match_length > raw_size) return false;
+
+        // Byte copy: overlapping matches repeat the window
+        const uint8_t *match = dst + op - offset;
+        for (size_t i = 0; i < match_length; i++) {
+            dst[op + i] = match[i];
+        }
+        op += match_length;
+    }
+
+    return op == raw_size;
+}
@@ -0,0 +1,31 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Codecs for chain file frames
+#define CODEC_NONE 0  // Stored as-is
+#define CODEC_LZ 1    // In-tree LZ77 codec (always available)
+#define CODEC_ZLIB 2  // System zlib (only when found at build time)
+
+bool codec_available(int codec);
+int default_codec(void);
+const char *codec_name(int codec);
+
+// Worst-case compressed size for n input bytes
+size_t codec_bound(int codec, size_t n);
+
+// Returns the compressed size, or 0 if dst is too small or the codec failed
+size_t codec_compress(int codec, const uint8_t *src, size_t n, uint8_t *dst, size_t capacity);
+
+// Decompresses exactly raw_size bytes; false on malformed input
+bool codec_decompress(int codec, const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size);
+
+// In-tree LZ codec (LZ4-style token stream, 64 KB window)
+size_t lz_compress_bound(size_t n);
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t capacity);
+bool lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size);
+
+#endif
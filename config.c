@@ -0,0 +1,101 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+void init_node_config(NodeConfig *config) {
+    if (config == NULL) return;
+    
+    memset(config, 0, sizeof(NodeConfig));
+    config->snapshot_interval = 100;
+    strcpy(config->snapshot_file, "archimed_state.dat");
+    config->huge_pages = true;
+    config->mempool_max_mb = 32;
+    config->cache_transactions = 65536;
+    config->cache_blocks = 4096;
+    strcpy(config->rescan_file, "archimed_rescan.dat");
+    strcpy(config->keystore_file, "archimed_keystore.dat");
+}
+
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return text;
+}
+
+static void set_string(char *target, size_t size, const char *value) {
+    strncpy(target, value, size - 1);
+    target[size - 1] = '\0';
+}
+
+// Applies one key of a section; unknown keys are ignored
+static void apply_setting(NodeConfig *config, const char *section, const char *key, const char *value) {
+    if (strcmp(section, "state") == 0) {
+        if (strcmp(key, "snapshot_interval") == 0) {
+            config->snapshot_interval = atoi(value);
+        } else if (strcmp(key, "snapshot_file") == 0) {
+            set_string(config->snapshot_file, sizeof(config->snapshot_file), value);
+        }
+    } else if (strcmp(section, "pruning") == 0) {
+        if (strcmp(key, "keep_blocks") == 0) {
+            config->prune_keep_blocks = atoi(value);
+        } else if (strcmp(key, "budget_mb") == 0) {
+            config->prune_budget_mb = atoi(value);
+        }
+    } else if (strcmp(section, "performance") == 0) {
+        if (strcmp(key, "huge_pages") == 0) {
+            config->huge_pages = strcmp(value, "false") != 0 && strcmp(value, "0") != 0;
+        }
+    } else if (strcmp(section, "mempool") == 0) {
+        if (strcmp(key, "max_mb") == 0) {
+            config->mempool_max_mb = atoi(value);
+        }
+    } else if (strcmp(section, "cache") == 0) {
+        if (strcmp(key, "transactions") == 0) {
+            config->cache_transactions = atoi(value);
+        } else if (strcmp(key, "blocks") == 0) {
+            config->cache_blocks = atoi(value);
+        }
+    } else if (strcmp(section, "wallet") == 0) {
+        if (strcmp(key, "rescan_file") == 0) {
+            set_string(config->rescan_file, sizeof(config->rescan_file), value);
+        } else if (strcmp(key, "keystore_file") == 0) {
+            set_string(config->keystore_file, sizeof(config->keystore_file), value);
+        }
+    }
+}
+
+bool load_node_config(NodeConfig *config, const char *filename) {
+    if (config == NULL || filename == NULL) return false;
+    
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) return false;
+    
+    char line[512];
+    char section[64] = "";
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *text = trim(line);
+        if (*text == '\0' || *text == '#' || *text == ';') continue;
+        
+        if (*text == '[') {
+            char *close = strchr(text, ']');
+            if (close != NULL) {
+                *close = '\0';
+                set_string(section, sizeof(section), trim(text + 1));
+            }
+            continue;
+        }
+        
+        char *equals = strchr(text, '=');
+        if (equals == NULL) continue;
+        *equals = '\0';
+        apply_setting(config, section, trim(text), trim(equals + 1));
+    }
+    
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+#define CONFIG_FILE "config.ini"
+
+// Node settings read from config.ini; keys not present keep their defaults
+typedef struct {
+    int snapshot_interval;      // [state] Blocks between balance snapshots (0 = off)
+    char snapshot_file[256];    // [state] Latest snapshot, replaced on each write
+    int prune_keep_blocks;      // [pruning] Recent blocks kept with full bodies (0 = all)
+    int prune_budget_mb;        // [pruning] Memory budget for block bodies (0 = unlimited)
+    bool huge_pages;            // [performance] Back large digit buffers with huge pages
+    int mempool_max_mb;         // [mempool] Memory cap for pending transfers
+    int cache_transactions;     // [cache] Verified transfer signatures remembered
+    int cache_blocks;           // [cache] Validated blocks remembered
+    char rescan_file[256];      // [wallet] Rescan watermarks, one per wallet address
+    char keystore_file[256];    // [wallet] Keystore holding any number of wallets
+} NodeConfig;
+
+void init_node_config(NodeConfig *config);
+bool load_node_config(NodeConfig *config, const char *filename);
+
+#endif
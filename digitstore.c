@@ -0,0 +1,375 @@
+#include "digitstore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static DigitStore digit_store;
+
+// Call before the store is shared between threads; later calls are no-ops
+bool init_digit_store(int initial_capacity) {
+    if (digit_store.entries != NULL) return true;
+    
+    digit_store.lock = create_mutex();
+    if (digit_store.lock == NULL) return false;
+    
+    // Power-of-two capacity so probing can mask instead of divide
+    int capacity = 64;
+    while (capacity < initial_capacity * 2) {
+        capacity <<= 1;
+    }
+    
+    digit_store.entries = calloc(capacity, sizeof(DigitStoreEntry));
+    if (digit_store.entries == NULL) {
+        destroy_mutex(digit_store.lock);
+        digit_store.lock = NULL;
+        return false;
+    }
+    
+    digit_store.capacity = capacity;
+    digit_store.count = 0;
+    digit_store.bytes_stored = 0;
+    digit_store.dedup_hits = 0;
+    return true;
+}
+
+void cleanup_digit_store(void) {
+    if (digit_store.entries != NULL) {
+        for (int i = 0; i < digit_store.capacity; i++) {
+            if (digit_store.entries[i].id != 0) {
+                pi_digits_free(&digit_store.entries[i].digits);
+            }
+        }
+        free(digit_store.entries);
+    }
+    free(digit_store.recipes);
+    destroy_mutex(digit_store.lock);
+    memset(&digit_store, 0, sizeof(DigitStore));
+}
+
+uint64_t digit_store_content_id(const PiDigits *digits) {
+    uint64_t hash = fast_hash64((const char *)digits->packed, pi_packed_size(digits->count));
+    hash ^= (uint64_t)digits->count * 0x9E3779B97F4A7C15ULL;
+    return hash != 0 ? hash : 1;
+}
+
+static bool same_content(const PiDigits *a, const PiDigits *b) {
+    return a->count == b->count &&
+           memcmp(a->packed, b->packed, pi_packed_size(a->count)) == 0;
+}
+
+static int find_slot(uint64_t id) {
+    if (digit_store.entries == NULL || id == 0) return -1;
+    
+    int mask = digit_store.capacity - 1;
+    for (int slot = (int)(id & mask); digit_store.entries[slot].id != 0; slot = (slot + 1) & mask) {
+        if (digit_store.entries[slot].id == id) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static bool grow_store(void) {
+    DigitStoreEntry *old_entries = digit_store.entries;
+    int old_capacity = digit_store.capacity;
+    int new_capacity = old_capacity * 2;
+    
+    DigitStoreEntry *entries = calloc(new_capacity, sizeof(DigitStoreEntry));
+    if (entries == NULL) return false;
+    
+    int mask = new_capacity - 1;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old_entries[i].id == 0) continue;
+        
+        int slot = (int)(old_entries[i].id & mask);
+        while (entries[slot].id != 0) {
+            slot = (slot + 1) & mask;
+        }
+        entries[slot] = old_entries[i];
+    }
+    
+    free(old_entries);
+    digit_store.entries = entries;
+    digit_store.capacity = new_capacity;
+    return true;
+}
+
+uint64_t digit_store_intern(PiDigits *digits) {
+    if (digits == NULL || digits->packed == NULL || digits->count <= 0) return 0;
+    if (!init_digit_store(64)) return 0;
+    
+    lock_mutex(digit_store.lock);
+    
+    // Keep the load factor under 1/2
+    if ((digit_store.count + 1) * 2 > digit_store.capacity && !grow_store()) {
+        unlock_mutex(digit_store.lock);
+        return 0;
+    }
+    
+    int mask = digit_store.capacity - 1;
+    uint64_t id = digit_store_content_id(digits);
+    int slot = (int)(id & mask);
+    
+    while (digit_store.entries[slot].id != 0) {
+        DigitStoreEntry *entry = &digit_store.entries[slot];
+        if (entry->id == id) {
+            if (same_content(&entry->digits, digits)) {
+                // Duplicate payload: drop the caller's copy, share ours
+                pi_digits_free(digits);
+                *digits = entry->digits;
+                entry->refcount++;
+                digit_store.dedup_hits++;
+                unlock_mutex(digit_store.lock);
+                return id;
+            }
+            
+            // Hash collision with different content: pick the next id
+            id = (id * 0x100000001B3ULL) + 1;
+            if (id == 0) id = 1;
+            slot = (int)(id & mask);
+            continue;
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    DigitStoreEntry *entry = &digit_store.entries[slot];
+    entry->id = id;
+    entry->digits = *digits;
+    entry->refcount = 1;
+    digit_store.count++;
+    digit_store.bytes_stored += pi_packed_size(digits->count);
+    unlock_mutex(digit_store.lock);
+    return id;
+}
+
+bool digit_store_lookup(uint64_t id, PiDigits *digits) {
+    if (digits == NULL) return false;
+    
+    lock_mutex(digit_store.lock);
+    int slot = find_slot(id);
+    if (slot >= 0) {
+        *digits = digit_store.entries[slot].digits;
+    }
+    unlock_mutex(digit_store.lock);
+    return slot >= 0;
+}
+
+bool digit_store_retain(uint64_t id) {
+    lock_mutex(digit_store.lock);
+    int slot = find_slot(id);
+    if (slot >= 0) {
+        digit_store.entries[slot].refcount++;
+    }
+    unlock_mutex(digit_store.lock);
+    return slot >= 0;
+}
+
+static void forget_recipes(uint64_t id) {
+    for (int i = 0; i < digit_store.recipe_count; ) {
+        if (digit_store.recipes[i].id == id) {
+            digit_store.recipes[i] = digit_store.recipes[--digit_store.recipe_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+void digit_store_release(uint64_t id) {
+    lock_mutex(digit_store.lock);
+    int slot = find_slot(id);
+    if (slot < 0 || --digit_store.entries[slot].refcount > 0) {
+        unlock_mutex(digit_store.lock);
+        return;
+    }
+    
+    DigitStoreEntry *entry = &digit_store.entries[slot];
+    
+    digit_store.bytes_stored -= pi_packed_size(entry->digits.count);
+    pi_digits_free(&entry->digits);
+    forget_recipes(id);
+    
+    // Backward-shift deletion keeps linear probe chains intact
+    int mask = digit_store.capacity - 1;
+    int hole = slot;
+    for (int next = (hole + 1) & mask; digit_store.entries[next].id != 0; next = (next + 1) & mask) {
+        int home = (int)(digit_store.entries[next].id & mask);
+        bool movable = (hole <= next) ? (home <= hole || home > next)
+                                      : (home <= hole && home > next);
+        if (movable) {
+            digit_store.entries[hole] = digit_store.entries[next];
+            hole = next;
+        }
+    }
+    memset(&digit_store.entries[hole], 0, sizeof(DigitStoreEntry));
+    digit_store.count--;
+    unlock_mutex(digit_store.lock);
+}
+
+static uint64_t find_recipe(int algorithm, int count) {
+    for (int i = 0; i < digit_store.recipe_count; i++) {
+        DigitRecipe *recipe = &digit_store.recipes[i];
+        if (recipe->algorithm == algorithm && recipe->count == count) {
+            return recipe->id;
+        }
+    }
+    return 0;
+}
+
+uint64_t digit_store_get_base(int algorithm, int count) {
+    if (!init_digit_store(64)) return 0;
+    
+    lock_mutex(digit_store.lock);
+    uint64_t cached = find_recipe(algorithm, count);
+    int slot = find_slot(cached);
+    if (slot >= 0) {
+        digit_store.entries[slot].refcount++;
+    }
+    unlock_mutex(digit_store.lock);
+    if (slot >= 0) return cached;
+    
+    // Generated without the lock held; a racing duplicate is deduplicated
+    PiDigits base;
+    if (!generate_pi_base_digits(&base, algorithm, count)) return 0;
+    
+    uint64_t id = digit_store_intern(&base);
+    if (id == 0) {
+        pi_digits_free(&base);
+        return 0;
+    }
+    
+    lock_mutex(digit_store.lock);
+    if (find_recipe(algorithm, count) == 0) {
+        if (digit_store.recipe_count >= digit_store.recipe_capacity) {
+            int new_capacity = digit_store.recipe_capacity ? digit_store.recipe_capacity * 2 : 16;
+            DigitRecipe *recipes = realloc(digit_store.recipes, new_capacity * sizeof(DigitRecipe));
+            if (recipes == NULL) {
+                unlock_mutex(digit_store.lock);
+                return id; // Still usable, just not cached
+            }
+            digit_store.recipes = recipes;
+            digit_store.recipe_capacity = new_capacity;
+        }
+        
+        DigitRecipe *recipe = &digit_store.recipes[digit_store.recipe_count++];
+        recipe->algorithm = algorithm;
+        recipe->count = count;
+        recipe->id = id;
+    }
+    unlock_mutex(digit_store.lock);
+    return id;
+}
+
+// Digit count of a stored payload, 0 when it is not in the store
+static int payload_count(uint64_t id) {
+    PiDigits digits;
+    return digit_store_lookup(id, &digits) ? digits.count : 0;
+}
+
+bool digit_derivation_extend(DigitDerivation *out, const DigitDerivation *prev, uint64_t prev_id,
+                             uint64_t base_id, int seed) {
+    if (out == NULL) return false;
+    
+    memset(out, 0, sizeof(DigitDerivation));
+    if (prev != NULL && prev->anchor_id != 0) {
+        *out = *prev;
+    } else {
+        out->anchor_id = prev_id;
+    }
+    
+    // The transform only covers the digits both sides have
+    int count = payload_count(base_id);
+    if (out->anchor_id == 0 || count == 0 || payload_count(out->anchor_id) != count) {
+        memset(out, 0, sizeof(DigitDerivation));
+        return false;
+    }
+    
+    int slot = 0;
+    while (slot < DIGIT_RECIPE_BASES && out->base_ids[slot] != 0 && out->base_ids[slot] != base_id) {
+        slot++;
+    }
+    if (slot == DIGIT_RECIPE_BASES) {
+        memset(out, 0, sizeof(DigitDerivation));
+        return false;
+    }
+    out->base_ids[slot] = base_id;
+    out->weights[slot] = (uint8_t)((out->weights[slot] + 1) % 10);
+    out->offset = (uint8_t)((out->offset + ((seed % 10) + 10) % 10) % 10);
+    
+    digit_store_retain(out->anchor_id);
+    for (int i = 0; i < DIGIT_RECIPE_BASES; i++) {
+        if (out->base_ids[i] != 0) digit_store_retain(out->base_ids[i]);
+    }
+    return true;
+}
+
+#define RECIPE_CHUNK_BYTES 512  // Packed bytes summed at a time
+
+bool digit_derivation_build(const DigitDerivation *derivation, int count, uint8_t *packed) {
+    if (derivation == NULL || derivation->anchor_id == 0 || packed == NULL) return false;
+    
+    PiDigits anchor;
+    if (!digit_store_lookup(derivation->anchor_id, &anchor) || anchor.count != count) return false;
+    
+    // Digit sums are at most 9 + 9 + 3 * 9 * 9, reduced once at the end
+    size_t bytes = pi_packed_size(count);
+    uint16_t high[RECIPE_CHUNK_BYTES], low[RECIPE_CHUNK_BYTES];
+    for (size_t start = 0; start < bytes; start += RECIPE_CHUNK_BYTES) {
+        size_t n = (bytes - start < RECIPE_CHUNK_BYTES) ? bytes - start : RECIPE_CHUNK_BYTES;
+        for (size_t i = 0; i < n; i++) {
+            high[i] = (uint16_t)((anchor.packed[start + i] >> 4) + derivation->offset);
+            low[i] = (uint16_t)((anchor.packed[start + i] & 0x0F) + derivation->offset);
+        }
+        
+        for (int b = 0; b < DIGIT_RECIPE_BASES; b++) {
+            uint8_t weight = derivation->weights[b];
+            PiDigits base;
+            if (weight == 0) continue;
+            if (!digit_store_lookup(derivation->base_ids[b], &base) || base.count != count) return false;
+            
+            for (size_t i = 0; i < n; i++) {
+                high[i] = (uint16_t)(high[i] + weight * (base.packed[start + i] >> 4));
+                low[i] = (uint16_t)(low[i] + weight * (base.packed[start + i] & 0x0F));
+            }
+        }
+        
+        for (size_t i = 0; i < n; i++) {
+            packed[start + i] = (uint8_t)(((high[i] % 10) << 4) | (low[i] % 10));
+        }
+    }
+    
+    // Odd digit count: low nibble of the last byte stays zero
+    if (count & 1) packed[bytes - 1] &= 0xF0;
+    return true;
+}
+
+uint64_t digit_derivation_key(const DigitDerivation *derivation) {
+    if (derivation == NULL || derivation->anchor_id == 0) return 0;
+    
+    uint8_t fields[8 * (DIGIT_RECIPE_BASES + 1) + DIGIT_RECIPE_BASES + 1];
+    memcpy(fields, &derivation->anchor_id, 8);
+    memcpy(fields + 8, derivation->base_ids, 8 * DIGIT_RECIPE_BASES);
+    memcpy(fields + 8 * (DIGIT_RECIPE_BASES + 1), derivation->weights, DIGIT_RECIPE_BASES);
+    fields[sizeof(fields) - 1] = derivation->offset;
+    uint64_t key = fast_hash64((const char *)fields, sizeof(fields));
+    return key != 0 ? key : 1;
+}
+
+void digit_derivation_release(DigitDerivation *derivation) {
+    if (derivation == NULL || derivation->anchor_id == 0) return;
+    
+    digit_store_release(derivation->anchor_id);
+    for (int i = 0; i < DIGIT_RECIPE_BASES; i++) {
+        if (derivation->base_ids[i] != 0) digit_store_release(derivation->base_ids[i]);
+    }
+    memset(derivation, 0, sizeof(DigitDerivation));
+}
+
+void get_digit_store_stats(DigitStoreStats *stats) {
+    if (stats == NULL) return;
+    
+    lock_mutex(digit_store.lock);
+    stats->payloads = digit_store.count;
+    stats->bytes_stored = digit_store.bytes_stored;
+    stats->dedup_hits = digit_store.dedup_hits;
+    unlock_mutex(digit_store.lock);
+}
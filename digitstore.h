@@ -0,0 +1,97 @@
+#ifndef DIGITSTORE_H
+#define DIGITSTORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pi.h"
+#include "performance.h"
+
+// Content-addressed store for packed Pi digit payloads.
+// Identical payloads are kept once and shared by reference count; entries
+// are identified by a 64-bit content hash (0 is never a valid id).
+// All functions are safe to call from several threads.
+typedef struct {
+    uint64_t id;
+    PiDigits digits;
+    int refcount;
+} DigitStoreEntry;
+
+// Generator output cache: (algorithm, count) -> base payload id
+typedef struct {
+    int algorithm;
+    int count;
+    uint64_t id;
+} DigitRecipe;
+
+typedef struct {
+    DigitStoreEntry *entries;
+    int capacity;
+    int count;
+    DigitRecipe *recipes;
+    int recipe_count;
+    int recipe_capacity;
+    size_t bytes_stored;
+    uint64_t dedup_hits;
+    PlatformMutex *lock;
+} DigitStore;
+
+// Digits kept as a recipe instead of a payload. A block's digits are its
+// base transformed by the previous block's digits (pi_digits_derive), so
+// along a run of blocks with the same digit count they add up to the
+// first block's digits plus each base a number of times plus the seed
+// offsets, digit by digit mod 10. Only that anchor payload is kept; the
+// recipe names it and the bases and holds a reference to each.
+#define DIGIT_RECIPE_BASES 3  // One per generator
+
+typedef struct {
+    uint64_t anchor_id;  // 0 = no recipe
+    uint64_t base_ids[DIGIT_RECIPE_BASES];  // 0 = unused
+    uint8_t weights[DIGIT_RECIPE_BASES];    // Times each base was added, mod 10
+    uint8_t offset;                         // Seed offsets added, mod 10
+} DigitDerivation;
+
+typedef struct {
+    int payloads;
+    size_t bytes_stored;
+    uint64_t dedup_hits;
+} DigitStoreStats;
+
+// Store lifecycle (a single process-wide store, created on first use)
+bool init_digit_store(int initial_capacity);
+void cleanup_digit_store(void);
+
+// Move digits into the store. On success digits points at the shared
+// payload and the returned id holds one reference; 0 means the caller
+// still owns digits. Lookups copy the descriptor out: the packed buffer
+// stays valid for as long as the caller holds a reference.
+uint64_t digit_store_intern(PiDigits *digits);
+bool digit_store_lookup(uint64_t id, PiDigits *digits);
+bool digit_store_retain(uint64_t id);
+void digit_store_release(uint64_t id);
+
+// Shared generator base for (algorithm, count), computed on first use.
+// Returns a new reference to the base payload, or 0 on failure.
+uint64_t digit_store_get_base(int algorithm, int count);
+
+// Content hash that identifies a payload in the store (never 0)
+uint64_t digit_store_content_id(const PiDigits *digits);
+
+// Recipe for base_id transformed with seed by the previous digits, which
+// are prev's recipe when it has one and otherwise the payload prev_id.
+// Fails (leaving out empty) when the lengths differ or the bases do not
+// fit; those digits have to be kept as a payload.
+bool digit_derivation_extend(DigitDerivation *out, const DigitDerivation *prev, uint64_t prev_id,
+                             uint64_t base_id, int seed);
+
+// Writes the count digits a recipe stands for into packed
+bool digit_derivation_build(const DigitDerivation *derivation, int count, uint8_t *packed);
+
+// Identifies what a recipe rebuilds without rebuilding it; not a content id
+uint64_t digit_derivation_key(const DigitDerivation *derivation);
+
+void digit_derivation_release(DigitDerivation *derivation);
+
+void get_digit_store_stats(DigitStoreStats *stats);
+
+#endif
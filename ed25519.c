@@ -0,0 +1,580 @@
+#include "ed25519.h"
+#include "sha512.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Field elements mod p = 2^255 - 19 as ten signed limbs of alternately 26
+// and 25 bits; limb i is worth 2^ceil(25.5 i). Products fit in 64 bits
+// while every limb stays below 2^27.
+typedef int64_t fe[10];
+
+// Extended coordinates: x = X/Z, y = Y/Z, x * y = T/Z
+typedef struct {
+    fe x, y, z, t;
+} GePoint;
+
+static const fe fe_d2 = {45281625, 27714825, 36363642, 13898781, 229458,
+                         15978800, 54557047, 27058993, 29715967, 9444199};
+static const fe fe_d = {56195235, 13857412, 51736253, 6949390, 114729,
+                        24766616, 60832955, 30306712, 48412415, 21499315};
+static const fe fe_sqrtm1 = {34513072, 25610706, 9377949, 3500415, 12389472,
+                             33281959, 41962654, 31548777, 326685, 11406482};
+static const GePoint base_point = {
+    {52811034, 25909283, 16144682, 17082669, 27570973, 30858332, 40966398, 8378388, 20764389, 8758491},
+    {40265304, 26843545, 13421772, 20132659, 26843545, 6710886, 53687091, 13421772, 40265318, 26843545},
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {28827043, 27438313, 39759291, 244362, 8635006, 11264893, 19351346, 13413597, 16611511, 27139452}
+};
+
+// The group order L = 2^252 + 27742317777372353535851937790883648493
+static const int64_t group_order[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+static int limb_bits(int i) {
+    return (i & 1) ? 25 : 26;
+}
+
+// Moves each limb's overflow into the next; the top limb wraps around
+// times 19 since 2^255 = 19 (mod p)
+static void fe_carry(fe h, int passes) {
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < 10; i++) {
+            int bits = limb_bits(i);
+            int64_t carry = h[i] >> bits;
+            h[i] -= carry * ((int64_t)1 << bits);
+            if (i == 9) {
+                h[0] += 19 * carry;
+            } else {
+                h[i + 1] += carry;
+            }
+        }
+    }
+}
+
+static void fe_copy(fe h, const fe f) {
+    memcpy(h, f, sizeof(fe));
+}
+
+static void fe_set(fe h, int64_t value) {
+    memset(h, 0, sizeof(fe));
+    h[0] = value;
+}
+
+static void fe_add(fe h, const fe f, const fe g) {
+    for (int i = 0; i < 10; i++) h[i] = f[i] + g[i];
+    fe_carry(h, 1);
+}
+
+static void fe_sub(fe h, const fe f, const fe g) {
+    for (int i = 0; i < 10; i++) h[i] = f[i] - g[i];
+    fe_carry(h, 1);
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+    int64_t t[19] = {0};
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 10; j++) {
+            // Two odd limbs overshoot the product's limb weight by one bit
+            int64_t product = f[i] * g[j];
+            t[i + j] += (i & j & 1) ? 2 * product : product;
+        }
+    }
+    for (int k = 18; k >= 10; k--) {
+        t[k - 10] += 19 * t[k];
+    }
+    for (int i = 0; i < 10; i++) h[i] = t[i];
+    fe_carry(h, 2);
+}
+
+static void fe_sq(fe h, const fe f) {
+    fe_mul(h, f, f);
+}
+
+// z^(p - 2)
+static void fe_invert(fe out, const fe z) {
+    fe c;
+    fe_copy(c, z);
+    for (int a = 253; a >= 0; a--) {
+        fe_sq(c, c);
+        if (a != 2 && a != 4) fe_mul(c, c, z);
+    }
+    fe_copy(out, c);
+}
+
+// z^((p - 5) / 8), the core of the square root
+static void fe_pow2523(fe out, const fe z) {
+    fe c;
+    fe_copy(c, z);
+    for (int a = 250; a >= 0; a--) {
+        fe_sq(c, c);
+        if (a != 1) fe_mul(c, c, z);
+    }
+    fe_copy(out, c);
+}
+
+// Canonical little-endian encoding, fully reduced below p
+static void fe_tobytes(uint8_t s[32], const fe f) {
+    fe h, w;
+    fe_copy(h, f);
+    fe_carry(h, 3);
+    
+    // h is now below 2^255; it is at least p exactly when h + 19 reaches 2^255
+    fe_copy(w, h);
+    w[0] += 19;
+    for (int i = 0; i < 9; i++) {
+        int64_t carry = w[i] >> limb_bits(i);
+        w[i] -= carry * ((int64_t)1 << limb_bits(i));
+        w[i + 1] += carry;
+    }
+    if ((w[9] >> 25) != 0) {
+        w[9] -= (int64_t)1 << 25;
+        fe_copy(h, w);
+    }
+    
+    uint64_t acc = 0;
+    int acc_bits = 0, out = 0;
+    for (int i = 0; i < 10; i++) {
+        acc |= (uint64_t)h[i] << acc_bits;
+        acc_bits += limb_bits(i);
+        while (acc_bits >= 8) {
+            s[out++] = (uint8_t)acc;
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+    s[out] = (uint8_t)acc;
+}
+
+// Reads 255 bits; the top bit of s is left to the caller
+static void fe_frombytes(fe h, const uint8_t s[32]) {
+    uint64_t acc = 0;
+    int acc_bits = 0, in = 0;
+    for (int i = 0; i < 10; i++) {
+        int bits = limb_bits(i);
+        while (acc_bits < bits) {
+            acc |= (uint64_t)s[in++] << acc_bits;
+            acc_bits += 8;
+        }
+        h[i] = (int64_t)(acc & (((uint64_t)1 << bits) - 1));
+        acc >>= bits;
+        acc_bits -= bits;
+    }
+}
+
+static bool fe_equal(const fe f, const fe g) {
+    uint8_t a[32], b[32];
+    fe_tobytes(a, f);
+    fe_tobytes(b, g);
+    return memcmp(a, b, 32) == 0;
+}
+
+static bool fe_iszero(const fe f) {
+    fe zero;
+    fe_set(zero, 0);
+    return fe_equal(f, zero);
+}
+
+static int fe_isnegative(const fe f) {
+    uint8_t s[32];
+    fe_tobytes(s, f);
+    return s[0] & 1;
+}
+
+static void fe_neg(fe h, const fe f) {
+    fe zero;
+    fe_set(zero, 0);
+    fe_sub(h, zero, f);
+}
+
+// Swaps f and g when bit is 1, without branching on it
+static void fe_cswap(fe f, fe g, int64_t bit) {
+    int64_t mask = -bit;
+    for (int i = 0; i < 10; i++) {
+        int64_t x = mask & (f[i] ^ g[i]);
+        f[i] ^= x;
+        g[i] ^= x;
+    }
+}
+
+static void ge_identity(GePoint *r) {
+    fe_set(r->x, 0);
+    fe_set(r->y, 1);
+    fe_set(r->z, 1);
+    fe_set(r->t, 0);
+}
+
+// Complete addition on the twisted Edwards curve (a = -1), also used for
+// doubling; r may alias p or q
+static void ge_add(GePoint *r, const GePoint *p, const GePoint *q) {
+    fe a, b, c, d, t, e, f, g, h;
+    fe_sub(a, p->y, p->x);
+    fe_sub(t, q->y, q->x);
+    fe_mul(a, a, t);
+    fe_add(b, p->x, p->y);
+    fe_add(t, q->x, q->y);
+    fe_mul(b, b, t);
+    fe_mul(c, p->t, q->t);
+    fe_mul(c, c, fe_d2);
+    fe_mul(d, p->z, q->z);
+    fe_add(d, d, d);
+    fe_sub(e, b, a);
+    fe_sub(f, d, c);
+    fe_add(g, d, c);
+    fe_add(h, b, a);
+    fe_mul(r->x, e, f);
+    fe_mul(r->y, h, g);
+    fe_mul(r->z, g, f);
+    fe_mul(r->t, e, h);
+}
+
+static void ge_neg(GePoint *p) {
+    fe_neg(p->x, p->x);
+    fe_neg(p->t, p->t);
+}
+
+static void ge_cswap(GePoint *p, GePoint *q, int64_t bit) {
+    fe_cswap(p->x, q->x, bit);
+    fe_cswap(p->y, q->y, bit);
+    fe_cswap(p->z, q->z, bit);
+    fe_cswap(p->t, q->t, bit);
+}
+
+static bool ge_is_identity(const GePoint *p) {
+    return fe_iszero(p->x) && fe_equal(p->y, p->z);
+}
+
+static void ge_tobytes(uint8_t s[32], const GePoint *p) {
+    fe zi, x, y;
+    fe_invert(zi, p->z);
+    fe_mul(x, p->x, zi);
+    fe_mul(y, p->y, zi);
+    fe_tobytes(s, y);
+    s[31] ^= (uint8_t)(fe_isnegative(x) << 7);
+}
+
+// Recovers x from y and its sign bit; rejects encodings that are not
+// canonical or not on the curve
+static bool ge_frombytes(GePoint *r, const uint8_t s[32]) {
+    fe one, num, den, den2, den4, den6, t, check;
+    uint8_t canonical[32];
+    
+    fe_set(one, 1);
+    fe_set(r->z, 1);
+    fe_frombytes(r->y, s);
+    fe_tobytes(canonical, r->y);
+    if (memcmp(canonical, s, 31) != 0 || canonical[31] != (s[31] & 0x7f)) return false;
+    
+    // x^2 = (y^2 - 1) / (d y^2 + 1)
+    fe_sq(num, r->y);
+    fe_mul(den, num, fe_d);
+    fe_sub(num, num, one);
+    fe_add(den, one, den);
+    fe_sq(den2, den);
+    fe_sq(den4, den2);
+    fe_mul(den6, den4, den2);
+    fe_mul(t, den6, num);
+    fe_mul(t, t, den);
+    fe_pow2523(t, t);
+    fe_mul(t, t, num);
+    fe_mul(t, t, den);
+    fe_mul(t, t, den);
+    fe_mul(r->x, t, den);
+    
+    fe_sq(check, r->x);
+    fe_mul(check, check, den);
+    if (!fe_equal(check, num)) fe_mul(r->x, r->x, fe_sqrtm1);
+    fe_sq(check, r->x);
+    fe_mul(check, check, den);
+    if (!fe_equal(check, num)) return false;
+    
+    int sign = s[31] >> 7;
+    if (sign && fe_iszero(r->x)) return false;
+    if (fe_isnegative(r->x) != sign) fe_neg(r->x, r->x);
+    fe_mul(r->t, r->x, r->y);
+    return true;
+}
+
+// Constant-time [scalar]B for signing
+static void ge_scalarmult_base(GePoint *r, const uint8_t scalar[32]) {
+    GePoint q = base_point;
+    ge_identity(r);
+    for (int i = 255; i >= 0; i--) {
+        int64_t bit = (scalar[i / 8] >> (i & 7)) & 1;
+        ge_cswap(r, &q, bit);
+        ge_add(&q, &q, r);
+        ge_add(r, r, r);
+        ge_cswap(r, &q, bit);
+    }
+}
+
+// Reduces a 512-bit value held as 64 byte-sized limbs modulo L
+static void sc_reduce_limbs(uint8_t r[32], int64_t x[64]) {
+    int64_t carry;
+    int i, j;
+    for (i = 63; i >= 32; i--) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * group_order[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * group_order[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) x[j] -= carry * group_order[j];
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+static void sc_reduce(uint8_t r[32], const uint8_t wide[64]) {
+    int64_t x[64];
+    for (int i = 0; i < 64; i++) x[i] = wide[i];
+    sc_reduce_limbs(r, x);
+}
+
+// r = a * b + c mod L
+static void sc_muladd(uint8_t r[32], const uint8_t a[32], const uint8_t b[32], const uint8_t c[32]) {
+    int64_t x[64] = {0};
+    for (int i = 0; i < 32; i++) x[i] = c[i];
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) x[i + j] += (int64_t)a[i] * b[j];
+    }
+    sc_reduce_limbs(r, x);
+}
+
+static bool sc_is_canonical(const uint8_t s[32]) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != group_order[i]) return s[i] < group_order[i];
+    }
+    return false;
+}
+
+static int scalar_window(const uint8_t s[32], int start, int width) {
+    int value = 0;
+    for (int b = 0; b < width && start + b < 256; b++) {
+        int bit = start + b;
+        value |= ((s[bit >> 3] >> (bit & 7)) & 1) << b;
+    }
+    return value;
+}
+
+#define MSM_MAX_WINDOW 7
+
+// Sum of [scalars[i]]points[i] by Pippenger's bucket method: per window
+// each point costs one addition, so the work per point shrinks as wider
+// windows pay off for larger batches. Scalars are below 2^253.
+static void multi_scalar_mult(GePoint *r, const GePoint *points, const uint8_t (*scalars)[32], int count) {
+    int window = count < 8 ? 3 : count < 32 ? 4 : count < 128 ? 5 : count < 512 ? 6 : MSM_MAX_WINDOW;
+    int bucket_count = (1 << window) - 1;
+    GePoint buckets[(1 << MSM_MAX_WINDOW) - 1];
+    bool used[(1 << MSM_MAX_WINDOW) - 1];
+    
+    ge_identity(r);
+    bool started = false;
+    for (int start = ((253 + window - 1) / window - 1) * window; start >= 0; start -= window) {
+        if (started) {
+            for (int i = 0; i < window; i++) ge_add(r, r, r);
+        }
+        
+        memset(used, 0, sizeof(used));
+        for (int i = 0; i < count; i++) {
+            int digit = scalar_window(scalars[i], start, window);
+            if (digit == 0) continue;
+            if (used[digit - 1]) {
+                ge_add(&buckets[digit - 1], &buckets[digit - 1], &points[i]);
+            } else {
+                buckets[digit - 1] = points[i];
+                used[digit - 1] = true;
+            }
+        }
+        
+        // Bucket j counts j + 1 times: running sums from the top down
+        GePoint running, total;
+        bool have_running = false, have_total = false;
+        for (int b = bucket_count - 1; b >= 0; b--) {
+            if (used[b]) {
+                if (have_running) {
+                    ge_add(&running, &running, &buckets[b]);
+                } else {
+                    running = buckets[b];
+                    have_running = true;
+                }
+            }
+            if (!have_running) continue;
+            if (have_total) {
+                ge_add(&total, &total, &running);
+            } else {
+                total = running;
+                have_total = true;
+            }
+        }
+        if (have_total) {
+            ge_add(r, r, &total);
+            started = true;
+        }
+    }
+}
+
+static void expand_seed(uint8_t expanded[64], const uint8_t seed[ED25519_SEED_SIZE]) {
+    sha512(seed, ED25519_SEED_SIZE, expanded);
+    expanded[0] &= 248;
+    expanded[31] &= 127;
+    expanded[31] |= 64;
+}
+
+void ed25519_public_key(uint8_t public_key[ED25519_PUBLIC_KEY_SIZE], const uint8_t seed[ED25519_SEED_SIZE]) {
+    uint8_t expanded[64];
+    GePoint a;
+    expand_seed(expanded, seed);
+    ge_scalarmult_base(&a, expanded);
+    ge_tobytes(public_key, &a);
+    memset(expanded, 0, sizeof(expanded));
+}
+
+static void challenge(uint8_t k[32], const uint8_t r[32], const uint8_t public_key[32],
+                      const uint8_t *message, size_t length) {
+    uint8_t wide[64];
+    Sha512 ctx;
+    sha512_init(&ctx);
+    sha512_update(&ctx, r, 32);
+    sha512_update(&ctx, public_key, 32);
+    sha512_update(&ctx, message, length);
+    sha512_final(&ctx, wide);
+    sc_reduce(k, wide);
+}
+
+void ed25519_sign(uint8_t signature[ED25519_SIGNATURE_SIZE], const uint8_t *message, size_t length,
+                  const uint8_t seed[ED25519_SEED_SIZE], const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE]) {
+    uint8_t expanded[64], wide[64], nonce[32], k[32];
+    GePoint r;
+    expand_seed(expanded, seed);
+    
+    // The nonce comes from the key's second half and the message
+    Sha512 ctx;
+    sha512_init(&ctx);
+    sha512_update(&ctx, expanded + 32, 32);
+    sha512_update(&ctx, message, length);
+    sha512_final(&ctx, wide);
+    sc_reduce(nonce, wide);
+    ge_scalarmult_base(&r, nonce);
+    ge_tobytes(signature, &r);
+    
+    challenge(k, signature, public_key, message, length);
+    sc_muladd(signature + 32, k, expanded, nonce);
+    
+    memset(expanded, 0, sizeof(expanded));
+    memset(nonce, 0, sizeof(nonce));
+}
+
+// Fills the 2 * count + 1 terms of the combined equation
+//   [-sum z_i S_i]B + sum [z_i]R_i + sum [z_i k_i]A_i = 0
+// with random 128-bit z_i tied to the whole batch (z = 1 for one item).
+static bool build_batch_terms(const Ed25519BatchItem *items, int count, GePoint *points, uint8_t (*scalars)[32]) {
+    uint8_t b_scalar[32] = {0};
+    uint8_t transcript[64];
+    Sha512 ctx;
+    
+    // Random bytes keep a forger from steering the z_i; the transcript
+    // binds them to the batch even if no randomness is available
+    uint8_t random[32] = {0};
+    secure_random_bytes(random, sizeof(random));
+    sha512_init(&ctx);
+    sha512_update(&ctx, random, sizeof(random));
+    
+    for (int i = 0; i < count; i++) {
+        const Ed25519BatchItem *item = &items[i];
+        if (item->signature == NULL || item->public_key == NULL || (item->message == NULL && item->length > 0)) {
+            return false;
+        }
+        if (!sc_is_canonical(item->signature + 32) ||
+            !ge_frombytes(&points[2 * i + 1], item->signature) ||
+            !ge_frombytes(&points[2 * i + 2], item->public_key)) {
+            return false;
+        }
+        ge_neg(&points[2 * i + 1]);
+        ge_neg(&points[2 * i + 2]);
+        challenge(scalars[2 * i + 2], item->signature, item->public_key, item->message, item->length);
+        sha512_update(&ctx, item->signature, ED25519_SIGNATURE_SIZE);
+        sha512_update(&ctx, item->public_key, ED25519_PUBLIC_KEY_SIZE);
+        sha512_update(&ctx, scalars[2 * i + 2], 32);
+    }
+    sha512_final(&ctx, transcript);
+    
+    for (int i = 0; i < count; i++) {
+        uint8_t z[32] = {0};
+        if (count == 1) {
+            z[0] = 1;
+        } else {
+            uint8_t index[4] = {(uint8_t)i, (uint8_t)(i >> 8), (uint8_t)(i >> 16), (uint8_t)(i >> 24)};
+            uint8_t digest[64];
+            sha512_init(&ctx);
+            sha512_update(&ctx, transcript, sizeof(transcript));
+            sha512_update(&ctx, index, sizeof(index));
+            sha512_final(&ctx, digest);
+            memcpy(z, digest, 16);
+            z[0] |= 1;
+        }
+        
+        uint8_t zero[32] = {0};
+        memcpy(scalars[2 * i + 1], z, 32);
+        sc_muladd(scalars[2 * i + 2], z, scalars[2 * i + 2], zero);
+        sc_muladd(b_scalar, z, items[i].signature + 32, b_scalar);
+    }
+    points[0] = base_point;
+    memcpy(scalars[0], b_scalar, 32);
+    return true;
+}
+
+static bool check_batch(const Ed25519BatchItem *items, int count, GePoint *points, uint8_t (*scalars)[32]) {
+    if (!build_batch_terms(items, count, points, scalars)) return false;
+    
+    // Multiplying by the cofactor ignores small-order components
+    GePoint sum;
+    multi_scalar_mult(&sum, points, (const uint8_t (*)[32])scalars, 2 * count + 1);
+    for (int i = 0; i < 3; i++) ge_add(&sum, &sum, &sum);
+    return ge_is_identity(&sum);
+}
+
+bool ed25519_verify(const uint8_t signature[ED25519_SIGNATURE_SIZE], const uint8_t *message, size_t length,
+                    const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE]) {
+    Ed25519BatchItem item = {message, length, public_key, signature};
+    GePoint points[3];
+    uint8_t scalars[3][32];
+    return check_batch(&item, 1, points, scalars);
+}
+
+bool ed25519_verify_batch(const Ed25519BatchItem *items, int count) {
+    if (count <= 0) return true;
+    if (items == NULL) return false;
+    if (count == 1) {
+        return ed25519_verify(items[0].signature, items[0].message, items[0].length, items[0].public_key);
+    }
+    
+    size_t terms = 2 * (size_t)count + 1;
+    GePoint *points = malloc(terms * sizeof(GePoint));
+    uint8_t (*scalars)[32] = malloc(terms * 32);
+    bool ok;
+    if (points != NULL && scalars != NULL) {
+        ok = check_batch(items, count, points, scalars);
+    } else {
+        // Without room for the batch, check one at a time
+        ok = true;
+        for (int i = 0; ok && i < count; i++) {
+            ok = ed25519_verify(items[i].signature, items[i].message, items[i].length, items[i].public_key);
+        }
+    }
+    free(points);
+    free(scalars);
+    return ok;
+}
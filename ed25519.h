@@ -0,0 +1,33 @@
+#ifndef ED25519_H
+#define ED25519_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Ed25519 signatures (RFC 8032). Signing runs in constant time; checking
+// does not need to. Both single and batch checks use the cofactored
+// equation [8][S]B = [8]R + [8][k]A, so a batch accepts exactly the
+// signatures that pass one by one.
+#define ED25519_SEED_SIZE 32
+#define ED25519_PUBLIC_KEY_SIZE 32
+#define ED25519_SIGNATURE_SIZE 64
+
+typedef struct {
+    const uint8_t *message;
+    size_t length;
+    const uint8_t *public_key;
+    const uint8_t *signature;
+} Ed25519BatchItem;
+
+void ed25519_public_key(uint8_t public_key[ED25519_PUBLIC_KEY_SIZE], const uint8_t seed[ED25519_SEED_SIZE]);
+void ed25519_sign(uint8_t signature[ED25519_SIGNATURE_SIZE], const uint8_t *message, size_t length,
+                  const uint8_t seed[ED25519_SEED_SIZE], const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE]);
+bool ed25519_verify(const uint8_t signature[ED25519_SIGNATURE_SIZE], const uint8_t *message, size_t length,
+                    const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE]);
+
+// Checks every signature with one multi-scalar multiplication, whose cost
+// per signature falls as the batch grows; true only if all of them hold
+bool ed25519_verify_batch(const Ed25519BatchItem *items, int count);
+
+#endif
@@ -0,0 +1,169 @@
+#include "journal.h"
+#include "performance.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Record checksum covers the type and length as well as the payload
+uint32_t record_checksum(uint8_t type, const void *data, uint32_t size) {
+    uint32_t hash = size ? fast_hash((const char *)data, size) : 0;
+    return hash ^ (type * 0x9E3779B1u) ^ (size * 0x85EBCA6Bu);
+}
+
+void encode_record_header(uint8_t *header, uint32_t magic, uint8_t type, const void *data, uint32_t size) {
+    uint32_t checksum = record_checksum(type, data, size);
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + 4, &type, sizeof(type));
+    memcpy(header + 5, &size, sizeof(size));
+    memcpy(header + 9, &checksum, sizeof(checksum));
+}
+
+bool decode_record_header(const uint8_t *header, uint32_t magic, uint8_t *type, uint32_t *size,
+                          uint32_t *checksum) {
+    uint32_t stored_magic;
+    memcpy(&stored_magic, header, sizeof(stored_magic));
+    memcpy(type, header + 4, sizeof(*type));
+    memcpy(size, header + 5, sizeof(*size));
+    memcpy(checksum, header + 9, sizeof(*checksum));
+    return stored_magic == magic;
+}
+
+bool write_record(FILE *file, uint32_t magic, uint8_t type, const void *data, uint32_t size) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    encode_record_header(header, magic, type, data, size);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+           (size == 0 || fwrite(data, 1, size, file) == size);
+}
+
+bool journal_open(Journal *journal, const char *path) {
+    if (journal == NULL || path == NULL) return false;
+    
+    memset(journal, 0, sizeof(Journal));
+    strncpy(journal->path, path, sizeof(journal->path) - 1);
+    
+    journal->file = fopen(path, "r+b");
+    if (journal->file == NULL) {
+        journal->file = fopen(path, "w+b");
+    }
+    if (journal->file == NULL) return false;
+    
+    // Until a replay has validated it, nothing in the file is trusted
+    journal->size = 0;
+    return true;
+}
+
+void journal_close(Journal *journal) {
+    if (journal == NULL || journal->file == NULL) return;
+    
+    fclose(journal->file);
+    journal->file = NULL;
+}
+
+int journal_replay(Journal *journal, JournalApplyFn apply, void *context) {
+    if (journal == NULL || journal->file == NULL) return -1;
+    
+    if (!file_seek(journal->file, 0, SEEK_END)) return -1;
+    int64_t length = file_tell(journal->file);
+    if (length < 0 || !file_seek(journal->file, 0, SEEK_SET)) return -1;
+    
+    uint8_t *data = malloc((size_t)length + 1);
+    if (data == NULL) return -1;
+    if (fread(data, 1, (size_t)length, journal->file) != (size_t)length) {
+        free(data);
+        return -1;
+    }
+    
+    // Records are applied group by group, only once the commit is seen
+    int64_t committed = 0;
+    int64_t pos = 0;
+    int groups = 0;
+    bool rejected = false;
+    
+    while (!rejected && length - pos >= RECORD_HEADER_SIZE) {
+        uint32_t size, checksum;
+        uint8_t type;
+        bool framed = decode_record_header(data + pos, JOURNAL_RECORD_MAGIC, &type, &size, &checksum);
+        
+        int64_t payload = pos + RECORD_HEADER_SIZE;
+        if (!framed || size > (uint64_t)(length - payload) ||
+            record_checksum(type, data + payload, size) != checksum) {
+            break; // Torn or corrupt tail
+        }
+        pos = payload + size;
+        
+        if (type != JOURNAL_COMMIT) continue;
+        
+        int64_t record = committed;
+        while (record < pos - RECORD_HEADER_SIZE - (int64_t)size) {
+            uint8_t record_type = data[record + 4];
+            uint32_t record_size;
+            memcpy(&record_size, data + record + 5, sizeof(record_size));
+            if (apply != NULL && !apply(context, record_type, data + record + RECORD_HEADER_SIZE, record_size)) {
+                rejected = true;
+                break;
+            }
+            record += RECORD_HEADER_SIZE + record_size;
+        }
+        if (rejected) break;
+        
+        if (size >= sizeof(uint64_t)) {
+            memcpy(&journal->sequence, data + payload, sizeof(uint64_t));
+        }
+        committed = pos;
+        groups++;
+    }
+    
+    free(data);
+    if (rejected) return -1;
+    
+    // Drop the uncommitted tail so new appends follow the last commit
+    if (committed != length && !truncate_file(journal->file, committed)) return -1;
+    journal->size = committed;
+    journal->failed = false;
+    return groups;
+}
+
+bool journal_append(Journal *journal, uint8_t type, const void *data, uint32_t size) {
+    if (journal == NULL || journal->file == NULL || journal->failed) return false;
+    if (data == NULL && size > 0) return false;
+    
+    if (!file_seek(journal->file, 0, SEEK_END) ||
+        !write_record(journal->file, JOURNAL_RECORD_MAGIC, type, data, size)) {
+        journal->failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool journal_commit(Journal *journal) {
+    if (journal == NULL || journal->file == NULL) return false;
+    
+    uint64_t sequence = journal->sequence + 1;
+    if (!journal->failed && journal_append(journal, JOURNAL_COMMIT, &sequence, sizeof(sequence)) &&
+        sync_file(journal->file)) {
+        journal->sequence = sequence;
+        journal->size = file_tell(journal->file);
+        return true;
+    }
+    
+    journal_abort(journal);
+    return false;
+}
+
+bool journal_abort(Journal *journal) {
+    if (journal == NULL || journal->file == NULL) return false;
+    
+    // Roll the file back to the previous commit
+    journal->failed = !truncate_file(journal->file, journal->size);
+    return !journal->failed;
+}
+
+bool journal_reset(Journal *journal) {
+    if (journal == NULL || journal->file == NULL) return false;
+    
+    if (!truncate_file(journal->file, 0) || !sync_file(journal->file)) return false;
+    
+    journal->size = 0;
+    journal->failed = false;
+    return true;
+}
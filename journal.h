@@ -0,0 +1,57 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Write-ahead journal shared by the chain and wallet files.
+// Records are appended and checksummed; a group of records only takes
+// effect once a commit record follows it, so a crash mid-save leaves
+// either the whole group or none of it. Replay applies committed groups
+// in order and cuts off a torn tail.
+#define JOURNAL_RECORD_MAGIC 0x4A435241u  // "ARCJ"
+
+#define JOURNAL_BLOCK 1   // Encoded block record, preceded by its height
+#define JOURNAL_WALLET 2  // Wallet header plus newly added transactions
+#define JOURNAL_COMMIT 3  // Commit point for everything since the last one
+
+// Record framing, shared with the keystore: magic, type, payload size
+// and a checksum over all three, then the payload
+#define RECORD_HEADER_SIZE 13
+
+uint32_t record_checksum(uint8_t type, const void *data, uint32_t size);
+void encode_record_header(uint8_t *header, uint32_t magic, uint8_t type, const void *data, uint32_t size);
+bool decode_record_header(const uint8_t *header, uint32_t magic, uint8_t *type, uint32_t *size,
+                          uint32_t *checksum);  // False when the magic differs
+bool write_record(FILE *file, uint32_t magic, uint8_t type, const void *data, uint32_t size);
+
+typedef struct {
+    FILE *file;
+    char path[256];
+    int64_t size;       // Bytes up to the last commit
+    uint64_t sequence;  // Commits written so far
+    bool failed;        // An append failed, the open group is dropped
+} Journal;
+
+// Called for each record of a committed group; false stops the replay
+typedef bool (*JournalApplyFn)(void *context, uint8_t type, const uint8_t *data, uint32_t size);
+
+// journal_replay must run once before the first append
+bool journal_open(Journal *journal, const char *path);
+void journal_close(Journal *journal);
+
+// Applies the committed groups and truncates anything after the last commit.
+// Returns the number of groups applied, or -1 if apply rejected a record.
+int journal_replay(Journal *journal, JournalApplyFn apply, void *context);
+
+bool journal_append(Journal *journal, uint8_t type, const void *data, uint32_t size);
+bool journal_commit(Journal *journal);
+
+// Drops records appended since the last commit
+bool journal_abort(Journal *journal);
+
+// Empties the journal once its contents are safe in the main files
+bool journal_reset(Journal *journal);
+
+#endif
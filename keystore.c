@@ -0,0 +1,444 @@
+#include "keystore.h"
+#include "journal.h"
+#include "performance.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYSTORE_HEADER_SIZE 8
+#define KEYSTORE_TRAILER_SIZE 12
+#define KEYSTORE_KEY_SIZE (WALLET_ADDRESS_LENGTH + PRIVATE_KEY_LENGTH)
+#define KEYSTORE_TX_SIZE (16 + sizeof(WireTransaction))
+#define KEYSTORE_UNSEQUENCED_TX_SIZE (16 + offsetof(WireTransaction, sequence))  // Written by version 1
+#define KEYSTORE_ENTRY_SIZE (WALLET_ADDRESS_LENGTH + 24)
+
+static bool record_size_matches(uint8_t type, uint32_t stored, uint32_t expected) {
+    return stored == expected ||
+           (type == KEYSTORE_TX && expected == KEYSTORE_TX_SIZE && stored == KEYSTORE_UNSEQUENCED_TX_SIZE);
+}
+
+// Records use the journal's framing (see journal.h). Reads the record at
+// the file position; false when it is torn or not of the expected type
+// and size (a *type of 0 accepts any type). A transaction record may also
+// have the shorter layout of version 1; *size is set to what was read.
+static bool read_record(FILE *file, uint8_t *type, uint8_t *data, uint32_t *size) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint8_t stored_type;
+    uint32_t stored_size, checksum;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        !decode_record_header(header, KEYSTORE_FILE_MAGIC, &stored_type, &stored_size, &checksum) ||
+        (*type != 0 && stored_type != *type) || !record_size_matches(stored_type, stored_size, *size)) {
+        return false;
+    }
+    
+    *type = stored_type;
+    *size = stored_size;
+    return fread(data, 1, stored_size, file) == stored_size && record_checksum(*type, data, stored_size) == checksum;
+}
+
+static bool read_record_at(FILE *file, uint64_t offset, uint8_t type, uint8_t *data, uint32_t *size) {
+    return file_seek(file, (int64_t)offset, SEEK_SET) && read_record(file, &type, data, size);
+}
+
+// Wallet slot, history position, previous record and transaction of a
+// transaction record of either layout
+static void decode_tx_record(const uint8_t *record, uint32_t size, int32_t *slot, int32_t *number,
+                             uint64_t *prev, WireTransaction *wire) {
+    memcpy(slot, record, 4);
+    memcpy(number, record + 4, 4);
+    memcpy(prev, record + 8, 8);
+    memset(wire, 0, sizeof(WireTransaction));
+    wire->sequence = TRANSACTION_UNSEQUENCED;
+    memcpy(wire, record + 16, size - 16);
+}
+
+static uint32_t address_hash(const char *address) {
+    size_t length = 0;
+    while (length < WALLET_ADDRESS_LENGTH - 1 && address[length] != '\0') length++;
+    return fast_hash(address, length);
+}
+
+// Slot holding address, or the empty slot where it would go
+static int find_slot(const Keystore *keystore, const char *address) {
+    int mask = keystore->slot_capacity - 1;
+    int slot = (int)(address_hash(address) & (uint32_t)mask);
+    while (keystore->slots[slot] >= 0 &&
+           strncmp(keystore->entries[keystore->slots[slot]].address, address, WALLET_ADDRESS_LENGTH - 1) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow_slots(Keystore *keystore) {
+    int capacity = keystore->slot_capacity ? keystore->slot_capacity * 2 : 64;
+    int *slots = malloc(capacity * sizeof(int));
+    if (slots == NULL) return false;
+    
+    for (int i = 0; i < capacity; i++) slots[i] = -1;
+    free(keystore->slots);
+    keystore->slots = slots;
+    keystore->slot_capacity = capacity;
+    for (int i = 0; i < keystore->count; i++) {
+        keystore->slots[find_slot(keystore, keystore->entries[i].address)] = i;
+    }
+    return true;
+}
+
+static bool add_entry(Keystore *keystore, const KeystoreEntry *entry) {
+    if ((keystore->count + 1) * 2 > keystore->slot_capacity && !grow_slots(keystore)) return false;
+    if (keystore->count == keystore->capacity) {
+        int capacity = keystore->capacity ? keystore->capacity * 2 : 16;
+        KeystoreEntry *entries = realloc(keystore->entries, capacity * sizeof(KeystoreEntry));
+        if (entries == NULL) return false;
+        keystore->entries = entries;
+        keystore->capacity = capacity;
+    }
+    
+    keystore->slots[find_slot(keystore, entry->address)] = keystore->count;
+    keystore->entries[keystore->count++] = *entry;
+    return true;
+}
+
+// The newest entry was never followed by another, so its slot can simply
+// be emptied without breaking a probe sequence
+static void drop_last_entry(Keystore *keystore) {
+    keystore->slots[find_slot(keystore, keystore->entries[keystore->count - 1].address)] = -1;
+    keystore->count--;
+}
+
+static void clear_entries(Keystore *keystore) {
+    free(keystore->entries);
+    free(keystore->slots);
+    keystore->entries = NULL;
+    keystore->slots = NULL;
+    keystore->count = keystore->capacity = keystore->slot_capacity = 0;
+}
+
+int keystore_find(const Keystore *keystore, const char *address) {
+    if (keystore == NULL || address == NULL || keystore->count == 0) return -1;
+    
+    return keystore->slots[find_slot(keystore, address)];
+}
+
+// Index record and trailer at the end of the records, then cut the file there
+static bool write_index(Keystore *keystore) {
+    uint32_t size = 4 + (uint32_t)keystore->count * KEYSTORE_ENTRY_SIZE;
+    uint8_t *data = malloc(size);
+    if (data == NULL) return false;
+    
+    int32_t count = keystore->count;
+    memcpy(data, &count, 4);
+    uint8_t *p = data + 4;
+    for (int i = 0; i < keystore->count; i++) {
+        const KeystoreEntry *entry = &keystore->entries[i];
+        memcpy(p, entry->address, WALLET_ADDRESS_LENGTH);
+        memcpy(p + WALLET_ADDRESS_LENGTH, &entry->key_offset, 8);
+        memcpy(p + WALLET_ADDRESS_LENGTH + 8, &entry->last_offset, 8);
+        memcpy(p + WALLET_ADDRESS_LENGTH + 16, &entry->transaction_count, 4);
+        memcpy(p + WALLET_ADDRESS_LENGTH + 20, &entry->last_hash, 4);
+        p += KEYSTORE_ENTRY_SIZE;
+    }
+    
+    uint8_t trailer[KEYSTORE_TRAILER_SIZE];
+    uint32_t magic = KEYSTORE_INDEX_MAGIC;
+    memcpy(trailer, &keystore->end, 8);
+    memcpy(trailer + 8, &magic, 4);
+    int64_t length = (int64_t)(keystore->end + RECORD_HEADER_SIZE + size + sizeof(trailer));
+    
+    bool ok = file_seek(keystore->file, (int64_t)keystore->end, SEEK_SET) &&
+              write_record(keystore->file, KEYSTORE_FILE_MAGIC, KEYSTORE_INDEX, data, size) &&
+              fwrite(trailer, 1, sizeof(trailer), keystore->file) == sizeof(trailer) &&
+              truncate_file(keystore->file, length) && sync_file(keystore->file);
+    free(data);
+    return ok;
+}
+
+static bool read_index(Keystore *keystore, int64_t length) {
+    uint8_t trailer[KEYSTORE_TRAILER_SIZE];
+    uint64_t index_offset;
+    uint32_t magic;
+    if (length < KEYSTORE_HEADER_SIZE + RECORD_HEADER_SIZE + 4 + KEYSTORE_TRAILER_SIZE ||
+        !file_seek(keystore->file, length - KEYSTORE_TRAILER_SIZE, SEEK_SET) ||
+        fread(trailer, 1, sizeof(trailer), keystore->file) != sizeof(trailer)) {
+        return false;
+    }
+    memcpy(&index_offset, trailer, 8);
+    memcpy(&magic, trailer + 8, 4);
+    
+    // The index record fills everything between its offset and the trailer
+    int64_t index_end = length - KEYSTORE_TRAILER_SIZE;
+    if (magic != KEYSTORE_INDEX_MAGIC || index_offset < KEYSTORE_HEADER_SIZE ||
+        index_offset + RECORD_HEADER_SIZE + 4 > (uint64_t)index_end) {
+        return false;
+    }
+    uint32_t size = (uint32_t)(index_end - (int64_t)index_offset - RECORD_HEADER_SIZE);
+    uint8_t *data = malloc(size);
+    if (data == NULL) return false;
+    
+    int32_t count = 0;
+    bool ok = read_record_at(keystore->file, index_offset, KEYSTORE_INDEX, data, &size);
+    if (ok) {
+        memcpy(&count, data, 4);
+        ok = count >= 0 && size == 4 + (uint32_t)count * KEYSTORE_ENTRY_SIZE;
+    }
+    const uint8_t *p = data + 4;
+    for (int i = 0; ok && i < count; i++) {
+        KeystoreEntry entry;
+        memcpy(entry.address, p, WALLET_ADDRESS_LENGTH);
+        entry.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+        memcpy(&entry.key_offset, p + WALLET_ADDRESS_LENGTH, 8);
+        memcpy(&entry.last_offset, p + WALLET_ADDRESS_LENGTH + 8, 8);
+        memcpy(&entry.transaction_count, p + WALLET_ADDRESS_LENGTH + 16, 4);
+        memcpy(&entry.last_hash, p + WALLET_ADDRESS_LENGTH + 20, 4);
+        ok = entry.key_offset < index_offset && entry.last_offset < index_offset &&
+             entry.transaction_count >= 0 && keystore_find(keystore, entry.address) < 0 &&
+             add_entry(keystore, &entry);
+        p += KEYSTORE_ENTRY_SIZE;
+    }
+    free(data);
+    
+    if (!ok) {
+        clear_entries(keystore);
+        return false;
+    }
+    keystore->end = index_offset;
+    return true;
+}
+
+// After a crash: every key and transaction record up to the first torn
+// one is read again, and the index written anew after them
+static bool rebuild_index(Keystore *keystore, int64_t length) {
+    uint8_t data[KEYSTORE_TX_SIZE > KEYSTORE_KEY_SIZE ? KEYSTORE_TX_SIZE : KEYSTORE_KEY_SIZE];
+    uint64_t pos = KEYSTORE_HEADER_SIZE;
+    bool ok = file_seek(keystore->file, (int64_t)pos, SEEK_SET);
+    while (ok) {
+        uint8_t header[RECORD_HEADER_SIZE];
+        uint8_t type;
+        uint32_t size, checksum;
+        if (fread(header, 1, sizeof(header), keystore->file) != sizeof(header) ||
+            !decode_record_header(header, KEYSTORE_FILE_MAGIC, &type, &size, &checksum)) {
+            break;
+        }
+        
+        // Old indexes are skipped; anything else must be a whole record
+        if (type == KEYSTORE_INDEX) {
+            if (pos + RECORD_HEADER_SIZE + size > (uint64_t)length ||
+                !file_seek(keystore->file, size, SEEK_CUR)) {
+                break;
+            }
+            pos += RECORD_HEADER_SIZE + size;
+            continue;
+        }
+        uint32_t expected = (type == KEYSTORE_KEY) ? KEYSTORE_KEY_SIZE : KEYSTORE_TX_SIZE;
+        if ((type != KEYSTORE_KEY && type != KEYSTORE_TX) || !record_size_matches(type, size, expected)) break;
+        if (!file_seek(keystore->file, (int64_t)pos, SEEK_SET) || !read_record(keystore->file, &type, data, &expected)) {
+            break;
+        }
+        
+        if (type == KEYSTORE_KEY) {
+            KeystoreEntry entry;
+            memset(&entry, 0, sizeof(KeystoreEntry));
+            memcpy(entry.address, data, WALLET_ADDRESS_LENGTH);
+            entry.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+            entry.key_offset = pos;
+            ok = keystore_find(keystore, entry.address) >= 0 || add_entry(keystore, &entry);
+        } else {
+            int32_t slot, number;
+            uint64_t prev;
+            WireTransaction wire;
+            decode_tx_record(data, size, &slot, &number, &prev, &wire);
+            if (slot < 0 || slot >= keystore->count) break;
+            
+            // Position 0 starts a history; anything else must follow on
+            KeystoreEntry *entry = &keystore->entries[slot];
+            if (number != 0 && (number != entry->transaction_count || prev != entry->last_offset)) break;
+            entry->last_offset = pos;
+            entry->transaction_count = number + 1;
+            entry->last_hash = wire.hash;
+        }
+        pos += RECORD_HEADER_SIZE + size;
+    }
+    if (!ok) return false;
+    
+    keystore->end = pos;
+    keystore->recovered = true;
+    return write_index(keystore);
+}
+
+bool keystore_open(Keystore *keystore, const char *path) {
+    if (keystore == NULL || path == NULL) return false;
+    
+    memset(keystore, 0, sizeof(Keystore));
+    uint8_t header[KEYSTORE_HEADER_SIZE];
+    uint32_t magic = KEYSTORE_FILE_MAGIC;
+    uint32_t version = KEYSTORE_FILE_VERSION;
+    keystore->file = fopen(path, "r+b");
+    if (keystore->file == NULL) {
+        keystore->file = fopen(path, "w+b");
+        memcpy(header, &magic, 4);
+        memcpy(header + 4, &version, 4);
+        keystore->end = KEYSTORE_HEADER_SIZE;
+        if (keystore->file != NULL && fwrite(header, 1, sizeof(header), keystore->file) == sizeof(header) &&
+            write_index(keystore)) {
+            return true;
+        }
+        keystore_close(keystore);
+        return false;
+    }
+    
+    // Another kind of file is left alone
+    uint32_t stored_version = 0;
+    bool ok = fread(header, 1, sizeof(header), keystore->file) == sizeof(header) &&
+              memcmp(header, &magic, 4) == 0;
+    if (ok) memcpy(&stored_version, header + 4, 4);
+    ok = ok && stored_version >= 1 && stored_version <= KEYSTORE_FILE_VERSION &&
+         file_seek(keystore->file, 0, SEEK_END);
+    int64_t length = ok ? file_tell(keystore->file) : -1;
+    if (length < 0 || (!read_index(keystore, length) && !rebuild_index(keystore, length))) {
+        keystore_close(keystore);
+        return false;
+    }
+    
+    // Version 1 records stay readable; the file is marked as one that
+    // may also hold records with sequence numbers
+    if (stored_version != KEYSTORE_FILE_VERSION &&
+        !(file_seek(keystore->file, 4, SEEK_SET) && fwrite(&version, 1, 4, keystore->file) == 4 &&
+          sync_file(keystore->file))) {
+        keystore_close(keystore);
+        return false;
+    }
+    return true;
+}
+
+void keystore_close(Keystore *keystore) {
+    if (keystore == NULL) return;
+    
+    if (keystore->file != NULL) fclose(keystore->file);
+    keystore->file = NULL;
+    clear_entries(keystore);
+}
+
+bool keystore_save(Keystore *keystore, const Wallet *wallet) {
+    if (keystore == NULL || keystore->file == NULL || wallet == NULL || wallet->address[0] == '\0') return false;
+    
+    int index = keystore_find(keystore, wallet->address);
+    KeystoreEntry entry;
+    memset(&entry, 0, sizeof(KeystoreEntry));
+    if (index >= 0) {
+        entry = keystore->entries[index];
+    } else {
+        memcpy(entry.address, wallet->address, WALLET_ADDRESS_LENGTH);
+        entry.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+    }
+    KeystoreEntry stored = entry;
+    
+    // Usual case: the stored history is a prefix of the wallet's
+    int first = 0;
+    if (entry.transaction_count <= wallet->transaction_count &&
+        (entry.transaction_count == 0 || wallet->transactions[entry.transaction_count - 1]->hash == entry.last_hash)) {
+        first = entry.transaction_count;
+    }
+    if (index >= 0 && first == wallet->transaction_count) return true;
+    
+    // New records go where the index was, and a new index after them
+    uint64_t old_end = keystore->end;
+    uint64_t pos = old_end;
+    bool ok = file_seek(keystore->file, (int64_t)pos, SEEK_SET);
+    if (ok && index < 0) {
+        uint8_t key[KEYSTORE_KEY_SIZE];
+        memcpy(key, entry.address, WALLET_ADDRESS_LENGTH);
+        memcpy(key + WALLET_ADDRESS_LENGTH, wallet->private_key, PRIVATE_KEY_LENGTH);
+        ok = write_record(keystore->file, KEYSTORE_FILE_MAGIC, KEYSTORE_KEY, key, sizeof(key));
+        entry.key_offset = pos;
+        pos += RECORD_HEADER_SIZE + sizeof(key);
+    }
+    
+    int32_t slot = (index >= 0) ? index : keystore->count;
+    for (int i = first; ok && i < wallet->transaction_count; i++) {
+        uint8_t record[KEYSTORE_TX_SIZE];
+        int32_t number = i;
+        uint64_t prev = (i > 0) ? entry.last_offset : 0;
+        WireTransaction wire;
+        transaction_to_wire(wallet->transactions[i], &wire);
+        memcpy(record, &slot, 4);
+        memcpy(record + 4, &number, 4);
+        memcpy(record + 8, &prev, 8);
+        memcpy(record + 16, &wire, sizeof(WireTransaction));
+        ok = write_record(keystore->file, KEYSTORE_FILE_MAGIC, KEYSTORE_TX, record, sizeof(record));
+        
+        entry.last_offset = pos;
+        entry.transaction_count = i + 1;
+        entry.last_hash = wallet->transactions[i]->hash;
+        pos += RECORD_HEADER_SIZE + sizeof(record);
+    }
+    
+    bool added = false;
+    if (ok && index >= 0) {
+        keystore->entries[index] = entry;
+    } else if (ok) {
+        ok = added = add_entry(keystore, &entry);
+    }
+    keystore->end = pos;
+    if (ok && write_index(keystore)) return true;
+    
+    // Put the previous index back so the store stays as it was
+    if (index >= 0) {
+        keystore->entries[index] = stored;
+    } else if (added) {
+        drop_last_entry(keystore);
+    }
+    keystore->end = old_end;
+    write_index(keystore);
+    return false;
+}
+
+bool keystore_load(Keystore *keystore, const char *address, Wallet *wallet) {
+    if (keystore == NULL || keystore->file == NULL || wallet == NULL) return false;
+    
+    int index = keystore_find(keystore, address);
+    if (index < 0) return false;
+    
+    const KeystoreEntry *entry = &keystore->entries[index];
+    uint8_t key[KEYSTORE_KEY_SIZE];
+    uint32_t key_size = sizeof(key);
+    if (!read_record_at(keystore->file, entry->key_offset, KEYSTORE_KEY, key, &key_size)) return false;
+    
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    memcpy(loaded.address, key, WALLET_ADDRESS_LENGTH);
+    memcpy(loaded.private_key, key + WALLET_ADDRESS_LENGTH, PRIVATE_KEY_LENGTH);
+    loaded.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+    
+    // Records link newest to oldest; they are collected backwards and
+    // added in order, which rebuilds the balance
+    int count = entry->transaction_count;
+    WireTransaction *wires = (count > 0) ? malloc(count * sizeof(WireTransaction)) : NULL;
+    bool ok = count == 0 || wires != NULL;
+    uint64_t offset = entry->last_offset;
+    for (int i = count - 1; ok && i >= 0; i--) {
+        uint8_t record[KEYSTORE_TX_SIZE];
+        uint32_t size = sizeof(record);
+        int32_t slot, number;
+        if (!read_record_at(keystore->file, offset, KEYSTORE_TX, record, &size)) {
+            ok = false;
+            break;
+        }
+        decode_tx_record(record, size, &slot, &number, &offset, &wires[i]);
+        ok = slot == index && number == i && (i > 0 || offset == 0);
+    }
+    
+    ok = ok && reserve_wallet_transactions(&loaded, count);
+    for (int i = 0; ok && i < count; i++) {
+        Transaction tx;
+        ok = transaction_from_wire(&tx, &wires[i]) && add_transaction_to_wallet(&loaded, &tx);
+    }
+    free(wires);
+    
+    if (!ok) {
+        cleanup_wallet(&loaded);
+        return false;
+    }
+    *wallet = loaded;
+    return true;
+}
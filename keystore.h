@@ -0,0 +1,63 @@
+#ifndef KEYSTORE_H
+#define KEYSTORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "wallet.h"
+
+// Many wallets in one file. Keys and transactions are appended as
+// checksummed records; the transactions of every wallet share one store,
+// each linked to the previous record of its own wallet's history. The
+// file ends with an index of address to key record, newest transaction
+// record and history length, which is all that opening reads, so loading
+// or saving one wallet only touches that wallet's records and the index.
+//
+// A save writes its records over the old index and then a new index; if
+// a crash leaves no valid index, opening rebuilds it from the records and
+// cuts off a torn tail. Histories that were rewritten rather than
+// extended are appended again; the old records stay unused in the file.
+// Version 2 adds transfer sequence numbers to transaction records; the
+// shorter records of version 1 are still read.
+#define KEYSTORE_FILE_MAGIC 0x4B435241u    // "ARCK"
+#define KEYSTORE_INDEX_MAGIC 0x49435241u   // "ARCI", ends the file after the index
+#define KEYSTORE_FILE_VERSION 2
+
+#define KEYSTORE_KEY 1    // Address and private key of a wallet
+#define KEYSTORE_TX 2     // One history entry: wallet, position, previous record, transaction
+#define KEYSTORE_INDEX 3  // Every wallet's entry, followed by the file trailer
+
+typedef struct {
+    char address[WALLET_ADDRESS_LENGTH];
+    uint64_t key_offset;
+    uint64_t last_offset;  // Newest transaction record, 0 when the history is empty
+    int32_t transaction_count;
+    uint32_t last_hash;    // Hash of the newest transaction
+} KeystoreEntry;
+
+typedef struct {
+    FILE *file;
+    KeystoreEntry *entries;  // In the order the wallets were added
+    int count;
+    int capacity;
+    int *slots;              // Open addressing by address hash; -1 = empty
+    int slot_capacity;       // Power of two, at most half full
+    uint64_t end;            // Where the records end and the index starts
+    bool recovered;          // The index was rebuilt when opening
+} Keystore;
+
+// Creates the file if it does not exist
+bool keystore_open(Keystore *keystore, const char *path);
+void keystore_close(Keystore *keystore);
+
+int keystore_find(const Keystore *keystore, const char *address);  // Entry index or -1
+
+// Adds the wallet or brings its stored history up to date, writing only
+// what the store does not have yet
+bool keystore_save(Keystore *keystore, const Wallet *wallet);
+
+// Reads one wallet's key and history into *wallet, which must not own a
+// history; the balance is recomputed from the history
+bool keystore_load(Keystore *keystore, const char *address, Wallet *wallet);
+
+#endif
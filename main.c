@@ -39,9 +39,11 @@ int main() {
     printf("Loading existing blockchain and wallet...\n");
     load_blockchain(&app);
     load_wallet(&app.miner_wallet, app.wallet_file);
+    recover_app_state(&app);
+    refresh_chain_state(&app);
     
     printf("Initialization complete!\n");
-    printf("Blockchain size: %d blocks\n", app.blockchain_size);
+    printf("Blockchain size: %d blocks\n", app.chain.size);
     
     char balance_str[64];
     format_amount(get_wallet_balance(&app.miner_wallet), balance_str, sizeof(balance_str));
@@ -0,0 +1,770 @@
+#include "mempool.h"
+#include "txpool.h"
+#include "performance.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum { HEAP_BEST, HEAP_WORST };
+
+struct MempoolEntry {
+    Transaction *tx;        // Shared record, one reference held
+    uint64_t sequence;      // Arrival order, breaks fee ties
+    MempoolSender *sender;
+    MempoolEntry *prev;     // Sender queue, oldest first
+    MempoolEntry *next;
+};
+
+struct MempoolSender {
+    AddressHandle address;
+    uint32_t hash;
+    MempoolEntry *head;
+    MempoolEntry *tail;
+    uint64_t pending;       // Amounts and fees of the queued transfers
+    uint64_t drawn;         // Taken in the current draw round
+    uint64_t draw_round;
+    uint64_t next_sequence; // What the round's next transfer must carry
+    int heap_pos[2];
+};
+
+#define MEMPOOL_SLAB_ENTRIES 256
+
+struct MempoolSlab {
+    MempoolSlab *next;
+    MempoolEntry entries[MEMPOOL_SLAB_ENTRIES];
+};
+
+// Entries churn with every arrival and departure, so like transaction
+// records they come from slabs and go back on a free list, linked through
+// next; the slabs are freed with the pool
+static MempoolEntry *new_entry(Mempool *pool) {
+    if (pool->free_entries == NULL) {
+        MempoolSlab *slab = malloc(sizeof(MempoolSlab));
+        if (slab == NULL) return NULL;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        for (int i = 0; i < MEMPOOL_SLAB_ENTRIES; i++) {
+            slab->entries[i].next = pool->free_entries;
+            pool->free_entries = &slab->entries[i];
+        }
+    }
+    
+    MempoolEntry *entry = pool->free_entries;
+    pool->free_entries = entry->next;
+    memset(entry, 0, sizeof(MempoolEntry));
+    return entry;
+}
+
+static void free_entry(Mempool *pool, MempoolEntry *entry) {
+    entry->next = pool->free_entries;
+    pool->free_entries = entry;
+}
+
+static size_t entry_bytes(void) {
+    return sizeof(MempoolEntry) + sizeof(Transaction);
+}
+
+static uint64_t transfer_cost(const Transaction *tx) {
+    return tx->amount + tx->fee;
+}
+
+// Higher fee first, then the earlier arrival
+static bool entry_better(const MempoolEntry *a, const MempoolEntry *b) {
+    if (a->tx->fee != b->tx->fee) return a->tx->fee > b->tx->fee;
+    return a->sequence < b->sequence;
+}
+
+static bool heap_before(int which, const MempoolSender *a, const MempoolSender *b) {
+    if (which == HEAP_BEST) return entry_better(a->head, b->head);
+    return entry_better(b->tail, a->tail);
+}
+
+static MempoolHeap *heap_of(Mempool *pool, int which) {
+    return (which == HEAP_BEST) ? &pool->best : &pool->worst;
+}
+
+static void heap_place(MempoolHeap *heap, int which, int pos, MempoolSender *sender) {
+    heap->items[pos] = sender;
+    sender->heap_pos[which] = pos;
+}
+
+static void heap_fix(Mempool *pool, int which, MempoolSender *sender) {
+    MempoolHeap *heap = heap_of(pool, which);
+    int pos = sender->heap_pos[which];
+    
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!heap_before(which, sender, heap->items[parent])) break;
+        heap_place(heap, which, pos, heap->items[parent]);
+        pos = parent;
+    }
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count && heap_before(which, heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+        if (!heap_before(which, heap->items[child], sender)) break;
+        heap_place(heap, which, pos, heap->items[child]);
+        pos = child;
+    }
+    heap_place(heap, which, pos, sender);
+}
+
+static bool reserve_heap(MempoolHeap *heap, int count) {
+    if (count <= heap->capacity) return true;
+    
+    int capacity = heap->capacity ? heap->capacity * 2 : 64;
+    MempoolSender **items = realloc(heap->items, (size_t)capacity * sizeof(MempoolSender *));
+    if (items == NULL) return false;
+    heap->items = items;
+    heap->capacity = capacity;
+    return true;
+}
+
+// Room must have been reserved
+static void heap_push(Mempool *pool, int which, MempoolSender *sender) {
+    MempoolHeap *heap = heap_of(pool, which);
+    heap_place(heap, which, heap->count++, sender);
+    heap_fix(pool, which, sender);
+}
+
+static void heap_remove(Mempool *pool, int which, MempoolSender *sender) {
+    MempoolHeap *heap = heap_of(pool, which);
+    int pos = sender->heap_pos[which];
+    MempoolSender *last = heap->items[--heap->count];
+    if (last != sender) {
+        heap_place(heap, which, pos, last);
+        heap_fix(pool, which, last);
+    }
+}
+
+// Open-addressing sets with linear probing and no tombstones
+static int find_entry_slot(const Mempool *pool, const Transaction *tx) {
+    int mask = pool->entry_capacity - 1;
+    int slot = (int)(tx->hash & (uint32_t)mask);
+    while (pool->entries[slot] != NULL && !same_transaction(pool->entries[slot]->tx, tx)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int find_sender_slot(const Mempool *pool, AddressHandle address, uint32_t hash) {
+    int mask = pool->sender_capacity - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    while (pool->senders[slot] != NULL && pool->senders[slot]->address != address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Removal from a linear-probing set: later members of the probe run move
+// back into the hole unless their home slot lies after it
+static bool keeps_slot(int hole, int slot, uint32_t home, int mask) {
+    int ideal = (int)(home & (uint32_t)mask);
+    return ((slot - ideal) & mask) < ((slot - hole) & mask);
+}
+
+static void remove_entry_slot(Mempool *pool, int hole) {
+    int mask = pool->entry_capacity - 1;
+    for (int slot = (hole + 1) & mask; pool->entries[slot] != NULL; slot = (slot + 1) & mask) {
+        if (!keeps_slot(hole, slot, pool->entries[slot]->tx->hash, mask)) {
+            pool->entries[hole] = pool->entries[slot];
+            hole = slot;
+        }
+    }
+    pool->entries[hole] = NULL;
+}
+
+static void remove_sender_slot(Mempool *pool, int hole) {
+    int mask = pool->sender_capacity - 1;
+    for (int slot = (hole + 1) & mask; pool->senders[slot] != NULL; slot = (slot + 1) & mask) {
+        if (!keeps_slot(hole, slot, pool->senders[slot]->hash, mask)) {
+            pool->senders[hole] = pool->senders[slot];
+            hole = slot;
+        }
+    }
+    pool->senders[hole] = NULL;
+}
+
+static bool grow_entries(Mempool *pool) {
+    int capacity = pool->entry_capacity * 2;
+    MempoolEntry **entries = calloc((size_t)capacity, sizeof(MempoolEntry *));
+    if (entries == NULL) return false;
+    
+    MempoolEntry **old = pool->entries;
+    int old_capacity = pool->entry_capacity;
+    pool->entries = entries;
+    pool->entry_capacity = capacity;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i] != NULL) pool->entries[find_entry_slot(pool, old[i]->tx)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static bool grow_senders(Mempool *pool) {
+    int capacity = pool->sender_capacity * 2;
+    MempoolSender **senders = calloc((size_t)capacity, sizeof(MempoolSender *));
+    if (senders == NULL) return false;
+    
+    MempoolSender **old = pool->senders;
+    int old_capacity = pool->sender_capacity;
+    pool->senders = senders;
+    pool->sender_capacity = capacity;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i] != NULL) {
+            pool->senders[find_sender_slot(pool, old[i]->address, old[i]->hash)] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+bool init_mempool(Mempool *pool, size_t max_bytes) {
+    if (pool == NULL) return false;
+    
+    memset(pool, 0, sizeof(Mempool));
+    pool->entry_capacity = 256;
+    pool->sender_capacity = 64;
+    pool->entries = calloc((size_t)pool->entry_capacity, sizeof(MempoolEntry *));
+    pool->senders = calloc((size_t)pool->sender_capacity, sizeof(MempoolSender *));
+    if (pool->entries == NULL || pool->senders == NULL) {
+        cleanup_mempool(pool);
+        return false;
+    }
+    pool->max_bytes = max_bytes;
+    return true;
+}
+
+void cleanup_mempool(Mempool *pool) {
+    if (pool == NULL) return;
+    
+    for (int i = 0; i < pool->entry_capacity && pool->entries != NULL; i++) {
+        if (pool->entries[i] != NULL) tx_release(pool->entries[i]->tx);
+    }
+    while (pool->slabs != NULL) {
+        MempoolSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    for (int i = 0; i < pool->sender_capacity && pool->senders != NULL; i++) {
+        free(pool->senders[i]);
+    }
+    free(pool->entries);
+    free(pool->senders);
+    free(pool->best.items);
+    free(pool->worst.items);
+    memset(pool, 0, sizeof(Mempool));
+}
+
+// Unlinks the entry from its sender and the set; the caller disposes of it
+static void detach_entry(Mempool *pool, MempoolEntry *entry) {
+    MempoolSender *sender = entry->sender;
+    bool was_head = sender->head == entry;
+    bool was_tail = sender->tail == entry;
+    
+    if (entry->prev != NULL) entry->prev->next = entry->next;
+    if (entry->next != NULL) entry->next->prev = entry->prev;
+    if (was_head) sender->head = entry->next;
+    if (was_tail) sender->tail = entry->prev;
+    sender->pending -= transfer_cost(entry->tx);
+    
+    remove_entry_slot(pool, find_entry_slot(pool, entry->tx));
+    pool->count--;
+    pool->bytes -= entry_bytes();
+    
+    if (sender->head == NULL) {
+        // Senders only exist while they have queued transfers
+        heap_remove(pool, HEAP_BEST, sender);
+        heap_remove(pool, HEAP_WORST, sender);
+        remove_sender_slot(pool, find_sender_slot(pool, sender->address, sender->hash));
+        pool->sender_count--;
+        free(sender);
+        return;
+    }
+    if (was_head) heap_fix(pool, HEAP_BEST, sender);
+    if (was_tail) heap_fix(pool, HEAP_WORST, sender);
+}
+
+static void notify(Mempool *pool, Transaction *tx, bool added) {
+    if (pool->listener != NULL) pool->listener(pool->listener_context, tx, added);
+}
+
+static void drop_entry(Mempool *pool, MempoolEntry *entry) {
+    Transaction *tx = entry->tx;
+    detach_entry(pool, entry);
+    notify(pool, tx, false);
+    tx_release(tx);
+    free_entry(pool, entry);
+}
+
+static MempoolSender *get_sender(Mempool *pool, AddressHandle address) {
+    uint32_t hash = address_handle_hash(address);
+    int slot = find_sender_slot(pool, address, hash);
+    if (pool->senders[slot] != NULL) return pool->senders[slot];
+    
+    if ((pool->sender_count + 1) * 2 > pool->sender_capacity) {
+        if (!grow_senders(pool)) return NULL;
+        slot = find_sender_slot(pool, address, hash);
+    }
+    
+    MempoolSender *sender = calloc(1, sizeof(MempoolSender));
+    if (sender == NULL) return NULL;
+    sender->address = address;
+    sender->hash = hash;
+    pool->senders[slot] = sender;
+    pool->sender_count++;
+    return sender;
+}
+
+static const MempoolSender *lookup_sender(const Mempool *pool, AddressHandle address) {
+    return pool->senders[find_sender_slot(pool, address, address_handle_hash(address))];
+}
+
+// After the sender's queued transfers, unless the chain has moved past them
+static uint64_t following_sequence(const MempoolSender *queued, const ChainState *state, AddressHandle address) {
+    uint64_t next = state_get_sequence(state, address);
+    if (queued != NULL && queued->tail->tx->sequence >= next) next = queued->tail->tx->sequence + 1;
+    return next;
+}
+
+uint64_t mempool_next_sequence(const Mempool *pool, const ChainState *state, AddressHandle sender) {
+    if (pool == NULL || pool->senders == NULL) return state_get_sequence(state, sender);
+    
+    return following_sequence(lookup_sender(pool, sender), state, sender);
+}
+
+bool mempool_contains(const Mempool *pool, const Transaction *tx) {
+    if (pool == NULL || tx == NULL || pool->entries == NULL) return false;
+    
+    return pool->entries[find_entry_slot(pool, tx)] != NULL;
+}
+
+// Links a shared copy of tx into the pool; NULL if memory runs out, with
+// the pool unchanged. The caller has made room in the set and the heaps.
+static MempoolEntry *insert_entry(Mempool *pool, const Transaction *tx) {
+    MempoolEntry *entry = new_entry(pool);
+    Transaction *record = (entry != NULL) ? tx_new(tx) : NULL;
+    MempoolSender *sender = (record != NULL) ? get_sender(pool, tx->from) : NULL;
+    if (sender == NULL) {
+        if (record != NULL) tx_release(record);
+        if (entry != NULL) free_entry(pool, entry);
+        return NULL;
+    }
+    
+    entry->tx = record;
+    entry->sequence = pool->next_sequence++;
+    entry->sender = sender;
+    entry->prev = sender->tail;
+    if (sender->head == NULL) {
+        sender->head = entry;
+        sender->tail = entry;
+        heap_push(pool, HEAP_BEST, sender);
+        heap_push(pool, HEAP_WORST, sender);
+    } else {
+        sender->tail->next = entry;
+        sender->tail = entry;
+        heap_fix(pool, HEAP_WORST, sender);
+    }
+    sender->pending += transfer_cost(tx);
+    
+    pool->entries[find_entry_slot(pool, record)] = entry;
+    pool->count++;
+    pool->bytes += entry_bytes();
+    notify(pool, record, true);
+    return entry;
+}
+
+// Over the cap, the worst queue tails go first; true if that reached an
+// entry added at or after first_sequence
+static bool trim_to_cap(Mempool *pool, uint64_t first_sequence) {
+    bool evicted_new = false;
+    while (pool->max_bytes > 0 && pool->bytes > pool->max_bytes && pool->worst.count > 0) {
+        MempoolEntry *victim = pool->worst.items[0]->tail;
+        evicted_new = evicted_new || victim->sequence >= first_sequence;
+        drop_entry(pool, victim);
+        pool->evicted++;
+    }
+    return evicted_new;
+}
+
+// Set and heap room for count more transfers from as many new senders
+static bool reserve_room(Mempool *pool, int count) {
+    while ((pool->count + count) * 2 > pool->entry_capacity) {
+        if (!grow_entries(pool)) return false;
+    }
+    return reserve_heap(&pool->best, pool->sender_count + count) &&
+           reserve_heap(&pool->worst, pool->sender_count + count);
+}
+
+MempoolResult mempool_add(Mempool *pool, const Transaction *tx, const ChainState *state) {
+    if (pool == NULL || pool->entries == NULL || !is_valid_transfer(tx)) return MEMPOOL_INVALID;
+    if (mempool_contains(pool, tx)) return MEMPOOL_DUPLICATE;
+    if (!verify_transaction(tx)) return MEMPOOL_INVALID;
+    
+    // The sender has to cover this transfer after everything it has queued
+    const MempoolSender *queued = lookup_sender(pool, tx->from);
+    uint64_t pending = (queued != NULL) ? queued->pending : 0;
+    if (state != NULL && tx->sequence != following_sequence(queued, state, tx->from)) {
+        return MEMPOOL_OUT_OF_SEQUENCE;
+    }
+    if (state != NULL &&
+        (pending > UINT64_MAX - transfer_cost(tx) ||
+         pending + transfer_cost(tx) > state_get_balance(state, tx->from))) {
+        return MEMPOOL_UNFUNDED;
+    }
+    
+    // Everything that can fail happens before the pool is touched
+    if (!reserve_room(pool, 1)) return MEMPOOL_INVALID;
+    MempoolEntry *entry = insert_entry(pool, tx);
+    if (entry == NULL) return MEMPOOL_INVALID;
+    
+    return trim_to_cap(pool, entry->sequence) ? MEMPOOL_FULL : MEMPOOL_ADDED;
+}
+
+// What each sender in a batch has queued, counting the batch so far;
+// 0 marks an empty slot
+typedef struct {
+    AddressHandle address;
+    uint64_t spent;
+    uint64_t next_sequence;
+    int last;  // Index of the sender's last transfer in the batch
+} BatchSpend;
+
+static int batch_slot(const BatchSpend *spends, int mask, AddressHandle address) {
+    int slot = (int)(address_handle_hash(address) & (uint32_t)mask);
+    while (spends[slot].address != 0 && spends[slot].address != address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static BatchSpend *batch_spend(const Mempool *pool, const ChainState *state, BatchSpend *spends, int mask,
+                               AddressHandle address) {
+    int slot = batch_slot(spends, mask, address);
+    if (spends[slot].address == 0) {
+        const MempoolSender *queued = lookup_sender(pool, address);
+        spends[slot].address = address;
+        spends[slot].spent = (queued != NULL) ? queued->pending : 0;
+        spends[slot].next_sequence = following_sequence(queued, state, address);
+    }
+    return &spends[slot];
+}
+
+// Indexes of the batch's transfers so far, by hash; true if one of them
+// has the same content as txs[index], which is recorded otherwise
+static bool seen_in_batch(const Transaction *txs, int index, int *seen, int mask) {
+    int slot = (int)(txs[index].hash & (uint32_t)mask);
+    while (seen[slot] >= 0) {
+        if (same_transaction(&txs[seen[slot]], &txs[index])) return true;
+        slot = (slot + 1) & mask;
+    }
+    seen[slot] = index;
+    return false;
+}
+
+// Checks every transfer as mempool_add would, counting a sender's earlier
+// transfers in the batch against its balance and sequence numbers
+static MempoolResult check_batch(const Mempool *pool, const Transaction *txs, int count,
+                                 const ChainState *state, int *rejected) {
+    int capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    int *seen = malloc((size_t)capacity * sizeof(int));
+    BatchSpend *spends = calloc((size_t)capacity, sizeof(BatchSpend));
+    const Transaction **batch = malloc((size_t)count * sizeof(Transaction *));
+    if (seen == NULL || spends == NULL || batch == NULL) {
+        free(seen);
+        free(spends);
+        free(batch);
+        return MEMPOOL_INVALID;
+    }
+    for (int i = 0; i < capacity; i++) {
+        seen[i] = -1;
+    }
+    
+    MempoolResult result = MEMPOOL_ADDED;
+    for (int i = 0; i < count && result == MEMPOOL_ADDED; i++) {
+        const Transaction *tx = &txs[i];
+        *rejected = i;
+        if (!is_valid_transfer(tx)) {
+            result = MEMPOOL_INVALID;
+        } else if (mempool_contains(pool, tx) || seen_in_batch(txs, i, seen, capacity - 1)) {
+            result = MEMPOOL_DUPLICATE;
+        } else {
+            BatchSpend *spend = batch_spend(pool, state, spends, capacity - 1, tx->from);
+            if (state != NULL && tx->sequence != spend->next_sequence) {
+                result = MEMPOOL_OUT_OF_SEQUENCE;
+            } else if (spend->spent > UINT64_MAX - transfer_cost(tx) ||
+                       (state != NULL && spend->spent + transfer_cost(tx) > state_get_balance(state, tx->from))) {
+                result = MEMPOOL_UNFUNDED;
+            }
+            spend->spent += transfer_cost(tx);
+            spend->next_sequence++;
+            batch[i] = tx;
+        }
+    }
+    
+    // All signatures in one batch check; only a failure looks at them one by one
+    if (result == MEMPOOL_ADDED && !verify_transaction_batch((Transaction *const *)batch, count)) {
+        for (int i = 0; i < count && result == MEMPOOL_ADDED; i++) {
+            *rejected = i;
+            if (!verify_transaction(&txs[i])) result = MEMPOOL_INVALID;
+        }
+    }
+    
+    free(seen);
+    free(spends);
+    free(batch);
+    return result;
+}
+
+// A sender's queue tail as eviction would see it once the batch is
+// queued; entry is NULL for a sender's last transfer in the batch
+typedef struct {
+    MempoolEntry *entry;
+    uint64_t fee;
+    uint64_t sequence;
+} EvictionCursor;
+
+static bool cursor_worse(const EvictionCursor *a, const EvictionCursor *b) {
+    if (a->fee != b->fee) return a->fee < b->fee;
+    return a->sequence > b->sequence;
+}
+
+// Min-heap of cursors ordered like the worst heap
+static void eviction_sift_down(EvictionCursor *heap, int count, int pos) {
+    EvictionCursor cursor = heap[pos];
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= count) break;
+        if (child + 1 < count && cursor_worse(&heap[child + 1], &heap[child])) child++;
+        if (!cursor_worse(&heap[child], &cursor)) break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = cursor;
+}
+
+// Whether trimming after the batch is queued stops before it reaches a
+// batch transfer. Eviction takes the worst queue tail first, and a batch
+// sender's tail is its last batch transfer, so the pool's own entries of
+// those senders are out of reach. False also when memory runs out.
+static bool batch_fits(const Mempool *pool, const Transaction *txs, int count) {
+    size_t needed = pool->bytes + (size_t)count * entry_bytes();
+    if (pool->max_bytes == 0 || needed <= pool->max_bytes) return true;
+    size_t evictions = (needed - pool->max_bytes + entry_bytes() - 1) / entry_bytes();
+    
+    int capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    BatchSpend *senders = calloc((size_t)capacity, sizeof(BatchSpend));
+    EvictionCursor *heap = malloc((size_t)(pool->sender_count + count) * sizeof(EvictionCursor));
+    if (senders == NULL || heap == NULL) {
+        free(senders);
+        free(heap);
+        return false;
+    }
+    int mask = capacity - 1;
+    for (int i = 0; i < count; i++) {
+        batch_spend(pool, NULL, senders, mask, txs[i].from)->last = i;
+    }
+    
+    int n = 0;
+    for (int i = 0; i < capacity; i++) {
+        if (senders[i].address == 0) continue;
+        int last = senders[i].last;
+        heap[n++] = (EvictionCursor){NULL, txs[last].fee, pool->next_sequence + (uint64_t)last};
+    }
+    for (int i = 0; i < pool->worst.count; i++) {
+        MempoolEntry *tail = pool->worst.items[i]->tail;
+        if (senders[batch_slot(senders, mask, tail->tx->from)].address == 0) {
+            heap[n++] = (EvictionCursor){tail, tail->tx->fee, tail->sequence};
+        }
+    }
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        eviction_sift_down(heap, n, i);
+    }
+    
+    bool fits = true;
+    while (fits && evictions-- > 0) {
+        fits = n > 0 && heap[0].entry != NULL;
+        if (!fits) break;
+        
+        MempoolEntry *prev = heap[0].entry->prev;
+        if (prev != NULL) {
+            heap[0] = (EvictionCursor){prev, prev->tx->fee, prev->sequence};
+        } else {
+            heap[0] = heap[--n];
+        }
+        if (n > 0) eviction_sift_down(heap, n, 0);
+    }
+    free(senders);
+    free(heap);
+    return fits;
+}
+
+MempoolResult mempool_add_batch(Mempool *pool, const Transaction *txs, int count,
+                                const ChainState *state, int *rejected) {
+    int fault = -1;
+    MempoolResult result = MEMPOOL_ADDED;
+    if (pool == NULL || pool->entries == NULL || txs == NULL || count < 0) {
+        result = MEMPOOL_INVALID;
+    } else if (count > 0) {
+        result = check_batch(pool, txs, count, state, &fault);
+        if (result == MEMPOOL_ADDED && !batch_fits(pool, txs, count)) {
+            fault = -1;
+            result = MEMPOOL_FULL;
+        }
+        if (result == MEMPOOL_ADDED && !reserve_room(pool, count)) {
+            fault = -1;
+            result = MEMPOOL_INVALID;
+        }
+    }
+    
+    if (result == MEMPOOL_ADDED && count > 0) {
+        uint64_t first_sequence = pool->next_sequence;
+        int inserted = 0;
+        while (inserted < count && insert_entry(pool, &txs[inserted]) != NULL) {
+            inserted++;
+        }
+        
+        // The room was checked, so trimming only evicts other transfers
+        if (inserted < count) {
+            for (int i = 0; i < inserted; i++) {
+                drop_entry(pool, pool->entries[find_entry_slot(pool, &txs[i])]);
+            }
+            fault = -1;
+            result = MEMPOOL_INVALID;
+        } else {
+            trim_to_cap(pool, first_sequence);
+        }
+    }
+    
+    if (rejected != NULL) *rejected = (result == MEMPOOL_ADDED) ? -1 : fault;
+    return result;
+}
+
+int mempool_take(Mempool *pool, const ChainState *state, Transaction **out, int max) {
+    if (pool == NULL || out == NULL || pool->entries == NULL) return 0;
+    
+    uint64_t round = ++pool->draw_round;
+    int taken = 0;
+    while (taken < max && pool->best.count > 0) {
+        MempoolSender *sender = pool->best.items[0];
+        if (sender->draw_round != round) {
+            sender->draw_round = round;
+            sender->drawn = 0;
+            sender->next_sequence = state_get_sequence(state, sender->address);
+        }
+        
+        // A transfer whose number the chain has used lost to another one
+        // the sender signed with it
+        MempoolEntry *entry = sender->head;
+        if (state != NULL && entry->tx->sequence < sender->next_sequence) {
+            drop_entry(pool, entry);
+            pool->evicted++;
+            continue;
+        }
+        
+        // Balances may have moved since admission; a sender's later
+        // transfers cannot be mined without the earlier ones
+        uint64_t cost = transfer_cost(entry->tx);
+        if (state != NULL && (entry->tx->sequence != sender->next_sequence ||
+                              sender->drawn + cost > state_get_balance(state, sender->address))) {
+            // The sender goes away with its last entry
+            while (entry != NULL) {
+                MempoolEntry *next = entry->next;
+                drop_entry(pool, entry);
+                pool->evicted++;
+                entry = next;
+            }
+            continue;
+        }
+        
+        sender->drawn += cost;
+        sender->next_sequence++;
+        out[taken++] = entry->tx;
+        detach_entry(pool, entry);
+        notify(pool, entry->tx, false);
+        free_entry(pool, entry);
+    }
+    return taken;
+}
+
+// Min-heap of sender cursors ordered like the best heap
+static void cursor_sift_down(MempoolEntry **heap, int count, int pos) {
+    MempoolEntry *entry = heap[pos];
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= count) break;
+        if (child + 1 < count && entry_better(heap[child + 1], heap[child])) child++;
+        if (!entry_better(heap[child], entry)) break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = entry;
+}
+
+int mempool_peek(Mempool *pool, const ChainState *state, Transaction **out, int max) {
+    if (pool == NULL || out == NULL || pool->entries == NULL || pool->best.count == 0) return 0;
+    
+    // One cursor per sender, starting at its oldest transfer
+    int count = pool->best.count;
+    MempoolEntry **heap = malloc((size_t)count * sizeof(MempoolEntry *));
+    if (heap == NULL) return 0;
+    for (int i = 0; i < count; i++) {
+        heap[i] = pool->best.items[i]->head;
+    }
+    
+    uint64_t round = ++pool->draw_round;
+    int listed = 0;
+    while (listed < max && count > 0) {
+        MempoolEntry *entry = heap[0];
+        MempoolSender *sender = entry->sender;
+        if (sender->draw_round != round) {
+            sender->draw_round = round;
+            sender->drawn = 0;
+            sender->next_sequence = state_get_sequence(state, sender->address);
+        }
+        
+        // A transfer whose number the chain has used is passed over; an
+        // unfunded or out of order one holds back the rest of its sender's queue
+        uint64_t cost = transfer_cost(entry->tx);
+        bool stale = state != NULL && entry->tx->sequence < sender->next_sequence;
+        bool usable = !stale && (state == NULL || (entry->tx->sequence == sender->next_sequence &&
+                                                   sender->drawn + cost <= state_get_balance(state, sender->address)));
+        if (usable) {
+            sender->drawn += cost;
+            sender->next_sequence++;
+            out[listed++] = entry->tx;
+        }
+        if ((usable || stale) && entry->next != NULL) {
+            heap[0] = entry->next;
+        } else {
+            heap[0] = heap[--count];
+        }
+        if (count > 0) cursor_sift_down(heap, count, 0);
+    }
+    free(heap);
+    return listed;
+}
+
+int mempool_remove_block(Mempool *pool, const Block *block) {
+    if (pool == NULL || block == NULL || pool->entries == NULL) return 0;
+    
+    int removed = 0;
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction *tx = block->transactions[i];
+        if (tx->is_coinbase) continue;
+        
+        MempoolEntry *entry = pool->entries[find_entry_slot(pool, tx)];
+        if (entry != NULL) {
+            drop_entry(pool, entry);
+            removed++;
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,95 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "block.h"
+#include "state.h"
+
+// Transfers waiting to be mined. A sender's transfers leave the pool in
+// the order they arrived; across senders, each sender's next transfer
+// competes by fee, then by age. Over the memory cap, the cheapest and
+// newest transfers at the back of a sender's queue are evicted first.
+// Not thread-safe; the pool holds one reference to each shared record.
+
+typedef enum {
+    MEMPOOL_ADDED,
+    MEMPOOL_DUPLICATE,
+    MEMPOOL_INVALID,   // Breaks the block transaction rules or is not signed by its sender
+    MEMPOOL_UNFUNDED,  // The sender's balance does not cover it and its queue
+    MEMPOOL_FULL,      // Ranks below everything kept under the memory cap
+    MEMPOOL_OUT_OF_SEQUENCE  // Not the sender's next sequence number: used already, or one is missing
+} MempoolResult;
+
+typedef struct MempoolEntry MempoolEntry;
+typedef struct MempoolSender MempoolSender;
+typedef struct MempoolSlab MempoolSlab;
+
+typedef struct {
+    MempoolSender **items;
+    int count;
+    int capacity;
+} MempoolHeap;
+
+typedef struct {
+    MempoolEntry **entries;   // Open-addressing set by transaction hash
+    int entry_capacity;
+    MempoolSender **senders;  // Open-addressing set by sender address
+    int sender_capacity;
+    int sender_count;
+    MempoolHeap best;         // Senders by their next transfer, best first
+    MempoolHeap worst;        // Senders by their last transfer, worst first
+    MempoolSlab *slabs;       // Entries are carved from these and recycled
+    MempoolEntry *free_entries;
+    int count;
+    size_t bytes;             // Held by pending transfers
+    size_t max_bytes;
+    uint64_t next_sequence;
+    uint64_t draw_round;
+    uint64_t evicted;         // Dropped for space or when no longer funded
+    
+    // Optional; told about every transfer entering or leaving the pool
+    void (*listener)(void *context, Transaction *tx, bool added);
+    void *listener_context;
+} Mempool;
+
+bool init_mempool(Mempool *pool, size_t max_bytes);
+void cleanup_mempool(Mempool *pool);
+
+// Checks the transfer against the state's balances and sequence numbers
+// (skipped when state is NULL) and queues a shared copy of it. A sender's
+// transfer must carry the number after its queued ones, or the state's
+// next one when it has none queued.
+MempoolResult mempool_add(Mempool *pool, const Transaction *tx, const ChainState *state);
+bool mempool_contains(const Mempool *pool, const Transaction *tx);
+
+// The sequence number the sender's next transfer has to carry
+uint64_t mempool_next_sequence(const Mempool *pool, const ChainState *state, AddressHandle sender);
+
+// Queues all count transfers or none of them. Each is checked as by
+// mempool_add, with a sender's earlier transfers in the batch counted
+// against its balance, and the signatures are checked in one batch.
+// Transfers are evicted to make room only once the whole batch is known
+// to fit; a refused batch leaves the pool as it was. *rejected (may be
+// NULL) is the index of the first transfer at fault, or -1 when none is.
+MempoolResult mempool_add_batch(Mempool *pool, const Transaction *txs, int count,
+                                const ChainState *state, int *rejected);
+
+// Removes up to max of the best transfers into out, in an order a block
+// can hold them; the caller owns the references. Transfers whose sequence
+// number the chain has used are dropped; those the state can no longer
+// fund, or that no longer follow on from the chain, are dropped along
+// with the rest of their sender's queue.
+int mempool_take(Mempool *pool, const ChainState *state, Transaction **out, int max);
+
+// Lists up to max of the best transfers in the order mempool_take would
+// hand them out, leaving them queued and out borrowing the pool's
+// references. Senders the state no longer funds are skipped, and so are
+// the transfers mempool_take would drop.
+int mempool_peek(Mempool *pool, const ChainState *state, Transaction **out, int max);
+
+// Drops the pool's copies of the block's transfers; returns how many
+int mempool_remove_block(Mempool *pool, const Block *block);
+
+#endif
@@ -1,4 +1,12 @@
 #include "menu.h"
+#include "pi.h"
+#include "digitstore.h"
+#include "txpool.h"
+#include "verifycache.h"
+#include "storage.h"
+#include "compress.h"
+#include "rescan.h"
+#include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,9 +40,11 @@ void display_main_menu(void) {
     printf("| 10. Import Blockchain       | Load blockchain from file                   |\n");
     printf("| 11. Create New Wallet       | Generate a new wallet address               |\n");
     printf("| 12. Load Existing Wallet    | Load wallet from file                       |\n");
+    printf("| 13. Batch Payout            | Send the transfers listed in a file         |\n");
+    printf("| 14. Wallet Keystore         | Store and switch between many wallets       |\n");
     printf("| 0. Exit                     | Quit the application                        |\n");
     printf("+==============================================================================+\n");
-    printf("Enter your choice (0-12): ");
+    printf("Enter your choice (0-14): ");
 }
 
 MenuOption get_menu_choice(void) {
@@ -43,13 +53,13 @@ MenuOption get_menu_choice(void) {
     
     if (fgets(input, sizeof(input), stdin) != NULL) {
         if (sscanf(input, "%d", &choice) == 1) {
-            if (choice >= 0 && choice <= 12) {
+            if (choice >= 0 && choice <= 14) {
                 return (MenuOption)choice;
             }
         }
     }
     
-    printf("Invalid choice! Please enter a number between 0 and 12.\n");
+    printf("Invalid choice! Please enter a number between 0 and 14.\n");
     return -1; // Invalid choice
 }
 
@@ -59,18 +69,15 @@ bool init_app_state(AppState *app) {
     memset(app, 0, sizeof(AppState));
     
     // Initialize blockchain
-    app->blockchain_capacity = 100;
-    app->blockchain = malloc(app->blockchain_capacity * sizeof(Block));
-    if (app->blockchain == NULL) {
+    if (!init_chain(&app->chain, 100)) {
         printf("Error: Could not allocate memory for blockchain\n");
         return false;
     }
-    app->blockchain_size = 0;
     
     // Initialize wallet
     if (!init_wallet(&app->miner_wallet)) {
         printf("Error: Could not initialize wallet\n");
-        free(app->blockchain);
+        cleanup_chain(&app->chain);
         return false;
     }
     
@@ -80,14 +87,24 @@ bool init_app_state(AppState *app) {
     // Initialize performance monitoring
     init_performance_metrics(&app->performance);
     
-    // Initialize memory pool
-    if (!init_memory_pool(&app->memory_pool, 64 * 1024 * 1024)) {
-        printf("Warning: Could not initialize memory pool\n");
-    }
-    
     // Set default filenames
     strcpy(app->blockchain_file, "archimed_blockchain.dat");
     strcpy(app->wallet_file, "archimed_wallet.dat");
+    strcpy(app->journal_file, "archimed_journal.dat");
+    app->chain_codec = default_codec();
+    
+    // Node settings; a missing config.ini leaves the defaults
+    init_node_config(&app->config);
+    load_node_config(&app->config, CONFIG_FILE);
+    set_large_pages_enabled(app->config.huge_pages);
+    init_chain_state(&app->state);
+    init_address_table();
+    init_tx_pool();
+    init_verify_cache(app->config.cache_transactions, app->config.cache_blocks);
+    init_mempool(&app->mempool, (size_t)app->config.mempool_max_mb * 1024 * 1024);
+    init_block_template(&app->block_template);
+    app->mempool.listener = block_template_on_mempool;
+    app->mempool.listener_context = &app->block_template;
     
     // Try to initialize network
     app->network_enabled = init_network(&app->network, 8333);
@@ -107,24 +124,28 @@ void cleanup_app_state(AppState *app) {
     if (app == NULL) return;
     
     // Save blockchain and wallet before cleanup
-    save_blockchain(app);
-    save_wallet(&app->miner_wallet, app->wallet_file);
+    checkpoint_app_state(app);
+    journal_close(&app->journal);
+    keystore_close(&app->keystore);
     
     // Cleanup blockchain
-    if (app->blockchain != NULL) {
-        for (int i = 0; i < app->blockchain_size; i++) {
-            cleanup_block(&app->blockchain[i]);
-        }
-        free(app->blockchain);
-    }
+    cleanup_chain(&app->chain);
+    cleanup_wallet(&app->miner_wallet);
+    cleanup_chain_state(&app->state);
+    cleanup_digit_store();
+    cleanup_mempool(&app->mempool);
+    cleanup_block_template(&app->block_template);
+    cleanup_tx_pool();
+    cleanup_verify_cache();
+    cleanup_address_table();
     
     // Cleanup network
     if (app->network_enabled) {
         shutdown_network(&app->network);
     }
     
-    // Cleanup memory pool
-    cleanup_memory_pool(&app->memory_pool);
+    // Cleanup the main thread's scratch arena
+    release_thread_scratch_pool();
     
     printf("Application cleanup completed\n");
 }
@@ -169,6 +190,12 @@ void handle_menu_choice(AppState *app, MenuOption choice) {
         case MENU_LOAD_WALLET:
             handle_load_wallet(app);
             break;
+        case MENU_BATCH_PAYOUT:
+            handle_batch_payout(app);
+            break;
+        case MENU_KEYSTORE:
+            handle_keystore(app);
+            break;
         case MENU_EXIT:
             printf("Shutting down Archimedes Blockchain...\n");
             break;
@@ -208,27 +235,23 @@ void handle_mine_blocks(AppState *app) {
     printf("\nStarting mining operations...\n");
     
     while (continuous || blocks_mined < blocks_to_mine) {
-        // Check if we need to expand blockchain capacity
-        if (app->blockchain_size >= app->blockchain_capacity) {
-            app->blockchain_capacity *= 2;
-            Block *temp = realloc(app->blockchain, app->blockchain_capacity * sizeof(Block));
-            if (temp == NULL) {
-                printf("Error: Could not expand blockchain memory\n");
-                break;
-            }
-            app->blockchain = temp;
-        }
-        
-        int block_index = app->blockchain_size;
-        Block *new_block = &app->blockchain[block_index];
+        // Mined into a local block, then moved into the chain; growing
+        // the chain never copies existing blocks
+        int block_index = app->chain.size;
+        Block mined;
+        Block *new_block = &mined;
         new_block->index = block_index;
         
-        uint32_t prev_hash = (block_index == 0) ? 0 : app->blockchain[block_index - 1].hash;
-        const Block *prev_block = (block_index == 0) ? NULL : &app->blockchain[block_index - 1];
+        const Block *prev_block = chain_tip(&app->chain);
         
         // Update reward system
         update_reward_system(&app->reward_system, block_index);
         
+        // The template already holds the best pending transfers; it only
+        // needs a refill when blocks arrived from elsewhere or room opened up
+        block_template_set_tip(&app->block_template, prev_block, app->miner_wallet.address, &app->reward_system);
+        block_template_refill(&app->block_template, &app->mempool, &app->state);
+        
         // Calculate expected reward
         uint64_t expected_reward = calculate_mining_reward(&app->reward_system, block_index);
         char reward_str[64];
@@ -244,25 +267,49 @@ void handle_mine_blocks(AppState *app) {
         }
         
         // Mine the block with Pi digit proof of work
-        mine_block(new_block, prev_hash, prev_block, app->miner_wallet.address, &app->reward_system);
+        if (!block_template_fill_block(&app->block_template, new_block)) {
+            printf("Error: Could not assemble block %d\n", block_index);
+            break;
+        }
+        int pending_count = app->block_template.count;
+        mine_assembled_block(new_block, prev_block);
         
         // End performance timing
         if (app->performance_monitoring) {
             end_timing(&app->performance);
-            calculate_performance_stats(&app->performance, new_block->pi_digits_count, new_block->nonce + 1);
+            calculate_performance_stats(&app->performance, new_block->pi_digits.count, new_block->nonce + 1);
         }
         
-        // Award mining reward
-        if (expected_reward > 0) {
-            award_mining_reward(&app->miner_wallet, &app->reward_system, block_index);
+        // A template that drifted from the balances must not reach the chain
+        if (!state_check_block(&app->state, new_block)) {
+            printf("Error: Block %d failed the balance check; rebuilding the pending transfers\n", block_index);
+            cleanup_block(new_block);
+            app->block_template.needs_rebuild = true;
+            break;
+        }
+        
+        if (!chain_append(&app->chain, new_block)) {
+            printf("Error: Could not expand blockchain memory\n");
+            cleanup_block(new_block);
+            break;
         }
+        new_block = chain_tip(&app->chain);
         
-        app->blockchain_size++;
+        // Record the block's coinbase, which carries the reward and the fees,
+        // only once the block is on the chain
+        if (new_block->transaction_count > 0 && new_block->transactions[0]->is_coinbase) {
+            add_shared_transaction_to_wallet(&app->miner_wallet, new_block->transactions[0]);
+        }
+        mempool_remove_block(&app->mempool, new_block);
+        refresh_chain_state(app);
         blocks_mined++;
         
         printf(">> Block %d mined successfully!\n", block_index);
         printf("   - Block Hash: %u\n", new_block->hash);
-        printf("   - Pi Digits Calculated: %d\n", new_block->pi_digits_count);
+        printf("   - Pi Digits Calculated: %d\n", new_block->pi_digits.count);
+        if (pending_count > 0) {
+            printf("   - Transfers Included: %d\n", pending_count);
+        }
         printf("   - Nonce: %u\n", new_block->nonce);        if (app->performance_monitoring) {
             printf("   - Mining Time: %.4f seconds\n", app->performance.mining_time);
             printf("   - Pi Digits/sec: %" PRIu64 "\n", app->performance.pi_digits_per_second);
@@ -297,8 +344,7 @@ void handle_mine_blocks(AppState *app) {
     
     // Save blockchain after mining
     if (blocks_mined > 0) {
-        save_blockchain(app);
-        save_wallet(&app->miner_wallet, app->wallet_file);
+        save_app_state(app);
         printf("Blockchain and wallet saved successfully.\n");
     }
 }
@@ -310,13 +356,13 @@ void handle_view_blockchain(AppState *app) {
     printf("|                            BLOCKCHAIN EXPLORER                              |\n");
     printf("+==============================================================================+\n");
     
-    if (app->blockchain_size == 0) {
+    if (app->chain.size == 0) {
         printf("| Blockchain is empty. Mine some blocks first!                                |\n");
         printf("+==============================================================================+\n");
         return;
     }
     
-    printf("| Total Blocks: %-10d                                                |\n", app->blockchain_size);
+    printf("| Total Blocks: %-10d                                                |\n", app->chain.size);
     printf("| Blockchain File: %-50s        |\n", app->blockchain_file);
     printf("+==============================================================================+\n");
     
@@ -338,10 +384,10 @@ void handle_view_blockchain(AppState *app) {
     switch (choice) {
         case 1: {
             // View all blocks
-            printf("\nDisplaying all %d blocks:\n", app->blockchain_size);
-            for (int i = 0; i < app->blockchain_size; i++) {
-                print_block(&app->blockchain[i]);
-                if ((i + 1) % 3 == 0 && i < app->blockchain_size - 1) {
+            printf("\nDisplaying all %d blocks:\n", app->chain.size);
+            for (int i = 0; i < app->chain.size; i++) {
+                print_block(chain_block(&app->chain, i));
+                if ((i + 1) % 3 == 0 && i < app->chain.size - 1) {
                     printf("Press Enter to continue or 'q' to quit...");
                     if (fgets(input, sizeof(input), stdin) != NULL) {
                         if (tolower(input[0]) == 'q') break;
@@ -352,12 +398,12 @@ void handle_view_blockchain(AppState *app) {
         }
         case 2: {
             // View specific block
-            printf("Enter block index (0-%d): ", app->blockchain_size - 1);
+            printf("Enter block index (0-%d): ", app->chain.size - 1);
             int block_index;
             if (fgets(input, sizeof(input), stdin) != NULL) {
                 if (sscanf(input, "%d", &block_index) == 1) {
-                    if (block_index >= 0 && block_index < app->blockchain_size) {
-                        print_block(&app->blockchain[block_index]);
+                    if (block_index >= 0 && block_index < app->chain.size) {
+                        print_block(chain_block(&app->chain, block_index));
                     } else {
                         printf("Block index out of range\n");
                     }
@@ -374,15 +420,16 @@ void handle_view_blockchain(AppState *app) {
             uint64_t total_rewards = 0;
             int total_pi_digits = 0;
             
-            for (int i = 0; i < app->blockchain_size; i++) {
-                total_rewards += app->blockchain[i].mining_reward;
-                total_pi_digits += app->blockchain[i].pi_digits_count;
+            for (int i = 0; i < app->chain.size; i++) {
+                const Block *block = chain_block(&app->chain, i);
+                total_rewards += block->mining_reward;
+                total_pi_digits += block->pi_digits.count;
                 
                 printf("| Block %3d | Hash: %10u | Pi: %6d | Reward: ", 
-                       i, app->blockchain[i].hash, app->blockchain[i].pi_digits_count);
+                       i, block->hash, block->pi_digits.count);
                 
                 char reward_str[32];
-                format_amount(app->blockchain[i].mining_reward, reward_str, sizeof(reward_str));
+                format_amount(block->mining_reward, reward_str, sizeof(reward_str));
                 printf("%-20s |\n", reward_str);
             }
             
@@ -400,16 +447,12 @@ void handle_view_blockchain(AppState *app) {
             uint32_t search_hash;
             if (fgets(input, sizeof(input), stdin) != NULL) {
                 if (sscanf(input, "%u", &search_hash) == 1) {
-                    bool found = false;
-                    for (int i = 0; i < app->blockchain_size; i++) {
-                        if (app->blockchain[i].hash == search_hash) {
-                            printf("Block found at index %d:\n", i);
-                            print_block(&app->blockchain[i]);
-                            found = true;
-                            break;
-                        }
-                    }
-                    if (!found) {
+                    // Scans only the header table
+                    int height = chain_find_hash(&app->chain, search_hash);
+                    if (height >= 0) {
+                        printf("Block found at index %d:\n", height);
+                        print_block(chain_block(&app->chain, height));
+                    } else {
                         printf("Block with hash %u not found\n", search_hash);
                     }
                 }
@@ -434,6 +477,11 @@ void handle_check_balance(AppState *app) {
     
     printf("| Wallet Address: %-56s |\n", app->miner_wallet.address);
     printf("| Current Balance: %-55s |\n", balance_str);
+    
+    char chain_balance_str[64];
+    format_amount(state_get_balance(&app->state, address_find(app->miner_wallet.address)),
+                  chain_balance_str, sizeof(chain_balance_str));
+    printf("| On-Chain Balance: %-43s (height %-4d) |\n", chain_balance_str, app->state.height);
     printf("| Total Transactions: %-50d |\n", app->miner_wallet.transaction_count);
     printf("+==============================================================================+\n");
     
@@ -445,12 +493,52 @@ void handle_check_balance(AppState *app) {
                    app->miner_wallet.transaction_count - 5 : 0;
         
         for (int i = start; i < app->miner_wallet.transaction_count; i++) {
-            print_transaction(&app->miner_wallet.transactions[i]);
+            print_transaction(app->miner_wallet.transactions[i]);
         }
         printf("+==============================================================================+\n");
     }
 }
 
+// What the wallet can still send: its balance on the chain, less its
+// transfers the chain has not recorded yet
+static uint64_t spendable_balance(const AppState *app) {
+    const Wallet *wallet = &app->miner_wallet;
+    AddressHandle self = address_find(wallet->address);
+    uint64_t sent = 0;
+    for (int i = 0; self != 0 && i < wallet->transaction_count; i++) {
+        const Transaction *tx = wallet->transactions[i];
+        if (!tx->is_coinbase && tx->from == self) {
+            sent += tx->amount + tx->fee;
+        }
+    }
+    
+    uint64_t confirmed = state_get_sent(&app->state, self);
+    uint64_t pending = (sent > confirmed) ? sent - confirmed : 0;
+    uint64_t balance = state_get_balance(&app->state, self);
+    return (balance > pending) ? balance - pending : 0;
+}
+
+static const char *rejection_reason(MempoolResult result) {
+    return result == MEMPOOL_DUPLICATE ? "already pending" :
+           result == MEMPOOL_UNFUNDED ? "not covered by the on-chain balance" :
+           result == MEMPOOL_FULL ? "fee too low for the full mempool" :
+           result == MEMPOOL_OUT_OF_SEQUENCE ? "out of sequence with the wallet's other transfers" :
+           "invalid transfer";
+}
+
+static bool broadcast_transaction(AppState *app, const Transaction *tx) {
+    if (!app->network_enabled || app->network.peer_count == 0) return false;
+    
+    NetworkMessage msg;
+    msg.type = MSG_TRANSACTION;
+    WireTransaction wire;
+    transaction_to_wire(tx, &wire);
+    msg.length = sizeof(WireTransaction);
+    memcpy(msg.data, &wire, sizeof(WireTransaction));
+    broadcast_message(&app->network, &msg);
+    return true;
+}
+
 void handle_transfer_funds(AppState *app) {
     if (app == NULL) return;
     
@@ -458,12 +546,14 @@ void handle_transfer_funds(AppState *app) {
     printf("|                           TRANSFER FUNDS                                    |\n");
     printf("+==============================================================================+\n");
     
+    // Checked against the chain, not the wallet's own bookkeeping
+    uint64_t spendable = spendable_balance(app);
     char balance_str[64];
-    format_amount(get_wallet_balance(&app->miner_wallet), balance_str, sizeof(balance_str));
-    printf("| Your Current Balance: %-51s |\n", balance_str);
+    format_amount(spendable, balance_str, sizeof(balance_str));
+    printf("| Your Spendable Balance: %-49s |\n", balance_str);
     printf("+==============================================================================+\n");
     
-    if (get_wallet_balance(&app->miner_wallet) == 0) {
+    if (spendable == 0) {
         printf("You have no funds to transfer. Mine some blocks first!\n");
         return;
     }
@@ -495,39 +585,56 @@ void handle_transfer_funds(AppState *app) {
         return;
     }
     
-    if (amount > get_wallet_balance(&app->miner_wallet)) {
+    // Higher fees are mined first
+    char fee_str[64];
+    printf("Enter fee for the miner (in ARC, Enter for none): ");
+    if (fgets(fee_str, sizeof(fee_str), stdin) == NULL) {
+        printf("Invalid fee input\n");
+        return;
+    }
+    fee_str[strcspn(fee_str, "\n")] = 0;
+    uint64_t fee = parse_amount(fee_str);
+    
+    if (amount > spendable || fee > spendable - amount) {
         printf("Insufficient funds\n");
         return;
     }
     
     // Create transaction
     Transaction tx;
-    if (create_transaction(&tx, app->miner_wallet.address, to_address, amount)) {
+    if (create_transaction_with_fee(&tx, app->miner_wallet.address, to_address, amount, fee)) {
+        // Numbered after the wallet's transfers on the chain and pending
+        set_transaction_sequence(&tx, mempool_next_sequence(&app->mempool, &app->state, tx.from));
+        if (!sign_transaction(&tx, app->miner_wallet.private_key)) {
+            printf("This wallet's address predates signed transfers; create a new wallet to send funds\n");
+            return;
+        }
+        
+        MempoolResult queued = mempool_add(&app->mempool, &tx, &app->state);
+        if (queued != MEMPOOL_ADDED) {
+            printf("Transaction rejected: %s\n", rejection_reason(queued));
+            return;
+        }
+        
         printf("\nTransaction created successfully!\n");
         printf("Transaction Hash: %u\n", tx.hash);
         
         char tx_amount_str[64];
         format_amount(amount, tx_amount_str, sizeof(tx_amount_str));
         printf("Amount: %s\n", tx_amount_str);
-        printf("From: %s\n", tx.from_address);
-        printf("To: %s\n", tx.to_address);
+        printf("From: %s\n", address_text(tx.from));
+        printf("To: %s\n", address_text(tx.to));
+        printf("Pending transfers: %d (mined with the next blocks)\n", app->mempool.count);
         
         // Add transaction to wallet
         add_transaction_to_wallet(&app->miner_wallet, &tx);
         
-        // In a real blockchain, you would broadcast this transaction to the network
-        // and wait for it to be included in a block
-        if (app->network_enabled && app->network.peer_count > 0) {
-            NetworkMessage msg;
-            msg.type = MSG_TRANSACTION;
-            msg.length = sizeof(Transaction);
-            // In practice, you'd serialize the transaction properly
-            broadcast_message(&app->network, &msg);
+        if (broadcast_transaction(app, &tx)) {
             printf("Transaction broadcasted to network\n");
         }
         
         // Save updated wallet
-        save_wallet(&app->miner_wallet, app->wallet_file);
+        save_app_state(app);
         
         printf("Transaction completed successfully!\n");
     } else {
@@ -535,6 +642,131 @@ void handle_transfer_funds(AppState *app) {
     }
 }
 
+MempoolResult submit_transfer_batch(AppState *app, const TransferRequest *requests, int count, int *rejected) {
+    if (rejected != NULL) *rejected = -1;
+    if (app == NULL || requests == NULL || count <= 0) return MEMPOOL_INVALID;
+    
+    Wallet *wallet = &app->miner_wallet;
+    uint64_t first_sequence = mempool_next_sequence(&app->mempool, &app->state, address_find(wallet->address));
+    Transaction *txs = malloc((size_t)count * sizeof(Transaction));
+    if (txs == NULL || !reserve_wallet_transactions(wallet, wallet->transaction_count + count) ||
+        !create_transfer_batch(txs, wallet, first_sequence, requests, count)) {
+        free(txs);
+        return MEMPOOL_INVALID;
+    }
+    
+    MempoolResult result = mempool_add_batch(&app->mempool, txs, count, &app->state, rejected);
+    if (result == MEMPOOL_ADDED) {
+        for (int i = 0; i < count; i++) {
+            add_transaction_to_wallet(wallet, &txs[i]);
+            broadcast_transaction(app, &txs[i]);
+        }
+        
+        // One save for the whole batch
+        save_app_state(app);
+    }
+    free(txs);
+    return result;
+}
+
+// Payout file lines: an address, an amount and an optional fee (in ARC);
+// blank lines and lines starting with '#' are skipped
+static int read_payout_file(const char *filename, TransferRequest **requests) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Could not open %s\n", filename);
+        return -1;
+    }
+    
+    TransferRequest *list = NULL;
+    int count = 0, capacity = 0, line_number = 0;
+    char line[256];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char address[WALLET_ADDRESS_LENGTH], amount_str[64], fee_str[64] = "";
+        int fields = sscanf(line, "%63s %63s %63s", address, amount_str, fee_str);
+        if (fields <= 0 || address[0] == '#') continue;
+        
+        uint64_t amount = (fields >= 2) ? parse_amount(amount_str) : 0;
+        if (amount == 0) {
+            printf("Line %d: expected an address and an amount\n", line_number);
+            ok = false;
+        } else if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            TransferRequest *grown = realloc(list, (size_t)capacity * sizeof(TransferRequest));
+            ok = grown != NULL;
+            if (ok) list = grown;
+        }
+        if (ok) {
+            memset(&list[count], 0, sizeof(TransferRequest));
+            strcpy(list[count].to, address);
+            list[count].amount = amount;
+            list[count].fee = parse_amount(fee_str);
+            count++;
+        }
+    }
+    fclose(file);
+    
+    if (!ok) {
+        free(list);
+        return -1;
+    }
+    *requests = list;
+    return count;
+}
+
+void handle_batch_payout(AppState *app) {
+    if (app == NULL) return;
+    
+    printf("\n+==============================================================================+\n");
+    printf("|                             BATCH PAYOUT                                    |\n");
+    printf("+==============================================================================+\n");
+    
+    printf("Enter payout file path (lines of: address amount [fee]): ");
+    char filename[256];
+    if (fgets(filename, sizeof(filename), stdin) == NULL) return;
+    filename[strcspn(filename, "\n")] = 0;
+    
+    TransferRequest *requests = NULL;
+    int count = read_payout_file(filename, &requests);
+    if (count <= 0) {
+        if (count == 0) printf("No transfers in %s\n", filename);
+        free(requests);
+        return;
+    }
+    
+    uint64_t total = 0;
+    bool overflow = false;
+    for (int i = 0; i < count && !overflow; i++) {
+        uint64_t cost = requests[i].amount + requests[i].fee;
+        overflow = cost < requests[i].amount || cost > UINT64_MAX - total;
+        total += cost;
+    }
+    if (overflow || total > spendable_balance(app)) {
+        printf("Insufficient funds for %d transfers\n", count);
+        free(requests);
+        return;
+    }
+    
+    int rejected;
+    MempoolResult result = submit_transfer_batch(app, requests, count, &rejected);
+    char total_str[64];
+    format_amount(total, total_str, sizeof(total_str));
+    if (result == MEMPOOL_ADDED) {
+        printf("%d transfers queued, %s in total with fees\n", count, total_str);
+        printf("Pending transfers: %d (mined with the next blocks)\n", app->mempool.count);
+    } else if (rejected >= 0) {
+        printf("Batch rejected, nothing was sent: transfer %d (to %s): %s\n",
+               rejected + 1, requests[rejected].to, rejection_reason(result));
+    } else if (result == MEMPOOL_INVALID) {
+        printf("Batch rejected, nothing was sent: this wallet cannot sign transfers\n");
+    } else {
+        printf("Batch rejected, nothing was sent: %s\n", rejection_reason(result));
+    }
+    free(requests);
+}
+
 void handle_view_wallet(AppState *app) {
     if (app == NULL) return;
     
@@ -546,7 +778,7 @@ void handle_view_wallet(AppState *app) {
         printf("+==============================================================================+\n");
         for (int i = 0; i < app->miner_wallet.transaction_count; i++) {
             printf("| %3d. ", i + 1);
-            print_transaction(&app->miner_wallet.transactions[i]);
+            print_transaction(app->miner_wallet.transactions[i]);
         }
         printf("+==============================================================================+\n");
     } else {
@@ -574,6 +806,12 @@ void handle_network_status(AppState *app) {
            app->network.port);
     printf("| Connected Peers: %-10d                                             |\n", 
            app->network.peer_count);
+    if (app->network.services & NODE_SERVICE_PRUNED) {
+        printf("| Serving Blocks : pruned, bodies from height %-10d                      |\n",
+               app->network.serve_from_height);
+    } else {
+        printf("| Serving Blocks : full archive                                               |\n");
+    }
     printf("+==============================================================================+\n");
     
     if (app->network.peer_count > 0) {
@@ -663,16 +901,50 @@ void handle_performance_stats(AppState *app) {
     printf("+==============================================================================+\n");
     printf("|                           MEMORY STATISTICS                                 |\n");
     printf("+==============================================================================+\n");
-    if (app->memory_pool.initialized) {
-        printf("| Memory Pool Size: %-10zu bytes                                      |\n", 
-               app->memory_pool.pool_size);
-        printf("| Memory Pool Used: %-10zu bytes                                      |\n", 
-               app->memory_pool.used_size);
-        printf("| Memory Available: %-10zu bytes                                      |\n", 
-               app->memory_pool.pool_size - app->memory_pool.used_size);
+    const MemoryPool *scratch = thread_scratch_pool();
+    if (scratch->initialized) {
+        printf("| Scratch Arena Size: %-10zu bytes                                    |\n", 
+               scratch->pool_size);
+        printf("| Scratch Arena Used: %-10zu bytes                                    |\n", 
+               scratch->used_size);
+        printf("| Scratch Arena Peak: %-10zu bytes (largest block's scratch)          |\n", 
+               scratch->peak_size);
     } else {
-        printf("| Memory Pool: Not initialized                                             |\n");
+        printf("| Scratch Arena: Not initialized                                           |\n");
     }
+    
+    LargeBufferStats large_stats;
+    get_large_buffer_stats(&large_stats);
+    printf("| Large Buffers: %" PRIu64 " huge, %" PRIu64 " transparent huge, %" PRIu64 " regular pages%s\n",
+           large_stats.explicit_huge, large_stats.transparent_huge, large_stats.regular,
+           large_pages_enabled() ? "" : " (huge pages off)");
+    
+    DigitStoreStats digit_stats;
+    get_digit_store_stats(&digit_stats);
+    printf("| Pi Digit Payloads: %-10d (shared across blocks)                      |\n",
+           digit_stats.payloads);
+    printf("| Pi Digit Storage: %-10zu bytes                                      |\n",
+           digit_stats.bytes_stored);
+    printf("| Deduplicated Payloads: %-10" PRIu64 "                                     |\n",
+           digit_stats.dedup_hits);
+    
+    printf("| Mempool: %-6d transfers, %-10zu bytes, %-8" PRIu64 " evicted              |\n",
+           app->mempool.count, app->mempool.bytes, app->mempool.evicted);
+    
+    TxPoolStats tx_stats;
+    get_tx_pool_stats(&tx_stats);
+    printf("| Transaction Records: %-10d in %d slabs (%zu bytes)                  |\n",
+           tx_stats.live_records, tx_stats.slabs, tx_stats.bytes_reserved);
+    
+    VerifyCacheStats tx_cache, block_cache;
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &tx_cache);
+    get_verify_cache_stats(VERIFY_CACHE_BLOCKS, &block_cache);
+    printf("| Verified Signatures: %-8d cached, %-10" PRIu64 " hits, %-10" PRIu64 " misses     |\n",
+           tx_cache.entries, tx_cache.hits, tx_cache.misses);
+    printf("| Validated Blocks: %-8d cached, %-10" PRIu64 " hits, %-10" PRIu64 " misses        |\n",
+           block_cache.entries, block_cache.hits, block_cache.misses);
+    printf("| Interned Addresses: %-10d (%d-byte ids)                                |\n",
+           address_count(), ADDRESS_ID_SIZE);
     printf("+==============================================================================+\n");
 }
 
@@ -696,7 +968,7 @@ void handle_sync_blockchain(AppState *app) {
     }
     
     printf("| Current blockchain size: %-10d blocks                               |\n", 
-           app->blockchain_size);
+           app->chain.size);
     printf("| Connected peers: %-10d                                              |\n", 
            app->network.peer_count);
     printf("+==============================================================================+\n");
@@ -714,6 +986,31 @@ void handle_sync_blockchain(AppState *app) {
     printf("and merge any longer valid chains received from the network.\n");
 }
 
+// Progress line for exports and imports, redrawn when the percentage moves
+static void print_transfer_progress(void *context, int done, int total) {
+    int *last_percent = (int *)context;
+    int percent = (total > 0) ? (int)((int64_t)done * 100 / total) : 100;
+    if (percent == *last_percent) return;
+    
+    *last_percent = percent;
+    printf("\r  Progress: %d/%d blocks (%d%%)", done, total, percent);
+    if (done == total) printf("\n");
+    fflush(stdout);
+}
+
+static void read_transfer_path(char *path, size_t size) {
+    printf("Enter blockchain file path (or press Enter for %s): ", EXPORT_FILE);
+    strcpy(path, EXPORT_FILE);
+    
+    char input[256];
+    if (fgets(input, sizeof(input), stdin) != NULL) {
+        input[strcspn(input, "\n")] = 0;
+        if (strlen(input) > 0) {
+            snprintf(path, size, "%s", input);
+        }
+    }
+}
+
 void handle_export_blockchain(AppState *app) {
     if (app == NULL) return;
     
@@ -721,10 +1018,14 @@ void handle_export_blockchain(AppState *app) {
     printf("|                          EXPORT BLOCKCHAIN                                  |\n");
     printf("+==============================================================================+\n");
     
-    if (save_blockchain(app)) {
-        printf("| Blockchain exported successfully to: %-38s |\n", app->blockchain_file);
+    char filename[256];
+    read_transfer_path(filename, sizeof(filename));
+    
+    int last_percent = -1;
+    if (export_chain_file(filename, &app->chain, app->chain_codec, print_transfer_progress, &last_percent)) {
+        printf("| Blockchain exported successfully to: %-38s |\n", filename);
         printf("| Blocks exported: %-10d                                           |\n", 
-               app->blockchain_size);
+               app->chain.size);
     } else {
         printf("| Failed to export blockchain                                                 |\n");
     }
@@ -738,22 +1039,48 @@ void handle_import_blockchain(AppState *app) {
     printf("|                          IMPORT BLOCKCHAIN                                  |\n");
     printf("+==============================================================================+\n");
     
-    printf("Enter blockchain file path (or press Enter for default): ");
     char filename[256];
-    if (fgets(filename, sizeof(filename), stdin) != NULL) {
-        filename[strcspn(filename, "\n")] = 0;
-        if (strlen(filename) > 0) {
-            strcpy(app->blockchain_file, filename);
+    read_transfer_path(filename, sizeof(filename));
+    
+    // A pruned node cannot rebuild balances from below its latest snapshot
+    int min_fork = (app->chain.pruned_height > 0) ? app->state.snapshot_height : 0;
+    int old_size = app->chain.size;
+    int last_percent = -1;
+    ChainImportResult result;
+    bool ok = import_chain_file(filename, &app->chain, &app->state, min_fork, print_transfer_progress,
+                                &last_percent, &result);
+    
+    if (ok || result.imported > 0) {
+        printf("| Blockchain imported from: %-50s |\n", filename);
+        printf("| Blocks imported: %-10d                                           |\n", 
+               result.imported);
+        if (result.reorganized) {
+            printf("| Switched to the heavier branch from block %-10d                         |\n",
+                   result.fork_height);
+        } else if (result.fork_height < old_size && result.imported == 0) {
+            printf("| Kept the current chain over the file's branch from block %-10d          |\n",
+                   result.fork_height);
+        }
+        if (result.invalid_height >= 0) {
+            printf("| Warning: block %-10d in the file failed validation                     |\n",
+                   result.invalid_height);
+        }
+        
+        // Blocks above the fork are journaled again on the next save
+        if (app->journal_height > result.fork_height) {
+            app->journal_height = result.fork_height;
+        }
+        for (int height = result.fork_height; height < app->chain.size; height++) {
+            mempool_remove_block(&app->mempool, chain_block(&app->chain, height));
         }
+        
+        // Before refreshing, which may prune bodies the rescan reads
+        rescan_app_wallet(app);
+        refresh_chain_state(app);
+        save_app_state(app);
     }
-    
-    int old_size = app->blockchain_size;
-    if (load_blockchain(app)) {
-        printf("| Blockchain imported successfully from: %-36s |\n", app->blockchain_file);
-        printf("| Blocks imported: %-10d                                           |\n", 
-               app->blockchain_size - old_size);
-    } else {
-        printf("| Failed to import blockchain from: %-40s |\n", app->blockchain_file);
+    if (!ok) {
+        printf("| Failed to import blockchain from: %-40s |\n", filename);
     }
     printf("+==============================================================================+\n");
 }
@@ -785,8 +1112,9 @@ void handle_create_wallet(AppState *app) {
             
             switch (choice) {
                 case 1:
+                    cleanup_wallet(&app->miner_wallet);
                     app->miner_wallet = new_wallet;
-                    save_wallet(&app->miner_wallet, app->wallet_file);
+                    save_app_state(app);
                     printf("Current wallet replaced and saved\n");
                     break;
                 case 2: {
@@ -833,6 +1161,7 @@ void handle_load_wallet(AppState *app) {
     }
     
     Wallet loaded_wallet;
+    memset(&loaded_wallet, 0, sizeof(Wallet));
     if (load_wallet(&loaded_wallet, filename)) {
         printf("| Wallet loaded successfully from: %-41s |\n", filename);
         printf("| Address: %-62s |\n", loaded_wallet.address);
@@ -847,100 +1176,508 @@ void handle_load_wallet(AppState *app) {
         char input[10];
         if (fgets(input, sizeof(input), stdin) != NULL) {
             if (tolower(input[0]) == 'y') {
+                cleanup_wallet(&app->miner_wallet);
                 app->miner_wallet = loaded_wallet;
+                memset(&loaded_wallet, 0, sizeof(Wallet));
                 strcpy(app->wallet_file, filename);
                 printf("Wallet replaced successfully\n");
+                rescan_app_wallet(app);
+                save_app_state(app);
             }
         }
+        cleanup_wallet(&loaded_wallet);
     } else {
         printf("| Failed to load wallet from: %-46s |\n", filename);
         printf("+==============================================================================+\n");
     }
 }
 
+// Keeps the keystore's copy of the current wallet up to date, if it has one
+static void sync_keystore_wallet(AppState *app) {
+    if (app->keystore.file != NULL && keystore_find(&app->keystore, app->miner_wallet.address) >= 0 &&
+        !keystore_save(&app->keystore, &app->miner_wallet)) {
+        printf("Warning: could not update wallet %s in the keystore\n", app->miner_wallet.address);
+    }
+}
+
+static bool open_app_keystore(AppState *app) {
+    if (app->keystore.file != NULL) return true;
+    
+    if (!keystore_open(&app->keystore, app->config.keystore_file)) {
+        printf("| Failed to open keystore: %-51s |\n", app->config.keystore_file);
+        return false;
+    }
+    if (app->keystore.recovered) {
+        printf("| Keystore index rebuilt after an interrupted save                            |\n");
+    }
+    return true;
+}
+
+static void switch_to_stored_wallet(AppState *app, int index) {
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    if (!keystore_load(&app->keystore, app->keystore.entries[index].address, &loaded)) {
+        printf("Failed to load wallet %s from the keystore\n", app->keystore.entries[index].address);
+        return;
+    }
+    
+    // The wallet being left keeps its latest history in the keystore
+    sync_keystore_wallet(app);
+    cleanup_wallet(&app->miner_wallet);
+    app->miner_wallet = loaded;
+    printf("Switched to wallet %s\n", app->miner_wallet.address);
+    rescan_app_wallet(app);
+    save_app_state(app);
+}
+
+void handle_keystore(AppState *app) {
+    if (app == NULL) return;
+    
+    printf("\n+==============================================================================+\n");
+    printf("|                            WALLET KEYSTORE                                  |\n");
+    printf("+==============================================================================+\n");
+    if (!open_app_keystore(app)) {
+        printf("+==============================================================================+\n");
+        return;
+    }
+    
+    // Listed from the index alone; no wallet is read
+    printf("| Keystore: %-66s |\n", app->config.keystore_file);
+    printf("| Stored Wallets: %-60d |\n", app->keystore.count);
+    for (int i = 0; i < app->keystore.count; i++) {
+        const KeystoreEntry *entry = &app->keystore.entries[i];
+        char current = (strcmp(entry->address, app->miner_wallet.address) == 0) ? '*' : ' ';
+        printf("| %c%4d. %-54s %10d txs |\n", current, i + 1, entry->address, entry->transaction_count);
+    }
+    printf("+==============================================================================+\n");
+    
+    printf("\n1. Add current wallet to the keystore\n");
+    printf("2. Switch to a stored wallet\n");
+    printf("3. Import a wallet file into the keystore\n");
+    printf("0. Back\n");
+    printf("Enter choice (0-3): ");
+    
+    char input[256];
+    int choice = 0;
+    if (fgets(input, sizeof(input), stdin) == NULL || sscanf(input, "%d", &choice) != 1) return;
+    
+    switch (choice) {
+        case 1:
+            if (keystore_save(&app->keystore, &app->miner_wallet)) {
+                printf("Wallet %s stored with %d transactions\n", app->miner_wallet.address,
+                       app->miner_wallet.transaction_count);
+            } else {
+                printf("Failed to store the current wallet\n");
+            }
+            break;
+        case 2: {
+            printf("Enter wallet number or address: ");
+            if (fgets(input, sizeof(input), stdin) == NULL) break;
+            input[strcspn(input, "\n")] = 0;
+            
+            int index = keystore_find(&app->keystore, input);
+            int number;
+            if (index < 0 && sscanf(input, "%d", &number) == 1 && number >= 1 && number <= app->keystore.count) {
+                index = number - 1;
+            }
+            if (index < 0) {
+                printf("No such wallet in the keystore\n");
+            } else if (strcmp(app->keystore.entries[index].address, app->miner_wallet.address) == 0) {
+                printf("Wallet %s is already the current wallet\n", app->miner_wallet.address);
+            } else {
+                switch_to_stored_wallet(app, index);
+            }
+            break;
+        }
+        case 3: {
+            printf("Enter wallet file path: ");
+            if (fgets(input, sizeof(input), stdin) == NULL) break;
+            input[strcspn(input, "\n")] = 0;
+            
+            Wallet imported;
+            memset(&imported, 0, sizeof(Wallet));
+            if (!load_wallet(&imported, input)) {
+                printf("Failed to load wallet from: %s\n", input);
+            } else if (keystore_save(&app->keystore, &imported)) {
+                printf("Wallet %s stored with %d transactions\n", imported.address, imported.transaction_count);
+            } else {
+                printf("Failed to store wallet %s\n", imported.address);
+            }
+            cleanup_wallet(&imported);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 // File I/O functions
 bool save_blockchain(const AppState *app) {
-    if (app == NULL || app->blockchain == NULL) return false;
+    if (app == NULL) return false;
     
-    FILE *file = fopen(app->blockchain_file, "wb");
-    if (file == NULL) return false;
+    return save_chain_file(app->blockchain_file, &app->chain, app->chain_codec);
+}
+
+// Only the part of the chain the account state can follow is kept: the
+// replay stops at a block that overspends or repeats a mined transfer, and
+// at one it cannot apply at all (a pruned body no snapshot covers, or
+// memory running out), so the state never trails the tip
+static void trim_chain_to_state(AppState *app) {
+    if (sync_chain_state(&app->state, &app->chain, app->config.snapshot_file,
+                         app->config.snapshot_interval) >= 0) {
+        return;
+    }
     
-    // Write blockchain size
-    fwrite(&app->blockchain_size, sizeof(int), 1, file);
+    int rejected = app->state.height;
+    const Block *block = chain_block(&app->chain, rejected);
+    if (!block->pruned && !state_check_block(&app->state, block)) {
+        printf("Warning: block %d failed the balance check, keeping the %d blocks before it\n",
+               rejected, rejected);
+    } else {
+        printf("Warning: block %d could not be applied to the chain state, keeping the %d blocks before it\n",
+               rejected, rejected);
+    }
+    chain_truncate(&app->chain, rejected);
+}
+
+bool load_blockchain(AppState *app) {
+    if (app == NULL) return false;
+    
+    // Blocks already in memory are kept, the rest of the file is appended
+    int old_size = chain_size(&app->chain);
+    if (!load_chain_file(app->blockchain_file, &app->chain)) return false;
     
-    // Write each block (without Pi digits to save space)
-    for (int i = 0; i < app->blockchain_size; i++) {
-        Block block_copy = app->blockchain[i];
-        // Don't save Pi digits to reduce file size
-        block_copy.pi_digits = NULL;
-        fwrite(&block_copy, sizeof(Block), 1, file);
+    // Only the valid prefix of what was read is kept
+    int invalid = chain_validate(&app->chain, old_size);
+    if (invalid >= 0) {
+        printf("Warning: block %d failed validation, keeping the %d blocks before it\n",
+               invalid, invalid);
+        chain_truncate(&app->chain, invalid);
     }
     
-    fclose(file);
+    trim_chain_to_state(app);
     return true;
 }
 
-bool load_blockchain(AppState *app) {
+bool save_wallet(const Wallet *wallet, const char *filename) {
+    if (wallet == NULL || filename == NULL) return false;
+    
+    return save_wallet_file(filename, wallet);
+}
+
+bool load_wallet(Wallet *wallet, const char *filename) {
+    if (wallet == NULL || filename == NULL) return false;
+    
+    // The history is read into a new wallet, the current one is replaced
+    Wallet loaded;
+    if (!load_wallet_file(filename, &loaded)) return false;
+    
+    cleanup_wallet(wallet);
+    *wallet = loaded;
+    return true;
+}
+
+// Journal records. Saves append the blocks and wallet changes made since
+// the last save as one committed group; the chain and wallet files are
+// only rewritten at checkpoints.
+#define JOURNAL_CHECKPOINT_SIZE (4L * 1024 * 1024)
+#define JOURNAL_WALLET_HEADER_SIZE (WALLET_ADDRESS_LENGTH + PRIVATE_KEY_LENGTH + 16)
+
+static uint32_t wallet_key(const Wallet *wallet) {
+    return fast_hash(wallet->address, WALLET_ADDRESS_LENGTH) ^
+           (fast_hash(wallet->private_key, PRIVATE_KEY_LENGTH) * 31);
+}
+
+static bool journal_blocks(AppState *app) {
+    for (int height = app->journal_height; height < app->chain.size; height++) {
+        uint8_t *record;
+        size_t size;
+        if (!encode_block_record(chain_block(&app->chain, height), &record, &size)) return false;
+        
+        MemoryPool *scratch = thread_scratch_pool();
+        PoolMark mark = memory_pool_mark(scratch);
+        uint8_t *payload = allocate_from_pool(scratch, sizeof(int32_t) + size);
+        if (payload == NULL) {
+            free(record);
+            return false;
+        }
+        int32_t h = height;
+        memcpy(payload, &h, sizeof(h));
+        memcpy(payload + sizeof(h), record, size);
+        
+        bool ok = journal_append(&app->journal, JOURNAL_BLOCK, payload, (uint32_t)(sizeof(h) + size));
+        reset_memory_pool_to(scratch, mark);
+        free(record);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Only transactions added since the last save are written, unless the
+// wallet was replaced
+static bool journal_wallet(AppState *app) {
+    const Wallet *wallet = &app->miner_wallet;
+    uint32_t key = wallet_key(wallet);
+    if (key == app->journal_wallet_key && wallet->balance == app->journal_wallet_balance &&
+        wallet->transaction_count == app->journal_wallet_count) {
+        return true;
+    }
+    
+    int32_t first = 0;
+    if (key == app->journal_wallet_key && wallet->transaction_count >= app->journal_wallet_count) {
+        first = app->journal_wallet_count;
+    }
+    int32_t count = wallet->transaction_count - first;
+    
+    size_t size = JOURNAL_WALLET_HEADER_SIZE + count * sizeof(WireTransaction);
+    uint8_t *payload = malloc(size);
+    if (payload == NULL) return false;
+    
+    uint8_t *p = payload;
+    memcpy(p, wallet->address, WALLET_ADDRESS_LENGTH);
+    p += WALLET_ADDRESS_LENGTH;
+    memcpy(p, wallet->private_key, PRIVATE_KEY_LENGTH);
+    p += PRIVATE_KEY_LENGTH;
+    memcpy(p, &wallet->balance, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    memcpy(p, &first, sizeof(first));
+    p += sizeof(first);
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+    for (int i = 0; i < count; i++) {
+        WireTransaction wire;
+        transaction_to_wire(wallet->transactions[first + i], &wire);
+        memcpy(p + i * sizeof(WireTransaction), &wire, sizeof(WireTransaction));
+    }
+    
+    bool ok = journal_append(&app->journal, JOURNAL_WALLET, payload, (uint32_t)size);
+    free(payload);
+    return ok;
+}
+
+static void mark_journaled(AppState *app) {
+    app->journal_height = app->chain.size;
+    app->journal_wallet_count = app->miner_wallet.transaction_count;
+    app->journal_wallet_balance = app->miner_wallet.balance;
+    app->journal_wallet_key = wallet_key(&app->miner_wallet);
+}
+
+static bool write_journal_group(AppState *app) {
+    if (app->journal_height > app->chain.size) {
+        app->journal_height = app->chain.size;
+    }
+    
+    if (!journal_blocks(app) || !journal_wallet(app) || !journal_commit(&app->journal)) {
+        journal_abort(&app->journal);
+        return false;
+    }
+    
+    mark_journaled(app);
+    return true;
+}
+
+bool save_app_state(AppState *app) {
     if (app == NULL) return false;
     
-    FILE *file = fopen(app->blockchain_file, "rb");
-    if (file == NULL) return false;
+    // Without a journal every save is a full checkpoint
+    if (app->journal.file == NULL && (app->journal_file[0] == '\0' || !recover_app_state(app))) {
+        return checkpoint_app_state(app);
+    }
+    
+    if (!write_journal_group(app)) return false;
+    sync_keystore_wallet(app);
     
-    int saved_size;
-    if (fread(&saved_size, sizeof(int), 1, file) != 1) {
-        fclose(file);
+    if (app->journal.size > JOURNAL_CHECKPOINT_SIZE) {
+        return checkpoint_app_state(app);
+    }
+    return true;
+}
+
+bool checkpoint_app_state(AppState *app) {
+    if (app == NULL) return false;
+    
+    // Journal first: a crash between the two file rewrites is then
+    // repaired by replaying the journal on the next start
+    if (app->journal.file != NULL && !write_journal_group(app)) return false;
+    
+    if (!save_blockchain(app) || !save_wallet(&app->miner_wallet, app->wallet_file)) {
         return false;
     }
+    sync_keystore_wallet(app);
     
-    // Expand blockchain capacity if needed
-    if (saved_size > app->blockchain_capacity) {
-        app->blockchain_capacity = saved_size * 2;
-        Block *temp = realloc(app->blockchain, app->blockchain_capacity * sizeof(Block));
-        if (temp == NULL) {
-            fclose(file);
-            return false;
-        }
-        app->blockchain = temp;
+    return app->journal.file == NULL || journal_reset(&app->journal);
+}
+
+// A replayed block passes the checks a loaded one did: it has to extend
+// the block below it, and the account state, kept in step with the replay,
+// has to accept it. Where a pruned body leaves the state behind, the trim
+// after the replay checks the rest.
+static bool append_journaled_block(AppState *app, int height, Block *block) {
+    if (height > app->chain.size) return false;
+    
+    // Already in the chain file when a checkpoint was interrupted
+    if (height < app->chain.size && chain_block(&app->chain, height)->hash == block->hash) {
+        cleanup_block(block);
+        return true;
     }
     
-    // Read blocks
-    for (int i = app->blockchain_size; i < saved_size; i++) {
-        if (fread(&app->blockchain[i], sizeof(Block), 1, file) != 1) {
-            fclose(file);
-            return false;
+    const Block *prev = (height > 0) ? chain_block(&app->chain, height - 1) : NULL;
+    if (!validate_block(block, prev)) return false;
+    
+    // A journaled fork replaces the blocks above it; the state steps back
+    // with the chain
+    if (height < app->chain.size) {
+        while (app->state.height > height &&
+               state_revert_block(&app->state, chain_block(&app->chain, app->state.height - 1))) {
         }
-        // Pi digits are not saved/loaded to save space
-        app->blockchain[i].pi_digits = NULL;
-        app->blockchain[i].pi_digits_count = 0;
+        chain_truncate(&app->chain, height);
     }
     
-    app->blockchain_size = saved_size;
-    fclose(file);
+    bool in_step = app->state.height == height && (height == 0 || app->state.tip_hash == prev->hash);
+    if (in_step && !block->pruned && !state_check_block(&app->state, block)) return false;
+    if (!chain_append(&app->chain, block)) return false;
+    if (in_step && !block->pruned) state_apply_block(&app->state, chain_tip(&app->chain));
     return true;
 }
 
-bool save_wallet(const Wallet *wallet, const char *filename) {
-    if (wallet == NULL || filename == NULL) return false;
+static bool apply_wallet_record(Wallet *wallet, const uint8_t *data, uint32_t size) {
+    if (size < JOURNAL_WALLET_HEADER_SIZE) return false;
+    
+    int32_t first, count;
+    const uint8_t *p = data + WALLET_ADDRESS_LENGTH + PRIVATE_KEY_LENGTH + sizeof(uint64_t);
+    memcpy(&first, p, sizeof(first));
+    memcpy(&count, p + sizeof(first), sizeof(count));
+    if (first < 0 || count < 0 || first > wallet->transaction_count ||
+        size != JOURNAL_WALLET_HEADER_SIZE + count * sizeof(WireTransaction) ||
+        !reserve_wallet_transactions(wallet, first + count)) {
+        return false;
+    }
     
-    FILE *file = fopen(filename, "wb");
-    if (file == NULL) return false;
+    // The record's transactions replace the history from first on; the
+    // balance is the one recorded, not what adding them works out
+    while (wallet->transaction_count > first) {
+        tx_release(wallet->transactions[--wallet->transaction_count]);
+    }
+    memcpy(wallet->address, data, WALLET_ADDRESS_LENGTH);
+    memcpy(wallet->private_key, data + WALLET_ADDRESS_LENGTH, PRIVATE_KEY_LENGTH);
+    for (int i = 0; i < count; i++) {
+        WireTransaction wire;
+        Transaction tx;
+        memcpy(&wire, data + JOURNAL_WALLET_HEADER_SIZE + i * sizeof(WireTransaction), sizeof(WireTransaction));
+        if (!transaction_from_wire(&tx, &wire) || !add_transaction_to_wallet(wallet, &tx)) return false;
+    }
+    memcpy(&wallet->balance, data + WALLET_ADDRESS_LENGTH + PRIVATE_KEY_LENGTH, sizeof(uint64_t));
+    return true;
+}
+
+static bool apply_journal_record(void *context, uint8_t type, const uint8_t *data, uint32_t size) {
+    AppState *app = (AppState *)context;
+    
+    switch (type) {
+        case JOURNAL_BLOCK: {
+            int32_t height;
+            Block block;
+            if (size < sizeof(height)) return false;
+            memcpy(&height, data, sizeof(height));
+            if (!decode_block_record(data + sizeof(height), size - sizeof(height), &block)) return false;
+            if (!append_journaled_block(app, height, &block)) {
+                cleanup_block(&block);
+                return false;
+            }
+            return true;
+        }
+        case JOURNAL_WALLET:
+            return apply_wallet_record(&app->miner_wallet, data, size);
+        default:
+            return false;
+    }
+}
+
+bool recover_app_state(AppState *app) {
+    if (app == NULL) return false;
     
-    fwrite(wallet, sizeof(Wallet), 1, file);
-    fclose(file);
+    if (app->journal.file == NULL && !journal_open(&app->journal, app->journal_file)) {
+        return false;
+    }
+    
+    int groups = journal_replay(&app->journal, apply_journal_record, app);
+    if (groups < 0) {
+        printf("Warning: journal replay stopped at a damaged or invalid record\n");
+    } else if (groups > 0) {
+        printf("Recovered %d journaled save(s)\n", groups);
+    }
+    
+    // Nothing the state rejects reaches the main files
+    if (groups != 0) trim_chain_to_state(app);
+    mark_journaled(app);
+    
+    // Fold recovered changes into the main files and start a fresh journal
+    if (groups != 0) {
+        return checkpoint_app_state(app);
+    }
     return true;
 }
 
-bool load_wallet(Wallet *wallet, const char *filename) {
-    if (wallet == NULL || filename == NULL) return false;
+bool refresh_chain_state(AppState *app) {
+    if (app == NULL) return false;
     
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL) return false;
+    int applied = sync_chain_state(&app->state, &app->chain, app->config.snapshot_file,
+                                   app->config.snapshot_interval);
+    if (applied < 0) {
+        printf("Warning: chain state could not be rebuilt\n");
+        return false;
+    }
     
-    if (fread(wallet, sizeof(Wallet), 1, file) != 1) {
-        fclose(file);
+    // Single blocks come from mining; report anything larger
+    if (applied > 1) {
+        printf("Chain state: replayed %d blocks from height %d\n", applied, app->state.height - applied);
+    }
+    
+    // Bodies are only dropped below the latest snapshot, so a restart can
+    // still rebuild the state from the blocks that follow it
+    int keep_from = chain_prune_height(&app->chain, app->config.prune_keep_blocks,
+                                       (size_t)app->config.prune_budget_mb * 1024 * 1024);
+    if (keep_from > app->state.snapshot_height) {
+        keep_from = app->state.snapshot_height;
+    }
+    int pruned = chain_prune_bodies(&app->chain, keep_from);
+    if (pruned > 1) {
+        printf("Pruning: dropped %d block bodies below height %d\n", pruned, app->chain.pruned_height);
+    }
+    set_node_services(&app->network, app->chain.pruned_height);
+    return true;
+}
+
+static bool transfer_pending(void *context, const Transaction *tx) {
+    return mempool_contains(context, tx);
+}
+
+bool rescan_app_wallet(AppState *app) {
+    if (app == NULL) return false;
+    
+    RescanWatermark mark;
+    RescanResult result;
+    load_rescan_watermark(app->config.rescan_file, app->miner_wallet.address, &mark);
+    if (!rescan_wallet(&app->miner_wallet, &app->chain, &mark, transfer_pending, &app->mempool, &result)) {
+        if (app->chain.pruned_height > 0) {
+            printf("Warning: wallet history could not be rescanned (blocks below %d are pruned)\n",
+                   app->chain.pruned_height);
+        } else {
+            printf("Warning: wallet history could not be rescanned\n");
+        }
         return false;
     }
     
-    fclose(file);
+    // Entries already journaled may have been replaced, so the next save
+    // journals the whole history
+    app->journal_wallet_key = ~wallet_key(&app->miner_wallet);
+    if (result.resumed) {
+        printf("Wallet rescan: %d new blocks scanned, %d transactions found\n", result.scanned, result.found);
+    } else {
+        printf("Wallet rescan: all %d blocks scanned, %d transactions found\n", result.scanned, result.found);
+    }
+    if (!save_rescan_watermark(app->config.rescan_file, &mark)) {
+        printf("Warning: could not save the rescan watermark to %s\n", app->config.rescan_file);
+    }
     return true;
 }
@@ -2,9 +2,19 @@
 #define MENU_H
 
 #include "block.h"
+#include "chain.h"
 #include "wallet.h"
 #include "network.h"
 #include "performance.h"
+#include "journal.h"
+#include "config.h"
+#include "state.h"
+#include "mempool.h"
+#include "blocktemplate.h"
+#include "keystore.h"
+
+// Default file for blockchain exports and imports
+#define EXPORT_FILE "archimed_export.dat"
 
 // Menu options
 typedef enum {
@@ -20,23 +30,36 @@ typedef enum {
     MENU_EXPORT_BLOCKCHAIN,
     MENU_IMPORT_BLOCKCHAIN,
     MENU_CREATE_WALLET,
-    MENU_LOAD_WALLET
+    MENU_LOAD_WALLET,
+    MENU_BATCH_PAYOUT,
+    MENU_KEYSTORE
 } MenuOption;
 
 // Application state
 typedef struct {
-    Block *blockchain;
-    int blockchain_size;
-    int blockchain_capacity;
+    Chain chain;
     Wallet miner_wallet;
     RewardSystem reward_system;
     NetworkManager network;
     PerformanceMetrics performance;
-    MemoryPool memory_pool;
     bool network_enabled;
     bool performance_monitoring;
     char blockchain_file[256];
     char wallet_file[256];
+    char journal_file[256];
+    int chain_codec;            // Codec for chain file frames (see compress.h)
+    NodeConfig config;
+    ChainState state;           // Balances derived from the chain
+    Mempool mempool;            // Transfers waiting for a block
+    BlockTemplate block_template;  // Next block, kept in step with the mempool
+    Keystore keystore;          // Opened on first use
+    
+    // Write-ahead journal and what has already been written to it
+    Journal journal;
+    int journal_height;              // Blocks below this are in the chain file or journal
+    int journal_wallet_count;        // Wallet transactions already journaled
+    uint64_t journal_wallet_balance;
+    uint32_t journal_wallet_key;     // Hash of the journaled wallet's address and key
 } AppState;
 
 // Function declarations
@@ -57,6 +80,8 @@ void handle_export_blockchain(AppState *app);
 void handle_import_blockchain(AppState *app);
 void handle_create_wallet(AppState *app);
 void handle_load_wallet(AppState *app);
+void handle_batch_payout(AppState *app);
+void handle_keystore(AppState *app);
 
 // Utility functions
 bool init_app_state(AppState *app);
@@ -64,6 +89,15 @@ void cleanup_app_state(AppState *app);
 bool save_blockchain(const AppState *app);
 bool load_blockchain(AppState *app);
 bool save_wallet(const Wallet *wallet, const char *filename);
+bool save_app_state(AppState *app);        // Journal new blocks and wallet changes, then commit
+bool checkpoint_app_state(AppState *app);  // Rewrite chain and wallet files, empty the journal
+bool recover_app_state(AppState *app);     // Replay the journal after loading the files
+bool refresh_chain_state(AppState *app);   // Catch the balance state up with the chain
+bool rescan_app_wallet(AppState *app);     // Rebuild the wallet's history from the chain (see rescan.h)
+// Signs the transfers from the app's wallet, queues all of them or none,
+// and records them in the wallet with one save; *rejected as for
+// mempool_add_batch (-1 also when the wallet cannot sign)
+MempoolResult submit_transfer_batch(AppState *app, const TransferRequest *requests, int count, int *rejected);
 bool load_wallet(Wallet *wallet, const char *filename);
 void print_app_banner(void);
 
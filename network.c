@@ -21,6 +21,7 @@ bool init_network(NetworkManager *nm, int port) {
     nm->port = port;
     nm->running = false;
     nm->peer_count = 0;
+    set_node_services(nm, 0);
     
 #ifdef _WIN32
     WSADATA wsaData;
@@ -227,3 +228,44 @@ void discover_peers(NetworkManager *nm) {
     if (nm->port != 8334) add_peer(nm, "127.0.0.1", 8334);
     if (nm->port != 8335) add_peer(nm, "127.0.0.1", 8335);
 }
+
+void set_node_services(NetworkManager *nm, int pruned_height) {
+    if (nm == NULL) return;
+    
+    nm->services = (pruned_height > 0) ? NODE_SERVICE_PRUNED : NODE_SERVICE_FULL_BLOCKS;
+    nm->serve_from_height = pruned_height;
+}
+
+void build_handshake_message(const NetworkManager *nm, int chain_height, NetworkMessage *msg) {
+    if (nm == NULL || msg == NULL) return;
+    
+    int32_t height = chain_height;
+    int32_t serve_from = nm->serve_from_height;
+    memset(msg, 0, sizeof(NetworkMessage));
+    msg->type = MSG_HANDSHAKE;
+    memcpy(msg->data, &nm->services, 4);
+    memcpy(msg->data + 4, &height, 4);
+    memcpy(msg->data + 8, &serve_from, 4);
+    msg->length = 12;
+}
+
+bool parse_handshake_message(const NetworkMessage *msg, Peer *peer, int *chain_height) {
+    if (msg == NULL || peer == NULL || msg->type != MSG_HANDSHAKE || msg->length < 12) {
+        return false;
+    }
+    
+    int32_t height, serve_from;
+    memcpy(&peer->services, msg->data, 4);
+    memcpy(&height, msg->data + 4, 4);
+    memcpy(&serve_from, msg->data + 8, 4);
+    peer->serve_from_height = (peer->services & NODE_SERVICE_PRUNED) ? serve_from : 0;
+    if (chain_height != NULL) *chain_height = height;
+    return true;
+}
+
+bool peer_can_serve(const Peer *peer, int height) {
+    if (peer == NULL) return false;
+    
+    if (peer->services & NODE_SERVICE_FULL_BLOCKS) return true;
+    return (peer->services & NODE_SERVICE_PRUNED) && height >= peer->serve_from_height;
+}
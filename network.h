@@ -10,6 +10,10 @@
 #define BUFFER_SIZE 4096
 #define MAX_MESSAGE_SIZE 1024
 
+// Service flags advertised in the handshake
+#define NODE_SERVICE_FULL_BLOCKS 0x1  // Serves the body of every block
+#define NODE_SERVICE_PRUNED 0x2       // Serves bodies from serve_from_height up
+
 // Network message types
 typedef enum {
     MSG_HANDSHAKE = 1,
@@ -37,6 +41,8 @@ typedef struct {
     int socket;
     bool connected;
     time_t last_seen;
+    uint32_t services;      // From the peer's handshake
+    int serve_from_height;
 } Peer;
 
 // Network manager
@@ -46,6 +52,8 @@ typedef struct {
     int server_socket;
     bool running;
     int port;
+    uint32_t services;      // Advertised to peers
+    int serve_from_height;  // Lowest height whose body this node still has
 } NetworkManager;
 
 // Function declarations
@@ -59,4 +67,10 @@ void handle_incoming_connections(NetworkManager *nm);
 void process_peer_messages(NetworkManager *nm);
 void discover_peers(NetworkManager *nm);
 
+// Handshake payload: services, chain height and the servable block range
+void set_node_services(NetworkManager *nm, int pruned_height);
+void build_handshake_message(const NetworkManager *nm, int chain_height, NetworkMessage *msg);
+bool parse_handshake_message(const NetworkMessage *msg, Peer *peer, int *chain_height);
+bool peer_can_serve(const Peer *peer, int height);
+
 #endif
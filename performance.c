@@ -1,9 +1,21 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS and madvise under strict C17
+#endif
+
 #include "performance.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 // Initialize performance metrics
 void init_performance_metrics(PerformanceMetrics *pm) {
     if (pm == NULL) return;
@@ -48,17 +60,181 @@ void print_performance_report(const PerformanceMetrics *pm) {
     printf("+==============================================================================+\n");
 }
 
+// Large buffers start with this header; the mapping is released from it
+#define LARGE_BUFFER_HEADER 64
+
+enum {
+    BACKING_HEAP,
+    BACKING_EXPLICIT_HUGE,
+    BACKING_TRANSPARENT_HUGE,
+    BACKING_REGULAR
+};
+
+typedef struct {
+    size_t mapped_size;
+    int backing;
+} LargeBufferHeader;
+
+static volatile int large_pages_off = 0;
+static volatile int explicit_huge_count = 0;
+static volatile int transparent_huge_count = 0;
+static volatile int regular_count = 0;
+
+void set_large_pages_enabled(bool enabled) {
+    atomic_store_int(&large_pages_off, enabled ? 0 : 1);
+}
+
+bool large_pages_enabled(void) {
+    return atomic_load_int(&large_pages_off) == 0;
+}
+
+static size_t round_up(size_t size, size_t unit) {
+    return (size + unit - 1) / unit * unit;
+}
+
+// Maps size bytes, preferring huge pages; NULL when mapping fails
+static void *map_large_buffer(size_t size, int *backing) {
+    bool huge = large_pages_enabled();
+#ifdef _WIN32
+    SIZE_T large_page = GetLargePageMinimum();
+    if (huge && large_page > 0) {
+        void *buffer = VirtualAlloc(NULL, round_up(size, large_page),
+                                    MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (buffer != NULL) {
+            *backing = BACKING_EXPLICIT_HUGE;
+            return buffer;
+        }
+    }
+    *backing = BACKING_REGULAR;
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+#ifdef MAP_HUGETLB
+    // Only succeeds when huge pages have been reserved for the system
+    if (huge) {
+        void *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer != MAP_FAILED) {
+            *backing = BACKING_EXPLICIT_HUGE;
+            return buffer;
+        }
+    }
+#endif
+    // Over-map so the buffer can start on a huge page boundary
+    size_t span = size + HUGE_PAGE_SIZE;
+    char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    
+    char *buffer = (char *)round_up((size_t)(uintptr_t)raw, HUGE_PAGE_SIZE);
+    if (buffer > raw) munmap(raw, (size_t)(buffer - raw));
+    if (raw + span > buffer + size) munmap(buffer + size, (size_t)(raw + span - (buffer + size)));
+    
+    *backing = BACKING_REGULAR;
+#ifdef MADV_HUGEPAGE
+    if (huge && madvise(buffer, size, MADV_HUGEPAGE) == 0) {
+        *backing = BACKING_TRANSPARENT_HUGE;
+    } else if (!huge) {
+        madvise(buffer, size, MADV_NOHUGEPAGE);
+    }
+#endif
+    return buffer;
+#endif
+}
+
+static void unmap_large_buffer(void *buffer, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+    munmap(buffer, size);
+#endif
+}
+
+void *large_buffer_alloc(size_t size) {
+    if (size < LARGE_BUFFER_THRESHOLD) return calloc(size, 1);
+    
+    // Whole huge pages, so the tail does not share a page with anything
+    size_t mapped = round_up(size + LARGE_BUFFER_HEADER, HUGE_PAGE_SIZE);
+    int backing;
+    char *base = map_large_buffer(mapped, &backing);
+    if (base == NULL) {
+        // Mapped memory is scarce; the heap may still have room
+        base = calloc(size + LARGE_BUFFER_HEADER, 1);
+        if (base == NULL) return NULL;
+        backing = BACKING_HEAP;
+    }
+    
+    LargeBufferHeader *header = (LargeBufferHeader *)base;
+    header->mapped_size = mapped;
+    header->backing = backing;
+    switch (backing) {
+        case BACKING_EXPLICIT_HUGE: atomic_add_int(&explicit_huge_count, 1); break;
+        case BACKING_TRANSPARENT_HUGE: atomic_add_int(&transparent_huge_count, 1); break;
+        default: atomic_add_int(&regular_count, 1); break;
+    }
+    return base + LARGE_BUFFER_HEADER;
+}
+
+void large_buffer_free(void *buffer, size_t size) {
+    if (buffer == NULL) return;
+    if (size < LARGE_BUFFER_THRESHOLD) {
+        free(buffer);
+        return;
+    }
+    
+    char *base = (char *)buffer - LARGE_BUFFER_HEADER;
+    const LargeBufferHeader *header = (const LargeBufferHeader *)base;
+    if (header->backing == BACKING_HEAP) {
+        free(base);
+    } else {
+        unmap_large_buffer(base, header->mapped_size);
+    }
+}
+
+void get_large_buffer_stats(LargeBufferStats *stats) {
+    if (stats == NULL) return;
+    
+    stats->explicit_huge = (uint64_t)atomic_load_int(&explicit_huge_count);
+    stats->transparent_huge = (uint64_t)atomic_load_int(&transparent_huge_count);
+    stats->regular = (uint64_t)atomic_load_int(&regular_count);
+}
+
+// Chunk header; the data follows, aligned like the allocations
+struct PoolChunk {
+    PoolChunk *next;
+    size_t size;
+    size_t used;
+};
+
+#define POOL_ALIGNMENT 16
+#define POOL_CHUNK_HEADER ((sizeof(PoolChunk) + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1))
+
+static PoolChunk *new_pool_chunk(MemoryPool *pool, size_t size) {
+    PoolChunk *chunk = large_buffer_alloc(POOL_CHUNK_HEADER + size);
+    if (chunk == NULL) return NULL;
+    
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    pool->pool_size += size;
+    return chunk;
+}
+
+static void free_pool_chunk(MemoryPool *pool, PoolChunk *chunk) {
+    pool->pool_size -= chunk->size;
+    large_buffer_free(chunk, POOL_CHUNK_HEADER + chunk->size);
+}
+
 // Initialize memory pool
 bool init_memory_pool(MemoryPool *pool, size_t size) {
-    if (pool == NULL) return false;
+    if (pool == NULL || size == 0) return false;
     
-    pool->memory_pool = malloc(size);
-    if (pool->memory_pool == NULL) return false;
+    memset(pool, 0, sizeof(MemoryPool));
+    pool->chunk_size = size;
+    pool->first = new_pool_chunk(pool, size);
+    if (pool->first == NULL) return false;
     
-    pool->pool_size = size;
-    pool->used_size = 0;
+    pool->current = pool->first;
     pool->initialized = true;
-    
     return true;
 }
 
@@ -66,38 +242,99 @@ bool init_memory_pool(MemoryPool *pool, size_t size) {
 void* allocate_from_pool(MemoryPool *pool, size_t size) {
     if (pool == NULL || !pool->initialized) return NULL;
     
-    // Align to 8-byte boundary
-    size = (size + 7) & ~7;
+    size = (size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
     
-    if (pool->used_size + size > pool->pool_size) {
-        return NULL; // Pool exhausted
+    PoolChunk *chunk = pool->current;
+    if (chunk->used + size > chunk->size) {
+        // Move on to the next kept chunk, or chain in a new one
+        PoolChunk *next = chunk->next;
+        if (next == NULL || next->size < size) {
+            next = new_pool_chunk(pool, (size > pool->chunk_size) ? size : pool->chunk_size);
+            if (next == NULL) return NULL;
+            next->next = chunk->next;
+            chunk->next = next;
+        }
+        next->used = 0;
+        pool->current = chunk = next;
     }
     
-    void *ptr = (char*)pool->memory_pool + pool->used_size;
+    void *ptr = (char *)chunk + POOL_CHUNK_HEADER + chunk->used;
+    chunk->used += size;
     pool->used_size += size;
-    
+    if (pool->used_size > pool->peak_size) {
+        pool->peak_size = pool->used_size;
+    }
     return ptr;
 }
 
+PoolMark memory_pool_mark(const MemoryPool *pool) {
+    PoolMark mark = {NULL, 0, 0};
+    if (pool != NULL && pool->initialized) {
+        mark.chunk = pool->current;
+        mark.offset = pool->current->used;
+        mark.used_size = pool->used_size;
+    }
+    return mark;
+}
+
+// Releases everything allocated since mark in one step
+void reset_memory_pool_to(MemoryPool *pool, PoolMark mark) {
+    if (pool == NULL || !pool->initialized) return;
+    if (mark.chunk == NULL) {
+        reset_memory_pool(pool);
+        return;
+    }
+    
+    // Nothing after the mark's chunk is live any more. Oversized chunks
+    // served a single large request and are not kept.
+    PoolChunk **link = &mark.chunk->next;
+    while (*link != NULL) {
+        PoolChunk *chunk = *link;
+        if (chunk->size > pool->chunk_size) {
+            *link = chunk->next;
+            free_pool_chunk(pool, chunk);
+        } else {
+            link = &chunk->next;
+        }
+    }
+    
+    mark.chunk->used = mark.offset;
+    pool->current = mark.chunk;
+    pool->used_size = mark.used_size;
+}
+
 // Reset memory pool
 void reset_memory_pool(MemoryPool *pool) {
-    if (pool == NULL) return;
+    if (pool == NULL || !pool->initialized) return;
     
-    pool->used_size = 0;
+    PoolMark start = {pool->first, 0, 0};
+    reset_memory_pool_to(pool, start);
 }
 
 // Cleanup memory pool
 void cleanup_memory_pool(MemoryPool *pool) {
     if (pool == NULL) return;
     
-    if (pool->memory_pool != NULL) {
-        free(pool->memory_pool);
-        pool->memory_pool = NULL;
+    PoolChunk *chunk = pool->first;
+    while (chunk != NULL) {
+        PoolChunk *next = chunk->next;
+        free_pool_chunk(pool, chunk);
+        chunk = next;
     }
-    
-    pool->pool_size = 0;
-    pool->used_size = 0;
-    pool->initialized = false;
+    memset(pool, 0, sizeof(MemoryPool));
+}
+
+static THREAD_LOCAL MemoryPool thread_pool;
+
+MemoryPool *thread_scratch_pool(void) {
+    if (!thread_pool.initialized) {
+        init_memory_pool(&thread_pool, SCRATCH_CHUNK_SIZE);
+    }
+    return &thread_pool;
+}
+
+void release_thread_scratch_pool(void) {
+    cleanup_memory_pool(&thread_pool);
 }
 
 // Fast hash function (FNV-1a variant)
@@ -173,3 +410,349 @@ void distribute_mining_work(int total_blocks, int num_threads) {
     
     printf("Mining work distributed across %d threads\n", num_threads);
 }
+
+// Portable mutex
+struct PlatformMutex {
+#ifdef _WIN32
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+PlatformMutex *create_mutex(void) {
+    PlatformMutex *mutex = malloc(sizeof(PlatformMutex));
+    if (mutex == NULL) return NULL;
+    
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->section);
+#else
+    if (pthread_mutex_init(&mutex->mutex, NULL) != 0) {
+        free(mutex);
+        return NULL;
+    }
+#endif
+    return mutex;
+}
+
+void lock_mutex(PlatformMutex *mutex) {
+    if (mutex == NULL) return;
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->section);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void unlock_mutex(PlatformMutex *mutex) {
+    if (mutex == NULL) return;
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->section);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void destroy_mutex(PlatformMutex *mutex) {
+    if (mutex == NULL) return;
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->section);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    free(mutex);
+}
+
+int atomic_load_int(const volatile int *value) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+int atomic_add_int(volatile int *value, int delta) {
+#ifdef _MSC_VER
+    return InterlockedExchangeAdd((volatile LONG *)value, delta) + delta;
+#else
+    return __atomic_add_fetch(value, delta, __ATOMIC_ACQ_REL);
+#endif
+}
+
+void atomic_store_int(volatile int *value, int new_value) {
+#ifdef _MSC_VER
+    InterlockedExchange((volatile LONG *)value, new_value);
+#else
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+#endif
+}
+
+void *atomic_load_ptr(void *const volatile *value) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchangePointer((PVOID volatile *)value, NULL, NULL);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void atomic_store_ptr(void *volatile *value, void *new_value) {
+#ifdef _MSC_VER
+    InterlockedExchangePointer((PVOID volatile *)value, new_value);
+#else
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Parallel loop support
+#define MAX_WORKER_THREADS 16
+#define MAX_THREAD_EXIT_HOOKS 8
+
+static ThreadExitHook thread_exit_hooks[MAX_THREAD_EXIT_HOOKS];
+static int thread_exit_hook_count = 0;
+
+bool add_thread_exit_hook(ThreadExitHook hook) {
+    if (hook == NULL) return false;
+    
+    for (int i = 0; i < thread_exit_hook_count; i++) {
+        if (thread_exit_hooks[i] == hook) return true;
+    }
+    if (thread_exit_hook_count >= MAX_THREAD_EXIT_HOOKS) return false;
+    
+    thread_exit_hooks[thread_exit_hook_count++] = hook;
+    return true;
+}
+
+static void run_thread_exit_hooks(void) {
+    for (int i = 0; i < thread_exit_hook_count; i++) {
+        thread_exit_hooks[i]();
+    }
+    release_thread_scratch_pool();
+}
+
+typedef struct {
+    ParallelTask task;
+    void *context;
+    int count;
+    volatile int next_index;  // Claimed with atomic_add_int
+} ParallelJob;
+
+#ifdef _WIN32
+typedef CONDITION_VARIABLE PoolCondition;
+#else
+typedef pthread_cond_t PoolCondition;
+#endif
+
+// Workers are started by the first parallel loop and kept until
+// stop_worker_pool, so their scratch arenas and caches outlive each loop.
+// The pool runs one loop at a time.
+typedef struct {
+#ifdef _WIN32
+    SRWLOCK lock;
+    PoolCondition wake;  // A job was posted or the pool is stopping
+    PoolCondition done;  // The workers left the job, or it was taken down
+    HANDLE threads[MAX_WORKER_THREADS];
+#else
+    pthread_mutex_t lock;
+    PoolCondition wake;
+    PoolCondition done;
+    pthread_t threads[MAX_WORKER_THREADS];
+#endif
+    int started;
+    ParallelJob *job;     // NULL while idle
+    unsigned generation;  // Bumped for each posted job
+    int wanted;           // Workers the job still takes
+    int running;          // Workers still inside the job
+    bool stopping;
+} WorkerPool;
+
+static WorkerPool worker_pool = {
+#ifdef _WIN32
+    .lock = SRWLOCK_INIT, .wake = CONDITION_VARIABLE_INIT, .done = CONDITION_VARIABLE_INIT,
+#else
+    .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER,
+#endif
+};
+
+static void pool_lock(void) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&worker_pool.lock);
+#else
+    pthread_mutex_lock(&worker_pool.lock);
+#endif
+}
+
+static void pool_unlock(void) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&worker_pool.lock);
+#else
+    pthread_mutex_unlock(&worker_pool.lock);
+#endif
+}
+
+static void pool_wait(PoolCondition *condition) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(condition, &worker_pool.lock, INFINITE, 0);
+#else
+    pthread_cond_wait(condition, &worker_pool.lock);
+#endif
+}
+
+static void pool_broadcast(PoolCondition *condition) {
+#ifdef _WIN32
+    WakeAllConditionVariable(condition);
+#else
+    pthread_cond_broadcast(condition);
+#endif
+}
+
+int get_worker_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = (int)info.dwNumberOfProcessors;
+#else
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cores < 1) cores = 1;
+    return (cores > MAX_WORKER_THREADS) ? MAX_WORKER_THREADS : cores;
+}
+
+// Set while a thread runs parallel_for tasks
+static THREAD_LOCAL bool in_parallel_job;
+
+// Workers take indices one at a time, so uneven items balance themselves
+static void run_parallel_job(ParallelJob *job) {
+    bool outer = in_parallel_job;
+    in_parallel_job = true;
+    for (;;) {
+        int index = atomic_add_int(&job->next_index, 1) - 1;
+        if (index >= job->count) break;
+        job->task(job->context, index);
+    }
+    in_parallel_job = outer;
+}
+
+// Each worker joins at most once per job, and only while it wants more
+static void run_pool_worker(unsigned seen) {
+    pool_lock();
+    for (;;) {
+        while (!worker_pool.stopping && worker_pool.generation == seen) {
+            pool_wait(&worker_pool.wake);
+        }
+        if (worker_pool.stopping) break;
+        
+        seen = worker_pool.generation;
+        if (worker_pool.wanted == 0) continue;
+        worker_pool.wanted--;
+        ParallelJob *job = worker_pool.job;
+        pool_unlock();
+        
+        run_parallel_job(job);
+        
+        pool_lock();
+        if (--worker_pool.running == 0) pool_broadcast(&worker_pool.done);
+    }
+    pool_unlock();
+    run_thread_exit_hooks();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI pool_worker(LPVOID arg) {
+    run_pool_worker((unsigned)(uintptr_t)arg);
+    return 0;
+}
+#else
+static void *pool_worker(void *arg) {
+    run_pool_worker((unsigned)(uintptr_t)arg);
+    return NULL;
+}
+#endif
+
+// Called with the pool locked; the calling thread works too, so the pool
+// has one fewer worker than there are cores
+static void start_pool_workers(void) {
+    if (worker_pool.started > 0) return;
+    
+    // New workers only take jobs posted after this one
+    void *arg = (void *)(uintptr_t)worker_pool.generation;
+    int helpers = get_worker_count() - 1;
+    for (int i = 0; i < helpers; i++) {
+#ifdef _WIN32
+        worker_pool.threads[worker_pool.started] = CreateThread(NULL, 0, pool_worker, arg, 0, NULL);
+        if (worker_pool.threads[worker_pool.started] == NULL) break;
+#else
+        if (pthread_create(&worker_pool.threads[worker_pool.started], NULL, pool_worker, arg) != 0) break;
+#endif
+        worker_pool.started++;
+    }
+}
+
+bool parallel_for(int count, ParallelTask task, void *context) {
+    if (task == NULL || count < 0) return false;
+    if (count == 0) return true;
+    
+    // A loop inside another one's task stays on its thread; the outer loop
+    // already keeps every core busy
+    if (in_parallel_job) {
+        for (int i = 0; i < count; i++) {
+            task(context, i);
+        }
+        return true;
+    }
+    
+    ParallelJob job;
+    job.task = task;
+    job.context = context;
+    job.count = count;
+    job.next_index = 0;
+    
+    // While another thread's loop has the pool, this one runs here alone
+    pool_lock();
+    bool posted = worker_pool.job == NULL && !worker_pool.stopping;
+    if (posted) start_pool_workers();
+    posted = posted && worker_pool.started > 0;
+    if (posted) {
+        worker_pool.job = &job;
+        worker_pool.wanted = (worker_pool.started < count - 1) ? worker_pool.started : count - 1;
+        worker_pool.running = worker_pool.wanted;
+        worker_pool.generation++;
+        pool_broadcast(&worker_pool.wake);
+    }
+    pool_unlock();
+    
+    run_parallel_job(&job);
+    
+    if (posted) {
+        pool_lock();
+        while (worker_pool.running > 0) pool_wait(&worker_pool.done);
+        worker_pool.job = NULL;
+        pool_broadcast(&worker_pool.done);
+        pool_unlock();
+    }
+    return true;
+}
+
+void stop_worker_pool(void) {
+    if (in_parallel_job) return;
+    
+    pool_lock();
+    while (worker_pool.job != NULL) pool_wait(&worker_pool.done);
+    int started = worker_pool.started;
+    worker_pool.stopping = true;
+    pool_broadcast(&worker_pool.wake);
+    pool_unlock();
+    
+    for (int i = 0; i < started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(worker_pool.threads[i], INFINITE);
+        CloseHandle(worker_pool.threads[i]);
+#else
+        pthread_join(worker_pool.threads[i], NULL);
+#endif
+    }
+    
+    pool_lock();
+    worker_pool.started = 0;
+    worker_pool.stopping = false;
+    pool_unlock();
+}
@@ -16,14 +16,28 @@ typedef struct {
     uint64_t pi_digits_per_second;
 } PerformanceMetrics;
 
-// Memory pool for efficient allocation
+// Chunk-chained bump allocator. Memory is never freed piece by piece:
+// a reset point taken with memory_pool_mark releases everything allocated
+// after it at once. Chunks are kept for reuse, except oversized ones made
+// for a single large request, which are freed when reset past.
+typedef struct PoolChunk PoolChunk;
+
 typedef struct {
-    void *memory_pool;
-    size_t pool_size;
-    size_t used_size;
+    PoolChunk *first;
+    PoolChunk *current;   // Chunk allocations are served from
+    size_t chunk_size;    // Size of regular chunks
+    size_t pool_size;     // Bytes reserved by all chunks
+    size_t used_size;     // Bytes handed out since the last reset
+    size_t peak_size;
     bool initialized;
 } MemoryPool;
 
+typedef struct {
+    PoolChunk *chunk;
+    size_t offset;
+    size_t used_size;
+} PoolMark;
+
 // Function declarations
 void init_performance_metrics(PerformanceMetrics *pm);
 void start_timing(PerformanceMetrics *pm);
@@ -31,12 +45,48 @@ void end_timing(PerformanceMetrics *pm);
 void calculate_performance_stats(PerformanceMetrics *pm, int pi_digits, int hashes);
 void print_performance_report(const PerformanceMetrics *pm);
 
-// Memory pool functions
+// Memory pool functions (size is the regular chunk size, reserved up front)
 bool init_memory_pool(MemoryPool *pool, size_t size);
 void* allocate_from_pool(MemoryPool *pool, size_t size);
+PoolMark memory_pool_mark(const MemoryPool *pool);
+void reset_memory_pool_to(MemoryPool *pool, PoolMark mark);
 void reset_memory_pool(MemoryPool *pool);
 void cleanup_memory_pool(MemoryPool *pool);
 
+// Large numeric buffers (packed digits, Pi work arrays). From
+// LARGE_BUFFER_THRESHOLD up they are mapped directly and backed by huge
+// pages when the system allows: an explicit huge page mapping first,
+// then transparent huge pages, then regular pages. Smaller buffers come
+// from the heap. Buffers are zeroed; free them with the size they were
+// allocated with.
+#define LARGE_BUFFER_THRESHOLD (2 * 1024 * 1024)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+    uint64_t explicit_huge;     // Explicit huge page mappings (MAP_HUGETLB, MEM_LARGE_PAGES)
+    uint64_t transparent_huge;  // Mappings advised to use transparent huge pages
+    uint64_t regular;           // Large buffers on regular pages
+} LargeBufferStats;
+
+void *large_buffer_alloc(size_t size);
+void large_buffer_free(void *buffer, size_t size);
+void set_large_pages_enabled(bool enabled);  // On by default
+bool large_pages_enabled(void);
+void get_large_buffer_stats(LargeBufferStats *stats);
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Per-thread scratch arena, created on first use. parallel_for's workers
+// release theirs when stop_worker_pool ends them; other threads call
+// release_thread_scratch_pool themselves.
+#define SCRATCH_CHUNK_SIZE (1024 * 1024)
+MemoryPool *thread_scratch_pool(void);
+void release_thread_scratch_pool(void);
+
 // Optimized hash functions
 uint32_t fast_hash(const char *data, size_t length);
 uint64_t fast_hash64(const char *data, size_t length);
@@ -57,4 +107,33 @@ bool init_parallel_mining(int num_threads);
 void shutdown_parallel_mining(void);
 void distribute_mining_work(int total_blocks, int num_threads);
 
+// Portable mutex (CRITICAL_SECTION on Windows, pthreads elsewhere)
+typedef struct PlatformMutex PlatformMutex;
+PlatformMutex *create_mutex(void);
+void lock_mutex(PlatformMutex *mutex);
+void unlock_mutex(PlatformMutex *mutex);
+void destroy_mutex(PlatformMutex *mutex);
+
+// Publication for lock-free readers: stores release, loads acquire
+int atomic_load_int(const volatile int *value);
+int atomic_add_int(volatile int *value, int delta);  // Returns the new value
+void atomic_store_int(volatile int *value, int new_value);
+void *atomic_load_ptr(void *const volatile *value);
+void atomic_store_ptr(void *volatile *value, void *new_value);
+
+// Parallel loop: runs task(context, i) for every i in [0, count) on a
+// pool of worker threads and returns once all of them have finished.
+// Called from inside a task, or while another thread's loop has the pool,
+// it runs the loop on the calling thread. The workers are started by the
+// first loop and live until stop_worker_pool.
+typedef void (*ParallelTask)(void *context, int index);
+int get_worker_count(void);
+bool parallel_for(int count, ParallelTask task, void *context);
+void stop_worker_pool(void);
+
+// Run by each worker as stop_worker_pool ends it, to hand back per-thread
+// caches. Register hooks before any parallel loop starts.
+typedef void (*ThreadExitHook)(void);
+bool add_thread_exit_hook(ThreadExitHook hook);
+
 #endif
@@ -1,12 +1,19 @@
 #include "pi.h"
 #include "block.h"
 #include "utils.h"
+#include "performance.h"
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
+// SSE2 is baseline on x86-64; other targets use the scalar kernels
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PI_USE_SSE2 1
+#endif
+
 // High-precision Pi digits (first 1000 digits after decimal point)
 static const char *KNOWN_PI_DIGITS = 
     "1415926535897932384626433832795028841971693993751058209749445923"
@@ -55,7 +62,10 @@ void calculate_pi_spigot(char *buffer, int digits) {
     // Simplified spigot algorithm implementation
     // This is a demonstration - real implementation would be more complex
     
-    int *a = malloc((digits + 100) * sizeof(int));
+    // The work array is scratch, released as soon as the digits are out
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    int *a = allocate_from_pool(scratch, (digits + 100) * sizeof(int));
     if (a == NULL) {
         // Fallback to pseudo-random generation
         for (int i = 0; i < digits; i++) {
@@ -85,7 +95,7 @@ void calculate_pi_spigot(char *buffer, int digits) {
     }
     
     buffer[digits] = '\0';
-    free(a);
+    reset_memory_pool_to(scratch, mark);
 }
 
 // Chudnovsky algorithm for high precision Pi calculation
@@ -141,33 +151,39 @@ void calculate_pi_machin(char *buffer, int digits) {
     buffer[digits] = '\0';
 }
 
-void get_pi_digits_from_previous(char *buffer, int digits, const void *prev_block_ptr) {
-    if (buffer == NULL || digits <= 0) {
-        if (buffer) buffer[0] = '\0';
-        return;
-    }
-    
-    // Cast the void pointer to Block pointer
+// Seed derived from the previous block (0 for the genesis block)
+int pi_seed_for_block(const void *prev_block_ptr) {
     const Block *prev_block = (const Block *)prev_block_ptr;
+    if (prev_block == NULL) return 0;
     
-    // If no previous block, use standard Pi calculation
-    if (prev_block == NULL) {
-        get_pi_digits(buffer, digits);
-        return;
-    }
-    
-    // Use previous block's information to seed the calculation
-    int seed = prev_block->index + prev_block->nonce;
-    int algorithm_choice = seed % 3;
+    return prev_block->index + prev_block->nonce;
+}
+
+// Generator chosen for a block: PI_ALGORITHM_REFERENCE for genesis
+int pi_algorithm_for_block(const void *prev_block_ptr) {
+    if (prev_block_ptr == NULL) return PI_ALGORITHM_REFERENCE;
     
-    switch (algorithm_choice) {
-        case 0:
+    return pi_seed_for_block(prev_block_ptr) % 3;
+}
+
+// Raw generator output for an algorithm, packed, before any transform
+bool generate_pi_base_digits(PiDigits *out, int algorithm, int digits) {
+    if (out == NULL || digits <= 0) return false;
+    
+    // The generators produce ASCII; it only lives until it is packed
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    char *buffer = allocate_from_pool(scratch, digits + 1);
+    if (buffer == NULL) return false;
+    
+    switch (algorithm) {
+        case PI_ALGORITHM_SPIGOT:
             calculate_pi_spigot(buffer, digits);
             break;
-        case 1:
+        case PI_ALGORITHM_CHUDNOVSKY:
             calculate_pi_chudnovsky(buffer, digits);
             break;
-        case 2:
+        case PI_ALGORITHM_MACHIN:
             calculate_pi_machin(buffer, digits);
             break;
         default:
@@ -175,20 +191,22 @@ void get_pi_digits_from_previous(char *buffer, int digits, const void *prev_bloc
             break;
     }
     
-    // Apply transformation based on previous block
-    if (prev_block->pi_digits != NULL) {
-        int prev_digits_len = strlen(prev_block->pi_digits);
-        for (int i = 0; i < digits && i < prev_digits_len; i++) {
-            int current_digit = buffer[i] - '0';
-            int prev_digit = prev_block->pi_digits[i] - '0';
-            
-            // Mathematical transformation to create dependency
-            int new_digit = (current_digit + prev_digit + seed) % 10;
-            buffer[i] = '0' + new_digit;
-        }
+    bool ok = pi_digits_from_string(out, buffer, digits);
+    reset_memory_pool_to(scratch, mark);
+    return ok;
+}
+
+// Block digits from a generator base: base transformed by the previous digits
+bool pi_digits_derive(PiDigits *out, const PiDigits *base, const PiDigits *prev, int seed) {
+    if (out == NULL || base == NULL || base->packed == NULL) return false;
+    if (!pi_digits_alloc(out, base->count)) return false;
+    
+    memcpy(out->packed, base->packed, pi_packed_size(base->count));
+    if (prev != NULL) {
+        pi_digits_transform(out, prev, seed);
     }
     
-    buffer[digits] = '\0';
+    return true;
 }
 
 // Verify Pi digits against known values
@@ -212,6 +230,19 @@ bool verify_pi_digits(const char *digits, int count, int starting_position) {
     return true;
 }
 
+// Pi digits should have roughly equal distribution
+static bool is_balanced_distribution(const int digit_count[10], int count) {
+    double expected = count / 10.0;
+    for (int i = 0; i < 10; i++) {
+        double ratio = digit_count[i] / expected;
+        if (ratio < 0.5 || ratio > 2.0) {
+            return false; // Too skewed
+        }
+    }
+    
+    return true;
+}
+
 // Check if a sequence looks like valid Pi digits
 bool is_valid_pi_sequence(const char *digits, int count) {
     if (digits == NULL || count <= 0) return false;
@@ -223,21 +254,250 @@ bool is_valid_pi_sequence(const char *digits, int count) {
         }
     }
     
-    // Statistical validation - Pi digits should have roughly equal distribution
+    // Statistical validation
     int digit_count[10] = {0};
     for (int i = 0; i < count; i++) {
         digit_count[digits[i] - '0']++;
     }
     
-    // Check if distribution is reasonable (not too skewed)
-    double expected = count / 10.0;
-    for (int i = 0; i < 10; i++) {
-        double ratio = digit_count[i] / expected;
-        if (ratio < 0.5 || ratio > 2.0) {
-            return false; // Too skewed
+    return is_balanced_distribution(digit_count, count);
+}
+
+// Same checks as is_valid_pi_sequence, computed on the packed form
+bool is_valid_pi_digits(const PiDigits *digits) {
+    if (digits == NULL || digits->packed == NULL || digits->count <= 0) return false;
+    
+    int digit_count[10];
+    if (!pi_digits_histogram(digits, digit_count)) {
+        return false;
+    }
+    
+    return is_balanced_distribution(digit_count, digits->count);
+}
+
+// Number of bytes needed to store count digits as BCD nibbles
+size_t pi_packed_size(int count) {
+    if (count <= 0) return 0;
+    return ((size_t)count + 1) / 2;
+}
+
+// Pack ASCII digits into BCD nibbles, first digit in the high nibble
+void pi_pack_digits(uint8_t *packed, const char *digits, int count) {
+    if (packed == NULL || digits == NULL || count <= 0) return;
+    
+    int i = 0;
+#ifdef PI_USE_SSE2
+    // 16 digits -> 8 bytes: each 16-bit lane holds one digit pair
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(digits + i)), ascii_zero);
+        __m128i first = _mm_and_si128(v, low_byte);
+        __m128i second = _mm_srli_epi16(v, 8);
+        __m128i pairs = _mm_or_si128(_mm_slli_epi16(first, 4), second);
+        _mm_storel_epi64((__m128i *)(packed + i / 2), _mm_packus_epi16(pairs, pairs));
+    }
+#endif
+    
+    for (; i + 1 < count; i += 2) {
+        packed[i / 2] = (uint8_t)(((digits[i] - '0') << 4) | (digits[i + 1] - '0'));
+    }
+    
+    // Odd digit count: low nibble of the last byte stays zero
+    if (i < count) {
+        packed[i / 2] = (uint8_t)((digits[i] - '0') << 4);
+    }
+}
+
+// Unpack BCD nibbles back into a NUL-terminated ASCII digit string
+void pi_unpack_digits(char *digits, const uint8_t *packed, int count) {
+    if (digits == NULL) return;
+    if (packed == NULL || count <= 0) {
+        digits[0] = '\0';
+        return;
+    }
+    
+    int i = 0;
+#ifdef PI_USE_SSE2
+    // 16 bytes -> 32 digits: split nibbles, interleave high before low
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; i + 32 <= count; i += 32) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(packed + i / 2));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+        __m128i low = _mm_and_si128(b, nibble);
+        _mm_storeu_si128((__m128i *)(digits + i),
+                         _mm_add_epi8(_mm_unpacklo_epi8(high, low), ascii_zero));
+        _mm_storeu_si128((__m128i *)(digits + i + 16),
+                         _mm_add_epi8(_mm_unpackhi_epi8(high, low), ascii_zero));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        uint8_t byte = packed[i / 2];
+        digits[i] = (char)('0' + ((i & 1) ? (byte & 0x0F) : (byte >> 4)));
+    }
+    digits[count] = '\0';
+}
+
+// Allocate a zeroed packed buffer for count digits
+bool pi_digits_alloc(PiDigits *digits, int count) {
+    if (digits == NULL || count <= 0) return false;
+    
+    digits->packed = large_buffer_alloc(pi_packed_size(count));
+    if (digits->packed == NULL) {
+        digits->count = 0;
+        return false;
+    }
+    
+    digits->count = count;
+    return true;
+}
+
+void pi_digits_free(PiDigits *digits) {
+    if (digits == NULL) return;
+    
+    large_buffer_free(digits->packed, pi_packed_size(digits->count));
+    digits->packed = NULL;
+    digits->count = 0;
+}
+
+// Allocate and fill a packed buffer from count ASCII digits
+bool pi_digits_from_string(PiDigits *digits, const char *ascii, int count) {
+    if (ascii == NULL || !pi_digits_alloc(digits, count)) return false;
+    
+    pi_pack_digits(digits->packed, ascii, count);
+    return true;
+}
+
+// Unpack count digits starting at start into out (NUL-terminated)
+void pi_digits_to_string(const PiDigits *digits, int start, int count, char *out) {
+    if (out == NULL) return;
+    if (digits == NULL || digits->packed == NULL || start < 0 || start >= digits->count) {
+        out[0] = '\0';
+        return;
+    }
+    
+    if (count > digits->count - start) {
+        count = digits->count - start;
+    }
+    
+    // Odd start: emit the low nibble first so the bulk unpack is byte-aligned
+    int written = 0;
+    if ((start & 1) && count > 0) {
+        out[written++] = (char)('0' + (digits->packed[start / 2] & 0x0F));
+        start++;
+    }
+    pi_unpack_digits(out + written, digits->packed + start / 2, count - written);
+}
+
+// digits[i] = (digits[i] + prev[i] + seed) mod 10 over the common prefix
+void pi_digits_transform(PiDigits *digits, const PiDigits *prev, int seed) {
+    if (digits == NULL || digits->packed == NULL ||
+        prev == NULL || prev->packed == NULL) {
+        return;
+    }
+    
+    int count = (digits->count < prev->count) ? digits->count : prev->count;
+    int bytes = count / 2;
+    int offset = ((seed % 10) + 10) % 10;
+    uint8_t *dst = digits->packed;
+    const uint8_t *src = prev->packed;
+    
+    int i = 0;
+#ifdef PI_USE_SSE2
+    // Each nibble sum is at most 9 + 9 + 9, so two conditional
+    // subtractions of 10 (unsigned min trick) give the residue
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i add = _mm_set1_epi8((char)offset);
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        
+        __m128i high = _mm_add_epi8(_mm_add_epi8(_mm_and_si128(_mm_srli_epi16(a, 4), nibble),
+                                                 _mm_and_si128(_mm_srli_epi16(b, 4), nibble)), add);
+        __m128i low = _mm_add_epi8(_mm_add_epi8(_mm_and_si128(a, nibble),
+                                                _mm_and_si128(b, nibble)), add);
+        high = _mm_min_epu8(high, _mm_sub_epi8(high, ten));
+        high = _mm_min_epu8(high, _mm_sub_epi8(high, ten));
+        low = _mm_min_epu8(low, _mm_sub_epi8(low, ten));
+        low = _mm_min_epu8(low, _mm_sub_epi8(low, ten));
+        
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_slli_epi16(high, 4), low));
+    }
+#endif
+    
+    for (; i < bytes; i++) {
+        int high = ((dst[i] >> 4) + (src[i] >> 4) + offset) % 10;
+        int low = ((dst[i] & 0x0F) + (src[i] & 0x0F) + offset) % 10;
+        dst[i] = (uint8_t)((high << 4) | low);
+    }
+    
+    // Odd common length: only the high nibble of the last byte is shared
+    if (count & 1) {
+        int high = ((dst[bytes] >> 4) + (src[bytes] >> 4) + offset) % 10;
+        dst[bytes] = (uint8_t)((high << 4) | (dst[bytes] & 0x0F));
+    }
+}
+
+// Count occurrences of each digit; false if any nibble is not a digit
+bool pi_digits_histogram(const PiDigits *digits, int counts[10]) {
+    if (digits == NULL || digits->packed == NULL || counts == NULL) return false;
+    
+    memset(counts, 0, 10 * sizeof(int));
+    int bytes = digits->count / 2;
+    const uint8_t *packed = digits->packed;
+    
+    int i = 0;
+#ifdef PI_USE_SSE2
+    // Per-digit byte counters are flushed with SAD before they can wrap
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i max_nibble = zero;
+    while (i + 16 <= bytes) {
+        __m128i acc[10];
+        for (int d = 0; d < 10; d++) acc[d] = zero;
+        
+        for (int rounds = 0; rounds < 127 && i + 16 <= bytes; rounds++, i += 16) {
+            __m128i b = _mm_loadu_si128((const __m128i *)(packed + i));
+            __m128i high = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+            __m128i low = _mm_and_si128(b, nibble);
+            max_nibble = _mm_max_epu8(max_nibble, _mm_max_epu8(high, low));
+            for (int d = 0; d < 10; d++) {
+                __m128i value = _mm_set1_epi8((char)d);
+                acc[d] = _mm_sub_epi8(acc[d], _mm_cmpeq_epi8(high, value));
+                acc[d] = _mm_sub_epi8(acc[d], _mm_cmpeq_epi8(low, value));
+            }
+        }
+        
+        for (int d = 0; d < 10; d++) {
+            __m128i sums = _mm_sad_epu8(acc[d], zero);
+            counts[d] += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
         }
     }
     
+    uint8_t lanes[16];
+    _mm_storeu_si128((__m128i *)lanes, max_nibble);
+    for (int l = 0; l < 16; l++) {
+        if (lanes[l] > 9) return false;
+    }
+#endif
+    
+    for (; i < bytes; i++) {
+        int high = packed[i] >> 4;
+        int low = packed[i] & 0x0F;
+        if (high > 9 || low > 9) return false;
+        counts[high]++;
+        counts[low]++;
+    }
+    
+    if (digits->count & 1) {
+        int high = packed[bytes] >> 4;
+        if (high > 9) return false;
+        counts[high]++;
+    }
+    
     return true;
 }
 
@@ -246,32 +506,34 @@ uint32_t calculate_pi_proof_hash(const char *pi_digits, int count, uint32_t nonc
     if (pi_digits == NULL || count <= 0) return 0;
     
     // Combine Pi digits with nonce for proof of work
-    char *combined = malloc(count + 20);
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    char *combined = allocate_from_pool(scratch, count + 20);
     if (combined == NULL) return 0;
     
     snprintf(combined, count + 20, "%s%u", pi_digits, nonce);
     uint32_t hash = simple_hash(combined);
     
-    free(combined);
+    reset_memory_pool_to(scratch, mark);
     return hash;
 }
 
-// Verify Pi-based proof of work
-bool verify_pi_proof_of_work(const char *pi_digits, int count, uint32_t difficulty) {
-    if (pi_digits == NULL || count <= 0) return false;
+// Verify Pi-based proof of work, on the packed digits
+bool verify_pi_proof_of_work(const PiDigits *digits, uint32_t difficulty) {
+    if (digits == NULL || digits->packed == NULL || digits->count <= 0) return false;
     
     // Verify that the Pi digits are valid
-    if (!is_valid_pi_sequence(pi_digits, count)) {
+    if (!is_valid_pi_digits(digits)) {
         return false;
     }
     
     // Check if the required number of digits were calculated
-    if (count < (int)difficulty) {
+    if (digits->count < (int)difficulty) {
         return false;
     }
     
     // Additional proof of work: hash of Pi digits must meet certain criteria
-    uint32_t hash = simple_hash(pi_digits);
+    uint32_t hash = fast_hash((const char *)digits->packed, pi_packed_size(digits->count));
     
     // Simple proof of work: hash must be divisible by some factor based on difficulty
     uint32_t divisor = (difficulty / 100) + 1;
@@ -3,10 +3,29 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+// Packed digit buffer: two decimal digits per byte (BCD nibbles, first
+// digit in the high nibble) with an explicit length instead of a NUL
+typedef struct {
+    uint8_t *packed;
+    int count;
+} PiDigits;
+
+// Digit generators selectable per block
+#define PI_ALGORITHM_REFERENCE -1
+#define PI_ALGORITHM_SPIGOT 0
+#define PI_ALGORITHM_CHUDNOVSKY 1
+#define PI_ALGORITHM_MACHIN 2
 
 // Enhanced Pi calculation functions
 void get_pi_digits(char *buffer, int digits);
-void get_pi_digits_from_previous(char *buffer, int digits, const void *prev_block);
+
+// Block digits = generator base transformed by the previous block's digits
+int pi_seed_for_block(const void *prev_block);
+int pi_algorithm_for_block(const void *prev_block);
+bool generate_pi_base_digits(PiDigits *out, int algorithm, int digits);
+bool pi_digits_derive(PiDigits *out, const PiDigits *base, const PiDigits *prev, int seed);
 
 // High-precision Pi calculation using different algorithms
 void calculate_pi_spigot(char *buffer, int digits);
@@ -17,8 +36,22 @@ void calculate_pi_machin(char *buffer, int digits);
 bool verify_pi_digits(const char *digits, int count, int starting_position);
 bool is_valid_pi_sequence(const char *digits, int count);
 
+// Compact digit storage: two decimal digits per byte (BCD nibbles)
+size_t pi_packed_size(int count);
+void pi_pack_digits(uint8_t *packed, const char *digits, int count);
+void pi_unpack_digits(char *digits, const uint8_t *packed, int count);
+
+// Packed digit buffer management and kernels
+bool pi_digits_alloc(PiDigits *digits, int count);
+void pi_digits_free(PiDigits *digits);
+bool pi_digits_from_string(PiDigits *digits, const char *ascii, int count);
+void pi_digits_to_string(const PiDigits *digits, int start, int count, char *out);
+void pi_digits_transform(PiDigits *digits, const PiDigits *prev, int seed);
+bool pi_digits_histogram(const PiDigits *digits, int counts[10]);
+bool is_valid_pi_digits(const PiDigits *digits);
+
 // Proof of work specific Pi functions
 uint32_t calculate_pi_proof_hash(const char *pi_digits, int count, uint32_t nonce);
-bool verify_pi_proof_of_work(const char *pi_digits, int count, uint32_t difficulty);
+bool verify_pi_proof_of_work(const PiDigits *digits, uint32_t difficulty);
 
 #endif
@@ -0,0 +1,257 @@
+#include "rescan.h"
+#include "performance.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESCAN_HEADER_SIZE 12
+#define RESCAN_RECORD_SIZE (WALLET_ADDRESS_LENGTH + 4 * sizeof(uint32_t))
+
+// Matches of one range, in chain order; the blocks' shared records
+typedef struct {
+    Transaction **matches;
+    int count;
+    int capacity;
+    bool failed;
+} RescanRange;
+
+typedef struct {
+    const Chain *chain;
+    AddressHandle self;
+    int start;
+    int end;
+    RescanRange *ranges;
+} RescanJob;
+
+static uint32_t history_hash(const Wallet *wallet, int count) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < count; i++) {
+        hash = (hash ^ wallet->transactions[i]->hash) * 16777619u;
+    }
+    return hash;
+}
+
+static bool add_match(RescanRange *range, Transaction *tx) {
+    if (range->count == range->capacity) {
+        int capacity = range->capacity ? range->capacity * 2 : 16;
+        Transaction **matches = realloc(range->matches, capacity * sizeof(Transaction *));
+        if (matches == NULL) return false;
+        range->matches = matches;
+        range->capacity = capacity;
+    }
+    range->matches[range->count++] = tx;
+    return true;
+}
+
+static void scan_range_task(void *context, int index) {
+    RescanJob *job = context;
+    RescanRange *range = &job->ranges[index];
+    int start = job->start + index * RESCAN_RANGE_BLOCKS;
+    int end = start + RESCAN_RANGE_BLOCKS;
+    if (end > job->end) end = job->end;
+    
+    for (int height = start; height < end && !range->failed; height++) {
+        const Block *block = chain_block(job->chain, height);
+        for (int i = 0; i < block->transaction_count; i++) {
+            Transaction *tx = block->transactions[i];
+            bool mine = tx->to == job->self || (!tx->is_coinbase && tx->from == job->self);
+            if (mine && !add_match(range, tx)) {
+                range->failed = true;
+                break;
+            }
+        }
+    }
+}
+
+// Whether the history up to mark still agrees with the chain
+static bool can_resume(const Wallet *wallet, const Chain *chain, const RescanWatermark *mark) {
+    if (mark == NULL || strncmp(mark->address, wallet->address, WALLET_ADDRESS_LENGTH) != 0) return false;
+    if (mark->height <= 0 || mark->height > chain_size(chain)) return false;
+    if (mark->confirmed < 0 || mark->confirmed > wallet->transaction_count) return false;
+    
+    return chain_block(chain, mark->height - 1)->hash == mark->tip_hash &&
+           history_hash(wallet, mark->confirmed) == mark->history_hash;
+}
+
+bool rescan_wallet(Wallet *wallet, const Chain *chain, RescanWatermark *mark,
+                   bool (*still_pending)(void *context, const Transaction *tx), void *context,
+                   RescanResult *result) {
+    if (wallet == NULL || chain == NULL) return false;
+    
+    int size = chain_size(chain);
+    bool resumed = can_resume(wallet, chain, mark);
+    int start = resumed ? mark->height : 0;
+    int keep = resumed ? mark->confirmed : 0;
+    if (start < size && chain->pruned_height > start) return false;
+    
+    // An address that was never interned cannot appear in any block
+    RescanJob job = {chain, address_find(wallet->address), start, size, NULL};
+    int ranges = (size - start + RESCAN_RANGE_BLOCKS - 1) / RESCAN_RANGE_BLOCKS;
+    bool ok = true;
+    if (job.self != 0 && ranges > 0) {
+        job.ranges = calloc(ranges, sizeof(RescanRange));
+        if (job.ranges == NULL) return false;
+        
+        if (!(ranges > 1 && parallel_for(ranges, scan_range_task, &job))) {
+            for (int i = 0; i < ranges; i++) scan_range_task(&job, i);
+        }
+        for (int i = 0; i < ranges; i++) ok = ok && !job.ranges[i].failed;
+    }
+    
+    int found = 0;
+    for (int i = 0; ok && job.ranges != NULL && i < ranges; i++) found += job.ranges[i].count;
+    
+    // The new history is the kept prefix, the matches in chain order, then
+    // whatever is still waiting to be mined; all of it shares the records
+    // the old history and the blocks hold
+    Wallet rebuilt;
+    memset(&rebuilt, 0, sizeof(Wallet));
+    memcpy(rebuilt.address, wallet->address, WALLET_ADDRESS_LENGTH);
+    memcpy(rebuilt.private_key, wallet->private_key, PRIVATE_KEY_LENGTH);
+    ok = ok && reserve_wallet_transactions(&rebuilt, keep + found + (wallet->transaction_count - keep));
+    for (int i = 0; ok && i < keep; i++) {
+        ok = add_shared_transaction_to_wallet(&rebuilt, wallet->transactions[i]);
+    }
+    for (int i = 0; ok && job.ranges != NULL && i < ranges; i++) {
+        for (int j = 0; ok && j < job.ranges[i].count; j++) {
+            ok = add_shared_transaction_to_wallet(&rebuilt, job.ranges[i].matches[j]);
+        }
+    }
+    int confirmed = rebuilt.transaction_count;
+    for (int i = keep; ok && i < wallet->transaction_count; i++) {
+        Transaction *tx = wallet->transactions[i];
+        if (still_pending != NULL && still_pending(context, tx)) ok = add_shared_transaction_to_wallet(&rebuilt, tx);
+    }
+    
+    for (int i = 0; job.ranges != NULL && i < ranges; i++) free(job.ranges[i].matches);
+    free(job.ranges);
+    if (!ok) {
+        cleanup_wallet(&rebuilt);
+        return false;
+    }
+    
+    cleanup_wallet(wallet);
+    *wallet = rebuilt;
+    if (mark != NULL) {
+        memset(mark, 0, sizeof(RescanWatermark));
+        memcpy(mark->address, wallet->address, WALLET_ADDRESS_LENGTH);
+        mark->address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+        mark->height = size;
+        mark->tip_hash = (size > 0) ? chain_block(chain, size - 1)->hash : 0;
+        mark->confirmed = confirmed;
+        mark->history_hash = history_hash(wallet, confirmed);
+    }
+    if (result != NULL) {
+        result->scanned = size - start;
+        result->found = found;
+        result->resumed = resumed;
+    }
+    return true;
+}
+
+// Every record in the file, with its count; NULL records when there are none
+static bool read_watermarks(const char *filename, uint8_t **records, int *count) {
+    *records = NULL;
+    *count = 0;
+    size_t size;
+    uint8_t *data = read_checksummed_file(filename, &size);
+    if (data == NULL) return false;
+    
+    uint32_t magic = 0, version = 0;
+    int32_t stored = -1;
+    if (size >= RESCAN_HEADER_SIZE) {
+        memcpy(&magic, data, 4);
+        memcpy(&version, data + 4, 4);
+        memcpy(&stored, data + 8, 4);
+    }
+    if (magic != RESCAN_FILE_MAGIC || version != RESCAN_FILE_VERSION || stored < 0 ||
+        size != RESCAN_HEADER_SIZE + (size_t)stored * RESCAN_RECORD_SIZE) {
+        free(data);
+        return false;
+    }
+    
+    memmove(data, data + RESCAN_HEADER_SIZE, size - RESCAN_HEADER_SIZE);
+    *records = data;
+    *count = stored;
+    return true;
+}
+
+static void decode_watermark(const uint8_t *p, RescanWatermark *mark) {
+    memcpy(mark->address, p, WALLET_ADDRESS_LENGTH);
+    mark->address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+    p += WALLET_ADDRESS_LENGTH;
+    memcpy(&mark->height, p, 4);
+    memcpy(&mark->tip_hash, p + 4, 4);
+    memcpy(&mark->confirmed, p + 8, 4);
+    memcpy(&mark->history_hash, p + 12, 4);
+}
+
+static void encode_watermark(uint8_t *p, const RescanWatermark *mark) {
+    size_t length = 0;
+    while (length < WALLET_ADDRESS_LENGTH - 1 && mark->address[length] != '\0') length++;
+    memset(p, 0, WALLET_ADDRESS_LENGTH);
+    memcpy(p, mark->address, length);
+    p += WALLET_ADDRESS_LENGTH;
+    memcpy(p, &mark->height, 4);
+    memcpy(p + 4, &mark->tip_hash, 4);
+    memcpy(p + 8, &mark->confirmed, 4);
+    memcpy(p + 12, &mark->history_hash, 4);
+}
+
+bool load_rescan_watermark(const char *filename, const char *address, RescanWatermark *mark) {
+    if (mark == NULL) return false;
+    
+    memset(mark, 0, sizeof(RescanWatermark));
+    uint8_t *records;
+    int count;
+    if (filename == NULL || address == NULL || !read_watermarks(filename, &records, &count)) return false;
+    
+    bool found = false;
+    for (int i = 0; i < count && !found; i++) {
+        const uint8_t *p = records + (size_t)i * RESCAN_RECORD_SIZE;
+        found = strncmp((const char *)p, address, WALLET_ADDRESS_LENGTH - 1) == 0;
+        if (found) decode_watermark(p, mark);
+    }
+    free(records);
+    return found;
+}
+
+bool save_rescan_watermark(const char *filename, const RescanWatermark *mark) {
+    if (filename == NULL || mark == NULL || mark->address[0] == '\0') return false;
+    
+    // A damaged file only loses the other wallets' watermarks, which
+    // costs them a full rescan
+    uint8_t *records;
+    int count;
+    read_watermarks(filename, &records, &count);
+    
+    int slot = 0;
+    while (slot < count &&
+           strncmp((const char *)records + (size_t)slot * RESCAN_RECORD_SIZE, mark->address,
+                   WALLET_ADDRESS_LENGTH - 1) != 0) {
+        slot++;
+    }
+    int total = (slot == count) ? count + 1 : count;
+    
+    size_t size = RESCAN_HEADER_SIZE + (size_t)total * RESCAN_RECORD_SIZE;
+    uint8_t *data = malloc(size);
+    if (data == NULL) {
+        free(records);
+        return false;
+    }
+    
+    uint32_t magic = RESCAN_FILE_MAGIC;
+    uint32_t version = RESCAN_FILE_VERSION;
+    int32_t stored = total;
+    memcpy(data, &magic, 4);
+    memcpy(data + 4, &version, 4);
+    memcpy(data + 8, &stored, 4);
+    if (count > 0) memcpy(data + RESCAN_HEADER_SIZE, records, (size_t)count * RESCAN_RECORD_SIZE);
+    encode_watermark(data + RESCAN_HEADER_SIZE + (size_t)slot * RESCAN_RECORD_SIZE, mark);
+    free(records);
+    
+    bool ok = write_checksummed_file(filename, data, size);
+    free(data);
+    return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef RESCAN_H
+#define RESCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wallet.h"
+#include "chain.h"
+
+// Rebuilds a wallet's history and balance from the chain. Block ranges
+// are scanned on worker threads and their matches merged in chain order.
+// A watermark records how far a wallet's history is known to agree with
+// the chain, so the next rescan of that wallet only reads the blocks
+// mined since; if the chain below the watermark changed (a reorg, another
+// chain file) or the history no longer starts the same way, the wallet is
+// rescanned from genesis. Watermarks are kept per address in one file.
+#define RESCAN_RANGE_BLOCKS CHAIN_CHUNK_BLOCKS
+#define RESCAN_FILE_MAGIC 0x52435241u  // "ARCR"
+#define RESCAN_FILE_VERSION 1
+
+typedef struct {
+    char address[WALLET_ADDRESS_LENGTH];
+    int32_t height;         // Blocks below this are in the history
+    uint32_t tip_hash;      // Hash of block height - 1, 0 when height is 0
+    int32_t confirmed;      // Leading history entries that came from those blocks
+    uint32_t history_hash;  // Over the hashes of those entries
+} RescanWatermark;
+
+typedef struct {
+    int scanned;   // Blocks read
+    int found;     // Transactions found in them
+    bool resumed;  // False when the history was rebuilt from genesis
+} RescanResult;
+
+// Entries that are not on the chain yet are kept at the end of the
+// history only while still_pending (NULL = never) returns true for them.
+// On success mark (which may be NULL) is moved to the tip; on failure the
+// wallet is unchanged. Fails when blocks that would have to be read were
+// pruned away.
+bool rescan_wallet(Wallet *wallet, const Chain *chain, RescanWatermark *mark,
+                   bool (*still_pending)(void *context, const Transaction *tx), void *context,
+                   RescanResult *result);
+
+// Whether the file has a watermark for address; if not, mark is left
+// empty, which forces a full rescan. Saving replaces the address's record
+// and keeps the others.
+bool load_rescan_watermark(const char *filename, const char *address, RescanWatermark *mark);
+bool save_rescan_watermark(const char *filename, const RescanWatermark *mark);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-512 (FIPS 180-4), used by the Ed25519 signatures
+#define SHA512_DIGEST_SIZE 64
+
+typedef struct {
+    uint64_t state[8];
+    uint64_t length;      // Bytes hashed so far
+    uint8_t buffer[128];
+    size_t buffered;
+} Sha512;
+
+void sha512_init(Sha512 *ctx);
+void sha512_update(Sha512 *ctx, const void *data, size_t length);
+void sha512_final(Sha512 *ctx, uint8_t digest[SHA512_DIGEST_SIZE]);
+void sha512(const void *data, size_t length, uint8_t digest[SHA512_DIGEST_SIZE]);
+
+#endif
@@ -0,0 +1,389 @@
+#include "state.h"
+#include "performance.h"
+#include "utils.h"
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+void init_chain_state(ChainState *state) {
+    if (state == NULL) return;
+    
+    memset(state, 0, sizeof(ChainState));
+}
+
+void cleanup_chain_state(ChainState *state) {
+    if (state == NULL) return;
+    
+    free(state->accounts);
+    memset(state, 0, sizeof(ChainState));
+}
+
+void reset_chain_state(ChainState *state) {
+    if (state == NULL) return;
+    
+    if (state->accounts != NULL) {
+        memset(state->accounts, 0, (size_t)state->capacity * sizeof(AccountBalance));
+    }
+    state->count = 0;
+    state->total_supply = 0;
+    state->height = 0;
+    state->tip_hash = 0;
+    state->snapshot_height = 0;
+}
+
+bool copy_chain_state(ChainState *copy, const ChainState *state) {
+    if (copy == NULL || state == NULL) return false;
+    
+    *copy = *state;
+    copy->accounts = NULL;
+    if (state->capacity > 0) {
+        copy->accounts = malloc((size_t)state->capacity * sizeof(AccountBalance));
+        if (copy->accounts == NULL) {
+            init_chain_state(copy);
+            return false;
+        }
+        memcpy(copy->accounts, state->accounts, (size_t)state->capacity * sizeof(AccountBalance));
+    }
+    return true;
+}
+
+// Slot holding address, or the empty slot where it would go
+static int find_account(const ChainState *state, AddressHandle address) {
+    int mask = state->capacity - 1;
+    int slot = (int)(address_handle_hash(address) & (uint32_t)mask);
+    while (state->accounts[slot].address != 0 && state->accounts[slot].address != address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow_accounts(ChainState *state) {
+    if (state->capacity < 0 || state->capacity > INT_MAX / 2) return false;
+    
+    size_t capacity = state->capacity ? (size_t)state->capacity * 2 : 64;
+    AccountBalance *old = state->accounts;
+    int old_capacity = state->capacity;
+    
+    state->accounts = calloc(capacity, sizeof(AccountBalance));
+    if (state->accounts == NULL) {
+        state->accounts = old;
+        return false;
+    }
+    state->capacity = (int)capacity;
+    
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].address != 0) {
+            state->accounts[find_account(state, old[i].address)] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+static AccountBalance *get_account(ChainState *state, AddressHandle address) {
+    if (address == 0) return NULL;
+    if (state->capacity > 0) {
+        AccountBalance *account = &state->accounts[find_account(state, address)];
+        if (account->address != 0) return account;
+    }
+    
+    if ((state->count + 1) * 2 > state->capacity && !grow_accounts(state)) return NULL;
+    
+    AccountBalance *account = &state->accounts[find_account(state, address)];
+    memset(account, 0, sizeof(AccountBalance));
+    account->address = address;
+    state->count++;
+    return account;
+}
+
+static const AccountBalance *lookup_account(const ChainState *state, AddressHandle address) {
+    if (state->count == 0 || address == 0) return NULL;
+    
+    const AccountBalance *account = &state->accounts[find_account(state, address)];
+    return (account->address != 0) ? account : NULL;
+}
+
+uint64_t state_get_balance(const ChainState *state, AddressHandle address) {
+    if (state == NULL) return 0;
+    
+    const AccountBalance *account = lookup_account(state, address);
+    return account ? account->balance : 0;
+}
+
+uint64_t state_get_sent(const ChainState *state, AddressHandle address) {
+    if (state == NULL) return 0;
+    
+    const AccountBalance *account = lookup_account(state, address);
+    return account ? account->sent : 0;
+}
+
+uint64_t state_get_sequence(const ChainState *state, AddressHandle address) {
+    if (state == NULL) return 0;
+    
+    const AccountBalance *account = lookup_account(state, address);
+    return account ? account->sequence : 0;
+}
+
+// Balances and sequence numbers of the addresses a block touches, as its
+// transactions run
+#define LEDGER_SLOTS 512  // Power of two, over twice the addresses a full block can touch
+
+typedef struct {
+    AddressHandle address;  // 0 for an empty slot
+    uint64_t balance;
+    uint64_t sequence;
+} LedgerEntry;
+
+static LedgerEntry *ledger_entry(LedgerEntry *ledger, const ChainState *state, AddressHandle address) {
+    int slot = (int)(address_handle_hash(address) & (LEDGER_SLOTS - 1));
+    while (ledger[slot].address != 0) {
+        if (ledger[slot].address == address) return &ledger[slot];
+        slot = (slot + 1) & (LEDGER_SLOTS - 1);
+    }
+    ledger[slot].address = address;
+    ledger[slot].balance = state_get_balance(state, address);
+    ledger[slot].sequence = state_get_sequence(state, address);
+    return &ledger[slot];
+}
+
+// Transfers already seen in the block, by leaf hash
+#define SEEN_SLOTS 256  // Power of two, over twice MAX_TRANSACTIONS_PER_BLOCK
+
+static bool seen_before(const Transaction **seen, const Transaction *tx) {
+    int slot = (int)(transaction_leaf_hash(tx) & (SEEN_SLOTS - 1));
+    while (seen[slot] != NULL) {
+        if (same_transaction(seen[slot], tx)) return true;
+        slot = (slot + 1) & (SEEN_SLOTS - 1);
+    }
+    seen[slot] = tx;
+    return false;
+}
+
+bool state_check_block(const ChainState *state, const Block *block) {
+    if (state == NULL || block == NULL || block->pruned) return false;
+    if (block->transaction_count < 0 || block->transaction_count > MAX_TRANSACTIONS_PER_BLOCK) return false;
+    
+    LedgerEntry ledger[LEDGER_SLOTS];
+    const Transaction *seen[SEEN_SLOTS];
+    memset(ledger, 0, sizeof(ledger));
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction *tx = block->transactions[i];
+        if (tx->to == 0 || (!tx->is_coinbase && tx->from == 0)) return false;
+        
+        if (!tx->is_coinbase) {
+            // Unsigned transfers from old chain files are not held to this
+            if (!block->unsigned_transfers && seen_before(seen, tx)) return false;
+            
+            LedgerEntry *sender = ledger_entry(ledger, state, tx->from);
+            if (tx->amount > UINT64_MAX - tx->fee || sender->balance < tx->amount + tx->fee) return false;
+            if (!block->unsequenced_transfers && tx->sequence != sender->sequence++) return false;
+            sender->balance -= tx->amount + tx->fee;
+        }
+        
+        LedgerEntry *receiver = ledger_entry(ledger, state, tx->to);
+        if (receiver->balance > UINT64_MAX - tx->amount) return false;
+        receiver->balance += tx->amount;
+    }
+    return true;
+}
+
+bool state_apply_block(ChainState *state, const Block *block) {
+    if (!state_check_block(state, block)) return false;
+    
+    // Room for every address the block can add, so it applies whole or not at all
+    while ((state->count + 2 * block->transaction_count) * 2 > state->capacity) {
+        if (!grow_accounts(state)) return false;
+    }
+    
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction *tx = block->transactions[i];
+        
+        if (tx->is_coinbase) {
+            state->total_supply += tx->amount;
+        } else {
+            // The fee leaves circulation here and comes back in the coinbase
+            AccountBalance *sender = get_account(state, tx->from);
+            if (sender == NULL || tx->amount > UINT64_MAX - tx->fee ||
+                sender->balance < tx->amount + tx->fee) {
+                return false;
+            }
+            sender->balance -= tx->amount + tx->fee;
+            sender->sent += tx->amount + tx->fee;
+            if (!block->unsequenced_transfers) sender->sequence++;
+            state->total_supply -= tx->fee;
+        }
+        
+        AccountBalance *receiver = get_account(state, tx->to);
+        if (receiver == NULL) return false;
+        receiver->balance += tx->amount;
+    }
+    
+    state->height++;
+    state->tip_hash = block->hash;
+    return true;
+}
+
+bool state_revert_block(ChainState *state, const Block *block) {
+    if (state == NULL || block == NULL || block->pruned) return false;
+    if (state->height == 0 || block->hash != state->tip_hash) return false;
+    
+    // The transactions are undone last to first
+    for (int i = block->transaction_count - 1; i >= 0; i--) {
+        const Transaction *tx = block->transactions[i];
+        AccountBalance *receiver = (AccountBalance *)lookup_account(state, tx->to);
+        if (receiver == NULL || receiver->balance < tx->amount) return false;
+        receiver->balance -= tx->amount;
+        
+        if (tx->is_coinbase) {
+            state->total_supply -= tx->amount;
+        } else {
+            AccountBalance *sender = (AccountBalance *)lookup_account(state, tx->from);
+            if (sender == NULL || sender->sent < tx->amount + tx->fee) return false;
+            if (!block->unsequenced_transfers && sender->sequence-- == 0) return false;
+            sender->balance += tx->amount + tx->fee;
+            sender->sent -= tx->amount + tx->fee;
+            state->total_supply += tx->fee;
+        }
+    }
+    
+    state->height--;
+    state->tip_hash = block->prev_hash;
+    return true;
+}
+
+bool save_state_snapshot(const ChainState *state, const char *filename) {
+    if (state == NULL || filename == NULL) return false;
+    
+    size_t entry_size = WALLET_ADDRESS_LENGTH + 3 * sizeof(uint64_t);
+    size_t size = 28 + (size_t)state->count * entry_size;
+    uint8_t *data = malloc(size);
+    if (data == NULL) return false;
+    
+    uint32_t magic = STATE_SNAPSHOT_MAGIC;
+    uint32_t version = STATE_SNAPSHOT_VERSION;
+    int32_t height = state->height;
+    int32_t count = state->count;
+    memcpy(data, &magic, 4);
+    memcpy(data + 4, &version, 4);
+    memcpy(data + 8, &height, 4);
+    memcpy(data + 12, &state->tip_hash, 4);
+    memcpy(data + 16, &state->total_supply, 8);
+    memcpy(data + 24, &count, 4);
+    
+    uint8_t *p = data + 28;
+    for (int i = 0; i < state->capacity; i++) {
+        const AccountBalance *account = &state->accounts[i];
+        if (account->address == 0) continue;
+        
+        // Snapshots keep the text, handles only hold within the process
+        memset(p, 0, WALLET_ADDRESS_LENGTH);
+        strncpy((char *)p, address_text(account->address), WALLET_ADDRESS_LENGTH - 1);
+        memcpy(p + WALLET_ADDRESS_LENGTH, &account->balance, sizeof(uint64_t));
+        memcpy(p + WALLET_ADDRESS_LENGTH + sizeof(uint64_t), &account->sent, sizeof(uint64_t));
+        memcpy(p + WALLET_ADDRESS_LENGTH + 2 * sizeof(uint64_t), &account->sequence, sizeof(uint64_t));
+        p += entry_size;
+    }
+    
+    bool ok = write_checksummed_file(filename, data, size);
+    free(data);
+    return ok;
+}
+
+bool load_state_snapshot(ChainState *state, const char *filename) {
+    if (state == NULL || filename == NULL) return false;
+    
+    size_t size;
+    uint8_t *data = read_checksummed_file(filename, &size);
+    if (data == NULL) return false;
+    
+    uint32_t magic = 0, version = 0;
+    int32_t height = -1, count = -1;
+    if (size >= 28) {
+        memcpy(&magic, data, 4);
+        memcpy(&version, data + 4, 4);
+        memcpy(&height, data + 8, 4);
+        memcpy(&count, data + 24, 4);
+    }
+    
+    // Version 1 entries have no sent total and version 2 entries no
+    // sequence, which is 0 then: no transfer before them had one
+    size_t entry_size = WALLET_ADDRESS_LENGTH + sizeof(uint64_t) * (version >= 3 ? 3 : version >= 2 ? 2 : 1);
+    if (magic != STATE_SNAPSHOT_MAGIC || version < 1 || version > STATE_SNAPSHOT_VERSION ||
+        height < 0 || count < 0 || size != 28 + (size_t)count * entry_size) {
+        free(data);
+        return false;
+    }
+    
+    // The entries are inserted into a fresh table
+    ChainState loaded;
+    init_chain_state(&loaded);
+    const uint8_t *p = data + 28;
+    for (int i = 0; i < count; i++) {
+        char address[WALLET_ADDRESS_LENGTH];
+        memcpy(address, p, WALLET_ADDRESS_LENGTH);
+        address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+        AccountBalance *account = get_account(&loaded, address_intern(address));
+        if (account == NULL) {
+            cleanup_chain_state(&loaded);
+            free(data);
+            return false;
+        }
+        memcpy(&account->balance, p + WALLET_ADDRESS_LENGTH, sizeof(uint64_t));
+        if (version >= 2) {
+            memcpy(&account->sent, p + WALLET_ADDRESS_LENGTH + sizeof(uint64_t), sizeof(uint64_t));
+        }
+        if (version >= 3) {
+            memcpy(&account->sequence, p + WALLET_ADDRESS_LENGTH + 2 * sizeof(uint64_t), sizeof(uint64_t));
+        }
+        p += entry_size;
+    }
+    
+    free(state->accounts);
+    state->accounts = loaded.accounts;
+    state->count = loaded.count;
+    state->capacity = loaded.capacity;
+    state->height = height;
+    state->snapshot_height = height;
+    memcpy(&state->tip_hash, data + 12, 4);
+    memcpy(&state->total_supply, data + 16, 8);
+    free(data);
+    return true;
+}
+
+// True if the state's tip is the chain's block at the same height
+static bool state_matches_chain(const ChainState *state, const Chain *chain) {
+    if (state->height > chain_size(chain)) return false;
+    if (state->height == 0) return true;
+    
+    return chain_block(chain, state->height - 1)->hash == state->tip_hash;
+}
+
+int sync_chain_state(ChainState *state, const Chain *chain, const char *snapshot_file, int interval) {
+    if (state == NULL || chain == NULL) return -1;
+    
+    if (!state_matches_chain(state, chain)) {
+        reset_chain_state(state);
+    }
+    
+    // A fresh state starts from the latest snapshot that fits the chain
+    if (state->height == 0 && snapshot_file != NULL && load_state_snapshot(state, snapshot_file) &&
+        !state_matches_chain(state, chain)) {
+        reset_chain_state(state);
+    }
+    
+    int target = chain_size(chain);
+    int applied = 0;
+    while (state->height < target) {
+        if (!state_apply_block(state, chain_block(chain, state->height))) return -1;
+        applied++;
+        
+        // Only the last snapshot height reached is worth writing
+        if (interval > 0 && snapshot_file != NULL && state->height % interval == 0 &&
+            state->height + interval > target && save_state_snapshot(state, snapshot_file)) {
+            state->snapshot_height = state->height;
+        }
+    }
+    return applied;
+}
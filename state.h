@@ -0,0 +1,75 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+#include "chain.h"
+
+// Balances derived from the chain. The state is rebuilt by applying
+// blocks in order; snapshots of it are written at configured heights so
+// a restart only replays the blocks mined after the latest snapshot.
+#define STATE_SNAPSHOT_MAGIC 0x53435241u  // "ARCS"
+#define STATE_SNAPSHOT_VERSION 3
+
+typedef struct {
+    AddressHandle address;  // 0 for an empty slot
+    uint64_t balance;
+    uint64_t sent;      // Total of the account's transfers on the chain, fees included
+    uint64_t sequence;  // Sequenced transfers on the chain, which is the next one's number
+} AccountBalance;
+
+typedef struct {
+    AccountBalance *accounts;  // Open-addressing table, linear probing
+    int count;
+    int capacity;              // Power of two, at most half full
+    uint64_t total_supply;
+    int height;         // Blocks applied so far
+    uint32_t tip_hash;  // Hash of the last applied block
+    int snapshot_height;  // Height of the latest snapshot on disk that matches
+} ChainState;
+
+void init_chain_state(ChainState *state);
+void cleanup_chain_state(ChainState *state);
+void reset_chain_state(ChainState *state);
+
+// Fills *copy, which must not own a table, with a state of its own; on
+// failure it is left empty
+bool copy_chain_state(ChainState *copy, const ChainState *state);
+
+uint64_t state_get_balance(const ChainState *state, AddressHandle address);
+uint64_t state_get_sent(const ChainState *state, AddressHandle address);
+uint64_t state_get_sequence(const ChainState *state, AddressHandle address);  // The next transfer's
+
+// Stateful half of block validation, after validate_block: each transfer
+// must be covered by its sender's balance at that point in the block and
+// carry the sender's next sequence number, so a transfer that was mined
+// once cannot be mined again. Blocks from before sequence numbers are only
+// kept from repeating a signed transfer within themselves. The state is
+// not changed.
+bool state_check_block(const ChainState *state, const Block *block);
+
+// Applies the block's transactions. Fails on a pruned block, one that
+// state_check_block rejects or when memory runs out, leaving the state as
+// it was.
+bool state_apply_block(ChainState *state, const Block *block);
+
+// Undoes state_apply_block for the state's last block, which must be the
+// one given, to roll the state back to below a fork. Fails on a pruned
+// block or another block; a state that does not add up (it was never
+// given that block) may be left partially updated.
+bool state_revert_block(ChainState *state, const Block *block);
+
+bool save_state_snapshot(const ChainState *state, const char *filename);
+bool load_state_snapshot(ChainState *state, const char *filename);
+
+// Brings the state up to the chain tip. A state that no longer matches
+// the chain restarts from the snapshot, or from genesis when the snapshot
+// does not match either. A snapshot is written at the last multiple of
+// interval passed (0 = never). Blocks at and above snapshot_height must
+// keep their bodies for a restart to rebuild the state. Returns the number of blocks applied, or
+// -1 if a block could not be applied; the state then ends at the block
+// before it.
+int sync_chain_state(ChainState *state, const Chain *chain, const char *snapshot_file, int interval);
+
+#endif
@@ -0,0 +1,1333 @@
+#include "storage.h"
+#include "compress.h"
+#include "digitstore.h"
+#include "txpool.h"
+#include "performance.h"
+#include "pi.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Digit encodings (record versions 3 and later). Derived digits are rebuilt
+// on load from a generator base and the previous block's digits, so each
+// distinct base is written once per frame and other blocks cost a few bytes.
+#define DIGITS_LITERAL 0          // Packed digits follow
+#define DIGITS_DERIVED 1          // Index of a base written earlier
+#define DIGITS_DERIVED_NEW_BASE 2 // Packed base follows, takes the next index
+
+// Transaction count of a pruned record (version 5 and later); the digit
+// commitment follows instead of transactions and digits
+#define RECORD_PRUNED (-1)
+
+// Transaction layout before fees (chain versions up to 5, wallet version 2);
+// it is a prefix of WireTransaction
+typedef struct {
+    char from_address[WALLET_ADDRESS_LENGTH];
+    char to_address[WALLET_ADDRESS_LENGTH];
+    uint64_t amount;
+    time_t timestamp;
+    uint32_t hash;
+    bool is_coinbase;
+} LegacyTransaction;
+
+// Transaction layout before signatures (chain versions 6 and 7, wallet
+// version 3), also a prefix of the current one
+#define UNSIGNED_TRANSACTION_SIZE offsetof(WireTransaction, public_key)
+
+// Transaction layout before sequence numbers (chain versions 8 and 9,
+// wallet version 4)
+#define UNSEQUENCED_TRANSACTION_SIZE offsetof(WireTransaction, sequence)
+
+// Block flags (version 7 and later)
+#define BLOCK_LEGACY_HASH 0x01
+#define BLOCK_UNSIGNED_TRANSFERS 0x02
+#define BLOCK_TEXT_LEAVES 0x04
+#define BLOCK_UNSEQUENCED_TRANSFERS 0x08
+
+#define CHAIN_HEADER_SIZE 12
+#define CHAIN_FOOTER_SIZE 16
+#define CHAIN_FRAME_INFO_SIZE 29
+
+// Frames read from disk per parallel decode round, bounds load memory
+#define LOAD_BATCH_FRAMES 64
+
+// Growable output buffer for serialization
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} ByteWriter;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} ByteReader;
+
+static void put_bytes(ByteWriter *writer, const void *src, size_t n) {
+    if (writer->failed) return;
+    
+    if (writer->size + n > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity : 4096;
+        while (capacity < writer->size + n) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(writer->data, capacity);
+        if (data == NULL) {
+            writer->failed = true;
+            return;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    
+    memcpy(writer->data + writer->size, src, n);
+    writer->size += n;
+}
+
+static bool get_bytes(ByteReader *reader, void *dst, size_t n) {
+    if (n > reader->size - reader->pos) return false;
+    
+    memcpy(dst, reader->data + reader->pos, n);
+    reader->pos += n;
+    return true;
+}
+
+// Digit-store ids of the generator bases seen in the current frame, by index.
+// Frames hold a few dozen distinct bases at most, so lookups are linear.
+typedef struct {
+    uint64_t *ids;
+    int count;
+    int capacity;
+} DigitBaseTable;
+
+static bool add_digit_base(DigitBaseTable *table, uint64_t id) {
+    if (table->count >= table->capacity) {
+        int new_capacity = table->capacity ? table->capacity * 2 : 16;
+        uint64_t *ids = realloc(table->ids, new_capacity * sizeof(uint64_t));
+        if (ids == NULL) return false;
+        table->ids = ids;
+        table->capacity = new_capacity;
+    }
+    
+    table->ids[table->count++] = id;
+    return true;
+}
+
+static int find_digit_base(const DigitBaseTable *table, uint64_t id) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->ids[i] == id) return i;
+    }
+    return -1;
+}
+
+// Drops the table's references (load side) and forgets all bases
+static void release_digit_bases(DigitBaseTable *bases) {
+    for (int i = 0; i < bases->count; i++) {
+        digit_store_release(bases->ids[i]);
+    }
+    bases->count = 0;
+}
+
+// True if block's digits can be rebuilt from its base and prev's digits.
+// A recipe was made from them; other digits are rebuilt and compared.
+static bool is_derivable(const Block *block, const PiDigits *digits, const Block *prev) {
+    if (prev != NULL && prev->pruned) return false;
+    if (block->pi_recipe.anchor_id != 0) return prev != NULL;
+    
+    PiDigits base;
+    if (!digit_store_lookup(block->pi_base_id, &base) || base.count != digits->count) {
+        return false;
+    }
+    
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits prev_digits, rebuilt;
+    bool have_prev = prev != NULL && block_pi_digits(prev, &prev_digits);
+    bool same = pi_digits_derive(&rebuilt, &base, have_prev ? &prev_digits : NULL, pi_seed_for_block(prev));
+    reset_memory_pool_to(scratch, mark);
+    if (!same) return false;
+    
+    same = memcmp(rebuilt.packed, digits->packed, pi_packed_size(rebuilt.count)) == 0;
+    pi_digits_free(&rebuilt);
+    return same;
+}
+
+static void encode_block_digits(ByteWriter *writer, const Block *block, const Block *prev,
+                                DigitBaseTable *bases) {
+    MemoryPool *scratch = thread_scratch_pool();
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits digits;
+    int32_t digit_count = block_pi_digits(block, &digits) ? digits.count : 0;
+    put_bytes(writer, &digit_count, sizeof(digit_count));
+    if (digit_count == 0) {
+        reset_memory_pool_to(scratch, mark);
+        return;
+    }
+    
+    uint8_t encoding = DIGITS_LITERAL;
+    int32_t base_index = -1;
+    if (block->pi_base_id != 0 && is_derivable(block, &digits, prev)) {
+        base_index = find_digit_base(bases, block->pi_base_id);
+        encoding = (base_index >= 0) ? DIGITS_DERIVED : DIGITS_DERIVED_NEW_BASE;
+    }
+    put_bytes(writer, &encoding, sizeof(encoding));
+    
+    size_t packed_size = pi_packed_size(digit_count);
+    PiDigits base;
+    switch (encoding) {
+        case DIGITS_DERIVED:
+            put_bytes(writer, &base_index, sizeof(base_index));
+            break;
+        case DIGITS_DERIVED_NEW_BASE:
+            if (!add_digit_base(bases, block->pi_base_id) ||
+                !digit_store_lookup(block->pi_base_id, &base)) {
+                writer->failed = true;
+                break;
+            }
+            put_bytes(writer, base.packed, packed_size);
+            break;
+        default:
+            put_bytes(writer, digits.packed, packed_size);
+            break;
+    }
+    reset_memory_pool_to(scratch, mark);
+}
+
+static bool decode_block_digits(ByteReader *reader, Block *block, const Block *prev,
+                                DigitBaseTable *bases, uint32_t version) {
+    int32_t digit_count;
+    if (!get_bytes(reader, &digit_count, sizeof(digit_count))) return false;
+    if (digit_count < 0 || digit_count > MAX_PI_DIGITS) return false;
+    if (digit_count == 0) return true;
+    
+    uint8_t encoding = DIGITS_LITERAL;
+    if (version >= 3 && !get_bytes(reader, &encoding, sizeof(encoding))) return false;
+    
+    size_t packed_size = pi_packed_size(digit_count);
+    uint64_t base_id = 0;
+    switch (encoding) {
+        case DIGITS_LITERAL:
+            // The in-memory form is the same packed layout as on disk
+            if (!pi_digits_alloc(&block->pi_digits, digit_count) ||
+                !get_bytes(reader, block->pi_digits.packed, packed_size)) {
+                pi_digits_free(&block->pi_digits);
+                return false;
+            }
+            block->pi_digits_id = digit_store_intern(&block->pi_digits);
+            return true;
+        case DIGITS_DERIVED: {
+            int32_t base_index;
+            if (!get_bytes(reader, &base_index, sizeof(base_index)) ||
+                base_index < 0 || base_index >= bases->count) {
+                return false;
+            }
+            base_id = bases->ids[base_index];
+            break;
+        }
+        case DIGITS_DERIVED_NEW_BASE: {
+            // The table keeps one reference per base until the frame ends
+            PiDigits base;
+            if (!pi_digits_alloc(&base, digit_count) ||
+                !get_bytes(reader, base.packed, packed_size) ||
+                (base_id = digit_store_intern(&base)) == 0) {
+                pi_digits_free(&base);
+                return false;
+            }
+            if (!add_digit_base(bases, base_id)) {
+                digit_store_release(base_id);
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    
+    // Digits as long as the previous block's are kept as a recipe, the
+    // others are rebuilt and become a payload
+    PiDigits base;
+    if (!digit_store_lookup(base_id, &base) || base.count != digit_count) return false;
+    
+    int seed = pi_seed_for_block(prev);
+    if (prev != NULL &&
+        digit_derivation_extend(&block->pi_recipe, &prev->pi_recipe, prev->pi_digits_id, base_id, seed)) {
+        block->pi_digits.count = digit_count;
+    } else {
+        MemoryPool *scratch = thread_scratch_pool();
+        PoolMark mark = memory_pool_mark(scratch);
+        PiDigits prev_digits;
+        bool have_prev = prev != NULL && block_pi_digits(prev, &prev_digits);
+        bool ok = pi_digits_derive(&block->pi_digits, &base, have_prev ? &prev_digits : NULL, seed);
+        reset_memory_pool_to(scratch, mark);
+        if (!ok) return false;
+        block->pi_digits_id = digit_store_intern(&block->pi_digits);
+    }
+    
+    digit_store_retain(base_id);
+    block->pi_base_id = base_id;
+    return true;
+}
+
+static void encode_block(ByteWriter *writer, const Block *block, const Block *prev,
+                         DigitBaseTable *bases) {
+    int64_t timestamp = (int64_t)block->timestamp;
+    int32_t tx_count = block->pruned ? RECORD_PRUNED : block->transaction_count;
+    uint8_t flags = (block->legacy_hash ? BLOCK_LEGACY_HASH : 0) |
+                    (block->unsigned_transfers ? BLOCK_UNSIGNED_TRANSFERS : 0) |
+                    (block->text_leaves ? BLOCK_TEXT_LEAVES : 0) |
+                    (block->unsequenced_transfers ? BLOCK_UNSEQUENCED_TRANSFERS : 0);
+    
+    put_bytes(writer, &block->index, sizeof(int));
+    put_bytes(writer, &timestamp, sizeof(timestamp));
+    put_bytes(writer, &block->difficulty, sizeof(int));
+    put_bytes(writer, &block->prev_hash, sizeof(uint32_t));
+    put_bytes(writer, &block->hash, sizeof(uint32_t));
+    put_bytes(writer, &block->merkle_root, sizeof(uint64_t));
+    put_bytes(writer, &flags, sizeof(flags));
+    put_bytes(writer, &block->nonce, sizeof(uint32_t));
+    put_bytes(writer, &block->mining_reward, sizeof(uint64_t));
+    put_bytes(writer, &block->total_difficulty, sizeof(uint64_t));
+    put_bytes(writer, block->miner_address, WALLET_ADDRESS_LENGTH);
+    put_bytes(writer, &tx_count, sizeof(tx_count));
+    
+    if (block->pruned) {
+        put_bytes(writer, &block->digits_commitment, sizeof(uint64_t));
+        return;
+    }
+    
+    // Only the used transaction slots are written
+    for (int i = 0; i < tx_count; i++) {
+        WireTransaction wire;
+        transaction_to_wire(block->transactions[i], &wire);
+        put_bytes(writer, &wire, sizeof(WireTransaction));
+    }
+    
+    // Pi digits are stored as BCD nibbles so the block hash can be rechecked
+    encode_block_digits(writer, block, prev, bases);
+}
+
+static bool decode_block(ByteReader *reader, Block *block, const Block *prev,
+                         DigitBaseTable *bases, uint32_t version) {
+    int64_t timestamp;
+    int32_t tx_count;
+    uint8_t flags = BLOCK_LEGACY_HASH | BLOCK_UNSIGNED_TRANSFERS | BLOCK_TEXT_LEAVES |
+                    BLOCK_UNSEQUENCED_TRANSFERS;
+    
+    // Blocks written before version 7 were hashed over their transaction
+    // text, before version 8 transfers carried no signatures, before
+    // version 9 Merkle leaves hashed the address text, and before version
+    // 10 transfers had no sequence numbers
+    memset(block, 0, sizeof(Block));
+    if (!get_bytes(reader, &block->index, sizeof(int)) ||
+        !get_bytes(reader, &timestamp, sizeof(timestamp)) ||
+        !get_bytes(reader, &block->difficulty, sizeof(int)) ||
+        !get_bytes(reader, &block->prev_hash, sizeof(uint32_t)) ||
+        !get_bytes(reader, &block->hash, sizeof(uint32_t)) ||
+        (version >= 7 && (!get_bytes(reader, &block->merkle_root, sizeof(uint64_t)) ||
+                          !get_bytes(reader, &flags, sizeof(flags)))) ||
+        !get_bytes(reader, &block->nonce, sizeof(uint32_t)) ||
+        !get_bytes(reader, &block->mining_reward, sizeof(uint64_t)) ||
+        !get_bytes(reader, &block->total_difficulty, sizeof(uint64_t)) ||
+        !get_bytes(reader, block->miner_address, WALLET_ADDRESS_LENGTH) ||
+        !get_bytes(reader, &tx_count, sizeof(tx_count))) {
+        return false;
+    }
+    block->timestamp = (time_t)timestamp;
+    block->miner_address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+    if (version == 7) flags |= BLOCK_UNSIGNED_TRANSFERS;
+    if (version < 9) flags |= BLOCK_TEXT_LEAVES;
+    if (version < 10) flags |= BLOCK_UNSEQUENCED_TRANSFERS;
+    block->legacy_hash = (flags & BLOCK_LEGACY_HASH) != 0;
+    block->unsigned_transfers = (flags & BLOCK_UNSIGNED_TRANSFERS) != 0;
+    block->text_leaves = (flags & BLOCK_TEXT_LEAVES) != 0;
+    block->unsequenced_transfers = (flags & BLOCK_UNSEQUENCED_TRANSFERS) != 0;
+    
+    if (version >= 5 && tx_count == RECORD_PRUNED) {
+        block->pruned = true;
+        return get_bytes(reader, &block->digits_commitment, sizeof(uint64_t));
+    }
+    if (tx_count < 0 || tx_count > MAX_TRANSACTIONS_PER_BLOCK) return false;
+    if (tx_count > 0) {
+        block->transactions = malloc(tx_count * sizeof(Transaction *));
+        if (block->transactions == NULL) return false;
+        block->transaction_capacity = tx_count;
+    }
+    size_t tx_size = (version >= 10) ? sizeof(WireTransaction) :
+                     (version >= 8) ? UNSEQUENCED_TRANSACTION_SIZE :
+                     (version >= 6) ? UNSIGNED_TRANSACTION_SIZE : sizeof(LegacyTransaction);
+    for (int i = 0; i < tx_count; i++) {
+        WireTransaction wire;
+        Transaction tx;
+        memset(&wire, 0, sizeof(WireTransaction));
+        wire.sequence = TRANSACTION_UNSEQUENCED;
+        if (!get_bytes(reader, &wire, tx_size) || !transaction_from_wire(&tx, &wire) ||
+            (block->transactions[i] = tx_new(&tx)) == NULL) {
+            cleanup_block(block);
+            return false;
+        }
+        block->transaction_count++;
+    }
+    if (version < 7) {
+        block->merkle_root = compute_merkle_root(block);
+    }
+    
+    if (!decode_block_digits(reader, block, prev, bases, version)) {
+        cleanup_block(block);
+        return false;
+    }
+    
+    return true;
+}
+
+// Decodes the records of one frame (heights first_height onwards) and keeps
+// those in [keep_from, keep_to) in out[height - keep_from]. Earlier records
+// are only decoded because derived digits need their predecessor.
+static bool decode_frame(const uint8_t *raw, size_t raw_size, int first_height, int block_count,
+                         uint32_t version, Block *out, int keep_from, int keep_to) {
+    ByteReader reader = {raw, raw_size, 0};
+    DigitBaseTable bases = {0};
+    Block *scratch = malloc(2 * sizeof(Block));
+    if (scratch == NULL) return false;
+    memset(scratch, 0, 2 * sizeof(Block));
+    
+    const Block *prev = NULL;
+    int slot = 0;
+    bool ok = true;
+    
+    for (int i = 0; ok && i < block_count; i++) {
+        int height = first_height + i;
+        if (height >= keep_to) break;
+        
+        Block *target;
+        if (height < keep_from) {
+            // Alternate between two scratch slots: one is prev, one is free
+            target = &scratch[slot];
+            cleanup_block(target);
+            slot ^= 1;
+        } else {
+            target = &out[height - keep_from];
+        }
+        
+        ok = decode_block(&reader, target, prev, &bases, version);
+        prev = target;
+    }
+    
+    cleanup_block(&scratch[0]);
+    cleanup_block(&scratch[1]);
+    free(scratch);
+    release_digit_bases(&bases);
+    free(bases.ids);
+    return ok;
+}
+
+// Block layout used by the pre-header format (raw structs, no Pi digits)
+typedef struct {
+    int index;
+    time_t timestamp;
+    int difficulty;
+    char *pi_digits;
+    int pi_digits_count;
+    uint32_t prev_hash;
+    uint32_t hash;
+    LegacyTransaction transactions[MAX_TRANSACTIONS_PER_BLOCK];
+    int transaction_count;
+    char miner_address[WALLET_ADDRESS_LENGTH];
+    uint64_t mining_reward;
+    uint32_t nonce;
+    uint64_t total_difficulty;
+} LegacyBlock;
+
+// Reads the blocks at heights existing..saved_size-1 into out[0..]
+static bool load_legacy_blocks(FILE *file, Block *out, int existing, int saved_size) {
+    LegacyBlock *legacy = malloc(sizeof(LegacyBlock));
+    if (legacy == NULL) return false;
+    
+    // Earlier records are skipped, they are already in memory
+    if (existing > 0 && !file_seek(file, (int64_t)existing * (int64_t)sizeof(LegacyBlock), SEEK_CUR)) {
+        free(legacy);
+        return false;
+    }
+    
+    for (int i = existing; i < saved_size; i++) {
+        if (fread(legacy, sizeof(LegacyBlock), 1, file) != 1 ||
+            legacy->transaction_count < 0 || legacy->transaction_count > MAX_TRANSACTIONS_PER_BLOCK) {
+            free(legacy);
+            return false;
+        }
+        
+        Block *block = &out[i - existing];
+        memset(block, 0, sizeof(Block));
+        block->index = legacy->index;
+        block->timestamp = legacy->timestamp;
+        block->difficulty = legacy->difficulty;
+        block->prev_hash = legacy->prev_hash;
+        block->hash = legacy->hash;
+        block->legacy_hash = true;
+        block->unsigned_transfers = true;
+        block->text_leaves = true;
+        block->unsequenced_transfers = true;
+        for (int t = 0; t < legacy->transaction_count; t++) {
+            WireTransaction wire;
+            Transaction tx;
+            memset(&wire, 0, sizeof(WireTransaction));
+            wire.sequence = TRANSACTION_UNSEQUENCED;
+            memcpy(&wire, &legacy->transactions[t], sizeof(LegacyTransaction));
+            if (!transaction_from_wire(&tx, &wire) || !add_transaction_to_block(block, &tx)) {
+                free(legacy);
+                return false;
+            }
+        }
+        memcpy(block->miner_address, legacy->miner_address, WALLET_ADDRESS_LENGTH);
+        block->mining_reward = legacy->mining_reward;
+        block->nonce = legacy->nonce;
+        block->total_difficulty = legacy->total_difficulty;
+        block->merkle_root = compute_merkle_root(block);
+        // Digits were never saved in this format
+    }
+    
+    free(legacy);
+    return true;
+}
+
+static bool write_frame(FILE *file, ByteWriter *frame, int codec, ChainFrameInfo *info) {
+    info->raw_size = (uint32_t)frame->size;
+    info->checksum = fast_hash((const char *)frame->data, frame->size);
+    info->codec = CODEC_NONE;
+    
+    // Frames that do not shrink are stored as-is
+    const uint8_t *payload = frame->data;
+    size_t payload_size = frame->size;
+    uint8_t *compressed = NULL;
+    if (codec != CODEC_NONE && codec_available(codec)) {
+        size_t bound = codec_bound(codec, frame->size);
+        compressed = malloc(bound);
+        if (compressed != NULL) {
+            size_t n = codec_compress(codec, frame->data, frame->size, compressed, bound);
+            if (n > 0 && n < frame->size) {
+                payload = compressed;
+                payload_size = n;
+                info->codec = (uint8_t)codec;
+            }
+        }
+    }
+    
+    info->stored_size = (uint32_t)payload_size;
+    bool ok = fwrite(payload, 1, payload_size, file) == payload_size;
+    free(compressed);
+    return ok;
+}
+
+static void encode_frame_info(ByteWriter *writer, const ChainFrameInfo *info) {
+    put_bytes(writer, &info->file_offset, sizeof(info->file_offset));
+    put_bytes(writer, &info->first_height, sizeof(info->first_height));
+    put_bytes(writer, &info->block_count, sizeof(info->block_count));
+    put_bytes(writer, &info->raw_size, sizeof(info->raw_size));
+    put_bytes(writer, &info->stored_size, sizeof(info->stored_size));
+    put_bytes(writer, &info->checksum, sizeof(info->checksum));
+    put_bytes(writer, &info->codec, sizeof(info->codec));
+}
+
+static bool decode_frame_info(ByteReader *reader, ChainFrameInfo *info) {
+    return get_bytes(reader, &info->file_offset, sizeof(info->file_offset)) &&
+           get_bytes(reader, &info->first_height, sizeof(info->first_height)) &&
+           get_bytes(reader, &info->block_count, sizeof(info->block_count)) &&
+           get_bytes(reader, &info->raw_size, sizeof(info->raw_size)) &&
+           get_bytes(reader, &info->stored_size, sizeof(info->stored_size)) &&
+           get_bytes(reader, &info->checksum, sizeof(info->checksum)) &&
+           get_bytes(reader, &info->codec, sizeof(info->codec));
+}
+
+bool save_chain_file(const char *filename, const Chain *chain, int codec) {
+    return export_chain_file(filename, chain, codec, NULL, NULL);
+}
+
+bool export_chain_file(const char *filename, const Chain *chain, int codec,
+                       ChainProgressFn progress, void *context) {
+    if (filename == NULL || chain == NULL) return false;
+    
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", filename);
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) return false;
+    
+    ByteWriter header = {0};
+    uint32_t magic = BLOCKCHAIN_FILE_MAGIC;
+    uint32_t version = BLOCKCHAIN_FILE_VERSION;
+    int count = chain->size;
+    int32_t block_count = count;
+    put_bytes(&header, &magic, sizeof(magic));
+    put_bytes(&header, &version, sizeof(version));
+    put_bytes(&header, &block_count, sizeof(block_count));
+    bool ok = !header.failed && fwrite(header.data, 1, header.size, file) == header.size;
+    free(header.data);
+    
+    ByteWriter frame = {0};
+    ByteWriter index = {0};
+    DigitBaseTable bases = {0};
+    uint64_t offset = CHAIN_HEADER_SIZE;
+    int frame_count = 0;
+    int frame_first = 0;
+    
+    for (int i = 0; ok && i < count; i++) {
+        // The first block of a frame never refers to the previous frame
+        const Block *prev = (i == frame_first) ? NULL : chain_block(chain, i - 1);
+        encode_block(&frame, chain_block(chain, i), prev, &bases);
+        ok = !frame.failed;
+        
+        if (ok && (frame.size >= CHAIN_FRAME_SIZE || i == count - 1)) {
+            ChainFrameInfo info;
+            info.file_offset = offset;
+            info.first_height = frame_first;
+            info.block_count = i + 1 - frame_first;
+            ok = write_frame(file, &frame, codec, &info);
+            
+            encode_frame_info(&index, &info);
+            offset += info.stored_size;
+            frame_count++;
+            
+            // The save path only borrows base ids, it holds no references
+            frame.size = 0;
+            bases.count = 0;
+            frame_first = i + 1;
+            
+            if (progress != NULL) progress(context, i + 1, count);
+        }
+    }
+    
+    uint64_t index_offset = offset;
+    uint32_t footer_magic = BLOCKCHAIN_FILE_MAGIC;
+    int32_t frames = frame_count;
+    put_bytes(&index, &index_offset, sizeof(index_offset));
+    put_bytes(&index, &frames, sizeof(frames));
+    put_bytes(&index, &footer_magic, sizeof(footer_magic));
+    
+    ok = ok && !index.failed && fwrite(index.data, 1, index.size, file) == index.size;
+    
+    ok = ok && sync_file(file);
+    
+    free(frame.data);
+    free(index.data);
+    free(bases.ids);
+    fclose(file);
+    
+    // The previous file stays intact until the new one is complete
+    if (!ok || !replace_file(temp_path, filename)) {
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+bool encode_block_record(const Block *block, uint8_t **data, size_t *size) {
+    if (block == NULL || data == NULL || size == NULL) return false;
+    
+    // Without a previous block the digits are written literally, or as a
+    // base for the genesis block
+    ByteWriter writer = {0};
+    DigitBaseTable bases = {0};
+    encode_block(&writer, block, NULL, &bases);
+    free(bases.ids);
+    
+    if (writer.failed) {
+        free(writer.data);
+        return false;
+    }
+    *data = writer.data;
+    *size = writer.size;
+    return true;
+}
+
+bool decode_block_record(const uint8_t *data, size_t size, Block *block) {
+    if (data == NULL || block == NULL) return false;
+    
+    ByteReader reader = {data, size, 0};
+    DigitBaseTable bases = {0};
+    bool ok = decode_block(&reader, block, NULL, &bases, BLOCKCHAIN_FILE_VERSION);
+    if (ok && reader.pos != size) {
+        cleanup_block(block);
+        ok = false;
+    }
+    
+    release_digit_bases(&bases);
+    free(bases.ids);
+    return ok;
+}
+
+// Reads the frame index of a framed (version 4 and later) file
+static bool read_frame_index(FILE *file, int block_count, ChainFrameInfo **frames, int *frame_count) {
+    uint8_t footer[CHAIN_FOOTER_SIZE];
+    if (!file_seek(file, -CHAIN_FOOTER_SIZE, SEEK_END) ||
+        fread(footer, 1, sizeof(footer), file) != sizeof(footer)) {
+        return false;
+    }
+    
+    ByteReader reader = {footer, sizeof(footer), 0};
+    uint64_t index_offset;
+    int32_t count;
+    uint32_t magic;
+    get_bytes(&reader, &index_offset, sizeof(index_offset));
+    get_bytes(&reader, &count, sizeof(count));
+    get_bytes(&reader, &magic, sizeof(magic));
+    if (magic != BLOCKCHAIN_FILE_MAGIC || count < 0 || count > block_count) return false;
+    
+    size_t index_size = (size_t)count * CHAIN_FRAME_INFO_SIZE;
+    uint8_t *data = malloc(index_size + 1);
+    *frames = malloc((count + 1) * sizeof(ChainFrameInfo));
+    if (data == NULL || *frames == NULL ||
+        !file_seek(file, (int64_t)index_offset, SEEK_SET) ||
+        fread(data, 1, index_size, file) != index_size) {
+        free(data);
+        free(*frames);
+        *frames = NULL;
+        return false;
+    }
+    
+    // Frames must cover the heights 0..block_count-1 in order
+    reader.data = data;
+    reader.size = index_size;
+    reader.pos = 0;
+    int next_height = 0;
+    bool ok = true;
+    for (int i = 0; ok && i < count; i++) {
+        ChainFrameInfo *info = &(*frames)[i];
+        ok = decode_frame_info(&reader, info) && info->first_height == next_height &&
+             info->block_count > 0 && codec_available(info->codec);
+        next_height += info->block_count;
+    }
+    ok = ok && next_height == block_count;
+    
+    free(data);
+    if (!ok) {
+        free(*frames);
+        *frames = NULL;
+        return false;
+    }
+    
+    *frame_count = count;
+    return true;
+}
+
+static uint8_t *read_frame_payload(FILE *file, const ChainFrameInfo *info) {
+    uint8_t *payload = malloc(info->stored_size + 1);
+    if (payload == NULL) return NULL;
+    
+    if (!file_seek(file, (int64_t)info->file_offset, SEEK_SET) ||
+        fread(payload, 1, info->stored_size, file) != info->stored_size) {
+        free(payload);
+        return NULL;
+    }
+    return payload;
+}
+
+static bool unpack_frame(const ChainFrameInfo *info, uint32_t version, const uint8_t *payload, Block *out,
+                         int keep_from, int keep_to) {
+    uint8_t *raw = malloc(info->raw_size + 1);
+    if (raw == NULL) return false;
+    
+    bool ok = codec_decompress(info->codec, payload, info->stored_size, raw, info->raw_size) &&
+              fast_hash((const char *)raw, info->raw_size) == info->checksum &&
+              decode_frame(raw, info->raw_size, info->first_height, info->block_count,
+                           version, out, keep_from, keep_to);
+    free(raw);
+    return ok;
+}
+
+// One parallel load round: a batch of frames already read from disk
+typedef struct {
+    const ChainFrameInfo *frames;
+    uint32_t version;
+    uint8_t **payloads;
+    Block *out;       // Receives the blocks from height existing on
+    int existing;
+    volatile int failed;
+} FrameLoadJob;
+
+static void load_frame_task(void *context, int index) {
+    FrameLoadJob *job = (FrameLoadJob *)context;
+    const ChainFrameInfo *info = &job->frames[index];
+    int keep_from = (info->first_height > job->existing) ? info->first_height : job->existing;
+    
+    if (!unpack_frame(info, job->version, job->payloads[index], job->out + (keep_from - job->existing), keep_from,
+                      info->first_height + info->block_count)) {
+        atomic_store_int(&job->failed, 1);
+    }
+}
+
+static bool load_frames(FILE *file, uint32_t version, int block_count, Block *out, int existing) {
+    ChainFrameInfo *frames;
+    int frame_count;
+    if (!init_address_table() || !read_frame_index(file, block_count, &frames, &frame_count)) return false;
+    
+    // Frames entirely below the existing height are never read
+    int first = 0;
+    while (first < frame_count && frames[first].first_height + frames[first].block_count <= existing) {
+        first++;
+    }
+    
+    bool ok = true;
+    uint8_t *payloads[LOAD_BATCH_FRAMES];
+    for (int start = first; ok && start < frame_count; start += LOAD_BATCH_FRAMES) {
+        int batch = frame_count - start;
+        if (batch > LOAD_BATCH_FRAMES) batch = LOAD_BATCH_FRAMES;
+        
+        // Disk reads stay sequential, decompression and decoding fan out
+        int loaded = 0;
+        while (loaded < batch && (payloads[loaded] = read_frame_payload(file, &frames[start + loaded])) != NULL) {
+            loaded++;
+        }
+        
+        FrameLoadJob job = {&frames[start], version, payloads, out, existing, 0};
+        ok = loaded == batch && parallel_for(batch, load_frame_task, &job) && !atomic_load_int(&job.failed);
+        
+        for (int i = 0; i < loaded; i++) {
+            free(payloads[i]);
+        }
+    }
+    
+    free(frames);
+    return ok;
+}
+
+// Versions 2 and 3: one record after another with no framing
+static bool load_record_stream(FILE *file, uint32_t version, int block_count, Block *out, int existing) {
+    int64_t start = file_tell(file);
+    if (start < 0 || !file_seek(file, 0, SEEK_END)) return false;
+    int64_t end = file_tell(file);
+    if (end < start || !file_seek(file, start, SEEK_SET)) return false;
+    
+    size_t size = (size_t)(end - start);
+    uint8_t *data = malloc(size + 1);
+    if (data == NULL) return false;
+    
+    bool ok = fread(data, 1, size, file) == size &&
+              decode_frame(data, size, 0, block_count, version, out, existing, block_count);
+    free(data);
+    return ok;
+}
+
+bool load_chain_file(const char *filename, Chain *chain) {
+    if (filename == NULL || chain == NULL) return false;
+    
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return false;
+    
+    uint32_t magic;
+    uint32_t version = 0;
+    int32_t block_count;
+    if (fread(&magic, sizeof(magic), 1, file) != 1) {
+        fclose(file);
+        return false;
+    }
+    
+    if (magic != BLOCKCHAIN_FILE_MAGIC) {
+        // Legacy file: the first word is the block count
+        block_count = (int32_t)magic;
+    } else if (fread(&version, sizeof(version), 1, file) != 1 ||
+               fread(&block_count, sizeof(block_count), 1, file) != 1 ||
+               version < 2 || version > BLOCKCHAIN_FILE_VERSION) {
+        fclose(file);
+        return false;
+    }
+    
+    int existing = chain->size;
+    if (block_count < 0) {
+        fclose(file);
+        return false;
+    }
+    if (block_count <= existing) {
+        fclose(file);
+        return true;
+    }
+    
+    // Blocks are decoded aside and moved into the chain once all are good
+    int count = block_count - existing;
+    Block *loaded = calloc((size_t)count, sizeof(Block));
+    if (loaded == NULL) {
+        fclose(file);
+        return false;
+    }
+    
+    // Decoding threads share the digit store and transaction pool, so
+    // both must exist up front
+    init_digit_store(block_count);
+    init_tx_pool();
+    
+    bool ok;
+    if (version == 0) {
+        ok = load_legacy_blocks(file, loaded, existing, block_count);
+    } else if (version >= 4) {
+        ok = load_frames(file, version, block_count, loaded, existing);
+    } else {
+        ok = load_record_stream(file, version, block_count, loaded, existing);
+    }
+    fclose(file);
+    
+    int moved = 0;
+    while (ok && moved < count && chain_append(chain, &loaded[moved])) {
+        moved++;
+    }
+    ok = ok && moved == count;
+    
+    for (int i = moved; i < count; i++) {
+        cleanup_block(&loaded[i]);
+    }
+    free(loaded);
+    
+    if (!ok) {
+        chain_truncate(chain, existing);
+    }
+    return ok;
+}
+
+bool read_chain_block(const char *filename, int height, Block *block) {
+    if (filename == NULL || block == NULL || height < 0) return false;
+    
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return false;
+    
+    uint32_t magic, version;
+    int32_t block_count;
+    ChainFrameInfo *frames = NULL;
+    int frame_count = 0;
+    if (fread(&magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        fread(&block_count, sizeof(block_count), 1, file) != 1 ||
+        magic != BLOCKCHAIN_FILE_MAGIC || version < 4 || version > BLOCKCHAIN_FILE_VERSION ||
+        height >= block_count || !read_frame_index(file, block_count, &frames, &frame_count)) {
+        fclose(file);
+        return false;
+    }
+    
+    // Binary search for the frame whose height range holds the block
+    int low = 0, high = frame_count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (frames[mid].first_height <= height) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    
+    memset(block, 0, sizeof(Block));
+    uint8_t *payload = read_frame_payload(file, &frames[low]);
+    bool ok = payload != NULL && unpack_frame(&frames[low], version, payload, block, height, height + 1);
+    
+    free(payload);
+    free(frames);
+    fclose(file);
+    return ok;
+}
+
+bool open_chain_reader(ChainReader *reader, const char *filename, int from_height) {
+    if (reader == NULL || filename == NULL || from_height < 0) return false;
+    
+    memset(reader, 0, sizeof(ChainReader));
+    reader->file = fopen(filename, "rb");
+    if (reader->file == NULL) return false;
+    
+    uint32_t magic, version;
+    int32_t block_count;
+    if (fread(&magic, sizeof(magic), 1, reader->file) != 1 ||
+        fread(&version, sizeof(version), 1, reader->file) != 1 ||
+        fread(&block_count, sizeof(block_count), 1, reader->file) != 1 ||
+        magic != BLOCKCHAIN_FILE_MAGIC || version < 4 || version > BLOCKCHAIN_FILE_VERSION ||
+        block_count < 0 ||
+        !read_frame_index(reader->file, block_count, &reader->frames, &reader->frame_count)) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return false;
+    }
+    
+    reader->version = version;
+    reader->block_count = block_count;
+    reader->height = (from_height < block_count) ? from_height : block_count;
+    while (reader->next_frame < reader->frame_count &&
+           reader->frames[reader->next_frame].first_height +
+           reader->frames[reader->next_frame].block_count <= reader->height) {
+        reader->next_frame++;
+    }
+    
+    init_digit_store(CHAIN_FRAME_SIZE / 1024);
+    init_tx_pool();
+    return true;
+}
+
+void close_chain_reader(ChainReader *reader) {
+    if (reader == NULL) return;
+    
+    for (int i = reader->next_block; i < reader->buffered; i++) {
+        cleanup_block(&reader->blocks[i]);
+    }
+    free(reader->blocks);
+    free(reader->frames);
+    if (reader->file != NULL) fclose(reader->file);
+    memset(reader, 0, sizeof(ChainReader));
+}
+
+// Replaces the buffered blocks with those of the next frame
+static bool read_next_frame(ChainReader *reader) {
+    free(reader->blocks);
+    reader->blocks = NULL;
+    reader->buffered = 0;
+    reader->next_block = 0;
+    if (reader->next_frame >= reader->frame_count) return false;
+    
+    const ChainFrameInfo *info = &reader->frames[reader->next_frame++];
+    int keep_to = info->first_height + info->block_count;
+    int count = keep_to - reader->height;
+    reader->blocks = calloc((size_t)count, sizeof(Block));
+    uint8_t *payload = (reader->blocks != NULL) ? read_frame_payload(reader->file, info) : NULL;
+    if (payload == NULL || !unpack_frame(info, reader->version, payload, reader->blocks, reader->height, keep_to)) {
+        free(payload);
+        reader->failed = true;
+        return false;
+    }
+    
+    free(payload);
+    reader->buffered = count;
+    return true;
+}
+
+bool chain_reader_next(ChainReader *reader, Block *block) {
+    if (reader == NULL || block == NULL || reader->file == NULL || reader->failed) return false;
+    
+    if (reader->next_block >= reader->buffered && !read_next_frame(reader)) return false;
+    
+    *block = reader->blocks[reader->next_block++];
+    reader->height++;
+    return true;
+}
+
+// A block from an imported file must carry its body and extend prev
+static bool accept_imported_block(const Block *block, const Block *prev, int height) {
+    uint64_t prev_total = (prev != NULL) ? prev->total_difficulty : 0;
+    return !block->pruned && block->index == height &&
+           block->total_difficulty == prev_total + (uint64_t)block->difficulty &&
+           validate_block(block, prev);
+}
+
+// Rolls a copy of the chain's state back from the tip to below height
+static bool rewind_state(ChainState *replay, const Chain *chain, int height) {
+    while (replay->height > height) {
+        if (!state_revert_block(replay, chain_block(chain, replay->height - 1))) return false;
+    }
+    return true;
+}
+
+bool import_chain_file(const char *filename, Chain *chain, const ChainState *state, int min_fork_height,
+                       ChainProgressFn progress, void *context, ChainImportResult *result) {
+    if (filename == NULL || chain == NULL) return false;
+    
+    ChainImportResult local;
+    if (result == NULL) result = &local;
+    memset(result, 0, sizeof(ChainImportResult));
+    result->fork_height = -1;
+    result->invalid_height = -1;
+    
+    int size = chain_size(chain);
+    ChainState replay;
+    init_chain_state(&replay);
+    if (state != NULL) {
+        if (state->height != size || (size > 0 && state->tip_hash != chain_tip(chain)->hash)) return false;
+        if (!copy_chain_state(&replay, state)) return false;
+    }
+    
+    ChainReader reader;
+    if (!open_chain_reader(&reader, filename, 0)) {
+        cleanup_chain_state(&replay);
+        return false;
+    }
+    
+    // First pass: skip shared blocks, then either append (the file extends
+    // the chain) or only validate (the file holds a competing branch)
+    int total = reader.block_count;
+    Block block, branch_tip;
+    bool holding = false;
+    bool ok = true;
+    while (chain_reader_next(&reader, &block)) {
+        int height = reader.height - 1;
+        if (progress != NULL) progress(context, height + 1, total);
+        
+        if (result->fork_height < 0) {
+            if (height < size && chain_block(chain, height)->hash == block.hash) {
+                cleanup_block(&block);
+                continue;
+            }
+            result->fork_height = height;
+            if (state != NULL && !rewind_state(&replay, chain, height)) {
+                cleanup_block(&block);
+                ok = false;
+                break;
+            }
+        }
+        
+        const Block *prev = holding ? &branch_tip : chain_block(chain, height - 1);
+        if (!accept_imported_block(&block, prev, height) ||
+            (state != NULL && !state_apply_block(&replay, &block))) {
+            result->invalid_height = height;
+            cleanup_block(&block);
+            break;
+        }
+        
+        if (result->fork_height == size) {
+            if (!chain_append(chain, &block)) {
+                cleanup_block(&block);
+                ok = false;
+                break;
+            }
+            result->imported++;
+        } else {
+            if (holding) cleanup_block(&branch_tip);
+            branch_tip = block;
+            holding = true;
+        }
+    }
+    ok = ok && !reader.failed;
+    close_chain_reader(&reader);
+    cleanup_chain_state(&replay);
+    if (result->fork_height < 0) result->fork_height = (total < size) ? total : size;
+    if (!holding) return ok;
+    
+    // The branch replaces the chain's blocks above the fork only if it is
+    // heavier. It is not kept from the first pass but read again into a
+    // staging chain, and spliced in only once all of it has been read
+    // back, so a file that changed in between leaves the chain as it was.
+    int fork = result->fork_height;
+    int branch_end = branch_tip.index + 1;
+    uint32_t branch_hash = branch_tip.hash;
+    bool heavier = branch_tip.total_difficulty > chain_tip(chain)->total_difficulty;
+    cleanup_block(&branch_tip);
+    if (!ok || !heavier || fork < min_fork_height) return ok;
+    
+    Chain staged;
+    if (!init_chain(&staged, branch_end - fork)) return false;
+    if (!open_chain_reader(&reader, filename, fork)) {
+        cleanup_chain(&staged);
+        return false;
+    }
+    
+    while (fork + chain_size(&staged) < branch_end && chain_reader_next(&reader, &block)) {
+        int height = reader.height - 1;
+        if (progress != NULL) progress(context, height + 1, total);
+        
+        const Block *prev = (chain_size(&staged) > 0) ? chain_tip(&staged) : chain_block(chain, fork - 1);
+        if (!accept_imported_block(&block, prev, height) || !chain_append(&staged, &block)) {
+            cleanup_block(&block);
+            break;
+        }
+    }
+    close_chain_reader(&reader);
+    ok = fork + chain_size(&staged) == branch_end && chain_tip(&staged)->hash == branch_hash;
+    
+    // The chain takes over the staged blocks
+    if (ok) {
+        chain_truncate(chain, fork);
+        result->reorganized = true;
+        for (int i = 0; ok && i < chain_size(&staged); i++) {
+            Block *staged_block = chain_block(&staged, i);
+            ok = chain_append(chain, staged_block);
+            if (ok) {
+                memset(staged_block, 0, sizeof(Block));
+                result->imported++;
+            }
+        }
+    }
+    cleanup_chain(&staged);
+    return ok;
+}
+
+#define WALLET_HEADER_SIZE (8 + WALLET_ADDRESS_LENGTH + PRIVATE_KEY_LENGTH + 4)
+#define WALLET_RECORD_SIZE (sizeof(WireTransaction) + sizeof(uint32_t))
+#define LEGACY_WALLET_TRANSACTIONS 1000
+
+// Wallet layout before version 2: the whole struct with a fixed history
+typedef struct {
+    char address[WALLET_ADDRESS_LENGTH];
+    char private_key[PRIVATE_KEY_LENGTH];
+    uint64_t balance;
+    LegacyTransaction transactions[LEGACY_WALLET_TRANSACTIONS];
+    int transaction_count;
+} LegacyWallet;
+
+static void encode_wallet_header(uint8_t *header, const Wallet *wallet) {
+    uint32_t magic = WALLET_FILE_MAGIC;
+    uint32_t version = WALLET_FILE_VERSION;
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, wallet->address, WALLET_ADDRESS_LENGTH);
+    memcpy(header + 8 + WALLET_ADDRESS_LENGTH, wallet->private_key, PRIVATE_KEY_LENGTH);
+    uint32_t checksum = fast_hash((const char *)header, WALLET_HEADER_SIZE - 4);
+    memcpy(header + WALLET_HEADER_SIZE - 4, &checksum, 4);
+}
+
+static bool write_wallet_records(FILE *file, const Wallet *wallet, int first) {
+    uint8_t record[WALLET_RECORD_SIZE];
+    for (int i = first; i < wallet->transaction_count; i++) {
+        WireTransaction wire;
+        transaction_to_wire(wallet->transactions[i], &wire);
+        memcpy(record, &wire, sizeof(WireTransaction));
+        uint32_t checksum = fast_hash((const char *)record, sizeof(WireTransaction));
+        memcpy(record + sizeof(WireTransaction), &checksum, sizeof(checksum));
+        if (fwrite(record, 1, WALLET_RECORD_SIZE, file) != WALLET_RECORD_SIZE) return false;
+    }
+    return true;
+}
+
+// Records the file already holds for this wallet, or -1 when it has to be
+// rewritten: another wallet or format, a torn tail, or a history that no
+// longer ends where the wallet's does
+static int64_t appendable_wallet_records(FILE *file, const Wallet *wallet) {
+    uint8_t header[WALLET_HEADER_SIZE];
+    uint8_t expected[WALLET_HEADER_SIZE];
+    encode_wallet_header(expected, wallet);
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, expected, sizeof(header)) != 0 || !file_seek(file, 0, SEEK_END)) {
+        return -1;
+    }
+    
+    int64_t size = file_tell(file);
+    if (size < WALLET_HEADER_SIZE || (size - WALLET_HEADER_SIZE) % WALLET_RECORD_SIZE != 0) return -1;
+    int64_t records = (size - WALLET_HEADER_SIZE) / (int64_t)WALLET_RECORD_SIZE;
+    if (records > wallet->transaction_count) return -1;
+    
+    if (records > 0) {
+        WireTransaction last;
+        if (!file_seek(file, size - (int64_t)WALLET_RECORD_SIZE, SEEK_SET) ||
+            fread(&last, sizeof(last), 1, file) != 1) {
+            return -1;
+        }
+        const Transaction *tx = wallet->transactions[records - 1];
+        if (last.hash != tx->hash || last.amount != tx->amount || last.timestamp != tx->timestamp) {
+            return -1;
+        }
+    }
+    return records;
+}
+
+bool save_wallet_file(const char *filename, const Wallet *wallet) {
+    if (filename == NULL || wallet == NULL) return false;
+    
+    // Usual case: only the transactions since the last save are written
+    FILE *file = fopen(filename, "rb+");
+    if (file != NULL) {
+        int64_t records = appendable_wallet_records(file, wallet);
+        bool ok = records == wallet->transaction_count ||
+                  (records >= 0 && file_seek(file, 0, SEEK_END) &&
+                   write_wallet_records(file, wallet, (int)records) && sync_file(file));
+        fclose(file);
+        if (ok) return true;
+    }
+    
+    // Written aside and renamed, so the old wallet survives a failed write
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", filename);
+    file = fopen(temp_path, "wb");
+    if (file == NULL) return false;
+    
+    uint8_t header[WALLET_HEADER_SIZE];
+    encode_wallet_header(header, wallet);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+              write_wallet_records(file, wallet, 0) && sync_file(file);
+    fclose(file);
+    
+    if (!ok || !replace_file(temp_path, filename)) {
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+static bool load_legacy_wallet(FILE *file, Wallet *wallet) {
+    LegacyWallet *legacy = malloc(sizeof(LegacyWallet));
+    if (legacy == NULL) return false;
+    
+    bool ok = file_seek(file, 0, SEEK_SET) && fread(legacy, sizeof(LegacyWallet), 1, file) == 1 &&
+              legacy->transaction_count >= 0 && legacy->transaction_count <= LEGACY_WALLET_TRANSACTIONS;
+    
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    if (ok) {
+        memcpy(loaded.address, legacy->address, WALLET_ADDRESS_LENGTH);
+        memcpy(loaded.private_key, legacy->private_key, PRIVATE_KEY_LENGTH);
+        loaded.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+        ok = reserve_wallet_transactions(&loaded, legacy->transaction_count);
+    }
+    for (int i = 0; ok && i < legacy->transaction_count; i++) {
+        WireTransaction wire;
+        Transaction tx;
+        memset(&wire, 0, sizeof(WireTransaction));
+        wire.sequence = TRANSACTION_UNSEQUENCED;
+        memcpy(&wire, &legacy->transactions[i], sizeof(LegacyTransaction));
+        ok = transaction_from_wire(&tx, &wire) && add_transaction_to_wallet(&loaded, &tx);
+    }
+    free(legacy);
+    
+    if (!ok) {
+        cleanup_wallet(&loaded);
+        return false;
+    }
+    *wallet = loaded;
+    return true;
+}
+
+bool load_wallet_file(const char *filename, Wallet *wallet) {
+    if (filename == NULL || wallet == NULL) return false;
+    
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return false;
+    
+    uint8_t header[WALLET_HEADER_SIZE];
+    uint32_t magic = 0, version = 0, checksum = 0;
+    if (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        memcpy(&magic, header, 4);
+        memcpy(&version, header + 4, 4);
+        memcpy(&checksum, header + WALLET_HEADER_SIZE - 4, 4);
+    }
+    if (magic != WALLET_FILE_MAGIC) {
+        bool ok = load_legacy_wallet(file, wallet);
+        fclose(file);
+        return ok;
+    }
+    if (version < 2 || version > WALLET_FILE_VERSION ||
+        checksum != fast_hash((const char *)header, WALLET_HEADER_SIZE - 4)) {
+        fclose(file);
+        return false;
+    }
+    
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    memcpy(loaded.address, header + 8, WALLET_ADDRESS_LENGTH);
+    memcpy(loaded.private_key, header + 8 + WALLET_ADDRESS_LENGTH, PRIVATE_KEY_LENGTH);
+    loaded.address[WALLET_ADDRESS_LENGTH - 1] = '\0';
+    
+    // Replaying the history rebuilds the balance
+    size_t tx_size = (version >= 5) ? sizeof(WireTransaction) :
+                     (version >= 4) ? UNSEQUENCED_TRANSACTION_SIZE :
+                     (version >= 3) ? UNSIGNED_TRANSACTION_SIZE : sizeof(LegacyTransaction);
+    uint8_t record[WALLET_RECORD_SIZE];
+    bool ok = true;
+    while (ok && fread(record, 1, tx_size + sizeof(checksum), file) == tx_size + sizeof(checksum)) {
+        memcpy(&checksum, record + tx_size, sizeof(checksum));
+        if (checksum != fast_hash((const char *)record, tx_size)) break;
+        
+        WireTransaction wire;
+        Transaction tx;
+        memset(&wire, 0, sizeof(WireTransaction));
+        wire.sequence = TRANSACTION_UNSEQUENCED;
+        memcpy(&wire, record, tx_size);
+        ok = transaction_from_wire(&tx, &wire) && add_transaction_to_wallet(&loaded, &tx);
+    }
+    fclose(file);
+    
+    if (!ok) {
+        cleanup_wallet(&loaded);
+        return false;
+    }
+    *wallet = loaded;
+    return true;
+}
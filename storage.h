@@ -0,0 +1,122 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+#include "chain.h"
+#include "state.h"
+
+// Chain file layout (version 6):
+//   header | frame 0 | frame 1 | ... | frame index | footer
+// Blocks are serialized into frames of about CHAIN_FRAME_SIZE bytes, each
+// compressed on its own. A frame never depends on another one: the first
+// block of a frame always carries its digits literally, so any block can be
+// read by decompressing a single frame. Version 5 adds pruned records,
+// which keep the header and a digit commitment but no body; version 6
+// adds transaction fees, version 7 the Merkle root of each block,
+// version 8 transfer signatures, version 9 Merkle leaves over binary
+// address ids and version 10 transfer sequence numbers.
+#define BLOCKCHAIN_FILE_MAGIC 0x42435241u  // "ARCB"
+#define BLOCKCHAIN_FILE_VERSION 10
+#define CHAIN_FRAME_SIZE (128 * 1024)
+
+typedef struct {
+    uint64_t file_offset;
+    int32_t first_height;
+    int32_t block_count;
+    uint32_t raw_size;
+    uint32_t stored_size;
+    uint32_t checksum;   // fast_hash of the uncompressed frame
+    uint8_t codec;
+} ChainFrameInfo;
+
+// Writes the chain to filename, compressing frames with codec.
+// The file is written under a temporary name and renamed over filename.
+bool save_chain_file(const char *filename, const Chain *chain, int codec);
+
+// Appends the file's blocks above the chain's current height (those below
+// are assumed to already match the file). Frames are decompressed and
+// decoded in parallel; the chain is left unchanged on failure.
+bool load_chain_file(const char *filename, Chain *chain);
+
+// Self-contained encoding of a single block, as stored in the journal.
+// encode_block_record allocates *data; the caller frees it.
+bool encode_block_record(const Block *block, uint8_t **data, size_t *size);
+bool decode_block_record(const uint8_t *data, size_t size, Block *block);
+
+// Random access: decodes only the frame that holds the block at height
+bool read_chain_block(const char *filename, int height, Block *block);
+
+// Called as blocks are written or read: done of total blocks
+typedef void (*ChainProgressFn)(void *context, int done, int total);
+
+// save_chain_file with progress reporting. Only one frame is held in
+// memory at a time, so exports of any size run in bounded memory.
+bool export_chain_file(const char *filename, const Chain *chain, int codec,
+                       ChainProgressFn progress, void *context);
+
+// Sequential reader over a framed (version 4 and later) chain file that
+// holds the blocks of a single frame at a time
+typedef struct {
+    FILE *file;
+    uint32_t version;
+    ChainFrameInfo *frames;
+    int frame_count;
+    int block_count;
+    int next_frame;
+    Block *blocks;     // Decoded blocks of the current frame
+    int buffered;
+    int next_block;
+    int height;        // Height of the next block returned
+    bool failed;
+} ChainReader;
+
+bool open_chain_reader(ChainReader *reader, const char *filename, int from_height);
+void close_chain_reader(ChainReader *reader);
+// Moves the next block into *block (the caller cleans it up). Returns
+// false at the end of the file, or on a read error with failed set.
+bool chain_reader_next(ChainReader *reader, Block *block);
+
+typedef struct {
+    int fork_height;     // First height where the file and the chain differ
+    int imported;        // Blocks appended from the file
+    int invalid_height;  // First invalid block in the file, or -1
+    bool reorganized;    // The chain was truncated at fork_height
+} ChainImportResult;
+
+// Merges a chain file into chain. Blocks the chain already has are skipped
+// and new blocks are validated as they are read. When the file branches
+// off below the tip, its branch is validated in a first pass and adopted
+// in a second one only if it carries more total difficulty; forks below
+// min_fork_height are refused. The chain is left as it was unless the
+// whole branch reads back the same the second time. Only the valid part
+// of the file is used.
+//
+// With the chain's state at its tip (NULL skips this), new blocks must
+// also pass state_check_block: they are replayed on a copy of the state,
+// rolled back to the fork for a branch, so a block that overspends or
+// repeats a mined transfer ends the valid part. Rolling back needs the
+// bodies above the fork.
+bool import_chain_file(const char *filename, Chain *chain, const ChainState *state, int min_fork_height,
+                       ChainProgressFn progress, void *context, ChainImportResult *result);
+
+// Wallet file layout (version 5; version 4 records have no sequence
+// numbers, version 3 records no signatures and version 2 records no fees):
+//   header | transaction record | transaction record | ...
+// The header holds the keys and each record one transaction with its
+// checksum. Saves append only the transactions the file does not have
+// yet; the balance is recomputed from the history on load.
+#define WALLET_FILE_MAGIC 0x57435241u  // "ARCW"
+#define WALLET_FILE_VERSION 5
+
+// Appends the new part of the history, or rewrites the file (under a
+// temporary name) when it holds another wallet or a diverging history
+bool save_wallet_file(const char *filename, const Wallet *wallet);
+
+// Fills *wallet, which must not own a history; also reads version 2 and
+// the fixed-size format written before it. A torn last record ends the history.
+bool load_wallet_file(const char *filename, Wallet *wallet);
+
+#endif
@@ -7,6 +7,7 @@
 #include "utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <math.h>
@@ -14,6 +15,17 @@
 #include "pi.h"
 #include "utils.h"
 #include "wallet.h"
+#include "menu.h"
+#include "digitstore.h"
+#include "compress.h"
+#include "storage.h"
+#include "state.h"
+#include "txpool.h"
+#include "mempool.h"
+#include "sha512.h"
+#include "verifycache.h"
+#include "rescan.h"
+#include "keystore.h"
 
 void test_pi_calculation() {
     printf("Testing Pi calculation...\n");
@@ -60,7 +72,7 @@ void test_block_mining() {
     
     // Initialize wallet and reward system for mining
     Wallet wallet;
-    init_wallet(&wallet, "test_wallet.dat");
+    init_wallet(&wallet);
     
     RewardSystem reward_system;
     init_reward_system(&reward_system);
@@ -71,14 +83,14 @@ void test_block_mining() {
     printf("  Index: %d\n", block.index);
     printf("  Timestamp: %lld\n", (long long)block.timestamp);
     printf("  Difficulty: %d\n", block.difficulty);
-    printf("  Pi digits length: %d\n", block.pi_digits_count);
+    printf("  Pi digits length: %d\n", block.pi_digits.count);
     printf("  Hash: %u\n", block.hash);
     
     // Basic validation
     assert(block.index == 0);
     assert(block.prev_hash == 0);
     assert(block.hash != 0);
-    assert(block.pi_digits_count > 0);
+    assert(block.pi_digits.count > 0);
     
     printf("✓ Block mining tests passed\n\n");
 }
@@ -90,7 +102,7 @@ void test_blockchain_sequence() {
     
     // Initialize wallet and reward system for mining
     Wallet wallet;
-    init_wallet(&wallet, "test_wallet_seq.dat");
+    init_wallet(&wallet);
     
     RewardSystem reward_system;
     init_reward_system(&reward_system);
@@ -117,6 +129,2042 @@ void test_blockchain_sequence() {
     printf("✓ Blockchain sequence tests passed\n\n");
 }
 
+void test_pi_digit_packing() {
+    printf("Testing Pi digit packing...\n");
+    
+    const char *digits = "14159265358";
+    int count = (int)strlen(digits);
+    uint8_t packed[8];
+    char unpacked[16];
+    
+    assert(pi_packed_size(count) == 6);
+    pi_pack_digits(packed, digits, count);
+    assert(packed[0] == 0x14);
+    
+    pi_unpack_digits(unpacked, packed, count);
+    assert(strcmp(unpacked, digits) == 0);
+    
+    printf("✓ Pi digit packing tests passed\n\n");
+}
+
+void test_pi_digit_kernels() {
+    printf("Testing packed Pi digit kernels...\n");
+    
+    // Long enough to exercise the vector loops plus odd-length tails
+    char current[1002], previous[998], expected[1002];
+    for (int i = 0; i < 1001; i++) current[i] = (char)('0' + (i * 7 + 3) % 10);
+    for (int i = 0; i < 997; i++) previous[i] = (char)('0' + (i * 3 + 1) % 10);
+    current[1001] = previous[997] = '\0';
+    
+    int seed = 1234;
+    strcpy(expected, current);
+    for (int i = 0; i < 997; i++) {
+        expected[i] = (char)('0' + ((current[i] - '0') + (previous[i] - '0') + seed) % 10);
+    }
+    
+    PiDigits cur, prev;
+    assert(pi_digits_from_string(&cur, current, 1001));
+    assert(pi_digits_from_string(&prev, previous, 997));
+    pi_digits_transform(&cur, &prev, seed);
+    
+    char unpacked[1002];
+    pi_digits_to_string(&cur, 0, cur.count, unpacked);
+    assert(strcmp(unpacked, expected) == 0);
+    pi_digits_to_string(&cur, 3, 5, unpacked);
+    assert(strncmp(unpacked, expected + 3, 5) == 0 && unpacked[5] == '\0');
+    
+    int counts[10], reference[10] = {0};
+    for (int i = 0; i < 1001; i++) reference[expected[i] - '0']++;
+    assert(pi_digits_histogram(&cur, counts));
+    assert(memcmp(counts, reference, sizeof(counts)) == 0);
+    assert(is_valid_pi_digits(&cur) == is_valid_pi_sequence(expected, 1001));
+    
+    // Proof of work is checked on the packed digits
+    char known[501];
+    PiDigits pi;
+    get_pi_digits(known, 500);
+    assert(pi_digits_from_string(&pi, known, 500));
+    assert(verify_pi_proof_of_work(&pi, 1) && !verify_pi_proof_of_work(&pi, 501));
+    assert(verify_pi_proof_of_work(&cur, 1) == is_valid_pi_digits(&cur));
+    pi_digits_free(&pi);
+    
+    pi_digits_free(&cur);
+    pi_digits_free(&prev);
+    
+    printf("✓ Packed Pi digit kernel tests passed\n\n");
+}
+
+void test_digit_store() {
+    printf("Testing Pi digit store...\n");
+    
+    PiDigits a, b;
+    assert(pi_digits_from_string(&a, "3141592653", 10));
+    assert(pi_digits_from_string(&b, "3141592653", 10));
+    
+    DigitStoreStats before;
+    get_digit_store_stats(&before);
+    
+    uint64_t id_a = digit_store_intern(&a);
+    uint64_t id_b = digit_store_intern(&b);
+    assert(id_a != 0 && id_a == id_b);
+    assert(a.packed == b.packed);
+    
+    DigitStoreStats after;
+    get_digit_store_stats(&after);
+    assert(after.payloads == before.payloads + 1);
+    assert(after.dedup_hits == before.dedup_hits + 1);
+    
+    // Shared payload survives until the last reference is released
+    digit_store_release(id_a);
+    PiDigits shared;
+    assert(digit_store_lookup(id_b, &shared) && shared.count == 10);
+    digit_store_release(id_b);
+    assert(!digit_store_lookup(id_b, &shared));
+    
+    // Generator bases are computed once per (algorithm, length)
+    uint64_t base1 = digit_store_get_base(PI_ALGORITHM_MACHIN, 64);
+    uint64_t base2 = digit_store_get_base(PI_ALGORITHM_MACHIN, 64);
+    assert(base1 != 0 && base1 == base2);
+    digit_store_release(base1);
+    digit_store_release(base2);
+    
+    printf("✓ Pi digit store tests passed\n\n");
+}
+
+void test_compression_codec() {
+    printf("Testing chain frame codec...\n");
+    
+    // Repetitive input with a short incompressible tail
+    uint8_t raw[4096];
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        raw[i] = (uint8_t)((i % 64 < 48) ? i % 7 : (i * 31) >> 3);
+    }
+    
+    int codecs[] = {CODEC_NONE, CODEC_LZ, CODEC_ZLIB};
+    for (int c = 0; c < 3; c++) {
+        if (!codec_available(codecs[c])) continue;
+        
+        uint8_t packed[8192];
+        uint8_t restored[4096];
+        size_t n = codec_compress(codecs[c], raw, sizeof(raw), packed, codec_bound(codecs[c], sizeof(raw)));
+        assert(n > 0);
+        if (codecs[c] != CODEC_NONE) assert(n < sizeof(raw));
+        assert(codec_decompress(codecs[c], packed, n, restored, sizeof(restored)));
+        assert(memcmp(raw, restored, sizeof(raw)) == 0);
+    }
+    
+    // Tiny inputs and truncated streams
+    uint8_t small[16];
+    size_t n = lz_compress((const uint8_t *)"abc", 3, small, sizeof(small));
+    assert(n > 0 && lz_decompress(small, n, small + 8, 3) && memcmp(small + 8, "abc", 3) == 0);
+    
+    uint8_t packed[8192];
+    uint8_t restored[4096];
+    n = lz_compress(raw, sizeof(raw), packed, sizeof(packed));
+    assert(!lz_decompress(packed, n - 1, restored, sizeof(restored)));
+    
+    printf("✓ Chain frame codec tests passed\n\n");
+}
+
+// Writer and reader sharing one chain: index 0 appends, index 1 reads
+typedef struct {
+    Chain *chain;
+    int target;
+    bool reader_ok;
+} ChainRace;
+
+static void chain_race_task(void *context, int index) {
+    ChainRace *race = (ChainRace *)context;
+    
+    if (index == 0) {
+        for (int i = chain_size(race->chain); i < race->target; i++) {
+            Block block;
+            memset(&block, 0, sizeof(Block));
+            block.index = i;
+            block.hash = (uint32_t)i * 2654435761u;
+            assert(chain_append(race->chain, &block));
+        }
+        return;
+    }
+    
+    while (chain_size(race->chain) < race->target) {
+        const Block *tip = chain_tip(race->chain);
+        if (tip != NULL && tip->hash != (uint32_t)tip->index * 2654435761u) {
+            race->reader_ok = false;
+        }
+    }
+}
+
+void test_chain_container() {
+    printf("Testing segmented chain container...\n");
+    
+    Chain chain;
+    assert(init_chain(&chain, 1));
+    
+    Block block;
+    memset(&block, 0, sizeof(Block));
+    block.hash = 0;
+    assert(chain_append(&chain, &block));
+    const Block *genesis = chain_block(&chain, 0);
+    
+    // Growth past many chunks and a directory resize
+    ChainRace race = {&chain, 40 * CHAIN_CHUNK_BLOCKS + 7, true};
+    assert(parallel_for(2, chain_race_task, &race));
+    assert(race.reader_ok);
+    assert(chain_size(&chain) == race.target);
+    
+    // Blocks never move
+    assert(chain_block(&chain, 0) == genesis);
+    int height = 17 * CHAIN_CHUNK_BLOCKS + 3;
+    assert(chain_block(&chain, height)->index == height);
+    assert(chain_find_hash(&chain, (uint32_t)height * 2654435761u) == height);
+    assert(chain_block(&chain, race.target) == NULL);
+    
+    chain_truncate(&chain, 5);
+    assert(chain_size(&chain) == 5 && chain_tip(&chain)->index == 4);
+    cleanup_chain(&chain);
+    
+    printf("✓ Segmented chain container tests passed\n\n");
+}
+
+void test_blockchain_persistence() {
+    printf("Testing blockchain save/load...\n");
+    
+    AppState app;
+    memset(&app, 0, sizeof(AppState));
+    init_chain(&app.chain, 4);
+    strcpy(app.blockchain_file, "test_blockchain.dat");
+    app.chain_codec = CODEC_LZ;
+    init_wallet(&app.miner_wallet);
+    init_reward_system(&app.reward_system);
+    
+    for (int i = 0; i < 3; i++) {
+        const Block *prev = chain_tip(&app.chain);
+        Block block;
+        block.index = i;
+        mine_block(&block, prev ? prev->hash : 0, prev,
+                   app.miner_wallet.address, &app.reward_system);
+        assert(chain_append(&app.chain, &block));
+    }
+    assert(save_blockchain(&app));
+    
+    AppState loaded;
+    memset(&loaded, 0, sizeof(AppState));
+    init_chain(&loaded.chain, 1);
+    strcpy(loaded.blockchain_file, app.blockchain_file);
+    assert(load_blockchain(&loaded));
+    assert(loaded.chain.size == 3);
+    
+    // Reloaded blocks must still hash to the stored value
+    for (int i = 0; i < loaded.chain.size; i++) {
+        const Block *prev = (i == 0) ? NULL : chain_block(&loaded.chain, i - 1);
+        assert(chain_block(&loaded.chain, i)->pi_digits.count == chain_block(&app.chain, i)->pi_digits.count);
+        assert(validate_block(chain_block(&loaded.chain, i), prev));
+    }
+    
+    // The header table mirrors the bodies
+    assert(chain_verify_links(&loaded.chain) == -1);
+    assert(chain_find_hash(&loaded.chain, chain_block(&app.chain, 1)->hash) == 1);
+    
+    // Random access decodes a single frame
+    Block single;
+    assert(read_chain_block(app.blockchain_file, 2, &single));
+    assert(single.hash == chain_block(&app.chain, 2)->hash);
+    assert(memcmp(single.pi_digits.packed, chain_block(&app.chain, 2)->pi_digits.packed,
+                  pi_packed_size(single.pi_digits.count)) == 0);
+    cleanup_block(&single);
+    assert(!read_chain_block(app.blockchain_file, 3, &single));
+    
+    cleanup_chain(&app.chain);
+    cleanup_chain(&loaded.chain);
+    cleanup_chain_state(&loaded.state);
+    remove(app.blockchain_file);
+    
+    printf("✓ Blockchain persistence tests passed\n\n");
+}
+
+static void mine_test_blocks(Chain *chain, int count, const Wallet *wallet, const RewardSystem *rs) {
+    for (int i = 0; i < count; i++) {
+        const Block *prev = chain_tip(chain);
+        Block block;
+        block.index = chain_size(chain);
+        mine_block(&block, prev ? prev->hash : 0, prev, wallet->address, rs);
+        assert(chain_append(chain, &block));
+    }
+}
+
+void test_digit_recipes() {
+    printf("Testing Pi digit recipes...\n");
+    
+    // Past block 13 every block stores the same number of digits, so all
+    // but the first of them keep a recipe instead of a payload
+    Wallet miner;
+    assert(init_wallet(&miner));
+    RewardSystem rs;
+    init_reward_system(&rs);
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    mine_test_blocks(&chain, 18, &miner, &rs);
+    const Block *anchor = chain_block(&chain, 13);
+    assert(anchor->pi_digits.packed != NULL && anchor->pi_recipe.anchor_id == 0);
+    
+    MemoryPool *scratch = thread_scratch_pool();
+    for (int i = 14; i < 18; i++) {
+        const Block *block = chain_block(&chain, i);
+        const Block *prev = chain_block(&chain, i - 1);
+        assert(block->pi_digits.packed == NULL && block->pi_recipe.anchor_id == anchor->pi_digits_id);
+        assert(block->pi_digits.count == 10000 && block_body_size(block) < 1000);
+        
+        // The recipe rebuilds exactly what deriving from the previous block gives
+        PoolMark mark = memory_pool_mark(scratch);
+        PiDigits digits, prev_digits, base, expected;
+        assert(block_pi_digits(block, &digits) && block_pi_digits(prev, &prev_digits));
+        assert(digit_store_lookup(block->pi_base_id, &base));
+        assert(pi_digits_derive(&expected, &base, &prev_digits, pi_seed_for_block(prev)));
+        assert(memcmp(digits.packed, expected.packed, pi_packed_size(expected.count)) == 0);
+        pi_digits_free(&expected);
+        reset_memory_pool_to(scratch, mark);
+    }
+    assert(chain_validate(&chain, 0) == -1);
+    
+    // Saved as derived digits and loaded back as recipes
+    const char *chain_file = "test_recipes.dat";
+    assert(save_chain_file(chain_file, &chain, CODEC_LZ));
+    Chain loaded;
+    assert(init_chain(&loaded, 4));
+    assert(load_chain_file(chain_file, &loaded) && chain_size(&loaded) == 18);
+    assert(chain_block(&loaded, 17)->pi_digits.packed == NULL && chain_block(&loaded, 17)->pi_recipe.anchor_id != 0);
+    assert(chain_validate(&loaded, 0) == -1);
+    
+    // Pruning commits to the rebuilt digits
+    PoolMark mark = memory_pool_mark(scratch);
+    PiDigits digits;
+    assert(block_pi_digits(chain_block(&chain, 16), &digits));
+    uint64_t commitment = digit_store_content_id(&digits);
+    reset_memory_pool_to(scratch, mark);
+    prune_block(chain_block(&loaded, 16));
+    assert(chain_block(&loaded, 16)->digits_commitment == commitment);
+    
+    cleanup_chain(&loaded);
+    cleanup_chain(&chain);
+    cleanup_wallet(&miner);
+    remove(chain_file);
+    
+    printf("✓ Pi digit recipe tests passed\n\n");
+}
+
+static long file_size(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+void test_wallet_file() {
+    printf("Testing wallet files...\n");
+    
+    const char *wallet_file = "test_wallet.dat";
+    remove(wallet_file);
+    long record_size = (long)(sizeof(WireTransaction) + sizeof(uint32_t));
+    
+    // The history has no fixed ceiling
+    Wallet wallet;
+    RewardSystem rs;
+    init_wallet(&wallet);
+    init_reward_system(&rs);
+    for (int i = 0; i < 1500; i++) {
+        assert(award_mining_reward(&wallet, &rs, i));
+    }
+    assert(wallet.transaction_count == 1500 && wallet.balance == 1500 * rs.base_reward);
+    
+    // Only used records are written, and later saves append
+    assert(save_wallet(&wallet, wallet_file));
+    long size = file_size(wallet_file);
+    assert(size > 1500 * record_size && size < 1500 * record_size + 256);
+    Transaction tx;
+    create_transaction(&tx, wallet.address, "ARCBOB", 25);
+    assert(add_transaction_to_wallet(&wallet, &tx));
+    assert(save_wallet(&wallet, wallet_file));
+    assert(file_size(wallet_file) == size + record_size);
+    assert(save_wallet(&wallet, wallet_file) && file_size(wallet_file) == size + record_size);
+    
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    assert(load_wallet(&loaded, wallet_file));
+    assert(strcmp(loaded.address, wallet.address) == 0);
+    assert(loaded.transaction_count == 1501 && loaded.balance == wallet.balance);
+    assert(loaded.transactions[1500]->hash == tx.hash);
+    
+    // A torn last record is dropped, and the next save repairs the file
+    FILE *file = fopen(wallet_file, "ab");
+    assert(file != NULL && fwrite(&tx, 1, 10, file) == 10);
+    fclose(file);
+    assert(load_wallet(&loaded, wallet_file) && loaded.transaction_count == 1501);
+    assert(save_wallet(&wallet, wallet_file) && file_size(wallet_file) == size + record_size);
+    
+    // Another wallet replaces the file instead of appending to it
+    Wallet other;
+    init_wallet(&other);
+    strcpy(other.address, "ARCOTHER");
+    assert(save_wallet(&other, wallet_file));
+    assert(load_wallet(&loaded, wallet_file));
+    assert(strcmp(loaded.address, "ARCOTHER") == 0 && loaded.transaction_count == 0 && loaded.balance == 0);
+    
+    cleanup_wallet(&loaded);
+    cleanup_wallet(&wallet);
+    remove(wallet_file);
+    
+    printf("✓ Wallet file tests passed\n\n");
+}
+
+void test_state_snapshot() {
+    printf("Testing balance state snapshots...\n");
+    
+    const char *snapshot_file = "test_state.dat";
+    remove(snapshot_file);
+    
+    Chain chain;
+    Wallet wallet;
+    RewardSystem rs;
+    assert(init_chain(&chain, 4));
+    init_wallet(&wallet);
+    init_reward_system(&rs);
+    
+    // Catching up to height 3 writes a snapshot at height 2
+    mine_test_blocks(&chain, 3, &wallet, &rs);
+    ChainState state;
+    init_chain_state(&state);
+    assert(sync_chain_state(&state, &chain, snapshot_file, 2) == 3);
+    
+    ChainState snapshot;
+    init_chain_state(&snapshot);
+    assert(load_state_snapshot(&snapshot, snapshot_file));
+    assert(snapshot.height == 2 && snapshot.tip_hash == chain_block(&chain, 1)->hash);
+    cleanup_chain_state(&snapshot);
+    
+    // A restart only replays the blocks after the snapshot
+    mine_test_blocks(&chain, 2, &wallet, &rs);
+    ChainState restarted;
+    init_chain_state(&restarted);
+    assert(sync_chain_state(&restarted, &chain, snapshot_file, 0) == 3);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 2);
+    
+    uint64_t mined = 0;
+    for (int i = 0; i < 5; i++) {
+        mined += chain_block(&chain, i)->mining_reward;
+    }
+    assert(restarted.total_supply == mined && state.total_supply == mined);
+    assert(state_get_balance(&restarted, address_find(wallet.address)) == mined);
+    assert(state_get_balance(&restarted, address_find("nobody")) == 0);
+    
+    // A snapshot that does not fit the chain is ignored
+    chain_block(&chain, 1)->hash ^= 1;
+    ChainState other;
+    init_chain_state(&other);
+    assert(sync_chain_state(&other, &chain, snapshot_file, 0) == 5);
+    assert(other.total_supply == mined);
+    
+    cleanup_chain_state(&state);
+    cleanup_chain_state(&restarted);
+    cleanup_chain_state(&other);
+    cleanup_chain(&chain);
+    remove(snapshot_file);
+    
+    printf("✓ Balance state snapshot tests passed\n\n");
+}
+
+void test_journal_recovery() {
+    printf("Testing write-ahead journal recovery...\n");
+    
+    const char *chain_file = "test_journal_chain.dat";
+    const char *wallet_file = "test_journal_wallet.dat";
+    const char *journal_file = "test_journal.dat";
+    remove(chain_file);
+    remove(wallet_file);
+    remove(journal_file);
+    
+    AppState app;
+    memset(&app, 0, sizeof(AppState));
+    init_chain(&app.chain, 4);
+    strcpy(app.blockchain_file, chain_file);
+    strcpy(app.wallet_file, wallet_file);
+    strcpy(app.journal_file, journal_file);
+    app.chain_codec = CODEC_LZ;
+    init_wallet(&app.miner_wallet);
+    init_reward_system(&app.reward_system);
+    assert(recover_app_state(&app));
+    
+    for (int i = 0; i < 2; i++) {
+        const Block *prev = chain_tip(&app.chain);
+        Block block;
+        block.index = i;
+        mine_block(&block, prev ? prev->hash : 0, prev,
+                   app.miner_wallet.address, &app.reward_system);
+        assert(chain_append(&app.chain, &block));
+        award_mining_reward(&app.miner_wallet, &app.reward_system, i);
+        assert(save_app_state(&app));
+    }
+    
+    // Saves only append to the journal
+    FILE *file = fopen(chain_file, "rb");
+    assert(file == NULL);
+    
+    // A save torn before its commit must be ignored
+    uint8_t garbage[32] = {0};
+    assert(journal_append(&app.journal, JOURNAL_BLOCK, garbage, sizeof(garbage)));
+    journal_close(&app.journal);
+    
+    AppState recovered;
+    memset(&recovered, 0, sizeof(AppState));
+    init_chain(&recovered.chain, 1);
+    strcpy(recovered.blockchain_file, chain_file);
+    strcpy(recovered.wallet_file, wallet_file);
+    strcpy(recovered.journal_file, journal_file);
+    recovered.chain_codec = CODEC_LZ;
+    init_wallet(&recovered.miner_wallet);
+    assert(!load_blockchain(&recovered));
+    assert(recover_app_state(&recovered));
+    
+    assert(recovered.chain.size == 2);
+    for (int i = 0; i < 2; i++) {
+        assert(chain_block(&recovered.chain, i)->hash == chain_block(&app.chain, i)->hash);
+        assert(validate_block(chain_block(&recovered.chain, i), i ? chain_block(&recovered.chain, i - 1) : NULL));
+    }
+    assert(strcmp(recovered.miner_wallet.address, app.miner_wallet.address) == 0);
+    assert(recovered.miner_wallet.balance == app.miner_wallet.balance);
+    assert(recovered.miner_wallet.transaction_count == app.miner_wallet.transaction_count);
+    
+    // Recovery checkpoints into the main files and empties the journal
+    assert(recovered.journal.size == 0);
+    Wallet saved;
+    memset(&saved, 0, sizeof(Wallet));
+    assert(load_wallet(&saved, wallet_file) && saved.balance == app.miner_wallet.balance);
+    
+    // A journaled block the state rejects is not replayed, and the
+    // checkpoint after the replay leaves it out of the chain file
+    Wallet broke;
+    assert(init_wallet(&broke));
+    Transaction overdraft;
+    assert(create_transaction_with_fee(&overdraft, broke.address, "ARCBOB", 10, 0));
+    set_transaction_sequence(&overdraft, 0);
+    assert(sign_transaction(&overdraft, broke.private_key));
+    Transaction *entry = tx_new(&overdraft);
+    assert(entry != NULL);
+    const Block *tip = chain_tip(&recovered.chain);
+    Block unfunded;
+    unfunded.index = 2;
+    mine_block_with_transactions(&unfunded, tip->hash, tip, "ARCMINER", &app.reward_system, &entry, 1);
+    tx_release(entry);
+    assert(validate_block(&unfunded, tip) && !state_check_block(&recovered.state, &unfunded));
+    assert(chain_append(&recovered.chain, &unfunded) && save_app_state(&recovered));
+    journal_close(&recovered.journal);
+    
+    AppState replayed;
+    memset(&replayed, 0, sizeof(AppState));
+    init_chain(&replayed.chain, 1);
+    strcpy(replayed.blockchain_file, chain_file);
+    strcpy(replayed.wallet_file, wallet_file);
+    strcpy(replayed.journal_file, journal_file);
+    replayed.chain_codec = CODEC_LZ;
+    init_wallet(&replayed.miner_wallet);
+    assert(load_blockchain(&replayed) && replayed.chain.size == 2);
+    assert(recover_app_state(&replayed));
+    assert(replayed.chain.size == 2 && replayed.state.height == 2 && replayed.journal.size == 0);
+    journal_close(&replayed.journal);
+    cleanup_chain(&replayed.chain);
+    cleanup_chain_state(&replayed.state);
+    cleanup_wallet(&replayed.miner_wallet);
+    
+    memset(&replayed, 0, sizeof(AppState));
+    init_chain(&replayed.chain, 1);
+    strcpy(replayed.blockchain_file, chain_file);
+    assert(load_blockchain(&replayed) && replayed.chain.size == 2);
+    cleanup_chain(&replayed.chain);
+    cleanup_chain_state(&replayed.state);
+    cleanup_wallet(&broke);
+    
+    cleanup_wallet(&saved);
+    cleanup_wallet(&app.miner_wallet);
+    cleanup_wallet(&recovered.miner_wallet);
+    cleanup_chain(&app.chain);
+    cleanup_chain(&recovered.chain);
+    cleanup_chain_state(&recovered.state);
+    remove(chain_file);
+    remove(wallet_file);
+    remove(journal_file);
+    
+    printf("✓ Journal recovery tests passed\n\n");
+}
+
+void test_chain_pruning() {
+    printf("Testing pruned block bodies...\n");
+    
+    const char *chain_file = "test_pruned.dat";
+    Chain chain;
+    Wallet wallet;
+    RewardSystem rs;
+    assert(init_chain(&chain, 4));
+    init_wallet(&wallet);
+    init_reward_system(&rs);
+    mine_test_blocks(&chain, 5, &wallet, &rs);
+    
+    // The tip body is always kept; limits walk down from it
+    assert(chain_prune_height(&chain, 0, 0) == 0);
+    assert(chain_prune_height(&chain, 0, 1) == 4);
+    assert(chain_prune_height(&chain, 2, 0) == 3);
+    
+    uint64_t commitment = digit_store_content_id(&chain_block(&chain, 1)->pi_digits);
+    assert(chain_prune_bodies(&chain, 3) == 3);
+    assert(chain.pruned_height == 3 && chain_prune_bodies(&chain, 3) == 0);
+    
+    const Block *pruned = chain_block(&chain, 1);
+    assert(pruned->pruned && pruned->digits_commitment == commitment);
+    assert(pruned->transaction_count == 0 && pruned->pi_digits.packed == NULL);
+    assert(block_body_size(pruned) == 0);
+    
+    // Headers survive, so links and proof of work still check out
+    assert(chain_verify_links(&chain) == -1);
+    assert(chain_find_hash(&chain, pruned->hash) == 1);
+    for (int i = 1; i < 5; i++) {
+        assert(validate_block(chain_block(&chain, i), chain_block(&chain, i - 1)));
+    }
+    
+    ChainState state;
+    init_chain_state(&state);
+    assert(!state_apply_block(&state, pruned));
+    cleanup_chain_state(&state);
+    
+    // Pruned records round-trip through the chain file
+    assert(save_chain_file(chain_file, &chain, CODEC_LZ));
+    Chain loaded;
+    assert(init_chain(&loaded, 1));
+    assert(load_chain_file(chain_file, &loaded));
+    assert(chain_size(&loaded) == 5 && loaded.pruned_height == 3);
+    assert(chain_block(&loaded, 2)->pruned && chain_block(&loaded, 1)->digits_commitment == commitment);
+    assert(!chain_block(&loaded, 3)->pruned);
+    assert(chain_block(&loaded, 3)->pi_digits.count == chain_block(&chain, 3)->pi_digits.count);
+    for (int i = 1; i < 5; i++) {
+        assert(validate_block(chain_block(&loaded, i), chain_block(&loaded, i - 1)));
+    }
+    
+    // Peers learn which bodies can be fetched from this node
+    NetworkManager nm;
+    memset(&nm, 0, sizeof(NetworkManager));
+    set_node_services(&nm, loaded.pruned_height);
+    NetworkMessage msg;
+    build_handshake_message(&nm, chain_size(&loaded), &msg);
+    Peer peer;
+    memset(&peer, 0, sizeof(Peer));
+    int height = 0;
+    assert(parse_handshake_message(&msg, &peer, &height) && height == 5);
+    assert(!peer_can_serve(&peer, 2) && peer_can_serve(&peer, 3));
+    
+    cleanup_chain(&chain);
+    cleanup_chain(&loaded);
+    remove(chain_file);
+    
+    printf("✓ Chain pruning tests passed\n\n");
+}
+
+// Digit-free block that passes validation without mining
+static void append_test_block(Chain *chain, const char *miner) {
+    const Block *prev = chain_tip(chain);
+    Block block;
+    memset(&block, 0, sizeof(Block));
+    block.index = chain_size(chain);
+    block.difficulty = 1;
+    block.prev_hash = prev ? prev->hash : 0;
+    block.total_difficulty = (prev ? prev->total_difficulty : 0) + 1;
+    block.mining_reward = 50;
+    strcpy(block.miner_address, miner);
+    
+    Transaction coinbase;
+    assert(create_coinbase_transaction(&coinbase, miner, block.mining_reward));
+    assert(add_transaction_to_block(&block, &coinbase));
+    block.merkle_root = compute_merkle_root(&block);
+    block.hash = calculate_block_hash(&block);
+    assert(chain_append(chain, &block));
+}
+
+// Transfer signed by the sending wallet
+static void sequenced_transfer(Transaction *tx, const Wallet *from, const char *to, uint64_t amount, uint64_t fee,
+                               uint64_t sequence) {
+    assert(create_transaction_with_fee(tx, from->address, to, amount, fee));
+    set_transaction_sequence(tx, sequence);
+    assert(sign_transaction(tx, from->private_key));
+}
+
+static void signed_transfer(Transaction *tx, const Wallet *from, const char *to, uint64_t amount, uint64_t fee) {
+    sequenced_transfer(tx, from, to, amount, fee, 0);
+}
+
+static void append_transfer_block(Chain *chain, const Transaction *tx, const RewardSystem *rs) {
+    const Block *prev = chain_tip(chain);
+    Transaction *entry = tx_new(tx);
+    assert(entry != NULL);
+    Block block;
+    block.index = chain_size(chain);
+    mine_block_with_transactions(&block, prev->hash, prev, "ARCMINER", rs, &entry, 1);
+    tx_release(entry);
+    assert(chain_append(chain, &block));
+}
+
+void test_account_state() {
+    printf("Testing the account state table...\n");
+    
+    // Rewards to many miners grow the table well past its first size
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    char miner[32];
+    for (int i = 0; i < 500; i++) {
+        snprintf(miner, sizeof(miner), "ARCMINER%03d", i);
+        append_test_block(&chain, miner);
+    }
+    
+    ChainState state;
+    init_chain_state(&state);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 500);
+    assert(state.count == 500 && state.capacity >= 1000);
+    for (int i = 0; i < 500; i++) {
+        snprintf(miner, sizeof(miner), "ARCMINER%03d", i);
+        assert(state_get_balance(&state, address_find(miner)) == 50);
+    }
+    assert(state_get_balance(&state, address_find("nobody")) == 0);
+    
+    // Transfers move balances and count toward the sender's total
+    Block block;
+    memset(&block, 0, sizeof(Block));
+    Transaction tx;
+    create_transaction(&tx, "ARCMINER007", "ARCMINER123", 20);
+    assert(add_transaction_to_block(&block, &tx));
+    create_transaction(&tx, "ARCMINER123", "ARCNEW", 70);
+    assert(add_transaction_to_block(&block, &tx));
+    assert(state_apply_block(&state, &block));
+    assert(state_get_balance(&state, address_find("ARCMINER007")) == 30 && state_get_sent(&state, address_find("ARCMINER007")) == 20);
+    assert(state_get_balance(&state, address_find("ARCMINER123")) == 0 && state_get_balance(&state, address_find("ARCNEW")) == 70);
+    cleanup_block(&block);
+    
+    // A transfer the sender cannot cover is refused, and the state keeps
+    // the transfers before it out too
+    memset(&block, 0, sizeof(Block));
+    create_transaction(&tx, "ARCMINER008", "ARCNEW", 10);
+    assert(add_transaction_to_block(&block, &tx));
+    create_transaction(&tx, "ARCMINER007", "ARCNEW", 51);
+    assert(add_transaction_to_block(&block, &tx));
+    ChainState copy;
+    init_chain_state(&copy);
+    assert(sync_chain_state(&copy, &chain, NULL, 0) == 500);
+    assert(!state_check_block(&copy, &block) && !state_apply_block(&copy, &block));
+    assert(state_get_balance(&copy, address_find("ARCMINER008")) == 50 && state_get_balance(&copy, address_find("ARCNEW")) == 0);
+    assert(copy.height == 500);
+    cleanup_block(&block);
+    
+    // The same signed transfer twice in a block is a double spend, even
+    // when the sender could cover both
+    memset(&block, 0, sizeof(Block));
+    create_transaction(&tx, "ARCMINER009", "ARCNEW", 20);
+    assert(add_transaction_to_block(&block, &tx) && add_transaction_to_block(&block, &tx));
+    assert(!state_check_block(&copy, &block));
+    block.unsigned_transfers = block.unsequenced_transfers = true;
+    assert(state_check_block(&copy, &block));
+    cleanup_block(&block);
+    
+    // Snapshots keep every account of the table
+    const char *snapshot_file = "test_accounts.dat";
+    assert(save_state_snapshot(&state, snapshot_file));
+    assert(load_state_snapshot(&copy, snapshot_file));
+    assert(copy.count == state.count && copy.total_supply == state.total_supply);
+    assert(state_get_balance(&copy, address_find("ARCNEW")) == 70 && state_get_sent(&copy, address_find("ARCMINER123")) == 70);
+    assert(state_get_balance(&copy, address_find("ARCMINER499")) == 50);
+    
+    remove(snapshot_file);
+    cleanup_chain_state(&copy);
+    cleanup_chain_state(&state);
+    cleanup_chain(&chain);
+    
+    printf("✓ Account state tests passed\n\n");
+}
+
+void test_chain_validation() {
+    printf("Testing parallel chain validation...\n");
+    
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    for (int i = 0; i < 300; i++) {
+        append_test_block(&chain, "miner");
+    }
+    assert(chain_validate(&chain, 0) == -1);
+    assert(chain_validate(&chain, 300) == -1);
+    
+    // A tampered body no longer matches its hash
+    Block *block = chain_block(&chain, 200);
+    block->transactions[0]->amount++;
+    assert(chain_validate(&chain, 0) == 200);
+    assert(chain_validate(&chain, 250) == -1);
+    block->transactions[0]->amount--;
+    
+    // Transaction rules; transfers carry their sender's signature
+    Wallet alice;
+    assert(init_wallet(&alice));
+    Transaction transfer;
+    signed_transfer(&transfer, &alice, "bob", 10, 0);
+    assert(add_transaction_to_block(block, &transfer));
+    assert(validate_block_transactions(block));
+    block->transactions[1]->amount++;
+    assert(!validate_block_transactions(block));
+    block->transactions[1]->amount--;
+    block->transactions[1]->is_coinbase = true;
+    assert(!validate_block_transactions(block));
+    block->transactions[1]->is_coinbase = false;
+    block->transactions[1]->to = address_intern(alice.address);
+    assert(!validate_block_transactions(block));
+    block->transaction_count = 1;
+    block->transactions[0]->amount = 1;
+    assert(!validate_block_transactions(block));
+    block->transactions[0]->amount = block->mining_reward;
+    
+    // A full block is checked in chunks; a bad transfer in any of them fails it
+    for (int i = 0; i < MAX_TRANSACTIONS_PER_BLOCK - 1; i++) {
+        signed_transfer(&transfer, &alice, "bob", (uint64_t)i + 1, 0);
+        assert(add_transaction_to_block(block, &transfer));
+    }
+    assert(validate_block_transactions(block));
+    for (int i = 1; i < MAX_TRANSACTIONS_PER_BLOCK; i += 37) {
+        block->transactions[i]->signature[5] ^= 1;
+        assert(!validate_block_transactions(block));
+        block->transactions[i]->signature[5] ^= 1;
+    }
+    while (block->transaction_count > 1) {
+        tx_release(block->transactions[--block->transaction_count]);
+    }
+    cleanup_wallet(&alice);
+    
+    // Broken links are found by the header sweep
+    chain_truncate(&chain, 280);
+    Block orphan;
+    memset(&orphan, 0, sizeof(Block));
+    orphan.index = 280;
+    orphan.difficulty = 1;
+    orphan.total_difficulty = chain_tip(&chain)->total_difficulty + 1;
+    orphan.prev_hash = chain_tip(&chain)->hash + 1;
+    orphan.hash = calculate_block_hash(&orphan);
+    assert(chain_append(&chain, &orphan));
+    assert(chain_validate(&chain, 0) == 280);
+    
+    cleanup_chain(&chain);
+    
+    printf("✓ Parallel chain validation tests passed\n\n");
+}
+
+static void count_progress(void *context, int done, int total) {
+    (void)total;
+    *(int *)context = done;
+}
+
+// Damages the file once its first import pass has read every block
+typedef struct {
+    const char *path;
+    bool damaged;
+} DamageOnce;
+
+static void damage_after_first_pass(void *context, int done, int total) {
+    DamageOnce *damage = context;
+    if (damage->damaged || done != total) return;
+    
+    FILE *file = fopen(damage->path, "r+b");
+    assert(file != NULL && fseek(file, file_size(damage->path) * 3 / 4, SEEK_SET) == 0);
+    uint8_t garbage[64];
+    memset(garbage, 0xA5, sizeof(garbage));
+    assert(fwrite(garbage, 1, sizeof(garbage), file) == sizeof(garbage));
+    fclose(file);
+    damage->damaged = true;
+}
+
+void test_chain_import() {
+    printf("Testing streaming export and import...\n");
+    
+    const char *main_file = "test_export_main.dat";
+    const char *fork_file = "test_export_fork.dat";
+    
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    for (int i = 0; i < 600; i++) {
+        append_test_block(&chain, "miner");
+    }
+    int done = 0;
+    assert(export_chain_file(main_file, &chain, CODEC_LZ, count_progress, &done));
+    assert(done == 600);
+    
+    // The reader can start anywhere and hands out blocks in order
+    ChainReader reader;
+    assert(open_chain_reader(&reader, main_file, 500));
+    assert(reader.frame_count > 1);
+    Block block;
+    int height = 500;
+    while (chain_reader_next(&reader, &block)) {
+        assert(block.hash == chain_block(&chain, height)->hash);
+        cleanup_block(&block);
+        height++;
+    }
+    assert(height == 600 && !reader.failed);
+    close_chain_reader(&reader);
+    
+    // Importing into an empty chain appends everything, a second time nothing
+    Chain copy;
+    assert(init_chain(&copy, 1));
+    ChainImportResult result;
+    assert(import_chain_file(main_file, &copy, NULL, 0, NULL, NULL, &result));
+    assert(result.fork_height == 0 && result.imported == 600 && chain_size(&copy) == 600);
+    assert(chain_tip(&copy)->hash == chain_tip(&chain)->hash);
+    assert(import_chain_file(main_file, &copy, NULL, 0, NULL, NULL, &result));
+    assert(result.imported == 0 && result.fork_height == 600 && !result.reorganized);
+    
+    // A heavier branch from height 400 replaces the blocks above the fork
+    chain_truncate(&chain, 400);
+    for (int i = 0; i < 250; i++) {
+        append_test_block(&chain, "other");
+    }
+    assert(export_chain_file(fork_file, &chain, CODEC_NONE, NULL, NULL));
+    assert(import_chain_file(fork_file, &copy, NULL, 500, NULL, NULL, &result));
+    assert(result.fork_height == 400 && !result.reorganized && chain_size(&copy) == 600);
+    assert(import_chain_file(fork_file, &copy, NULL, 0, NULL, NULL, &result));
+    assert(result.fork_height == 400 && result.reorganized && result.imported == 250);
+    assert(chain_size(&copy) == 650 && chain_tip(&copy)->hash == chain_tip(&chain)->hash);
+    
+    // The lighter branch is left out
+    assert(import_chain_file(main_file, &copy, NULL, 0, NULL, NULL, &result));
+    assert(result.fork_height == 400 && !result.reorganized && chain_size(&copy) == 650);
+    
+    // Only the valid part of a file is used
+    for (int i = 0; i < 20; i++) {
+        append_test_block(&chain, "other");
+    }
+    chain_block(&chain, 660)->transactions[0]->amount++;
+    assert(export_chain_file(fork_file, &chain, CODEC_LZ, NULL, NULL));
+    assert(import_chain_file(fork_file, &copy, NULL, 0, NULL, NULL, &result));
+    assert(result.imported == 10 && result.invalid_height == 660 && chain_size(&copy) == 660);
+    
+    // A file that changes between the two passes leaves the chain alone
+    chain_truncate(&chain, 300);
+    for (int i = 0; i < 400; i++) {
+        append_test_block(&chain, "third");
+    }
+    assert(export_chain_file(fork_file, &chain, CODEC_NONE, NULL, NULL));
+    uint32_t tip_hash = chain_tip(&copy)->hash;
+    DamageOnce damage = {fork_file, false};
+    assert(!import_chain_file(fork_file, &copy, NULL, 0, damage_after_first_pass, &damage, &result));
+    assert(damage.damaged && result.fork_height == 300 && !result.reorganized);
+    assert(chain_size(&copy) == 660 && chain_tip(&copy)->hash == tip_hash);
+    assert(chain_validate(&copy, 0) == -1);
+    
+    // With the state, a block repeating a mined transfer ends the valid
+    // part of a file, on import and on load
+    Wallet alice;
+    assert(init_wallet(&alice));
+    RewardSystem rs;
+    init_reward_system(&rs);
+    Chain funded;
+    assert(init_chain(&funded, 4));
+    append_test_block(&funded, alice.address);
+    Transaction paid, spent;
+    signed_transfer(&paid, &alice, "ARCBOB", 10, 0);
+    append_transfer_block(&funded, &paid, &rs);
+    append_transfer_block(&funded, &paid, &rs);
+    append_test_block(&funded, "other");
+    assert(chain_validate(&funded, 0) == -1);
+    assert(export_chain_file(fork_file, &funded, CODEC_LZ, NULL, NULL));
+    
+    Chain target;
+    assert(init_chain(&target, 4));
+    ChainState state;
+    init_chain_state(&state);
+    assert(import_chain_file(fork_file, &target, &state, 0, NULL, NULL, &result));
+    assert(result.imported == 2 && result.invalid_height == 2 && chain_size(&target) == 2);
+    
+    AppState app;
+    memset(&app, 0, sizeof(AppState));
+    assert(init_chain(&app.chain, 1));
+    strcpy(app.blockchain_file, main_file);
+    assert(save_chain_file(main_file, &funded, CODEC_LZ) && load_blockchain(&app));
+    assert(chain_size(&app.chain) == 2 && app.state.height == 2);
+    cleanup_chain(&app.chain);
+    cleanup_chain_state(&app.state);
+    
+    // Without a snapshot to start from, a pruned body ends it as well
+    Chain pruned;
+    assert(init_chain(&pruned, 4));
+    for (int i = 0; i < 3; i++) {
+        append_test_block(&pruned, alice.address);
+    }
+    assert(chain_prune_bodies(&pruned, 2) == 2 && save_chain_file(main_file, &pruned, CODEC_LZ));
+    assert(init_chain(&app.chain, 1) && load_blockchain(&app));
+    assert(chain_size(&app.chain) == app.state.height && app.state.height == 0);
+    cleanup_chain(&app.chain);
+    cleanup_chain_state(&app.state);
+    cleanup_chain(&pruned);
+    
+    // A heavier branch is checked against the state rolled back to the
+    // fork: the replay is refused, another transfer numbered 1 is adopted
+    assert(sync_chain_state(&state, &target, NULL, 0) == 2);
+    sequenced_transfer(&spent, &alice, "ARCCAROL", 5, 0, 1);
+    append_transfer_block(&target, &spent, &rs);
+    assert(sync_chain_state(&state, &target, NULL, 0) == 1);
+    assert(import_chain_file(fork_file, &target, &state, 0, NULL, NULL, &result));
+    assert(result.fork_height == 2 && result.invalid_height == 2 && !result.reorganized);
+    assert(chain_size(&target) == 3 && state_get_sequence(&state, paid.from) == 2);
+    
+    chain_truncate(&funded, 2);
+    sequenced_transfer(&spent, &alice, "ARCDAVE", 7, 0, 1);
+    append_transfer_block(&funded, &spent, &rs);
+    append_test_block(&funded, "other");
+    assert(export_chain_file(fork_file, &funded, CODEC_NONE, NULL, NULL));
+    assert(import_chain_file(fork_file, &target, &state, 0, NULL, NULL, &result));
+    assert(result.reorganized && result.imported == 2 && result.invalid_height == -1);
+    assert(sync_chain_state(&state, &target, NULL, 0) == 4);
+    assert(state_get_balance(&state, paid.from) == 33 && state_get_sequence(&state, paid.from) == 2);
+    
+    // A state that is not at the chain's tip is refused
+    chain_truncate(&target, 3);
+    assert(!import_chain_file(fork_file, &target, &state, 0, NULL, NULL, &result));
+    
+    cleanup_chain_state(&state);
+    cleanup_chain(&target);
+    cleanup_chain(&funded);
+    cleanup_wallet(&alice);
+    cleanup_chain(&chain);
+    cleanup_chain(&copy);
+    remove(main_file);
+    remove(fork_file);
+    
+    printf("✓ Streaming export and import tests passed\n\n");
+}
+
+void test_memory_pool() {
+    printf("Testing scratch arenas...\n");
+    
+    MemoryPool pool;
+    assert(init_memory_pool(&pool, 256));
+    assert(pool.pool_size == 256);
+    
+    char *a = allocate_from_pool(&pool, 100);
+    assert(a != NULL && ((uintptr_t)a % 16) == 0);
+    memset(a, 1, 100);
+    
+    // Reset points release everything allocated after them
+    PoolMark mark = memory_pool_mark(&pool);
+    char *b = allocate_from_pool(&pool, 200);   // Chains a second chunk
+    char *big = allocate_from_pool(&pool, 4096); // Oversized chunk
+    assert(b != NULL && big != NULL && pool.pool_size == 256 * 2 + 4096);
+    memset(big, 2, 4096);
+    assert(pool.used_size == 112 + 208 + 4096 && pool.peak_size == pool.used_size);
+    
+    reset_memory_pool_to(&pool, mark);
+    assert(pool.used_size == 112 && pool.pool_size == 256 * 2);
+    assert(a[99] == 1);
+    
+    // Kept chunks are reused without growing the pool
+    assert(allocate_from_pool(&pool, 200) == b);
+    assert(pool.pool_size == 256 * 2);
+    
+    reset_memory_pool(&pool);
+    assert(pool.used_size == 0 && allocate_from_pool(&pool, 16) == a);
+    cleanup_memory_pool(&pool);
+    assert(!pool.initialized && allocate_from_pool(&pool, 16) == NULL);
+    
+    // Mining scratch is released when the work is done
+    MemoryPool *scratch = thread_scratch_pool();
+    size_t used = scratch->used_size;
+    char digits[65];
+    calculate_pi_spigot(digits, 64);
+    assert(strlen(digits) == 64);
+    assert(scratch->used_size == used && scratch->peak_size >= 64 * sizeof(int));
+    
+    printf("✓ Scratch arena tests passed\n\n");
+}
+
+static void tx_churn_task(void *context, int index) {
+    (void)context;
+    Transaction *held[64];
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 64; i++) {
+            Transaction value;
+            assert(create_transaction(&value, "alice", "bob", (uint64_t)(index * 64 + i + 1)));
+            held[i] = tx_new(&value);
+            assert(held[i] != NULL && held[i]->amount == value.amount);
+        }
+        for (int i = 0; i < 64; i++) {
+            tx_release(held[i]);
+        }
+    }
+}
+
+void test_large_buffers() {
+    printf("Testing large buffers...\n");
+    
+    // Small buffers come from the heap, large ones are mapped; both zeroed
+    size_t sizes[] = {64, LARGE_BUFFER_THRESHOLD - 1, LARGE_BUFFER_THRESHOLD, 3 * LARGE_BUFFER_THRESHOLD + 17};
+    for (int pass = 0; pass < 2; pass++) {
+        set_large_pages_enabled(pass == 0);
+        for (int i = 0; i < 4; i++) {
+            uint8_t *buffer = large_buffer_alloc(sizes[i]);
+            assert(buffer != NULL);
+            assert(buffer[0] == 0 && buffer[sizes[i] / 2] == 0 && buffer[sizes[i] - 1] == 0);
+            memset(buffer, 0xAB, sizes[i]);
+            large_buffer_free(buffer, sizes[i]);
+        }
+    }
+    set_large_pages_enabled(true);
+    assert(large_pages_enabled());
+    
+    LargeBufferStats stats;
+    get_large_buffer_stats(&stats);
+    assert(stats.explicit_huge + stats.transparent_huge + stats.regular >= 4);
+    
+    // Digit buffers above the threshold round-trip through the mapping
+    int count = 2 * LARGE_BUFFER_THRESHOLD + 3;
+    PiDigits digits;
+    assert(pi_digits_alloc(&digits, count));
+    digits.packed[pi_packed_size(count) - 1] = 0x90;
+    char last[4];
+    pi_digits_to_string(&digits, count - 1, 1, last);
+    assert(last[0] == '9');
+    pi_digits_free(&digits);
+    assert(digits.packed == NULL && digits.count == 0);
+    
+    printf("✓ Large buffer tests passed\n\n");
+}
+
+static volatile int worker_exits;
+
+static void count_worker_exit(void) {
+    atomic_add_int(&worker_exits, 1);
+}
+
+void test_tx_pool() {
+    printf("Testing shared transaction records...\n");
+    
+    assert(init_tx_pool());
+    TxPoolStats before;
+    get_tx_pool_stats(&before);
+    
+    Transaction value;
+    assert(create_transaction(&value, "alice", "bob", 42));
+    Transaction *tx = tx_new(&value);
+    assert(tx != NULL && tx_refcount(tx) == 1 && tx->amount == 42);
+    
+    // Blocks share the record instead of copying it
+    Block a, b;
+    memset(&a, 0, sizeof(Block));
+    memset(&b, 0, sizeof(Block));
+    assert(add_shared_transaction(&a, tx) && add_shared_transaction(&b, tx));
+    assert(a.transactions[0] == tx && b.transactions[0] == tx && tx_refcount(tx) == 3);
+    cleanup_block(&a);
+    assert(tx_refcount(tx) == 2 && b.transactions[0]->amount == 42);
+    
+    // Copies get a record of their own
+    assert(add_transaction_to_block(&b, &value));
+    assert(b.transactions[1] != tx && tx_refcount(b.transactions[1]) == 1);
+    
+    TxPoolStats stats;
+    get_tx_pool_stats(&stats);
+    assert(stats.live_records == before.live_records + 2 && stats.slabs >= 1);
+    
+    cleanup_block(&b);
+    tx_release(tx);
+    
+    // Released records are reused from the thread cache
+    Transaction *reused = tx_new(NULL);
+    assert(reused == tx && reused->amount == 0);
+    tx_release(reused);
+    
+    // Worker threads allocate and release concurrently
+    assert(parallel_for(8, tx_churn_task, NULL));
+    get_tx_pool_stats(&stats);
+    assert(stats.live_records == before.live_records);
+    
+    // The workers, and their caches, outlive each loop
+    assert(add_thread_exit_hook(count_worker_exit));
+    assert(parallel_for(8, tx_churn_task, NULL) && parallel_for(8, tx_churn_task, NULL));
+    assert(atomic_load_int(&worker_exits) == 0);
+    stop_worker_pool();
+    assert(atomic_load_int(&worker_exits) == get_worker_count() - 1);
+    get_tx_pool_stats(&stats);
+    assert(stats.live_records == before.live_records);
+    
+    printf("✓ Shared transaction record tests passed\n\n");
+}
+
+static void from_hex(const char *hex, uint8_t *out, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned int byte;
+        assert(sscanf(hex + 2 * i, "%2x", &byte) == 1);
+        out[i] = (uint8_t)byte;
+    }
+}
+
+void test_ed25519() {
+    printf("Testing Ed25519 signatures...\n");
+    
+    uint8_t digest[SHA512_DIGEST_SIZE], expected[SHA512_DIGEST_SIZE];
+    sha512("abc", 3, digest);
+    from_hex("ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+             "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f", expected, sizeof(expected));
+    assert(memcmp(digest, expected, sizeof(digest)) == 0);
+    
+    // RFC 8032 section 7.1, tests 1 and 2
+    const char *vectors[2][4] = {
+        {"9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+         "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+         "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"},
+        {"4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+         "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+         "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"}
+    };
+    for (int v = 0; v < 2; v++) {
+        uint8_t seed[32], public_key[32], expected_key[32], signature[64], expected_signature[64], message[1];
+        size_t length = strlen(vectors[v][2]) / 2;
+        from_hex(vectors[v][0], seed, 32);
+        from_hex(vectors[v][1], expected_key, 32);
+        from_hex(vectors[v][2], message, length);
+        from_hex(vectors[v][3], expected_signature, 64);
+        ed25519_public_key(public_key, seed);
+        assert(memcmp(public_key, expected_key, 32) == 0);
+        ed25519_sign(signature, message, length, seed, public_key);
+        assert(memcmp(signature, expected_signature, 64) == 0);
+        assert(ed25519_verify(signature, message, length, public_key));
+        signature[10] ^= 1;
+        assert(!ed25519_verify(signature, message, length, public_key));
+    }
+    
+    // A batch holds exactly when every signature in it does
+    enum { BATCH = 40 };
+    static uint8_t keys[BATCH][32], signatures[BATCH][64], messages[BATCH][8];
+    Ed25519BatchItem items[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        uint8_t seed[32];
+        memset(seed, i + 1, sizeof(seed));
+        memset(messages[i], 'a' + i % 26, sizeof(messages[i]));
+        ed25519_public_key(keys[i], seed);
+        ed25519_sign(signatures[i], messages[i], sizeof(messages[i]), seed, keys[i]);
+        items[i] = (Ed25519BatchItem){messages[i], sizeof(messages[i]), keys[i], signatures[i]};
+    }
+    assert(ed25519_verify_batch(items, BATCH) && ed25519_verify_batch(items, 1));
+    messages[17][3] ^= 1;
+    assert(!ed25519_verify_batch(items, BATCH) && ed25519_verify_batch(items, 17));
+    messages[17][3] ^= 1;
+    items[30].public_key = keys[31];
+    assert(!ed25519_verify_batch(items, BATCH));
+    
+    // Wallet transfers sign everything but the signature itself
+    Wallet wallet;
+    assert(init_wallet(&wallet));
+    Transaction tx;
+    assert(create_transaction_with_fee(&tx, wallet.address, "ARCBOB", 25, 2));
+    assert(!verify_transaction(&tx));
+    assert(sign_transaction(&tx, wallet.private_key) && verify_transaction(&tx));
+    Transaction *batch[1] = {&tx};
+    assert(verify_transaction_batch(batch, 1));
+    tx.timestamp++;
+    assert(!verify_transaction(&tx) && !verify_transaction_batch(batch, 1));
+    tx.timestamp--;
+    tx.to = address_intern("ARCEVE");
+    assert(!verify_transaction(&tx));
+    cleanup_wallet(&wallet);
+    
+    printf("✓ Ed25519 tests passed\n\n");
+}
+
+void test_verify_cache() {
+    printf("Testing the verification caches...\n");
+    
+    assert(init_verify_cache(256, 256));
+    VerifyCacheStats stats;
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &stats);
+    assert(stats.capacity >= 256 && stats.entries == 0);
+    
+    // A verified signature is remembered; a changed transfer misses
+    Wallet wallet;
+    assert(init_wallet(&wallet));
+    Transaction a, b;
+    signed_transfer(&a, &wallet, "ARCBOB", 5, 0);
+    signed_transfer(&b, &wallet, "ARCBOB", 6, 0);
+    assert(verify_transaction(&a) && verify_transaction(&a));
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &stats);
+    assert(stats.entries == 1 && stats.hits == 1 && stats.misses == 1);
+    a.amount++;
+    assert(!verify_transaction(&a));
+    a.amount--;
+    
+    // A block only re-checks what it changed
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    for (int i = 0; i < 40; i++) {
+        append_test_block(&chain, wallet.address);
+    }
+    Block *block = chain_block(&chain, 39);
+    assert(add_transaction_to_block(block, &a) && add_transaction_to_block(block, &b));
+    block->merkle_root = compute_merkle_root(block);
+    block->hash = calculate_block_hash(block);
+    assert(validate_block_contents(block));
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &stats);
+    assert(stats.entries == 2 && stats.hits == 2);
+    assert(validate_block_contents(block));
+    get_verify_cache_stats(VERIFY_CACHE_BLOCKS, &stats);
+    assert(stats.entries == 1 && stats.hits == 1);
+    block->transactions[2]->signature[0] ^= 1;
+    assert(!validate_block_contents(block));
+    block->transactions[2]->signature[0] ^= 1;
+    assert(validate_block_contents(block));
+    
+    // A second pass over the chain is all hits
+    assert(chain_validate(&chain, 0) == -1);
+    VerifyCacheStats before;
+    get_verify_cache_stats(VERIFY_CACHE_BLOCKS, &before);
+    assert(chain_validate(&chain, 0) == -1);
+    get_verify_cache_stats(VERIFY_CACHE_BLOCKS, &stats);
+    assert(stats.hits - before.hits == 40 && stats.misses == before.misses);
+    chain_block(&chain, 7)->mining_reward++;
+    assert(chain_validate(&chain, 0) == 7);
+    cleanup_chain(&chain);
+    
+    // Memory stays fixed however many keys go in
+    for (uint64_t i = 1; i <= 5000; i++) {
+        VerifyKey key = {i * 0x9E3779B97F4A7C15ULL, i};
+        verify_cache_insert(VERIFY_CACHE_TRANSACTIONS, &key);
+    }
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &stats);
+    assert(stats.entries <= stats.capacity && stats.capacity < 5000);
+    
+    cleanup_verify_cache();
+    get_verify_cache_stats(VERIFY_CACHE_TRANSACTIONS, &stats);
+    assert(stats.capacity == 0);
+    assert(verify_transaction(&b));
+    cleanup_wallet(&wallet);
+    
+    printf("✓ Verification cache tests passed\n\n");
+}
+
+void test_mempool() {
+    printf("Testing the mempool...\n");
+    
+    // Three funded miners
+    Wallet alice, bob, carol, nobody;
+    assert(init_wallet(&alice) && init_wallet(&bob) && init_wallet(&carol) && init_wallet(&nobody));
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    append_test_block(&chain, alice.address);
+    append_test_block(&chain, bob.address);
+    append_test_block(&chain, carol.address);
+    ChainState state;
+    init_chain_state(&state);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 3);
+    
+    Mempool pool;
+    assert(init_mempool(&pool, 1 << 20));
+    Transaction a1, a2, b1, c1, tx;
+    signed_transfer(&a1, &alice, "ARCDAVE", 10, 1);
+    sequenced_transfer(&a2, &alice, "ARCDAVE", 11, 9, 1);
+    signed_transfer(&b1, &bob, "ARCDAVE", 12, 5);
+    signed_transfer(&c1, &carol, "ARCDAVE", 13, 0);
+    assert(mempool_add(&pool, &a1, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &a2, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &b1, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &c1, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &b1, &state) == MEMPOOL_DUPLICATE);
+    assert(mempool_contains(&pool, &a2) && pool.count == 4);
+    
+    // Rejected: spends past the balance with what is already queued, reuses
+    // or skips a sequence number, breaks the rules, or is not signed by the
+    // sender's key
+    sequenced_transfer(&tx, &alice, "ARCDAVE", 20, 1, 2);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_UNFUNDED);
+    sequenced_transfer(&tx, &alice, "ARCDAVE", 1, 1, 1);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_OUT_OF_SEQUENCE);
+    sequenced_transfer(&tx, &alice, "ARCDAVE", 1, 1, 3);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_OUT_OF_SEQUENCE);
+    signed_transfer(&tx, &nobody, "ARCDAVE", 1, 0);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_UNFUNDED);
+    signed_transfer(&tx, &bob, bob.address, 1, 0);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_INVALID);
+    assert(create_transaction_with_fee(&tx, carol.address, "ARCDAVE", 1, 0));
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_INVALID);
+    assert(!sign_transaction(&tx, bob.private_key));
+    signed_transfer(&tx, &carol, "ARCDAVE", 1, 0);
+    tx.fee = 2;
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_INVALID);
+    
+    // Highest fee first across senders, arrival order within a sender
+    Transaction *taken[8];
+    assert(mempool_take(&pool, &state, taken, 3) == 3);
+    assert(taken[0]->amount == 12 && taken[1]->amount == 10 && taken[2]->amount == 11);
+    assert(pool.count == 1 && mempool_contains(&pool, &c1));
+    
+    // The mined block pays the fees to the miner and applies cleanly
+    RewardSystem rs;
+    init_reward_system(&rs);
+    const Block *prev = chain_tip(&chain);
+    Block block;
+    block.index = chain_size(&chain);
+    mine_block_with_transactions(&block, prev->hash, prev, "ARCMINER", &rs, taken, 3);
+    for (int i = 0; i < 3; i++) {
+        tx_release(taken[i]);
+    }
+    assert(block.transaction_count == 4 && block.transactions[0]->amount == block.mining_reward + 15);
+    assert(validate_block_transactions(&block));
+    assert(chain_append(&chain, &block));
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 1);
+    assert(state_get_balance(&state, address_find(alice.address)) == 50 - 31 && state_get_sent(&state, address_find(alice.address)) == 31);
+    assert(state_get_balance(&state, address_find("ARCDAVE")) == 33);
+    assert(state_get_balance(&state, address_find("ARCMINER")) == chain_tip(&chain)->mining_reward + 15);
+    
+    // Transfers already in a block leave the pool
+    assert(mempool_remove_block(&pool, chain_tip(&chain)) == 0);
+    Block carol_block;
+    memset(&carol_block, 0, sizeof(Block));
+    assert(add_transaction_to_block(&carol_block, &c1));
+    assert(mempool_remove_block(&pool, &carol_block) == 1 && pool.count == 0 && pool.bytes == 0);
+    cleanup_block(&carol_block);
+    
+    // Departed entries are reused before another slab is taken
+    MempoolSlab *slab = pool.slabs;
+    assert(slab != NULL && pool.free_entries != NULL);
+    assert(mempool_add(&pool, &c1, &state) == MEMPOOL_ADDED && pool.slabs == slab);
+    cleanup_mempool(&pool);
+    
+    // Under a cap of two transfers the lowest fee is evicted, or refused when it is the newcomer
+    assert(init_mempool(&pool, 1 << 20));
+    assert(mempool_add(&pool, &c1, &state) == MEMPOOL_ADDED);
+    size_t entry_size = pool.bytes;
+    cleanup_mempool(&pool);
+    assert(init_mempool(&pool, 2 * entry_size));
+    Transaction low, mid, high;
+    sequenced_transfer(&low, &bob, "ARCDAVE", 1, 3, 1);
+    signed_transfer(&mid, &carol, "ARCDAVE", 1, 5);
+    sequenced_transfer(&high, &alice, "ARCDAVE", 1, 9, 2);
+    assert(mempool_add(&pool, &low, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &mid, &state) == MEMPOOL_ADDED);
+    sequenced_transfer(&tx, &alice, "ARCDAVE", 1, 1, 2);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_FULL && pool.count == 2);
+    assert(mempool_add(&pool, &high, &state) == MEMPOOL_ADDED);
+    assert(pool.count == 2 && pool.evicted == 2 && !mempool_contains(&pool, &low));
+    assert(pool.bytes <= pool.max_bytes);
+    cleanup_mempool(&pool);
+    
+    // A mined transfer cannot be mined again in the next block, nor queued again
+    Block replay;
+    Transaction *again = tx_new(&a1);
+    assert(again != NULL);
+    prev = chain_tip(&chain);
+    replay.index = chain_size(&chain);
+    mine_block_with_transactions(&replay, prev->hash, prev, "ARCMINER", &rs, &again, 1);
+    tx_release(again);
+    assert(validate_block(&replay, prev) && !state_check_block(&state, &replay));
+    assert(!state_apply_block(&state, &replay) && state.height == chain_size(&chain));
+    cleanup_block(&replay);
+    assert(init_mempool(&pool, 1 << 20));
+    assert(mempool_add(&pool, &a1, &state) == MEMPOOL_OUT_OF_SEQUENCE);
+    
+    // A queued transfer whose number another one took on the chain is dropped
+    Transaction rival;
+    sequenced_transfer(&tx, &alice, "ARCDAVE", 2, 0, 2);
+    sequenced_transfer(&rival, &alice, "ARCEVE", 2, 0, 2);
+    assert(mempool_add(&pool, &tx, &state) == MEMPOOL_ADDED);
+    Transaction *mined = tx_new(&rival);
+    assert(mined != NULL);
+    replay.index = chain_size(&chain);
+    mine_block_with_transactions(&replay, prev->hash, prev, "ARCMINER", &rs, &mined, 1);
+    tx_release(mined);
+    assert(chain_append(&chain, &replay) && sync_chain_state(&state, &chain, NULL, 0) == 1);
+    assert(mempool_peek(&pool, &state, taken, 8) == 0 && mempool_take(&pool, &state, taken, 8) == 0);
+    assert(pool.count == 0 && mempool_next_sequence(&pool, &state, rival.from) == 3);
+    cleanup_mempool(&pool);
+    
+    cleanup_chain_state(&state);
+    cleanup_chain(&chain);
+    cleanup_wallet(&alice);
+    cleanup_wallet(&bob);
+    cleanup_wallet(&carol);
+    cleanup_wallet(&nobody);
+    
+    printf("✓ Mempool tests passed\n\n");
+}
+
+void test_block_template() {
+    printf("Testing the block template...\n");
+    
+    Wallet alice, bob;
+    assert(init_wallet(&alice) && init_wallet(&bob));
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    append_test_block(&chain, alice.address);
+    append_test_block(&chain, bob.address);
+    ChainState state;
+    init_chain_state(&state);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 2);
+    RewardSystem rs;
+    init_reward_system(&rs);
+    
+    Mempool pool;
+    BlockTemplate tmpl;
+    assert(init_mempool(&pool, 1 << 20));
+    init_block_template(&tmpl);
+    pool.listener = block_template_on_mempool;
+    pool.listener_context = &tmpl;
+    block_template_set_tip(&tmpl, chain_tip(&chain), "ARCMINER", &rs);
+    assert(tmpl.height == 2 && tmpl.needs_rebuild);
+    assert(block_template_refill(&tmpl, &pool, NULL) && !tmpl.needs_rebuild);
+    
+    // Arrivals keep the root equal to a full recomputation, until the template is full
+    static Transaction transfers[TEMPLATE_MAX_TRANSFERS + 1];
+    Block block;
+    uint64_t fees = 0;
+    for (int i = 0; i <= TEMPLATE_MAX_TRANSFERS; i++) {
+        signed_transfer(&transfers[i], (i % 2) ? &alice : &bob, "ARCDAVE", (uint64_t)i + 1, (uint64_t)(i % 7));
+        assert(mempool_add(&pool, &transfers[i], NULL) == MEMPOOL_ADDED);
+        if (i < TEMPLATE_MAX_TRANSFERS) fees += transfers[i].fee;
+        if (i % 8 == 0 || i >= TEMPLATE_MAX_TRANSFERS - 1) {
+            assert(block_template_fill_block(&tmpl, &block));
+            assert(block.merkle_root == compute_merkle_root(&block));
+            assert(i < TEMPLATE_MAX_TRANSFERS - 1 || validate_block_transactions(&block));
+            cleanup_block(&block);
+        }
+    }
+    assert(tmpl.count == TEMPLATE_MAX_TRANSFERS && pool.count == TEMPLATE_MAX_TRANSFERS + 1);
+    assert(tmpl.fees == fees && tmpl.coinbase.amount == tmpl.reward + fees);
+    
+    // The last arrival outranks bob's last transfer, so the next refill rebuilds
+    assert(tmpl.needs_rebuild);
+    
+    // Departures from the pool leave the template too; a refill takes up the slack
+    Block mined_elsewhere;
+    memset(&mined_elsewhere, 0, sizeof(Block));
+    assert(add_transaction_to_block(&mined_elsewhere, &transfers[5]));
+    assert(add_transaction_to_block(&mined_elsewhere, &transfers[50]));
+    uint64_t revision = tmpl.revision;
+    assert(mempool_remove_block(&pool, &mined_elsewhere) == 2);
+    cleanup_block(&mined_elsewhere);
+    assert(tmpl.count == TEMPLATE_MAX_TRANSFERS - 2 && tmpl.revision != revision);
+    assert(block_template_fill_block(&tmpl, &block));
+    assert(block.merkle_root == compute_merkle_root(&block));
+    cleanup_block(&block);
+    assert(block_template_refill(&tmpl, &pool, NULL) && tmpl.count == TEMPLATE_MAX_TRANSFERS - 1);
+    assert(!block_template_refill(&tmpl, &pool, NULL));
+    assert(block_template_fill_block(&tmpl, &block));
+    assert(block.merkle_root == compute_merkle_root(&block));
+    cleanup_block(&block);
+    
+    // Once full, only an arrival paying more than a sender's last transfer gets in
+    Wallet carol;
+    assert(init_wallet(&carol));
+    Transaction cheap, cheaper, rich;
+    signed_transfer(&cheap, &carol, "ARCDAVE", 1, 0);
+    signed_transfer(&cheaper, &carol, "ARCDAVE", 2, 0);
+    assert(mempool_add(&pool, &cheap, NULL) == MEMPOOL_ADDED && tmpl.count == TEMPLATE_MAX_TRANSFERS);
+    assert(mempool_add(&pool, &cheaper, NULL) == MEMPOOL_ADDED && !tmpl.needs_rebuild);
+    assert(!block_template_refill(&tmpl, &pool, NULL));
+    Wallet dave;
+    assert(init_wallet(&dave));
+    signed_transfer(&rich, &dave, "ARCDAVE", 3, 9);
+    assert(mempool_add(&pool, &rich, NULL) == MEMPOOL_ADDED && tmpl.needs_rebuild);
+    assert(block_template_refill(&tmpl, &pool, NULL) && tmpl.count == TEMPLATE_MAX_TRANSFERS);
+    bool taken = false;
+    for (int i = 0; i < tmpl.count; i++) {
+        taken = taken || same_transaction(tmpl.transfers[i], &rich);
+    }
+    assert(taken);
+    assert(block_template_fill_block(&tmpl, &block));
+    assert(block.merkle_root == compute_merkle_root(&block) && validate_block_transactions(&block));
+    cleanup_block(&block);
+    cleanup_wallet(&carol);
+    cleanup_wallet(&dave);
+    cleanup_mempool(&pool);
+    cleanup_block_template(&tmpl);
+    
+    // A block mined from the template extends the chain and empties it
+    assert(init_mempool(&pool, 1 << 20));
+    init_block_template(&tmpl);
+    pool.listener = block_template_on_mempool;
+    pool.listener_context = &tmpl;
+    Transaction a, b;
+    signed_transfer(&a, &alice, "ARCDAVE", 10, 2);
+    signed_transfer(&b, &bob, "ARCDAVE", 5, 1);
+    assert(mempool_add(&pool, &a, &state) == MEMPOOL_ADDED);
+    assert(mempool_add(&pool, &b, &state) == MEMPOOL_ADDED);
+    block_template_set_tip(&tmpl, chain_tip(&chain), "ARCMINER", &rs);
+    assert(tmpl.count == 2 && block_template_refill(&tmpl, &pool, &state) && tmpl.count == 2);
+    
+    const Block *tip = chain_tip(&chain);
+    assert(block_template_fill_block(&tmpl, &block));
+    mine_assembled_block(&block, tip);
+    assert(validate_block(&block, tip) && block.transactions[0]->amount == block.mining_reward + 3);
+    assert(chain_append(&chain, &block));
+    assert(mempool_remove_block(&pool, chain_tip(&chain)) == 2 && tmpl.count == 0);
+    block_template_set_tip(&tmpl, chain_tip(&chain), "ARCMINER", &rs);
+    assert(tmpl.height == 3 && !tmpl.needs_rebuild && tmpl.fees == 0);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 1);
+    assert(state_get_balance(&state, address_find(alice.address)) == 38 && state_get_balance(&state, address_find("ARCDAVE")) == 15);
+    
+    // Anything but the next block means the balances have to be checked again
+    block_template_set_tip(&tmpl, chain_block(&chain, 0), "ARCMINER", &rs);
+    assert(tmpl.height == 1 && tmpl.needs_rebuild);
+    cleanup_mempool(&pool);
+    cleanup_block_template(&tmpl);
+    
+    // A sender's second batch arrives while the rest of its first is still
+    // queued; the template must not take the new transfers ahead of them
+    Wallet erin;
+    assert(init_wallet(&erin));
+    for (int i = 0; i < 6; i++) {
+        append_test_block(&chain, erin.address);
+    }
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 6);
+    assert(init_mempool(&pool, 1 << 20));
+    init_block_template(&tmpl);
+    pool.listener = block_template_on_mempool;
+    pool.listener_context = &tmpl;
+    
+    enum { FIRST_BATCH = TEMPLATE_MAX_TRANSFERS + 51 };
+    static Transaction batches[FIRST_BATCH + TEMPLATE_MAX_TRANSFERS];
+    for (int i = 0; i < FIRST_BATCH; i++) {
+        sequenced_transfer(&batches[i], &erin, "ARCDAVE", 1, 0, (uint64_t)i);
+        assert(mempool_add(&pool, &batches[i], &state) == MEMPOOL_ADDED);
+    }
+    block_template_set_tip(&tmpl, chain_tip(&chain), "ARCMINER", &rs);
+    assert(block_template_refill(&tmpl, &pool, &state) && tmpl.count == TEMPLATE_MAX_TRANSFERS);
+    
+    tip = chain_tip(&chain);
+    assert(block_template_fill_block(&tmpl, &block));
+    mine_assembled_block(&block, tip);
+    assert(state_check_block(&state, &block) && chain_append(&chain, &block));
+    assert(mempool_remove_block(&pool, chain_tip(&chain)) == TEMPLATE_MAX_TRANSFERS && tmpl.count == 0);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 1);
+    block_template_set_tip(&tmpl, chain_tip(&chain), "ARCMINER", &rs);
+    
+    for (int i = FIRST_BATCH; i < FIRST_BATCH + TEMPLATE_MAX_TRANSFERS; i++) {
+        sequenced_transfer(&batches[i], &erin, "ARCDAVE", 1, 0, (uint64_t)i);
+        assert(mempool_add(&pool, &batches[i], &state) == MEMPOOL_ADDED);
+    }
+    assert(tmpl.count == 0 && tmpl.needs_rebuild);
+    assert(block_template_refill(&tmpl, &pool, &state) && tmpl.count == TEMPLATE_MAX_TRANSFERS);
+    assert(tmpl.transfers[0]->sequence == TEMPLATE_MAX_TRANSFERS);
+    tip = chain_tip(&chain);
+    assert(block_template_fill_block(&tmpl, &block));
+    mine_assembled_block(&block, tip);
+    assert(state_check_block(&state, &block));
+    cleanup_block(&block);
+    
+    cleanup_wallet(&erin);
+    cleanup_mempool(&pool);
+    cleanup_block_template(&tmpl);
+    cleanup_chain_state(&state);
+    cleanup_chain(&chain);
+    cleanup_wallet(&alice);
+    cleanup_wallet(&bob);
+    
+    printf("✓ Block template tests passed\n\n");
+}
+
+void test_address_table() {
+    printf("Testing the address table...\n");
+    
+    assert(init_address_table());
+    assert(address_find(COINBASE_ADDRESS_TEXT) == ADDRESS_COINBASE);
+    assert(strcmp(address_text(ADDRESS_COINBASE), COINBASE_ADDRESS_TEXT) == 0);
+    assert(address_intern("") == 0 && address_text(0)[0] == '\0' && address_id(0) == NULL);
+    
+    // Key-derived addresses carry their id; other text is hashed to one
+    const char *canonical = "ARC00112233445566778899AABBCCDDEEFF00112233";
+    AddressHandle handle = address_intern(canonical);
+    assert(handle > ADDRESS_COINBASE && address_intern(canonical) == handle);
+    assert(address_find(canonical) == handle && strcmp(address_text(handle), canonical) == 0);
+    assert(address_id(handle)->bytes[0] == 0x00 && address_id(handle)->bytes[1] == 0x11 &&
+           address_id(handle)->bytes[ADDRESS_ID_SIZE - 1] == 0x33);
+    assert(address_find("ARCNEVERSEEN") == 0);
+    AddressHandle legacy = address_intern("ARCMINER123");
+    assert(legacy != 0 && legacy != handle && address_id(legacy) != NULL);
+    int count = address_count();
+    assert(address_intern("ARCMINER123") == legacy && address_count() == count);
+    
+    // Transactions hold handles; files and peers get the text
+    assert(sizeof(Transaction) < sizeof(WireTransaction) - WALLET_ADDRESS_LENGTH);
+    Wallet alice;
+    assert(init_wallet(&alice));
+    Transaction tx, back;
+    signed_transfer(&tx, &alice, canonical, 7, 0);
+    WireTransaction wire;
+    transaction_to_wire(&tx, &wire);
+    assert(strcmp(wire.from_address, alice.address) == 0 && strcmp(wire.to_address, canonical) == 0);
+    assert(transaction_from_wire(&back, &wire) && same_transaction(&tx, &back) && verify_transaction(&back));
+    memset(wire.to_address, 'A', WALLET_ADDRESS_LENGTH);
+    assert(!transaction_from_wire(&back, &wire));
+    
+    // Blocks from older chain files keep their text-leaf Merkle roots
+    const char *chain_file = "test_addresses.dat";
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    append_test_block(&chain, "ARCMINER");
+    append_test_block(&chain, "ARCMINER");
+    Block *block = chain_block(&chain, 1);
+    assert(add_transaction_to_block(block, &tx));
+    uint64_t id_root = compute_merkle_root(block);
+    block->text_leaves = true;
+    block->merkle_root = compute_merkle_root(block);
+    assert(block->merkle_root != id_root);
+    block->hash = calculate_block_hash(block);
+    assert(validate_block(block, chain_block(&chain, 0)));
+    assert(save_chain_file(chain_file, &chain, CODEC_NONE));
+    Chain loaded;
+    assert(init_chain(&loaded, 1));
+    assert(load_chain_file(chain_file, &loaded));
+    assert(chain_block(&loaded, 1)->text_leaves && !chain_block(&loaded, 0)->text_leaves);
+    assert(chain_block(&loaded, 1)->transactions[1]->to == handle);
+    assert(validate_block(chain_block(&loaded, 1), chain_block(&loaded, 0)));
+    
+    cleanup_chain(&chain);
+    cleanup_chain(&loaded);
+    cleanup_wallet(&alice);
+    remove(chain_file);
+    
+    printf("✓ Address table tests passed\n\n");
+}
+
+void test_transfer_batch() {
+    printf("Testing batched transfers...\n");
+    
+    Wallet alice, bob;
+    assert(init_wallet(&alice) && init_wallet(&bob));
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    for (int i = 0; i < 4; i++) {
+        append_test_block(&chain, alice.address);
+    }
+    append_test_block(&chain, bob.address);
+    ChainState state;
+    init_chain_state(&state);
+    assert(sync_chain_state(&state, &chain, NULL, 0) == 5);
+    
+    // Built and signed in one call, across several signing chunks
+    enum { PAYOUTS = 100 };
+    TransferRequest requests[PAYOUTS];
+    Transaction txs[PAYOUTS];
+    for (int i = 0; i < PAYOUTS; i++) {
+        memset(&requests[i], 0, sizeof(TransferRequest));
+        snprintf(requests[i].to, sizeof(requests[i].to), "ARCPAYEE%03d", i);
+        requests[i].amount = 1;
+        requests[i].fee = i % 3;
+    }
+    assert(create_transfer_batch(txs, &alice, 0, requests, PAYOUTS));
+    for (int i = 0; i < PAYOUTS; i++) {
+        assert(txs[i].from == address_find(alice.address) && strcmp(address_text(txs[i].to), requests[i].to) == 0);
+        assert(txs[i].fee == (uint64_t)(i % 3) && txs[i].timestamp == txs[0].timestamp && verify_transaction(&txs[i]));
+        assert(txs[i].sequence == (uint64_t)i);
+    }
+    Wallet forged;
+    memset(&forged, 0, sizeof(Wallet));
+    strcpy(forged.address, alice.address);
+    strcpy(forged.private_key, "not alice's key");
+    Transaction unsigned_tx;
+    assert(!create_transfer_batch(&unsigned_tx, &forged, 0, requests, 1));
+    
+    // One transfer at fault keeps the whole batch out
+    Mempool pool;
+    assert(init_mempool(&pool, 1 << 20));
+    int rejected;
+    requests[PAYOUTS - 1].amount = 200;
+    assert(create_transfer_batch(txs, &alice, 0, requests, PAYOUTS));
+    assert(mempool_add_batch(&pool, txs, PAYOUTS, &state, &rejected) == MEMPOOL_UNFUNDED);
+    assert(rejected == PAYOUTS - 1 && pool.count == 0);
+    requests[PAYOUTS - 1].amount = 1;
+    assert(create_transfer_batch(txs, &alice, 0, requests, PAYOUTS));
+    txs[40].signature[0] ^= 1;
+    assert(mempool_add_batch(&pool, txs, PAYOUTS, &state, &rejected) == MEMPOOL_INVALID);
+    assert(rejected == 40 && pool.count == 0);
+    txs[40].signature[0] ^= 1;
+    assert(create_transfer_batch(txs, &alice, 1, requests, PAYOUTS));
+    assert(mempool_add_batch(&pool, txs, PAYOUTS, &state, &rejected) == MEMPOOL_OUT_OF_SEQUENCE);
+    assert(rejected == 0 && pool.count == 0);
+    assert(create_transfer_batch(txs, &alice, 0, requests, PAYOUTS));
+    Transaction twice[2] = {txs[0], txs[0]};
+    assert(mempool_add_batch(&pool, twice, 2, &state, &rejected) == MEMPOOL_DUPLICATE && rejected == 1);
+    
+    // Accepted whole; later transfers count what the batch queued
+    assert(mempool_add_batch(&pool, txs, PAYOUTS, &state, &rejected) == MEMPOOL_ADDED);
+    assert(rejected == -1 && pool.count == PAYOUTS);
+    assert(mempool_add_batch(&pool, txs, 1, &state, &rejected) == MEMPOOL_DUPLICATE && rejected == 0);
+    Transaction extra;
+    signed_transfer(&extra, &alice, "ARCPAYEE", 2, 0);
+    assert(mempool_add(&pool, &extra, &state) == MEMPOOL_OUT_OF_SEQUENCE);
+    assert(mempool_next_sequence(&pool, &state, extra.from) == PAYOUTS);
+    sequenced_transfer(&extra, &alice, "ARCPAYEE", 2, 0, PAYOUTS);
+    assert(mempool_add(&pool, &extra, &state) == MEMPOOL_UNFUNDED);
+    size_t entry_size = pool.bytes / PAYOUTS;
+    cleanup_mempool(&pool);
+    
+    // Repeated payout lines become distinct transfers that can be queued
+    // and mined together
+    TransferRequest same[3];
+    Transaction repeated[3];
+    for (int i = 0; i < 3; i++) {
+        memset(&same[i], 0, sizeof(TransferRequest));
+        strcpy(same[i].to, "ARCPAYEE");
+        same[i].amount = 2;
+        same[i].fee = 1;
+    }
+    assert(create_transfer_batch(repeated, &bob, 0, same, 3));
+    assert(repeated[0].hash != repeated[1].hash && repeated[1].hash != repeated[2].hash);
+    assert(!same_transaction(&repeated[0], &repeated[2]));
+    assert(init_mempool(&pool, 1 << 20));
+    assert(mempool_add_batch(&pool, repeated, 3, &state, &rejected) == MEMPOOL_ADDED && pool.count == 3);
+    Block payout;
+    memset(&payout, 0, sizeof(Block));
+    for (int i = 0; i < 3; i++) {
+        assert(add_transaction_to_block(&payout, &repeated[i]));
+    }
+    assert(state_check_block(&state, &payout));
+    cleanup_block(&payout);
+    cleanup_mempool(&pool);
+    
+    // A batch the cap cannot hold, or one that would only push itself out,
+    // leaves the pool as it was
+    assert(init_mempool(&pool, 10 * entry_size));
+    assert(mempool_add_batch(&pool, txs, 11, &state, &rejected) == MEMPOOL_FULL && rejected == -1);
+    assert(pool.count == 0 && pool.bytes == 0);
+    TransferRequest rich[5];
+    Transaction rich_txs[5];
+    for (int i = 0; i < 5; i++) {
+        memset(&rich[i], 0, sizeof(TransferRequest));
+        snprintf(rich[i].to, sizeof(rich[i].to), "ARCRICH%d", i);
+        rich[i].amount = 1;
+        rich[i].fee = 9;
+    }
+    assert(create_transfer_batch(rich_txs, &bob, 0, rich, 5));
+    assert(mempool_add_batch(&pool, rich_txs, 5, &state, &rejected) == MEMPOOL_ADDED);
+    assert(mempool_add_batch(&pool, txs, 6, &state, &rejected) == MEMPOOL_FULL);
+    assert(pool.count == 5 && mempool_contains(&pool, &rich_txs[4]) && !mempool_contains(&pool, &txs[0]));
+    cleanup_mempool(&pool);
+    
+    // Nothing is evicted for a batch that would go on to push itself out
+    Wallet carol;
+    assert(init_wallet(&carol));
+    Transaction cheap[2];
+    rich[0].fee = rich[1].fee = 0;
+    assert(create_transfer_batch(cheap, &carol, 0, rich, 2));
+    for (int i = 0; i < 6; i++) {
+        requests[i].fee = 1;
+    }
+    assert(create_transfer_batch(txs, &alice, 0, requests, 6));
+    assert(init_mempool(&pool, 10 * entry_size));
+    assert(mempool_add_batch(&pool, rich_txs, 5, NULL, &rejected) == MEMPOOL_ADDED);
+    assert(mempool_add_batch(&pool, cheap, 2, NULL, &rejected) == MEMPOOL_ADDED);
+    assert(mempool_add_batch(&pool, txs, 6, NULL, &rejected) == MEMPOOL_FULL && rejected == -1);
+    assert(pool.count == 7 && pool.evicted == 0 && mempool_contains(&pool, &cheap[0]));
+    assert(mempool_add_batch(&pool, txs, 5, NULL, &rejected) == MEMPOOL_ADDED);
+    assert(pool.count == 10 && pool.evicted == 2 && !mempool_contains(&pool, &cheap[1]));
+    cleanup_mempool(&pool);
+    cleanup_wallet(&carol);
+    
+    cleanup_chain_state(&state);
+    cleanup_chain(&chain);
+    cleanup_wallet(&alice);
+    cleanup_wallet(&bob);
+    
+    printf("✓ Batched transfer tests passed\n\n");
+}
+
+static bool is_test_pending(void *context, const Transaction *tx) {
+    return same_transaction(context, tx);
+}
+
+void test_rescan() {
+    printf("Testing wallet rescans...\n");
+    
+    // Alice mines every tenth block, across several scan ranges
+    Wallet alice, bob;
+    assert(init_wallet(&alice) && init_wallet(&bob));
+    Chain chain;
+    assert(init_chain(&chain, 4));
+    for (int i = 0; i < 600; i++) {
+        append_test_block(&chain, (i % 10 == 0) ? alice.address : "ARCRESCANMINER");
+    }
+    Transaction to_alice, from_alice;
+    signed_transfer(&to_alice, &bob, alice.address, 30, 0);
+    signed_transfer(&from_alice, &alice, bob.address, 20, 5);
+    assert(add_transaction_to_block(chain_block(&chain, 300), &to_alice));
+    assert(add_transaction_to_block(chain_block(&chain, 550), &from_alice));
+    
+    // A full rescan drops what is not on the chain and keeps what is pending
+    Transaction orphan, pending;
+    assert(create_coinbase_transaction(&orphan, alice.address, 50));
+    signed_transfer(&pending, &alice, "ARCPAYEE", 5, 1);
+    assert(add_transaction_to_wallet(&alice, &orphan) && add_transaction_to_wallet(&alice, &pending));
+    RescanWatermark mark;
+    RescanResult result;
+    assert(rescan_wallet(&alice, &chain, &mark, is_test_pending, &pending, &result));
+    assert(!result.resumed && result.scanned == 600 && result.found == 62);
+    assert(alice.transaction_count == 63 && alice.balance == 60 * 50 + 30 - 25 - 6);
+    assert(same_transaction(alice.transactions[31], &to_alice) && same_transaction(alice.transactions[62], &pending));
+    
+    // Matches share the blocks' records rather than copying them
+    assert(alice.transactions[31] == chain_block(&chain, 300)->transactions[1]);
+    assert(alice.transactions[0] == chain_block(&chain, 0)->transactions[0] && tx_refcount(alice.transactions[0]) == 2);
+    assert(mark.height == 600 && mark.confirmed == 62 && strcmp(mark.address, alice.address) == 0);
+    
+    // Resuming only reads the new blocks
+    for (int i = 600; i < 605; i++) {
+        append_test_block(&chain, (i % 10 == 0) ? alice.address : "ARCRESCANMINER");
+    }
+    assert(rescan_wallet(&alice, &chain, &mark, is_test_pending, &pending, &result));
+    assert(result.resumed && result.scanned == 5 && result.found == 1);
+    assert(alice.transaction_count == 64 && same_transaction(alice.transactions[63], &pending));
+    append_test_block(&chain, "ARCRESCANMINER");
+    assert(add_transaction_to_block(chain_block(&chain, 605), &pending));
+    assert(rescan_wallet(&alice, &chain, &mark, NULL, NULL, &result));
+    assert(result.resumed && result.scanned == 1 && result.found == 1);
+    assert(alice.transaction_count == 64 && alice.balance == 61 * 50 + 30 - 25 - 6);
+    
+    // A reorg below the watermark, or a history that no longer matches it,
+    // forces a full rescan
+    chain_truncate(&chain, 603);
+    for (int i = 603; i < 606; i++) {
+        append_test_block(&chain, "ARCOTHERMINER");
+    }
+    assert(rescan_wallet(&alice, &chain, &mark, NULL, NULL, &result));
+    assert(!result.resumed && result.scanned == 606 && result.found == 63);
+    assert(alice.transaction_count == 63 && alice.balance == 61 * 50 + 30 - 25);
+    uint32_t hash = alice.transactions[5]->hash;
+    Transaction altered = *alice.transactions[5];
+    altered.hash ^= 1;
+    tx_release(alice.transactions[5]);
+    assert((alice.transactions[5] = tx_new(&altered)) != NULL);
+    assert(rescan_wallet(&alice, &chain, &mark, NULL, NULL, &result));
+    assert(!result.resumed && alice.transactions[5]->hash == hash && mark.confirmed == 63);
+    
+    // Watermarks are kept per address
+    const char *rescan_file = "test_rescan.dat";
+    remove(rescan_file);
+    RescanWatermark loaded, other = mark;
+    strcpy(other.address, bob.address);
+    other.height = 7;
+    assert(!load_rescan_watermark(rescan_file, alice.address, &loaded) && loaded.address[0] == '\0');
+    assert(save_rescan_watermark(rescan_file, &other) && save_rescan_watermark(rescan_file, &mark));
+    mark.confirmed = 62;
+    assert(save_rescan_watermark(rescan_file, &mark));
+    assert(load_rescan_watermark(rescan_file, alice.address, &loaded));
+    assert(loaded.height == 606 && loaded.confirmed == 62 && loaded.tip_hash == mark.tip_hash &&
+           loaded.history_hash == mark.history_hash);
+    assert(load_rescan_watermark(rescan_file, bob.address, &loaded) && loaded.height == 7);
+    assert(!load_rescan_watermark(rescan_file, "ARCNOBODY", &loaded));
+    remove(rescan_file);
+    
+    // Pruned bodies cannot be rescanned; the wallet is left as it was
+    mark.confirmed = 63;
+    assert(chain_prune_bodies(&chain, 100) == 100);
+    assert(!rescan_wallet(&alice, &chain, NULL, NULL, NULL, &result));
+    assert(alice.transaction_count == 63);
+    assert(rescan_wallet(&alice, &chain, &mark, NULL, NULL, &result) && result.resumed && result.scanned == 0);
+    
+    cleanup_chain(&chain);
+    cleanup_wallet(&alice);
+    cleanup_wallet(&bob);
+    
+    printf("✓ Wallet rescan tests passed\n\n");
+}
+
+static void assert_same_wallet(const Wallet *a, const Wallet *b) {
+    assert(strcmp(a->address, b->address) == 0 && memcmp(a->private_key, b->private_key, PRIVATE_KEY_LENGTH) == 0);
+    assert(a->balance == b->balance && a->transaction_count == b->transaction_count);
+    for (int i = 0; i < a->transaction_count; i++) {
+        assert(same_transaction(a->transactions[i], b->transactions[i]));
+    }
+}
+
+void test_keystore() {
+    printf("Testing the wallet keystore...\n");
+    
+    const char *path = "test_keystore.dat";
+    remove(path);
+    Keystore keystore;
+    assert(keystore_open(&keystore, path) && keystore.count == 0 && !keystore.recovered);
+    
+    // Many wallets, each with its own history, in one file
+    enum { WALLETS = 200 };
+    Wallet *wallets = calloc(WALLETS, sizeof(Wallet));
+    assert(wallets != NULL);
+    for (int i = 0; i < WALLETS; i++) {
+        snprintf(wallets[i].address, WALLET_ADDRESS_LENGTH, "ARCSTORE%03d", i);
+        snprintf(wallets[i].private_key, PRIVATE_KEY_LENGTH, "key-%d", i);
+        for (int j = 0; j < i % 4; j++) {
+            Transaction tx;
+            assert(create_coinbase_transaction(&tx, wallets[i].address, 50 + j));
+            assert(add_transaction_to_wallet(&wallets[i], &tx));
+        }
+        assert(keystore_save(&keystore, &wallets[i]));
+    }
+    assert(keystore.count == WALLETS && keystore_find(&keystore, "ARCSTORE123") == 123);
+    assert(keystore_find(&keystore, "ARCNOTSTORED") == -1);
+    keystore_close(&keystore);
+    
+    // Reopening reads the index; a wallet is read when it is loaded
+    assert(keystore_open(&keystore, path) && !keystore.recovered && keystore.count == WALLETS);
+    assert(keystore.entries[7].transaction_count == 3);
+    Wallet loaded;
+    memset(&loaded, 0, sizeof(Wallet));
+    assert(keystore_load(&keystore, "ARCSTORE007", &loaded));
+    assert_same_wallet(&loaded, &wallets[7]);
+    cleanup_wallet(&loaded);
+    assert(!keystore_load(&keystore, "ARCNOTSTORED", &loaded));
+    
+    // Saves write only what is new, and a rewritten history replaces the old one
+    long size = file_size(path);
+    assert(keystore_save(&keystore, &wallets[7]) && file_size(path) == size);
+    Transaction tx;
+    assert(create_transaction(&tx, wallets[7].address, "ARCPAYEE", 10));
+    assert(add_transaction_to_wallet(&wallets[7], &tx));
+    assert(keystore_save(&keystore, &wallets[7]));
+    assert(file_size(path) - size < (long)(2 * sizeof(WireTransaction)));
+    cleanup_wallet(&wallets[5]);
+    wallets[5].balance = 0;
+    assert(add_transaction_to_wallet(&wallets[5], &tx));
+    assert(keystore_save(&keystore, &wallets[5]));
+    for (int i = 5; i <= 7; i++) {
+        assert(keystore_load(&keystore, wallets[i].address, &loaded));
+        assert_same_wallet(&loaded, &wallets[i]);
+        cleanup_wallet(&loaded);
+    }
+    keystore_close(&keystore);
+    
+    // A torn index is rebuilt from the records
+    FILE *file = fopen(path, "rb+");
+    assert(file != NULL && truncate_file(file, file_size(path) - 5));
+    fclose(file);
+    assert(keystore_open(&keystore, path) && keystore.recovered && keystore.count == WALLETS);
+    for (int i = 0; i < WALLETS; i += 7) {
+        assert(keystore_load(&keystore, wallets[i].address, &loaded));
+        assert_same_wallet(&loaded, &wallets[i]);
+        cleanup_wallet(&loaded);
+    }
+    keystore_close(&keystore);
+    assert(keystore_open(&keystore, path) && !keystore.recovered);
+    keystore_close(&keystore);
+    
+    // Other files are left alone
+    const char *wallet_path = "test_keystore_wallet.dat";
+    assert(save_wallet_file(wallet_path, &wallets[3]));
+    size = file_size(wallet_path);
+    assert(!keystore_open(&keystore, wallet_path) && file_size(wallet_path) == size);
+    remove(wallet_path);
+    
+    for (int i = 0; i < WALLETS; i++) {
+        cleanup_wallet(&wallets[i]);
+    }
+    free(wallets);
+    remove(path);
+    
+    printf("✓ Keystore tests passed\n\n");
+}
+
 int main() {
     printf("Archimedes Blockchain - Test Suite\n");
     printf("===================================\n\n");
@@ -125,6 +2173,31 @@ int main() {
     test_hash_function();
     test_block_mining();
     test_blockchain_sequence();
+    test_pi_digit_packing();
+    test_pi_digit_kernels();
+    test_digit_store();
+    test_compression_codec();
+    test_chain_container();
+    test_blockchain_persistence();
+    test_digit_recipes();
+    test_journal_recovery();
+    test_wallet_file();
+    test_state_snapshot();
+    test_account_state();
+    test_chain_pruning();
+    test_chain_validation();
+    test_chain_import();
+    test_memory_pool();
+    test_large_buffers();
+    test_tx_pool();
+    test_ed25519();
+    test_verify_cache();
+    test_mempool();
+    test_block_template();
+    test_address_table();
+    test_transfer_batch();
+    test_rescan();
+    test_keystore();
     
     printf("🎉 All tests passed successfully!\n");
     return 0;
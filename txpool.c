@@ -0,0 +1,163 @@
+#include "txpool.h"
+#include "performance.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The transaction comes first, so record and transaction pointers convert
+typedef struct TxRecord {
+    Transaction tx;
+    volatile int refcount;
+    struct TxRecord *next_free;
+} TxRecord;
+
+typedef struct TxSlab {
+    struct TxSlab *next;
+    TxRecord records[TX_SLAB_RECORDS];
+} TxSlab;
+
+typedef struct {
+    TxSlab *slabs;
+    int slab_count;
+    TxRecord *free_list;
+    volatile int live_records;
+    PlatformMutex *lock;
+} TxPool;
+
+typedef struct {
+    TxRecord *head;
+    int count;
+} TxCache;
+
+static TxPool tx_pool;
+static THREAD_LOCAL TxCache tx_cache;
+
+bool init_tx_pool(void) {
+    if (tx_pool.lock != NULL) return true;
+    
+    tx_pool.lock = create_mutex();
+    if (tx_pool.lock == NULL) return false;
+    
+    add_thread_exit_hook(release_thread_tx_cache);
+    return true;
+}
+
+void cleanup_tx_pool(void) {
+    // The workers hand their caches back as they stop; records cached by
+    // other threads die with their slabs
+    stop_worker_pool();
+    tx_cache.head = NULL;
+    tx_cache.count = 0;
+    
+    TxSlab *slab = tx_pool.slabs;
+    while (slab != NULL) {
+        TxSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    destroy_mutex(tx_pool.lock);
+    memset(&tx_pool, 0, sizeof(TxPool));
+}
+
+// Moves up to half a cache's worth of free records into the thread cache
+static bool refill_cache(void) {
+    if (!init_tx_pool()) return false;
+    
+    lock_mutex(tx_pool.lock);
+    if (tx_pool.free_list == NULL) {
+        TxSlab *slab = malloc(sizeof(TxSlab));
+        if (slab == NULL) {
+            unlock_mutex(tx_pool.lock);
+            return false;
+        }
+        slab->next = tx_pool.slabs;
+        tx_pool.slabs = slab;
+        tx_pool.slab_count++;
+        for (int i = 0; i < TX_SLAB_RECORDS; i++) {
+            slab->records[i].next_free = tx_pool.free_list;
+            tx_pool.free_list = &slab->records[i];
+        }
+    }
+    
+    while (tx_pool.free_list != NULL && tx_cache.count < TX_THREAD_CACHE / 2) {
+        TxRecord *record = tx_pool.free_list;
+        tx_pool.free_list = record->next_free;
+        record->next_free = tx_cache.head;
+        tx_cache.head = record;
+        tx_cache.count++;
+    }
+    unlock_mutex(tx_pool.lock);
+    return true;
+}
+
+// Hands count records from the thread cache back to the pool
+static void drain_cache(int count) {
+    if (count <= 0 || tx_cache.head == NULL) return;
+    
+    lock_mutex(tx_pool.lock);
+    while (count-- > 0 && tx_cache.head != NULL) {
+        TxRecord *record = tx_cache.head;
+        tx_cache.head = record->next_free;
+        tx_cache.count--;
+        record->next_free = tx_pool.free_list;
+        tx_pool.free_list = record;
+    }
+    unlock_mutex(tx_pool.lock);
+}
+
+Transaction *tx_new(const Transaction *value) {
+    if (tx_cache.head == NULL && !refill_cache()) return NULL;
+    
+    TxRecord *record = tx_cache.head;
+    tx_cache.head = record->next_free;
+    tx_cache.count--;
+    
+    if (value != NULL) {
+        record->tx = *value;
+    } else {
+        memset(&record->tx, 0, sizeof(Transaction));
+    }
+    record->refcount = 1;
+    record->next_free = NULL;
+    atomic_add_int(&tx_pool.live_records, 1);
+    return &record->tx;
+}
+
+Transaction *tx_retain(Transaction *tx) {
+    if (tx != NULL) {
+        atomic_add_int(&((TxRecord *)tx)->refcount, 1);
+    }
+    return tx;
+}
+
+void tx_release(Transaction *tx) {
+    if (tx == NULL) return;
+    
+    TxRecord *record = (TxRecord *)tx;
+    if (atomic_add_int(&record->refcount, -1) > 0) return;
+    
+    atomic_add_int(&tx_pool.live_records, -1);
+    record->next_free = tx_cache.head;
+    tx_cache.head = record;
+    tx_cache.count++;
+    if (tx_cache.count > TX_THREAD_CACHE) {
+        drain_cache(tx_cache.count - TX_THREAD_CACHE / 2);
+    }
+}
+
+int tx_refcount(const Transaction *tx) {
+    return (tx != NULL) ? atomic_load_int(&((const TxRecord *)tx)->refcount) : 0;
+}
+
+void release_thread_tx_cache(void) {
+    drain_cache(tx_cache.count);
+}
+
+void get_tx_pool_stats(TxPoolStats *stats) {
+    if (stats == NULL) return;
+    
+    lock_mutex(tx_pool.lock);
+    stats->slabs = tx_pool.slab_count;
+    stats->live_records = atomic_load_int(&tx_pool.live_records);
+    stats->bytes_reserved = (size_t)tx_pool.slab_count * sizeof(TxSlab);
+    unlock_mutex(tx_pool.lock);
+}
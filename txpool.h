@@ -0,0 +1,38 @@
+#ifndef TXPOOL_H
+#define TXPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "wallet.h"
+
+// Shared, reference-counted Transaction records carved out of fixed-size
+// slabs. Blocks, wallets, the mempool and the block template hold
+// references to one record rather than copies; a record must not be
+// modified once it is shared. Each thread keeps a small cache of free
+// records, so allocating and releasing rarely takes the pool lock.
+// Records are recycled, never freed, until cleanup_tx_pool.
+#define TX_SLAB_RECORDS 256
+#define TX_THREAD_CACHE 32
+
+typedef struct {
+    int slabs;
+    int live_records;     // Records currently referenced
+    size_t bytes_reserved;
+} TxPoolStats;
+
+// Call before records are shared between threads; later calls are no-ops
+bool init_tx_pool(void);
+void cleanup_tx_pool(void);  // Every record must have been released
+
+// New record holding a copy of value with one reference, NULL on failure
+Transaction *tx_new(const Transaction *value);
+Transaction *tx_retain(Transaction *tx);
+void tx_release(Transaction *tx);
+int tx_refcount(const Transaction *tx);
+
+// Returns the calling thread's cached free records to the pool
+void release_thread_tx_cache(void);
+
+void get_tx_pool_stats(TxPoolStats *stats);
+
+#endif
@@ -1,6 +1,24 @@
+// fileno, fsync, ftruncate, fseeko and ftello are POSIX, hidden by
+// strict -std=c17; off_t is 64 bits even on 32-bit systems
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#else
+#define _CRT_RAND_S  // rand_s, backed by the system's secure generator
+#endif
+
 #include "utils.h"
+#include "performance.h"
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 uint32_t simple_hash(const char *input) {
     if (input == NULL) {
         return 0;
@@ -13,3 +31,118 @@ uint32_t simple_hash(const char *input) {
     }
     return hash;
 }
+
+bool sync_file(FILE *file) {
+    if (file == NULL || fflush(file) != 0) return false;
+    
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool truncate_file(FILE *file, int64_t size) {
+    if (file == NULL || size < 0 || fflush(file) != 0) return false;
+    
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+bool file_seek(FILE *file, int64_t offset, int origin) {
+    if (file == NULL) return false;
+    
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+int64_t file_tell(FILE *file) {
+    if (file == NULL) return -1;
+    
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+bool replace_file(const char *temp_path, const char *path) {
+    if (temp_path == NULL || path == NULL) return false;
+    
+#ifdef _WIN32
+    // rename() refuses to overwrite on Windows
+    return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(temp_path, path) == 0;
+#endif
+}
+
+bool write_checksummed_file(const char *path, const void *data, size_t size) {
+    if (path == NULL || (data == NULL && size > 0)) return false;
+    
+    uint32_t checksum = fast_hash((const char *)data, size);
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    bool ok = file != NULL && fwrite(data, 1, size, file) == size &&
+              fwrite(&checksum, 1, sizeof(checksum), file) == sizeof(checksum) && sync_file(file);
+    if (file != NULL) fclose(file);
+    
+    if (!ok || !replace_file(temp_path, path)) {
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+uint8_t *read_checksummed_file(const char *path, size_t *size) {
+    if (path == NULL || size == NULL) return NULL;
+    
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    
+    int64_t length = file_seek(file, 0, SEEK_END) ? file_tell(file) : -1;
+    uint8_t *data = (length >= (int64_t)sizeof(uint32_t)) ? malloc((size_t)length) : NULL;
+    bool ok = data != NULL && file_seek(file, 0, SEEK_SET) &&
+              fread(data, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    
+    uint32_t checksum;
+    *size = ok ? (size_t)length - sizeof(checksum) : 0;
+    if (ok) {
+        memcpy(&checksum, data + *size, sizeof(checksum));
+        ok = checksum == fast_hash((const char *)data, *size);
+    }
+    if (!ok) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+bool secure_random_bytes(void *buffer, size_t length) {
+    if (buffer == NULL) return false;
+    
+#ifdef _WIN32
+    uint8_t *out = buffer;
+    for (size_t i = 0; i < length; i += sizeof(unsigned int)) {
+        unsigned int value;
+        if (rand_s(&value) != 0) return false;
+        size_t take = (length - i < sizeof(value)) ? length - i : sizeof(value);
+        memcpy(out + i, &value, take);
+    }
+    return true;
+#else
+    FILE *source = fopen("/dev/urandom", "rb");
+    if (source == NULL) return false;
+    bool ok = fread(buffer, 1, length, source) == length;
+    fclose(source);
+    return ok;
+#endif
+}
@@ -2,7 +2,29 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 
 uint32_t simple_hash(const char *input);
 
+// Durable file helpers
+bool sync_file(FILE *file);                                // Flush to disk
+bool truncate_file(FILE *file, int64_t size);
+bool replace_file(const char *temp_path, const char *path); // Atomic rename over path
+
+// fseek and ftell with 64-bit offsets; long is 32 bits on Windows
+bool file_seek(FILE *file, int64_t offset, int origin);
+int64_t file_tell(FILE *file);                              // -1 on failure
+
+// Small files written whole: the payload and a checksum over it go to a
+// temporary file that is synced and renamed over path. Reading returns
+// the payload (freed by the caller) and its size, or NULL when the file
+// is missing, short or fails the checksum.
+bool write_checksummed_file(const char *path, const void *data, size_t size);
+uint8_t *read_checksummed_file(const char *path, size_t *size);
+
+// Bytes from the operating system's secure random generator
+bool secure_random_bytes(void *buffer, size_t length);
+
 #endif
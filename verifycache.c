@@ -0,0 +1,150 @@
+#include "verifycache.h"
+#include "performance.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    PlatformMutex *lock;
+    VerifyKey *slots;    // VERIFY_CACHE_WAYS per bucket; an all-zero key is an empty slot
+    uint8_t *next_way;   // Per bucket, the way the next insert replaces
+    int bucket_mask;
+    int entries;
+    uint64_t hits;
+    uint64_t misses;
+} VerifyShard;
+
+typedef struct {
+    VerifyShard shards[VERIFY_CACHE_SHARDS];
+    int capacity;
+} VerifyCache;
+
+static VerifyCache caches[VERIFY_CACHE_KINDS];
+
+static bool is_empty_key(const VerifyKey *key) {
+    return key->lo == 0 && key->hi == 0;
+}
+
+static void free_cache(VerifyCache *cache) {
+    for (int s = 0; s < VERIFY_CACHE_SHARDS; s++) {
+        VerifyShard *shard = &cache->shards[s];
+        destroy_mutex(shard->lock);
+        free(shard->slots);
+        free(shard->next_way);
+    }
+    memset(cache, 0, sizeof(VerifyCache));
+}
+
+static bool create_cache(VerifyCache *cache, int entries) {
+    // Power-of-two buckets per shard so lookups can mask instead of divide
+    int buckets = 1;
+    while ((long)buckets * VERIFY_CACHE_SHARDS * VERIFY_CACHE_WAYS < entries) {
+        buckets <<= 1;
+    }
+    
+    for (int s = 0; s < VERIFY_CACHE_SHARDS; s++) {
+        VerifyShard *shard = &cache->shards[s];
+        shard->lock = create_mutex();
+        shard->slots = calloc((size_t)buckets * VERIFY_CACHE_WAYS, sizeof(VerifyKey));
+        shard->next_way = calloc(buckets, sizeof(uint8_t));
+        shard->bucket_mask = buckets - 1;
+        if (shard->lock == NULL || shard->slots == NULL || shard->next_way == NULL) {
+            free_cache(cache);
+            return false;
+        }
+    }
+    cache->capacity = buckets * VERIFY_CACHE_SHARDS * VERIFY_CACHE_WAYS;
+    return true;
+}
+
+bool init_verify_cache(int transaction_entries, int block_entries) {
+    if (caches[VERIFY_CACHE_TRANSACTIONS].capacity > 0) return true;
+    
+    if (!create_cache(&caches[VERIFY_CACHE_TRANSACTIONS], transaction_entries)) return false;
+    if (!create_cache(&caches[VERIFY_CACHE_BLOCKS], block_entries)) {
+        free_cache(&caches[VERIFY_CACHE_TRANSACTIONS]);
+        return false;
+    }
+    return true;
+}
+
+void cleanup_verify_cache(void) {
+    for (int kind = 0; kind < VERIFY_CACHE_KINDS; kind++) {
+        if (caches[kind].capacity > 0) free_cache(&caches[kind]);
+    }
+}
+
+VerifyKey verify_key_from_digest(const uint8_t digest[SHA512_DIGEST_SIZE]) {
+    VerifyKey key;
+    memcpy(&key.lo, digest, sizeof(uint64_t));
+    memcpy(&key.hi, digest + sizeof(uint64_t), sizeof(uint64_t));
+    if (is_empty_key(&key)) key.lo = 1;
+    return key;
+}
+
+// The shard comes from the low bits of the key, the bucket from the next
+static VerifyShard *shard_for(VerifyCacheKind kind, const VerifyKey *key, VerifyKey **bucket, int *bucket_index) {
+    if ((unsigned)kind >= VERIFY_CACHE_KINDS || caches[kind].capacity == 0 || key == NULL) return NULL;
+    
+    VerifyShard *shard = &caches[kind].shards[key->lo & (VERIFY_CACHE_SHARDS - 1)];
+    *bucket_index = (int)((key->lo / VERIFY_CACHE_SHARDS) & (uint64_t)shard->bucket_mask);
+    *bucket = shard->slots + (size_t)*bucket_index * VERIFY_CACHE_WAYS;
+    return shard;
+}
+
+bool verify_cache_contains(VerifyCacheKind kind, const VerifyKey *key) {
+    VerifyKey *bucket;
+    int bucket_index;
+    VerifyShard *shard = shard_for(kind, key, &bucket, &bucket_index);
+    if (shard == NULL) return false;
+    
+    bool found = false;
+    lock_mutex(shard->lock);
+    for (int way = 0; way < VERIFY_CACHE_WAYS && !found; way++) {
+        found = bucket[way].lo == key->lo && bucket[way].hi == key->hi;
+    }
+    if (found) {
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    unlock_mutex(shard->lock);
+    return found;
+}
+
+void verify_cache_insert(VerifyCacheKind kind, const VerifyKey *key) {
+    VerifyKey *bucket;
+    int bucket_index;
+    VerifyShard *shard = shard_for(kind, key, &bucket, &bucket_index);
+    if (shard == NULL || is_empty_key(key)) return;
+    
+    lock_mutex(shard->lock);
+    bool present = false;
+    for (int way = 0; way < VERIFY_CACHE_WAYS && !present; way++) {
+        present = bucket[way].lo == key->lo && bucket[way].hi == key->hi;
+    }
+    if (!present) {
+        // Ways fill in order, then the oldest is replaced
+        int way = shard->next_way[bucket_index];
+        if (is_empty_key(&bucket[way])) shard->entries++;
+        bucket[way] = *key;
+        shard->next_way[bucket_index] = (uint8_t)((way + 1) % VERIFY_CACHE_WAYS);
+    }
+    unlock_mutex(shard->lock);
+}
+
+void get_verify_cache_stats(VerifyCacheKind kind, VerifyCacheStats *stats) {
+    if (stats == NULL) return;
+    
+    memset(stats, 0, sizeof(VerifyCacheStats));
+    if ((unsigned)kind >= VERIFY_CACHE_KINDS || caches[kind].capacity == 0) return;
+    
+    stats->capacity = caches[kind].capacity;
+    for (int s = 0; s < VERIFY_CACHE_SHARDS; s++) {
+        VerifyShard *shard = &caches[kind].shards[s];
+        lock_mutex(shard->lock);
+        stats->entries += shard->entries;
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        unlock_mutex(shard->lock);
+    }
+}
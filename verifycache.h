@@ -0,0 +1,49 @@
+#ifndef VERIFYCACHE_H
+#define VERIFYCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sha512.h"
+
+// Process-wide caches of checks that already passed, so a transfer
+// verified on its way into the mempool is not verified again inside a
+// block, and a block validated once is not validated again when it comes
+// back from a peer, an import or a re-validation after loading.
+// Only successes are recorded. A key is 128 bits of a SHA-512 over
+// everything the check looked at, so any change to the checked data
+// misses. Each cache is split into shards with their own lock, and each
+// shard into small buckets that replace their oldest entry when full, so
+// the memory used never grows. Before init_verify_cache every lookup
+// misses. All functions are safe to call from several threads.
+#define VERIFY_CACHE_SHARDS 16
+#define VERIFY_CACHE_WAYS 4
+
+typedef enum {
+    VERIFY_CACHE_TRANSACTIONS,  // Transfers whose signature holds
+    VERIFY_CACHE_BLOCKS,        // Blocks that passed validate_block_contents
+    VERIFY_CACHE_KINDS
+} VerifyCacheKind;
+
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} VerifyKey;
+
+typedef struct {
+    int capacity;
+    int entries;
+    uint64_t hits;
+    uint64_t misses;
+} VerifyCacheStats;
+
+// Call before the caches are shared between threads; later calls are no-ops
+bool init_verify_cache(int transaction_entries, int block_entries);
+void cleanup_verify_cache(void);
+
+VerifyKey verify_key_from_digest(const uint8_t digest[SHA512_DIGEST_SIZE]);
+bool verify_cache_contains(VerifyCacheKind kind, const VerifyKey *key);
+void verify_cache_insert(VerifyCacheKind kind, const VerifyKey *key);
+
+void get_verify_cache_stats(VerifyCacheKind kind, VerifyCacheStats *stats);
+
+#endif
@@ -1,5 +1,9 @@
 #include "wallet.h"
+#include "txpool.h"
 #include "utils.h"
+#include "sha512.h"
+#include "verifycache.h"
+#include "performance.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,20 +37,46 @@ uint64_t calculate_mining_reward(const RewardSystem *rs, int block_height) {
     return reward;
 }
 
-// Generate a simple wallet address (simplified for demo)
+// Signing keys come from a hash of the private key text, so any wallet's
+// key can sign; only addresses derived from the key verify though
+static void derive_keys(const char *private_key, uint8_t seed[ED25519_SEED_SIZE],
+                        uint8_t public_key[ED25519_PUBLIC_KEY_SIZE]) {
+    uint8_t digest[SHA512_DIGEST_SIZE];
+    size_t length = 0;
+    while (length < PRIVATE_KEY_LENGTH && private_key[length] != '\0') length++;
+    sha512(private_key, length, digest);
+    memcpy(seed, digest, ED25519_SEED_SIZE);
+    ed25519_public_key(public_key, seed);
+    memset(digest, 0, sizeof(digest));
+}
+
+void address_from_public_key(const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE], char address[WALLET_ADDRESS_LENGTH]) {
+    uint8_t digest[SHA512_DIGEST_SIZE];
+    sha512(public_key, ED25519_PUBLIC_KEY_SIZE, digest);
+    memset(address, 0, WALLET_ADDRESS_LENGTH);
+    memcpy(address, "ARC", 3);
+    for (int i = 0; i < 20; i++) {
+        snprintf(address + 3 + 2 * i, 3, "%02X", digest[i]);
+    }
+}
+
+// Generate a wallet: a random private key and the address of its public key
 bool generate_wallet_address(Wallet *wallet) {
     if (wallet == NULL) return false;
     
-    // Generate pseudo-random address and private key
-    srand(time(NULL) + (uintptr_t)wallet);
-    
-    // Generate address (simplified - in real blockchain this would use cryptographic methods)
-    snprintf(wallet->address, WALLET_ADDRESS_LENGTH, "ARC%016llX%08X", 
-             (unsigned long long)time(NULL), rand());
+    uint8_t secret[28];
+    if (!secure_random_bytes(secret, sizeof(secret))) return false;
+    memset(wallet->private_key, 0, PRIVATE_KEY_LENGTH);
+    memcpy(wallet->private_key, "PVT", 3);
+    for (size_t i = 0; i < sizeof(secret); i++) {
+        snprintf(wallet->private_key + 3 + 2 * i, 3, "%02X", secret[i]);
+    }
+    memset(secret, 0, sizeof(secret));
     
-    // Generate private key (simplified)
-    snprintf(wallet->private_key, PRIVATE_KEY_LENGTH, "PVT%016llX%016llX",
-             (unsigned long long)rand(), (unsigned long long)rand());
+    uint8_t seed[ED25519_SEED_SIZE], public_key[ED25519_PUBLIC_KEY_SIZE];
+    derive_keys(wallet->private_key, seed, public_key);
+    memset(seed, 0, sizeof(seed));
+    address_from_public_key(public_key, wallet->address);
     
     return true;
 }
@@ -67,6 +97,35 @@ bool init_wallet(Wallet *wallet) {
     return true;
 }
 
+// Free the transaction history
+void cleanup_wallet(Wallet *wallet) {
+    if (wallet == NULL) return;
+    
+    for (int i = 0; i < wallet->transaction_count; i++) {
+        tx_release(wallet->transactions[i]);
+    }
+    free(wallet->transactions);
+    wallet->transactions = NULL;
+    wallet->transaction_count = 0;
+    wallet->transaction_capacity = 0;
+}
+
+// Make room for at least capacity transactions
+bool reserve_wallet_transactions(Wallet *wallet, int capacity) {
+    if (wallet == NULL || capacity < 0) return false;
+    if (capacity <= wallet->transaction_capacity) return true;
+    
+    int new_capacity = wallet->transaction_capacity ? wallet->transaction_capacity : 16;
+    while (new_capacity < capacity) new_capacity *= 2;
+    
+    Transaction **transactions = realloc(wallet->transactions, (size_t)new_capacity * sizeof(Transaction *));
+    if (transactions == NULL) return false;
+    
+    wallet->transactions = transactions;
+    wallet->transaction_capacity = new_capacity;
+    return true;
+}
+
 // Get wallet balance
 uint64_t get_wallet_balance(const Wallet *wallet) {
     if (wallet == NULL) return 0;
@@ -75,39 +134,59 @@ uint64_t get_wallet_balance(const Wallet *wallet) {
 
 // Create transaction
 bool create_transaction(Transaction *tx, const char *from, const char *to, uint64_t amount) {
+    return create_transaction_with_fee(tx, from, to, amount, 0);
+}
+
+// Hash identifying a transfer, over its text
+static uint32_t transfer_hash(const Transaction *tx) {
+    char tx_data[256];
+    snprintf(tx_data, sizeof(tx_data), "%s%s%" PRIu64 "%lld%" PRIu64 "#%" PRIu64, 
+             address_text(tx->from), address_text(tx->to), tx->amount, (long long)tx->timestamp, tx->fee,
+             tx->sequence);
+    return simple_hash(tx_data);
+}
+
+// Create transaction paying a fee to the miner
+bool create_transaction_with_fee(Transaction *tx, const char *from, const char *to, uint64_t amount, uint64_t fee) {
     if (tx == NULL || from == NULL || to == NULL) return false;
     
     memset(tx, 0, sizeof(Transaction));
     
-    strncpy(tx->from_address, from, WALLET_ADDRESS_LENGTH - 1);
-    strncpy(tx->to_address, to, WALLET_ADDRESS_LENGTH - 1);
+    tx->from = address_intern(from);
+    tx->to = address_intern(to);
+    if (tx->from == 0 || tx->to == 0) return false;
     tx->amount = amount;
+    tx->fee = fee;
     tx->timestamp = time(NULL);
     tx->is_coinbase = false;
-      // Calculate transaction hash
-    char tx_data[256];
-    snprintf(tx_data, sizeof(tx_data), "%s%s%" PRIu64 "%lld", 
-             tx->from_address, tx->to_address, tx->amount, (long long)tx->timestamp);
-    tx->hash = simple_hash(tx_data);
+    tx->hash = transfer_hash(tx);
     
     return true;
 }
 
+void set_transaction_sequence(Transaction *tx, uint64_t sequence) {
+    if (tx == NULL || tx->is_coinbase) return;
+    
+    tx->sequence = sequence;
+    tx->hash = transfer_hash(tx);
+}
+
 // Create coinbase transaction (mining reward)
 bool create_coinbase_transaction(Transaction *tx, const char *miner_address, uint64_t reward) {
     if (tx == NULL || miner_address == NULL) return false;
     
     memset(tx, 0, sizeof(Transaction));
     
-    strcpy(tx->from_address, "COINBASE");
-    strncpy(tx->to_address, miner_address, WALLET_ADDRESS_LENGTH - 1);
+    tx->from = address_intern(COINBASE_ADDRESS_TEXT);
+    tx->to = address_intern(miner_address);
+    if (tx->from != ADDRESS_COINBASE || tx->to == 0) return false;
     tx->amount = reward;
     tx->timestamp = time(NULL);
     tx->is_coinbase = true;
       // Calculate transaction hash
     char tx_data[256];
     snprintf(tx_data, sizeof(tx_data), "COINBASE%s%" PRIu64 "%lld", 
-             tx->to_address, tx->amount, (long long)tx->timestamp);
+             address_text(tx->to), tx->amount, (long long)tx->timestamp);
     tx->hash = simple_hash(tx_data);
     
     return true;
@@ -121,41 +200,294 @@ bool award_mining_reward(Wallet *miner_wallet, const RewardSystem *rs, int block
     if (reward == 0) return false;
     
     // Create coinbase transaction
-    if (miner_wallet->transaction_count >= MAX_TRANSACTIONS) return false;
-    
-    Transaction *tx = &miner_wallet->transactions[miner_wallet->transaction_count];
-    if (!create_coinbase_transaction(tx, miner_wallet->address, reward)) {
+    Transaction tx;
+    if (!create_coinbase_transaction(&tx, miner_wallet->address, reward)) {
         return false;
     }
     
-    // Add to wallet
-    miner_wallet->balance += reward;
-    miner_wallet->transaction_count++;
-    
-    return true;
+    // Add to wallet, which credits the reward
+    return add_transaction_to_wallet(miner_wallet, &tx);
 }
 
 // Add transaction to wallet
 bool add_transaction_to_wallet(Wallet *wallet, const Transaction *tx) {
     if (wallet == NULL || tx == NULL) return false;
     
-    if (wallet->transaction_count >= MAX_TRANSACTIONS) return false;
+    Transaction *record = tx_new(tx);
+    if (record == NULL) return false;
+    bool ok = add_shared_transaction_to_wallet(wallet, record);
+    tx_release(record);
+    return ok;
+}
+
+bool add_shared_transaction_to_wallet(Wallet *wallet, Transaction *tx) {
+    if (wallet == NULL || tx == NULL) return false;
     
-    // Copy transaction
-    wallet->transactions[wallet->transaction_count] = *tx;
+    if (!reserve_wallet_transactions(wallet, wallet->transaction_count + 1)) return false;
+    
+    wallet->transactions[wallet->transaction_count] = tx_retain(tx);
     wallet->transaction_count++;
     
     // Update balance
-    if (strcmp(tx->to_address, wallet->address) == 0) {
+    AddressHandle self = address_find(wallet->address);
+    if (self != 0 && tx->to == self) {
         wallet->balance += tx->amount;  // Received money
     }
-    if (strcmp(tx->from_address, wallet->address) == 0 && !tx->is_coinbase) {
-        wallet->balance -= tx->amount;  // Sent money
+    if (self != 0 && tx->from == self && !tx->is_coinbase) {
+        wallet->balance -= tx->amount + tx->fee;  // Sent money
+    }
+    
+    return true;
+}
+
+// What a transfer's signature covers: every field but the signature. The
+// sequence comes last and is left out for transfers signed before there
+// were sequence numbers.
+#define TX_MESSAGE_SIZE (5 + 2 * WALLET_ADDRESS_LENGTH + 4 * sizeof(uint64_t) + sizeof(uint32_t) + \
+                         ED25519_PUBLIC_KEY_SIZE)
+#define TX_UNSEQUENCED_MESSAGE_SIZE (TX_MESSAGE_SIZE - sizeof(uint64_t))
+
+// Up to the terminator; the rest of the field stays zero
+static void copy_address(uint8_t *out, const char *address) {
+    for (int i = 0; i < WALLET_ADDRESS_LENGTH && address[i] != '\0'; i++) {
+        out[i] = (uint8_t)address[i];
+    }
+}
+
+static void transaction_message(const Transaction *tx, uint8_t message[TX_MESSAGE_SIZE]) {
+    int64_t timestamp = (int64_t)tx->timestamp;
+    size_t offset = 0;
+    memset(message, 0, TX_MESSAGE_SIZE);
+    memcpy(message, "ARCTX", 5);
+    offset += 5;
+    copy_address(message + offset, address_text(tx->from));
+    offset += WALLET_ADDRESS_LENGTH;
+    copy_address(message + offset, address_text(tx->to));
+    offset += WALLET_ADDRESS_LENGTH;
+    memcpy(message + offset, &tx->amount, sizeof(uint64_t));
+    offset += sizeof(uint64_t);
+    memcpy(message + offset, &timestamp, sizeof(int64_t));
+    offset += sizeof(int64_t);
+    memcpy(message + offset, &tx->fee, sizeof(uint64_t));
+    offset += sizeof(uint64_t);
+    memcpy(message + offset, &tx->hash, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(message + offset, tx->public_key, ED25519_PUBLIC_KEY_SIZE);
+    offset += ED25519_PUBLIC_KEY_SIZE;
+    if (tx->sequence != TRANSACTION_UNSEQUENCED) memcpy(message + offset, &tx->sequence, sizeof(uint64_t));
+}
+
+static size_t message_size(const Transaction *tx) {
+    return (tx->sequence != TRANSACTION_UNSEQUENCED) ? TX_MESSAGE_SIZE : TX_UNSEQUENCED_MESSAGE_SIZE;
+}
+
+static bool key_matches_sender(const Transaction *tx) {
+    char address[WALLET_ADDRESS_LENGTH];
+    address_from_public_key(tx->public_key, address);
+    return tx->from != 0 && strncmp(address, address_text(tx->from), WALLET_ADDRESS_LENGTH) == 0;
+}
+
+bool sign_transaction(Transaction *tx, const char *private_key) {
+    if (tx == NULL || private_key == NULL || tx->is_coinbase) return false;
+    
+    uint8_t seed[ED25519_SEED_SIZE], public_key[ED25519_PUBLIC_KEY_SIZE];
+    derive_keys(private_key, seed, public_key);
+    memcpy(tx->public_key, public_key, ED25519_PUBLIC_KEY_SIZE);
+    bool ok = key_matches_sender(tx);
+    if (ok) {
+        uint8_t message[TX_MESSAGE_SIZE];
+        transaction_message(tx, message);
+        ed25519_sign(tx->signature, message, message_size(tx), seed, public_key);
+    } else {
+        memset(tx->public_key, 0, ED25519_PUBLIC_KEY_SIZE);
+    }
+    memset(seed, 0, sizeof(seed));
+    return ok;
+}
+
+// Transfers a worker builds and signs at once
+#define TRANSFER_BATCH_CHUNK 32
+
+typedef struct {
+    Transaction *txs;
+    const TransferRequest *requests;
+    int count;
+    AddressHandle from;
+    time_t timestamp;
+    uint64_t first_sequence;
+    const uint8_t *seed;
+    const uint8_t *public_key;
+    volatile int failed;
+} TransferBatchJob;
+
+static bool build_transfer_range(TransferBatchJob *job, int start, int end) {
+    for (int i = start; i < end; i++) {
+        Transaction *tx = &job->txs[i];
+        memset(tx, 0, sizeof(Transaction));
+        tx->from = job->from;
+        tx->to = address_intern(job->requests[i].to);
+        if (tx->to == 0) return false;
+        tx->amount = job->requests[i].amount;
+        tx->fee = job->requests[i].fee;
+        tx->timestamp = job->timestamp;
+        tx->sequence = job->first_sequence + (uint64_t)i;
+        tx->hash = transfer_hash(tx);
+        memcpy(tx->public_key, job->public_key, ED25519_PUBLIC_KEY_SIZE);
+        
+        uint8_t message[TX_MESSAGE_SIZE];
+        transaction_message(tx, message);
+        ed25519_sign(tx->signature, message, message_size(tx), job->seed, job->public_key);
+    }
+    return true;
+}
+
+static void build_transfers_task(void *context, int index) {
+    TransferBatchJob *job = context;
+    if (atomic_load_int(&job->failed)) return;
+    
+    int start = index * TRANSFER_BATCH_CHUNK;
+    int end = start + TRANSFER_BATCH_CHUNK;
+    if (end > job->count) end = job->count;
+    if (!build_transfer_range(job, start, end)) {
+        atomic_store_int(&job->failed, 1);
     }
+}
+
+bool create_transfer_batch(Transaction *txs, const Wallet *from, uint64_t first_sequence,
+                           const TransferRequest *requests, int count) {
+    if (txs == NULL || from == NULL || requests == NULL || count < 0) return false;
+    
+    uint8_t seed[ED25519_SEED_SIZE], public_key[ED25519_PUBLIC_KEY_SIZE];
+    char address[WALLET_ADDRESS_LENGTH];
+    derive_keys(from->private_key, seed, public_key);
+    address_from_public_key(public_key, address);
+    
+    // Interning from several threads needs the table set up first
+    bool ok = init_address_table() && strncmp(address, from->address, WALLET_ADDRESS_LENGTH) == 0;
+    
+    TransferBatchJob job = {txs, requests, count, ok ? address_intern(from->address) : 0, time(NULL),
+                            first_sequence, seed, public_key, 0};
+    ok = job.from != 0;
+    if (ok) {
+        int chunks = (count + TRANSFER_BATCH_CHUNK - 1) / TRANSFER_BATCH_CHUNK;
+        if (chunks > 1 && parallel_for(chunks, build_transfers_task, &job)) {
+            ok = !job.failed;
+        } else {
+            ok = build_transfer_range(&job, 0, count);
+        }
+    }
+    memset(seed, 0, sizeof(seed));
+    return ok;
+}
+
+// A signature check depends on the signed message and the signature alone
+static VerifyKey transaction_verify_key(const Transaction *tx, const uint8_t message[TX_MESSAGE_SIZE]) {
+    Sha512 ctx;
+    uint8_t digest[SHA512_DIGEST_SIZE];
+    sha512_init(&ctx);
+    sha512_update(&ctx, message, message_size(tx));
+    sha512_update(&ctx, tx->signature, ED25519_SIGNATURE_SIZE);
+    sha512_final(&ctx, digest);
+    return verify_key_from_digest(digest);
+}
+
+bool verify_transaction(const Transaction *tx) {
+    if (tx == NULL || tx->is_coinbase) return false;
     
+    uint8_t message[TX_MESSAGE_SIZE];
+    transaction_message(tx, message);
+    VerifyKey key = transaction_verify_key(tx, message);
+    if (verify_cache_contains(VERIFY_CACHE_TRANSACTIONS, &key)) return true;
+    
+    if (!key_matches_sender(tx) || !ed25519_verify(tx->signature, message, message_size(tx), tx->public_key)) {
+        return false;
+    }
+    verify_cache_insert(VERIFY_CACHE_TRANSACTIONS, &key);
     return true;
 }
 
+bool verify_transaction_batch(Transaction *const *transactions, int count) {
+    if (count <= 0) return true;
+    if (transactions == NULL) return false;
+    
+    // Transfers verified before (usually on their way into the mempool)
+    // are left out of the batch
+    uint8_t (*messages)[TX_MESSAGE_SIZE] = malloc((size_t)count * TX_MESSAGE_SIZE);
+    Ed25519BatchItem *items = malloc((size_t)count * sizeof(Ed25519BatchItem));
+    VerifyKey *keys = malloc((size_t)count * sizeof(VerifyKey));
+    bool ok = messages != NULL && items != NULL && keys != NULL;
+    int signed_count = 0;
+    for (int i = 0; ok && i < count; i++) {
+        const Transaction *tx = transactions[i];
+        if (tx->is_coinbase) continue;
+        transaction_message(tx, messages[signed_count]);
+        keys[signed_count] = transaction_verify_key(tx, messages[signed_count]);
+        if (verify_cache_contains(VERIFY_CACHE_TRANSACTIONS, &keys[signed_count])) continue;
+        if (!key_matches_sender(tx)) {
+            ok = false;
+            break;
+        }
+        items[signed_count].message = messages[signed_count];
+        items[signed_count].length = message_size(tx);
+        items[signed_count].public_key = tx->public_key;
+        items[signed_count].signature = tx->signature;
+        signed_count++;
+    }
+    ok = ok && ed25519_verify_batch(items, signed_count);
+    for (int i = 0; ok && i < signed_count; i++) {
+        verify_cache_insert(VERIFY_CACHE_TRANSACTIONS, &keys[i]);
+    }
+    free(messages);
+    free(items);
+    free(keys);
+    return ok;
+}
+
+bool same_transaction(const Transaction *a, const Transaction *b) {
+    if (a == b) return true;
+    if (a == NULL || b == NULL) return false;
+    
+    return a->hash == b->hash && a->amount == b->amount && a->fee == b->fee &&
+           a->timestamp == b->timestamp && a->is_coinbase == b->is_coinbase &&
+           a->sequence == b->sequence && a->from == b->from && a->to == b->to;
+}
+
+void transaction_to_wire(const Transaction *tx, WireTransaction *wire) {
+    memset(wire, 0, sizeof(WireTransaction));
+    strncpy(wire->from_address, address_text(tx->from), WALLET_ADDRESS_LENGTH - 1);
+    strncpy(wire->to_address, address_text(tx->to), WALLET_ADDRESS_LENGTH - 1);
+    wire->amount = tx->amount;
+    wire->timestamp = tx->timestamp;
+    wire->hash = tx->hash;
+    wire->is_coinbase = tx->is_coinbase;
+    wire->fee = tx->fee;
+    memcpy(wire->public_key, tx->public_key, ED25519_PUBLIC_KEY_SIZE);
+    memcpy(wire->signature, tx->signature, ED25519_SIGNATURE_SIZE);
+    wire->sequence = tx->sequence;
+}
+
+// Fails for text that fills its whole field without a terminator, which
+// no valid transaction had
+bool transaction_from_wire(Transaction *tx, const WireTransaction *wire) {
+    memset(tx, 0, sizeof(Transaction));
+    if (memchr(wire->from_address, '\0', WALLET_ADDRESS_LENGTH) == NULL ||
+        memchr(wire->to_address, '\0', WALLET_ADDRESS_LENGTH) == NULL) {
+        return false;
+    }
+    
+    tx->from = address_intern(wire->from_address);
+    tx->to = address_intern(wire->to_address);
+    tx->amount = wire->amount;
+    tx->timestamp = wire->timestamp;
+    tx->hash = wire->hash;
+    tx->is_coinbase = wire->is_coinbase;
+    tx->fee = wire->fee;
+    memcpy(tx->public_key, wire->public_key, ED25519_PUBLIC_KEY_SIZE);
+    memcpy(tx->signature, wire->signature, ED25519_SIGNATURE_SIZE);
+    tx->sequence = wire->sequence;
+    return (wire->from_address[0] == '\0' || tx->from != 0) && (wire->to_address[0] == '\0' || tx->to != 0);
+}
+
 // Format amount for display
 void format_amount(uint64_t amount, char *buffer, size_t buffer_size) {
     if (buffer == NULL) return;
@@ -199,7 +531,7 @@ void print_transaction(const Transaction *tx) {
     
     printf("| %s: %s -> %s | %s |\n", 
            tx->is_coinbase ? "REWARD" : "TRANSFER",
-           tx->from_address, tx->to_address, amount_str);
+           address_text(tx->from), address_text(tx->to), amount_str);
 }
 
 // Update reward system
@@ -4,28 +4,60 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include "address.h"
+#include "ed25519.h"
 
-#define MAX_TRANSACTIONS 1000
-#define WALLET_ADDRESS_LENGTH 64
+#define WALLET_ADDRESS_LENGTH ADDRESS_TEXT_LENGTH
 #define PRIVATE_KEY_LENGTH 64
 
-// Transaction structure
+// Transaction structure. Addresses are interned (see address.h); their
+// text only appears in files, on the network and on screen.
 typedef struct {
-    char from_address[WALLET_ADDRESS_LENGTH];
-    char to_address[WALLET_ADDRESS_LENGTH];
+    AddressHandle from;
+    AddressHandle to;
     uint64_t amount;  // Amount in satoshi-like units (1 coin = 100,000,000 units)
     time_t timestamp;
     uint32_t hash;
     bool is_coinbase;  // True for mining rewards
+    uint64_t fee;      // Paid by the sender to the miner that includes the transfer
+    uint64_t sequence; // The sender's earlier transfers on the chain; each must come next
+    
+    // Transfers are signed by the key the sender's address was derived from
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
 } Transaction;
 
-// Wallet structure
+// Layout transactions are written in (chain files, wallet files, the
+// journal and network messages), with the addresses as text. New fields
+// go at the end, so the layouts of older files are prefixes of it.
+typedef struct {
+    char from_address[WALLET_ADDRESS_LENGTH];
+    char to_address[WALLET_ADDRESS_LENGTH];
+    uint64_t amount;
+    time_t timestamp;
+    uint32_t hash;
+    bool is_coinbase;
+    uint64_t fee;
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
+    uint64_t sequence;
+} WireTransaction;
+
+// Sequence of transactions written before transfers carried one; their
+// signatures do not cover it
+#define TRANSACTION_UNSEQUENCED UINT64_MAX
+
+// Wallet structure. The history grows as needed and holds one reference
+// to each shared record (see txpool.h), so a transaction mined into a
+// block is not copied; a wallet owns its history until cleanup_wallet, so
+// assigning one wallet to another moves it.
 typedef struct {
     char address[WALLET_ADDRESS_LENGTH];
     char private_key[PRIVATE_KEY_LENGTH];
     uint64_t balance;
-    Transaction transactions[MAX_TRANSACTIONS];
+    Transaction **transactions;
     int transaction_count;
+    int transaction_capacity;
 } Wallet;
 
 // Blockchain reward system
@@ -39,13 +71,44 @@ typedef struct {
 
 // Function declarations
 bool init_wallet(Wallet *wallet);
+void cleanup_wallet(Wallet *wallet);
+bool reserve_wallet_transactions(Wallet *wallet, int capacity);
 bool generate_wallet_address(Wallet *wallet);
 uint64_t get_wallet_balance(const Wallet *wallet);
 bool create_transaction(Transaction *tx, const char *from, const char *to, uint64_t amount);
+bool create_transaction_with_fee(Transaction *tx, const char *from, const char *to, uint64_t amount, uint64_t fee);
 bool create_coinbase_transaction(Transaction *tx, const char *miner_address, uint64_t reward);
+void set_transaction_sequence(Transaction *tx, uint64_t sequence);  // Rehashes; sign afterwards
+
+// One transfer of a batch
+typedef struct {
+    char to[WALLET_ADDRESS_LENGTH];
+    uint64_t amount;
+    uint64_t fee;
+} TransferRequest;
+
+// Builds, hashes and signs count transfers from the wallet in one call.
+// The key is derived and the sender interned once, the transfers share a
+// timestamp and take the sequence numbers from first_sequence on, and
+// larger batches are signed on several threads. Fails if the wallet
+// cannot sign or a request has no recipient.
+bool create_transfer_batch(Transaction *txs, const Wallet *from, uint64_t first_sequence,
+                           const TransferRequest *requests, int count);
+
+// Signing keys are derived from the wallet's private key text, and an
+// address from the public key ("ARC" and 40 hex digits of its SHA-512),
+// so a transfer's signature also proves it came from its sender.
+// Addresses made before signatures commit to no key and cannot sign.
+void address_from_public_key(const uint8_t public_key[ED25519_PUBLIC_KEY_SIZE], char address[WALLET_ADDRESS_LENGTH]);
 bool sign_transaction(Transaction *tx, const char *private_key);
-bool verify_transaction(const Transaction *tx, const char *public_key);
-bool add_transaction_to_wallet(Wallet *wallet, const Transaction *tx);
+bool verify_transaction(const Transaction *tx);
+bool verify_transaction_batch(Transaction *const *transactions, int count);  // Coinbases are skipped
+bool add_transaction_to_wallet(Wallet *wallet, const Transaction *tx);     // Adds a shared copy of tx
+bool add_shared_transaction_to_wallet(Wallet *wallet, Transaction *tx);   // Adds a reference to tx
+bool same_transaction(const Transaction *a, const Transaction *b);  // Same content, wherever stored
+
+void transaction_to_wire(const Transaction *tx, WireTransaction *wire);
+bool transaction_from_wire(Transaction *tx, const WireTransaction *wire);  // Interns the addresses
 
 // Reward system functions
 void init_reward_system(RewardSystem *rs);